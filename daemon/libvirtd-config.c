@@ -273,6 +273,13 @@ daemonConfigNew(bool privileged ATTRIBUTE_UNUSED)
     data->max_requests = 20;
     data->max_client_requests = 5;
 
+    data->max_client_events = 0;
+    data->event_coalesce_interval = 0;
+
+    data->max_identity_requests = 0;
+    data->identity_request_rate = 0;
+    data->identity_request_burst = 0;
+
     data->audit_level = 1;
     data->audit_logging = 0;
 
@@ -344,6 +351,13 @@ daemonConfigFree(struct daemonConfig *data)
     }
     VIR_FREE(data->sasl_allowed_username_list);
 
+    tmp = data->request_costs;
+    while (tmp && *tmp) {
+        VIR_FREE(*tmp);
+        tmp++;
+    }
+    VIR_FREE(data->request_costs);
+
     VIR_FREE(data->key_file);
     VIR_FREE(data->ca_file);
     VIR_FREE(data->cert_file);
@@ -428,6 +442,17 @@ daemonConfigLoadOptions(struct daemonConfig *data,
     GET_CONF_INT(conf, filename, max_requests);
     GET_CONF_INT(conf, filename, max_client_requests);
 
+    GET_CONF_INT(conf, filename, max_client_events);
+    GET_CONF_INT(conf, filename, event_coalesce_interval);
+
+    GET_CONF_INT(conf, filename, max_identity_requests);
+    GET_CONF_INT(conf, filename, identity_request_rate);
+    GET_CONF_INT(conf, filename, identity_request_burst);
+
+    if (remoteConfigGetStringList(conf, "request_costs",
+                                  &data->request_costs, filename) < 0)
+        goto error;
+
     GET_CONF_INT(conf, filename, audit_level);
     GET_CONF_INT(conf, filename, audit_logging);
 
@@ -71,6 +71,14 @@ struct daemonConfig {
     int max_requests;
     int max_client_requests;
 
+    int max_client_events;
+    int event_coalesce_interval;
+
+    int max_identity_requests;
+    int identity_request_rate;
+    int identity_request_burst;
+    char **request_costs;
+
     int log_level;
     char *log_filters;
     char *log_outputs;
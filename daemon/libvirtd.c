@@ -760,6 +760,38 @@ daemonSetupAccessManager(struct daemonConfig *config)
 }
 
 
+static int
+daemonSetupQuota(virNetServerPtr srv,
+                 struct daemonConfig *config)
+{
+    virNetServerQuotaPtr quota;
+    char **cost;
+    int ret = -1;
+
+    if (config->max_identity_requests <= 0 &&
+        config->identity_request_rate <= 0)
+        return 0;
+
+    if (!(quota = virNetServerQuotaNew(MAX(config->max_identity_requests, 0),
+                                       MAX(config->identity_request_rate, 0),
+                                       MAX(config->identity_request_burst, 0))))
+        return -1;
+
+    for (cost = config->request_costs; cost && *cost; cost++) {
+        if (virNetServerQuotaParseCost(quota, *cost) < 0)
+            goto cleanup;
+    }
+
+    if (virNetServerSetQuota(srv, quota) < 0)
+        goto cleanup;
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(quota);
+    return ret;
+}
+
+
 /* Display version information. */
 static void
 daemonVersion(const char *argv0)
@@ -1364,7 +1396,7 @@ int main(int argc, char **argv) {
                                 remoteClientInitHook,
                                 NULL,
                                 remoteClientFreeFunc,
-                                NULL))) {
+                                config))) {
         ret = VIR_DAEMON_ERR_INIT;
         goto cleanup;
     }
@@ -1421,6 +1453,14 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
+    /* The costs are checked against the procedures of the programs */
+    if (daemonSetupQuota(srv, config) < 0) {
+        VIR_ERROR(_("Can't set up call quotas: %s"),
+                  virGetLastErrorMessage());
+        ret = VIR_DAEMON_ERR_CONFIG;
+        goto cleanup;
+    }
+
     if (timeout != -1) {
         VIR_DEBUG("Registering shutdown timeout %d", timeout);
         virNetServerAutoShutdown(srv,
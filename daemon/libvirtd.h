@@ -57,6 +57,9 @@ struct daemonClientPrivate {
     daemonClientEventCallbackPtr *qemuEventCallbacks;
     size_t nqemuEventCallbacks;
 
+    /* Minimum interval between coalesced events, 0 if disabled */
+    unsigned int eventCoalesceInterval;
+
 # if WITH_SASL
     virNetSASLSessionPtr sasl;
 # endif
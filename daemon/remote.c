@@ -30,7 +30,9 @@
 #endif
 
 #include "remote.h"
+#include "remote_event.h"
 #include "libvirtd.h"
+#include "libvirtd-config.h"
 #include "libvirt_internal.h"
 #include "datatypes.h"
 #include "viralloc.h"
@@ -53,6 +55,8 @@
 #include "domain_conf.h"
 #include "network_conf.h"
 #include "virprobe.h"
+#include "virhash.h"
+#include "virtime.h"
 #include "viraccessapicheck.h"
 #include "viraccessapicheckqemu.h"
 
@@ -84,6 +88,7 @@ struct daemonClientEventCallback {
     int eventID;
     int callbackID;
     bool legacy;
+    remoteEventThrottlePtr throttle; /* NULL unless events are coalesced */
 };
 
 static virDomainPtr get_nonnull_domain(virConnectPtr conn, remote_nonnull_domain domain);
@@ -122,6 +127,12 @@ remoteSerializeDomainDiskErrors(virDomainDiskErrorPtr errors,
 
 
 /* Prototypes */
+static virNetMessagePtr
+remoteEncodeObjectEvent(virNetServerProgramPtr program,
+                        int procnr,
+                        xdrproc_t proc,
+                        void *data);
+
 static void
 remoteDispatchObjectEventSend(virNetServerClientPtr client,
                               virNetServerProgramPtr program,
@@ -129,10 +140,71 @@ remoteDispatchObjectEventSend(virNetServerClientPtr client,
                               xdrproc_t proc,
                               void *data);
 
+
+static int
+remoteEventCallbackSetPolicy(daemonClientEventCallbackPtr callback,
+                             struct daemonClientPrivate *priv)
+{
+    if (!priv->eventCoalesceInterval ||
+        !remoteEventCanCoalesce(callback->eventID))
+        return 0;
+
+    if (!(callback->throttle = remoteEventThrottleNew(callback->client,
+                                                      priv->eventCoalesceInterval)))
+        return -1;
+
+    return 0;
+}
+
+
 static void
 remoteEventCallbackFree(void *opaque)
 {
-    VIR_FREE(opaque);
+    daemonClientEventCallbackPtr callback = opaque;
+
+    if (!callback)
+        return;
+
+    remoteEventThrottleClose(callback->throttle);
+    virObjectUnref(callback->throttle);
+    VIR_FREE(callback);
+}
+
+
+/* Send a domain event for @callback, coalescing it with others about
+ * the same domain (and @subkey, if any) when the callback asks for it */
+static void
+remoteDispatchDomainEventSendCoalesced(daemonClientEventCallbackPtr callback,
+                                       virDomainPtr dom,
+                                       const char *subkey,
+                                       int procnr,
+                                       xdrproc_t proc,
+                                       void *data)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    char *key = NULL;
+    virNetMessagePtr msg;
+
+    if (!callback->throttle) {
+        remoteDispatchObjectEventSend(callback->client, remoteProgram,
+                                      procnr, proc, data);
+        return;
+    }
+
+    virUUIDFormat(dom->uuid, uuidstr);
+    if (!(msg = remoteEncodeObjectEvent(remoteProgram, procnr, proc, data)))
+        goto cleanup;
+
+    if (virAsprintf(&key, "%s/%s", uuidstr, subkey ? subkey : "") < 0) {
+        virNetMessageFree(msg);
+        goto cleanup;
+    }
+
+    remoteEventThrottleSend(callback->throttle, key, msg);
+
+ cleanup:
+    VIR_FREE(key);
+    xdr_free(proc, data);
 }
 
 
@@ -317,16 +389,16 @@ remoteRelayDomainEventRTCChange(virConnectPtr conn,
     data.offset = offset;
 
     if (callback->legacy) {
-        remoteDispatchObjectEventSend(callback->client, remoteProgram,
-                                      REMOTE_PROC_DOMAIN_EVENT_RTC_CHANGE,
-                                      (xdrproc_t)xdr_remote_domain_event_rtc_change_msg, &data);
+        remoteDispatchDomainEventSendCoalesced(callback, dom, NULL,
+                                               REMOTE_PROC_DOMAIN_EVENT_RTC_CHANGE,
+                                               (xdrproc_t)xdr_remote_domain_event_rtc_change_msg, &data);
     } else {
         remote_domain_event_callback_rtc_change_msg msg = { callback->callbackID,
                                                             data };
 
-        remoteDispatchObjectEventSend(callback->client, remoteProgram,
-                                      REMOTE_PROC_DOMAIN_EVENT_CALLBACK_RTC_CHANGE,
-                                      (xdrproc_t)xdr_remote_domain_event_callback_rtc_change_msg, &msg);
+        remoteDispatchDomainEventSendCoalesced(callback, dom, NULL,
+                                               REMOTE_PROC_DOMAIN_EVENT_CALLBACK_RTC_CHANGE,
+                                               (xdrproc_t)xdr_remote_domain_event_callback_rtc_change_msg, &msg);
     }
 
     return 0;
@@ -582,16 +654,16 @@ remoteRelayDomainEventBlockJob(virConnectPtr conn,
     make_nonnull_domain(&data.dom, dom);
 
     if (callback->legacy) {
-        remoteDispatchObjectEventSend(callback->client, remoteProgram,
-                                      REMOTE_PROC_DOMAIN_EVENT_BLOCK_JOB,
-                                      (xdrproc_t)xdr_remote_domain_event_block_job_msg, &data);
+        remoteDispatchDomainEventSendCoalesced(callback, dom, path,
+                                               REMOTE_PROC_DOMAIN_EVENT_BLOCK_JOB,
+                                               (xdrproc_t)xdr_remote_domain_event_block_job_msg, &data);
     } else {
         remote_domain_event_callback_block_job_msg msg = { callback->callbackID,
                                                            data };
 
-        remoteDispatchObjectEventSend(callback->client, remoteProgram,
-                                      REMOTE_PROC_DOMAIN_EVENT_CALLBACK_BLOCK_JOB,
-                                      (xdrproc_t)xdr_remote_domain_event_callback_block_job_msg, &msg);
+        remoteDispatchDomainEventSendCoalesced(callback, dom, path,
+                                               REMOTE_PROC_DOMAIN_EVENT_CALLBACK_BLOCK_JOB,
+                                               (xdrproc_t)xdr_remote_domain_event_callback_block_job_msg, &msg);
     }
 
     return 0;
@@ -836,16 +908,16 @@ remoteRelayDomainEventBalloonChange(virConnectPtr conn,
     data.actual = actual;
 
     if (callback->legacy) {
-        remoteDispatchObjectEventSend(callback->client, remoteProgram,
-                                      REMOTE_PROC_DOMAIN_EVENT_BALLOON_CHANGE,
-                                      (xdrproc_t)xdr_remote_domain_event_balloon_change_msg, &data);
+        remoteDispatchDomainEventSendCoalesced(callback, dom, NULL,
+                                               REMOTE_PROC_DOMAIN_EVENT_BALLOON_CHANGE,
+                                               (xdrproc_t)xdr_remote_domain_event_balloon_change_msg, &data);
     } else {
         remote_domain_event_callback_balloon_change_msg msg = { callback->callbackID,
                                                                 data };
 
-        remoteDispatchObjectEventSend(callback->client, remoteProgram,
-                                      REMOTE_PROC_DOMAIN_EVENT_CALLBACK_BALLOON_CHANGE,
-                                      (xdrproc_t)xdr_remote_domain_event_callback_balloon_change_msg, &msg);
+        remoteDispatchDomainEventSendCoalesced(callback, dom, NULL,
+                                               REMOTE_PROC_DOMAIN_EVENT_CALLBACK_BALLOON_CHANGE,
+                                               (xdrproc_t)xdr_remote_domain_event_callback_balloon_change_msg, &msg);
     }
 
     return 0;
@@ -958,9 +1030,9 @@ remoteRelayDomainEventBlockJob2(virConnectPtr conn,
     data.status = status;
     make_nonnull_domain(&data.dom, dom);
 
-    remoteDispatchObjectEventSend(callback->client, remoteProgram,
-                                  REMOTE_PROC_DOMAIN_EVENT_BLOCK_JOB_2,
-                                  (xdrproc_t)xdr_remote_domain_event_block_job_2_msg, &data);
+    remoteDispatchDomainEventSendCoalesced(callback, dom, dst,
+                                           REMOTE_PROC_DOMAIN_EVENT_BLOCK_JOB_2,
+                                           (xdrproc_t)xdr_remote_domain_event_block_job_2_msg, &data);
 
     return 0;
  error:
@@ -1101,6 +1173,7 @@ void remoteClientFreeFunc(void *data)
             VIR_DEBUG("Deregistering remote domain event relay %d",
                       callbackID);
             priv->domainEventCallbacks[i]->callbackID = -1;
+            remoteEventThrottleClose(priv->domainEventCallbacks[i]->throttle);
             if (virConnectDomainEventDeregisterAny(priv->conn, callbackID) < 0)
                 VIR_WARN("unexpected domain event deregister failure");
         }
@@ -1149,14 +1222,27 @@ void remoteClientFreeFunc(void *data)
 static void remoteClientCloseFunc(virNetServerClientPtr client)
 {
     struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
+    size_t nevents;
+    size_t nevents_peak;
+    unsigned long long nevents_dropped;
 
     daemonRemoveAllClientStreams(priv->streams);
+
+    virNetServerClientGetEventStats(client, &nevents, &nevents_peak,
+                                    &nevents_dropped);
+    if (nevents_dropped)
+        VIR_WARN("Client %p dropped %llu events, at most %zu were queued",
+                 client, nevents_dropped, nevents_peak);
+    else
+        VIR_DEBUG("Client %p queued at most %zu events",
+                  client, nevents_peak);
 }
 
 
 void *remoteClientInitHook(virNetServerClientPtr client,
-                           void *opaque ATTRIBUTE_UNUSED)
+                           void *opaque)
 {
+    struct daemonConfig *config = opaque;
     struct daemonClientPrivate *priv;
 
     if (VIR_ALLOC(priv) < 0)
@@ -1168,6 +1254,13 @@ void *remoteClientInitHook(virNetServerClientPtr client,
         return NULL;
     }
 
+    if (config) {
+        if (config->max_client_events > 0)
+            virNetServerClientSetMaxEvents(client, config->max_client_events);
+        if (config->event_coalesce_interval > 0)
+            priv->eventCoalesceInterval = config->event_coalesce_interval;
+    }
+
     virNetServerClientSetCloseHook(client, remoteClientCloseFunc);
     return priv;
 }
@@ -1543,6 +1636,60 @@ remoteDispatchConnectListAllDomains(virNetServerPtr server ATTRIBUTE_UNUSED,
     return rv;
 }
 
+static int
+remoteDispatchConnectListDomainsPage(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                     virNetServerClientPtr client,
+                                     virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                     virNetMessageErrorPtr rerr,
+                                     remote_connect_list_domains_page_args *args,
+                                     remote_connect_list_domains_page_ret *ret)
+{
+    virDomainPtr *objs = NULL;
+    int nobjs = 0;
+    size_t i;
+    int rv = -1;
+    struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    if (args->maxdomains > REMOTE_LIST_PAGE_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many domains requested '%u' for limit '%d'"),
+                       args->maxdomains, REMOTE_LIST_PAGE_MAX);
+        goto cleanup;
+    }
+
+    if ((nobjs = virConnectListDomainsPage(priv->conn,
+                                           args->after ? *args->after : NULL,
+                                           args->maxdomains, &objs, args->flags)) < 0)
+        goto cleanup;
+
+    if (nobjs) {
+        if (VIR_ALLOC_N(ret->domains.domains_val, nobjs) < 0)
+            goto cleanup;
+
+        ret->domains.domains_len = nobjs;
+
+        for (i = 0; i < nobjs; i++)
+            make_nonnull_domain(ret->domains.domains_val + i, objs[i]);
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    if (objs) {
+        for (i = 0; i < nobjs; i++)
+            virDomainFree(objs[i]);
+        VIR_FREE(objs);
+    }
+    return rv;
+}
+
 static int
 remoteDispatchDomainGetSchedulerParametersFlags(virNetServerPtr server ATTRIBUTE_UNUSED,
                                                 virNetServerClientPtr client ATTRIBUTE_UNUSED,
@@ -3645,17 +3792,16 @@ remoteDispatchConnectDomainEventDeregister(virNetServerPtr server ATTRIBUTE_UNUS
     return rv;
 }
 
-static void
-remoteDispatchObjectEventSend(virNetServerClientPtr client,
-                              virNetServerProgramPtr program,
-                              int procnr,
-                              xdrproc_t proc,
-                              void *data)
+static virNetMessagePtr
+remoteEncodeObjectEvent(virNetServerProgramPtr program,
+                        int procnr,
+                        xdrproc_t proc,
+                        void *data)
 {
     virNetMessagePtr msg;
 
     if (!(msg = virNetMessageNew(false)))
-        goto cleanup;
+        return NULL;
 
     msg->header.prog = virNetServerProgramGetID(program);
     msg->header.vers = virNetServerProgramGetVersion(program);
@@ -3665,19 +3811,35 @@ remoteDispatchObjectEventSend(virNetServerClientPtr client,
     msg->header.status = VIR_NET_OK;
 
     if (virNetMessageEncodeHeader(msg) < 0)
-        goto cleanup;
+        goto error;
 
     if (virNetMessageEncodePayload(msg, proc, data) < 0)
+        goto error;
+
+    return msg;
+
+ error:
+    virNetMessageFree(msg);
+    return NULL;
+}
+
+static void
+remoteDispatchObjectEventSend(virNetServerClientPtr client,
+                              virNetServerProgramPtr program,
+                              int procnr,
+                              xdrproc_t proc,
+                              void *data)
+{
+    virNetMessagePtr msg;
+
+    if (!(msg = remoteEncodeObjectEvent(program, procnr, proc, data)))
         goto cleanup;
 
     VIR_DEBUG("Queue event %d %zu", procnr, msg->bufferLength);
-    virNetServerClientSendMessage(client, msg);
-
-    xdr_free(proc, data);
-    return;
+    if (virNetServerClientSendEvent(client, msg) < 0)
+        virNetMessageFree(msg);
 
  cleanup:
-    virNetMessageFree(msg);
     xdr_free(proc, data);
 }
 
@@ -3804,6 +3966,8 @@ remoteDispatchConnectDomainEventRegisterAny(virNetServerPtr server ATTRIBUTE_UNU
     callback->callbackID = -1;
     callback->legacy = true;
     ref = callback;
+    if (remoteEventCallbackSetPolicy(callback, priv) < 0)
+        goto cleanup;
     if (VIR_APPEND_ELEMENT(priv->domainEventCallbacks,
                            priv->ndomainEventCallbacks,
                            callback) < 0)
@@ -3826,7 +3990,7 @@ remoteDispatchConnectDomainEventRegisterAny(virNetServerPtr server ATTRIBUTE_UNU
     rv = 0;
 
  cleanup:
-    VIR_FREE(callback);
+    remoteEventCallbackFree(callback);
     if (rv < 0)
         virNetMessageSaveError(rerr);
     virMutexUnlock(&priv->lock);
@@ -3879,6 +4043,8 @@ remoteDispatchConnectDomainEventCallbackRegisterAny(virNetServerPtr server ATTRI
     callback->eventID = args->eventID;
     callback->callbackID = -1;
     ref = callback;
+    if (remoteEventCallbackSetPolicy(callback, priv) < 0)
+        goto cleanup;
     if (VIR_APPEND_ELEMENT(priv->domainEventCallbacks,
                            priv->ndomainEventCallbacks,
                            callback) < 0)
@@ -3902,7 +4068,7 @@ remoteDispatchConnectDomainEventCallbackRegisterAny(virNetServerPtr server ATTRI
     rv = 0;
 
  cleanup:
-    VIR_FREE(callback);
+    remoteEventCallbackFree(callback);
     if (rv < 0)
         virNetMessageSaveError(rerr);
     if (dom)
@@ -4855,6 +5021,66 @@ remoteDispatchStoragePoolListAllVolumes(virNetServerPtr server ATTRIBUTE_UNUSED,
     return rv;
 }
 
+static int
+remoteDispatchStoragePoolListVolumesPage(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                         virNetServerClientPtr client,
+                                         virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                         virNetMessageErrorPtr rerr,
+                                         remote_storage_pool_list_volumes_page_args *args,
+                                         remote_storage_pool_list_volumes_page_ret *ret)
+{
+    virStorageVolPtr *objs = NULL;
+    virStoragePoolPtr pool = NULL;
+    int nobjs = 0;
+    size_t i;
+    int rv = -1;
+    struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    if (args->maxvols > REMOTE_LIST_PAGE_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many storage volumes requested '%u' for limit '%d'"),
+                       args->maxvols, REMOTE_LIST_PAGE_MAX);
+        goto cleanup;
+    }
+
+    if (!(pool = get_nonnull_storage_pool(priv->conn, args->pool)))
+        goto cleanup;
+
+    if ((nobjs = virStoragePoolListVolumesPage(pool,
+                                               args->after ? *args->after : NULL,
+                                               args->maxvols, &objs, args->flags)) < 0)
+        goto cleanup;
+
+    if (nobjs) {
+        if (VIR_ALLOC_N(ret->vols.vols_val, nobjs) < 0)
+            goto cleanup;
+
+        ret->vols.vols_len = nobjs;
+
+        for (i = 0; i < nobjs; i++)
+            make_nonnull_storage_vol(ret->vols.vols_val + i, objs[i]);
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    if (objs) {
+        for (i = 0; i < nobjs; i++)
+            virStorageVolFree(objs[i]);
+        VIR_FREE(objs);
+    }
+    if (pool)
+        virStoragePoolFree(pool);
+    return rv;
+}
+
 static int
 remoteDispatchConnectListAllNetworks(virNetServerPtr server ATTRIBUTE_UNUSED,
                                      virNetServerClientPtr client,
@@ -5032,6 +5258,60 @@ remoteDispatchConnectListAllNodeDevices(virNetServerPtr server ATTRIBUTE_UNUSED,
     return rv;
 }
 
+static int
+remoteDispatchConnectListNodeDevicesPage(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                         virNetServerClientPtr client,
+                                         virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                         virNetMessageErrorPtr rerr,
+                                         remote_connect_list_node_devices_page_args *args,
+                                         remote_connect_list_node_devices_page_ret *ret)
+{
+    virNodeDevicePtr *objs = NULL;
+    int nobjs = 0;
+    size_t i;
+    int rv = -1;
+    struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    if (args->maxdevices > REMOTE_LIST_PAGE_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many node devices requested '%u' for limit '%d'"),
+                       args->maxdevices, REMOTE_LIST_PAGE_MAX);
+        goto cleanup;
+    }
+
+    if ((nobjs = virConnectListNodeDevicesPage(priv->conn,
+                                               args->after ? *args->after : NULL,
+                                               args->maxdevices, &objs, args->flags)) < 0)
+        goto cleanup;
+
+    if (nobjs) {
+        if (VIR_ALLOC_N(ret->devices.devices_val, nobjs) < 0)
+            goto cleanup;
+
+        ret->devices.devices_len = nobjs;
+
+        for (i = 0; i < nobjs; i++)
+            make_nonnull_node_device(ret->devices.devices_val + i, objs[i]);
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    if (objs) {
+        for (i = 0; i < nobjs; i++)
+            virNodeDeviceFree(objs[i]);
+        VIR_FREE(objs);
+    }
+    return rv;
+}
+
 static int
 remoteDispatchConnectListAllNWFilters(virNetServerPtr server ATTRIBUTE_UNUSED,
                                       virNetServerClientPtr client,
@@ -6404,6 +6684,117 @@ remoteDispatchNetworkGetDHCPLeasesForMAC(virNetServerPtr server ATTRIBUTE_UNUSED
 }
 
 
+static int
+remoteDispatchDomainListEvacuate(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                 virNetServerClientPtr client,
+                                 virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                 virNetMessageErrorPtr rerr,
+                                 remote_domain_list_evacuate_args *args)
+{
+    int rv = -1;
+    size_t i;
+    size_t ndoms = 0;
+    virDomainPtr *doms = NULL;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    if (args->doms.doms_len > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("too many domains '%d' for limit '%d'"),
+                       args->doms.doms_len, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(doms, args->doms.doms_len) < 0)
+        goto cleanup;
+
+    for (ndoms = 0; ndoms < args->doms.doms_len; ndoms++) {
+        if (!(doms[ndoms] = get_nonnull_domain(priv->conn,
+                                               args->doms.doms_val[ndoms])))
+            goto cleanup;
+    }
+
+    if (!(params = remoteDeserializeTypedParameters(args->params.params_val,
+                                                    args->params.params_len,
+                                                    REMOTE_DOMAIN_EVACUATE_PARAMETERS_MAX,
+                                                    &nparams)))
+        goto cleanup;
+
+    if (virDomainListEvacuate(doms, ndoms, params, nparams, args->flags) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    for (i = 0; i < ndoms; i++)
+        virDomainFree(doms[i]);
+    VIR_FREE(doms);
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
+
+
+static int
+remoteDispatchDomainGetBlockJobStats(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                     virNetServerClientPtr client,
+                                     virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                     virNetMessageErrorPtr rerr,
+                                     remote_domain_get_block_job_stats_args *args,
+                                     remote_domain_get_block_job_stats_ret *ret)
+{
+    virDomainPtr dom = NULL;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int rv = -1;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    if (!(dom = get_nonnull_domain(priv->conn, args->dom)))
+        goto cleanup;
+
+    if ((ret->found = virDomainGetBlockJobStats(dom, args->path, &params,
+                                                &nparams, args->flags)) < 0)
+        goto cleanup;
+
+    if (nparams > REMOTE_DOMAIN_BLOCK_JOB_STATS_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many block job stats '%d' for limit '%d'"),
+                       nparams, REMOTE_DOMAIN_BLOCK_JOB_STATS_MAX);
+        goto cleanup;
+    }
+
+    if (remoteSerializeTypedParameters(params, nparams,
+                                       &ret->params.params_val,
+                                       &ret->params.params_len,
+                                       0) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virTypedParamsFree(params, nparams);
+    if (dom)
+        virDomainFree(dom);
+    return rv;
+}
+
+
 /*----- Helpers. -----*/
 
 /* get_nonnull_domain and get_nonnull_network turn an on-wire
@@ -0,0 +1,303 @@
+/*
+ * remote_event.c: coalescing of high frequency events
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "remote_event.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virevent.h"
+#include "virhash.h"
+#include "virlog.h"
+#include "virobject.h"
+#include "virthread.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+VIR_LOG_INIT("daemon.remote_event");
+
+/* Coalesces the events of one high frequency callback, so that at
+ * most one event per object is sent every @interval milliseconds,
+ * the latest one.  The pending message of each object is kept in
+ * @entries, and a timer sends them once their interval has passed */
+struct _remoteEventThrottle {
+    virObjectLockable parent;
+
+    virNetServerClientPtr client;
+    unsigned int interval;
+    int timer;
+    bool armed;
+    bool closed;
+    virHashTablePtr entries;
+    unsigned long long coalesced;
+};
+
+typedef struct _remoteEventThrottleEntry remoteEventThrottleEntry;
+typedef remoteEventThrottleEntry *remoteEventThrottleEntryPtr;
+struct _remoteEventThrottleEntry {
+    unsigned long long lastSent;
+    virNetMessagePtr pending;
+};
+
+struct remoteEventThrottleFlushData {
+    remoteEventThrottlePtr throttle;
+    unsigned long long now;
+    size_t npending;
+};
+
+static virClassPtr remoteEventThrottleClass;
+static void remoteEventThrottleDispose(void *obj);
+
+static int
+remoteEventThrottleOnceInit(void)
+{
+    if (!(remoteEventThrottleClass =
+          virClassNew(virClassForObjectLockable(),
+                      "remoteEventThrottle",
+                      sizeof(remoteEventThrottle),
+                      remoteEventThrottleDispose)))
+        return -1;
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(remoteEventThrottle)
+
+
+static void
+remoteEventThrottleDispose(void *obj)
+{
+    remoteEventThrottlePtr throttle = obj;
+
+    virHashFree(throttle->entries);
+}
+
+
+static void
+remoteEventThrottleEntryFree(void *payload,
+                             const void *name ATTRIBUTE_UNUSED)
+{
+    remoteEventThrottleEntryPtr entry = payload;
+
+    virNetMessageFree(entry->pending);
+    VIR_FREE(entry);
+}
+
+
+/* Called with @throttle locked */
+static void
+remoteEventThrottleSendPending(remoteEventThrottlePtr throttle,
+                               remoteEventThrottleEntryPtr entry,
+                               unsigned long long now)
+{
+    virNetMessagePtr msg = entry->pending;
+
+    entry->pending = NULL;
+    entry->lastSent = now;
+    if (virNetServerClientSendEvent(throttle->client, msg) < 0)
+        virNetMessageFree(msg);
+}
+
+
+static void
+remoteEventThrottleFlushEntry(void *payload,
+                              const void *name ATTRIBUTE_UNUSED,
+                              void *opaque)
+{
+    remoteEventThrottleEntryPtr entry = payload;
+    struct remoteEventThrottleFlushData *data = opaque;
+
+    if (entry->pending &&
+        data->now >= entry->lastSent + data->throttle->interval)
+        remoteEventThrottleSendPending(data->throttle, entry, data->now);
+
+    if (entry->pending)
+        data->npending++;
+}
+
+
+/* Once its interval has passed, an entry without pending event
+ * is no different from a missing one */
+static int
+remoteEventThrottleEntryIsIdle(const void *payload,
+                               const void *name ATTRIBUTE_UNUSED,
+                               const void *opaque)
+{
+    const remoteEventThrottleEntry *entry = payload;
+    const struct remoteEventThrottleFlushData *data = opaque;
+
+    return !entry->pending &&
+        data->now >= entry->lastSent + data->throttle->interval;
+}
+
+
+static void
+remoteEventThrottleTimer(int timer ATTRIBUTE_UNUSED,
+                         void *opaque)
+{
+    remoteEventThrottlePtr throttle = opaque;
+    struct remoteEventThrottleFlushData data = { throttle, 0, 0 };
+
+    virObjectLock(throttle);
+
+    if (throttle->closed ||
+        virTimeMillisNowRaw(&data.now) < 0)
+        goto cleanup;
+
+    virHashForEach(throttle->entries, remoteEventThrottleFlushEntry, &data);
+    virHashRemoveSet(throttle->entries, remoteEventThrottleEntryIsIdle, &data);
+
+    if (data.npending == 0) {
+        virEventUpdateTimeout(throttle->timer, -1);
+        throttle->armed = false;
+    }
+
+ cleanup:
+    virObjectUnlock(throttle);
+}
+
+
+remoteEventThrottlePtr
+remoteEventThrottleNew(virNetServerClientPtr client,
+                       unsigned int interval)
+{
+    remoteEventThrottlePtr throttle;
+
+    if (remoteEventThrottleInitialize() < 0)
+        return NULL;
+
+    if (!(throttle = virObjectLockableNew(remoteEventThrottleClass)))
+        return NULL;
+
+    throttle->client = client;
+    throttle->interval = interval;
+    throttle->timer = -1;
+
+    if (!(throttle->entries = virHashCreate(10, remoteEventThrottleEntryFree)))
+        goto error;
+
+    /* The timer holds a reference on the throttle */
+    virObjectRef(throttle);
+    if ((throttle->timer = virEventAddTimeout(-1, remoteEventThrottleTimer,
+                                              throttle,
+                                              virObjectFreeCallback)) < 0) {
+        virObjectUnref(throttle);
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to register event coalescing timer"));
+        goto error;
+    }
+
+    return throttle;
+
+ error:
+    virObjectUnref(throttle);
+    return NULL;
+}
+
+
+/* Stop sending events through @throttle, dropping the pending ones.
+ * The client does not hold a reference here, so this must happen
+ * before the client goes away */
+void
+remoteEventThrottleClose(remoteEventThrottlePtr throttle)
+{
+    if (!throttle)
+        return;
+
+    virObjectLock(throttle);
+    if (!throttle->closed) {
+        throttle->closed = true;
+        VIR_DEBUG("Closing event throttle %p for client %p, coalesced %llu events",
+                  throttle, throttle->client, throttle->coalesced);
+        virHashRemoveAll(throttle->entries);
+        virEventRemoveTimeout(throttle->timer);
+        throttle->timer = -1;
+    }
+    virObjectUnlock(throttle);
+}
+
+
+/* Send @msg about the object @key through @throttle, taking ownership
+ * of @msg.  If another event for the same object was sent less than
+ * the interval ago, @msg waits for the timer and replaces any event
+ * already waiting */
+void
+remoteEventThrottleSend(remoteEventThrottlePtr throttle,
+                        const char *key,
+                        virNetMessagePtr msg)
+{
+    remoteEventThrottleEntryPtr entry;
+    unsigned long long now;
+
+    virObjectLock(throttle);
+
+    if (throttle->closed ||
+        virTimeMillisNowRaw(&now) < 0) {
+        virNetMessageFree(msg);
+        goto cleanup;
+    }
+
+    if (!(entry = virHashLookup(throttle->entries, key))) {
+        if (VIR_ALLOC(entry) < 0 ||
+            virHashAddEntry(throttle->entries, key, entry) < 0) {
+            /* Can't coalesce it, so just let it through */
+            VIR_FREE(entry);
+            virResetLastError();
+            if (virNetServerClientSendEvent(throttle->client, msg) < 0)
+                virNetMessageFree(msg);
+            goto cleanup;
+        }
+    }
+
+    if (entry->pending) {
+        virNetMessageFree(entry->pending);
+        entry->pending = msg;
+        throttle->coalesced++;
+    } else {
+        entry->pending = msg;
+        if (now >= entry->lastSent + throttle->interval) {
+            remoteEventThrottleSendPending(throttle, entry, now);
+        } else if (!throttle->armed) {
+            virEventUpdateTimeout(throttle->timer, throttle->interval);
+            throttle->armed = true;
+        }
+    }
+
+ cleanup:
+    virObjectUnlock(throttle);
+}
+
+
+/* The events which can be coalesced, because only the latest state
+ * matters to the client and they can arrive in quick succession */
+bool
+remoteEventCanCoalesce(int eventID)
+{
+    switch (eventID) {
+    case VIR_DOMAIN_EVENT_ID_RTC_CHANGE:
+    case VIR_DOMAIN_EVENT_ID_BLOCK_JOB:
+    case VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE:
+    case VIR_DOMAIN_EVENT_ID_BLOCK_JOB_2:
+        return true;
+
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,39 @@
+/*
+ * remote_event.h: coalescing of high frequency events
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LIBVIRTD_REMOTE_EVENT_H__
+# define __LIBVIRTD_REMOTE_EVENT_H__
+
+# include "internal.h"
+# include "rpc/virnetserverclient.h"
+
+typedef struct _remoteEventThrottle remoteEventThrottle;
+typedef remoteEventThrottle *remoteEventThrottlePtr;
+
+remoteEventThrottlePtr remoteEventThrottleNew(virNetServerClientPtr client,
+                                              unsigned int interval);
+void remoteEventThrottleClose(remoteEventThrottlePtr throttle);
+void remoteEventThrottleSend(remoteEventThrottlePtr throttle,
+                             const char *key,
+                             virNetMessagePtr msg);
+
+bool remoteEventCanCoalesce(int eventID);
+
+#endif /* __LIBVIRTD_REMOTE_EVENT_H__ */
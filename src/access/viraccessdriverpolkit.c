@@ -22,11 +22,16 @@
 
 #include "viraccessdriverpolkit.h"
 #include "viralloc.h"
+#include "virbuffer.h"
 #include "vircommand.h"
+#include "virdbus.h"
+#include "virhash.h"
 #include "virlog.h"
+#include "virpolkit.h"
 #include "virprocess.h"
 #include "virerror.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_ACCESS
 
@@ -38,17 +43,116 @@ VIR_LOG_INIT("access.accessdriverpolkit");
 
 #define VIR_ACCESS_DRIVER_POLKIT_ACTION_PREFIX "org.libvirt.api"
 
+/* Past this many remembered decisions the cache is emptied
+ * rather than being allowed to grow without bound */
+#define VIR_ACCESS_DRIVER_POLKIT_CACHE_MAX 4096
+
+#define VIR_ACCESS_DRIVER_POLKIT_CHANGED_MATCH                          \
+    "type='signal',"                                                    \
+    "sender='" VIR_POLKIT_AUTHORITY_SERVICE "',"                        \
+    "interface='" VIR_POLKIT_AUTHORITY_INTERFACE "',"                   \
+    "member='Changed'"
+
 typedef struct _virAccessDriverPolkitPrivate virAccessDriverPolkitPrivate;
 typedef virAccessDriverPolkitPrivate *virAccessDriverPolkitPrivatePtr;
 
 struct _virAccessDriverPolkitPrivate {
     bool ignore;
+
+    virMutex lock;
+    /* Decisions keyed on action, process and object attributes,
+     * NULL unless polkit can tell us when to forget them */
+    virHashTablePtr cache;
 };
 
+enum {
+    VIR_ACCESS_DRIVER_POLKIT_DENIED = 1,
+    VIR_ACCESS_DRIVER_POLKIT_ALLOWED,
+};
+
+
+#ifdef WITH_DBUS
+/* Rules or sessions changed, every remembered decision is suspect */
+static DBusHandlerResult
+virAccessDriverPolkitChanged(DBusConnection *connection ATTRIBUTE_UNUSED,
+                             DBusMessage *message,
+                             void *opaque)
+{
+    virAccessDriverPolkitPrivatePtr priv = opaque;
+
+    if (dbus_message_is_signal(message, VIR_POLKIT_AUTHORITY_INTERFACE,
+                               "Changed")) {
+        VIR_DEBUG("Polkit authority changed, flushing cached decisions");
+        virMutexLock(&priv->lock);
+        virHashRemoveAll(priv->cache);
+        virMutexUnlock(&priv->lock);
+    }
+
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+
+static int virAccessDriverPolkitSetup(virAccessManagerPtr manager)
+{
+    virAccessDriverPolkitPrivatePtr priv = virAccessManagerGetPrivateData(manager);
+    DBusConnection *sysbus;
+
+    if (virMutexInit(&priv->lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize mutex"));
+        return -1;
+    }
+
+    /* Without the system bus checks will fail anyway, leave
+     * reporting that to them */
+    if (!virDBusHasSystemBus() ||
+        !(sysbus = virDBusGetSystemBus()))
+        return 0;
+
+    if (!(priv->cache = virHashCreate(VIR_ACCESS_DRIVER_POLKIT_CACHE_MAX / 16,
+                                      NULL)))
+        return -1;
+
+    dbus_bus_add_match(sysbus, VIR_ACCESS_DRIVER_POLKIT_CHANGED_MATCH, NULL);
+    if (!dbus_connection_add_filter(sysbus, virAccessDriverPolkitChanged,
+                                    priv, NULL)) {
+        VIR_WARN("Cannot watch polkit for changes, not caching decisions");
+        dbus_bus_remove_match(sysbus, VIR_ACCESS_DRIVER_POLKIT_CHANGED_MATCH,
+                              NULL);
+        virHashFree(priv->cache);
+        priv->cache = NULL;
+    }
+
+    return 0;
+}
+
+
+static void virAccessDriverPolkitCleanup(virAccessManagerPtr manager)
+{
+    virAccessDriverPolkitPrivatePtr priv = virAccessManagerGetPrivateData(manager);
+    DBusConnection *sysbus;
+
+    if (priv->cache &&
+        (sysbus = virDBusGetSystemBus())) {
+        dbus_connection_remove_filter(sysbus, virAccessDriverPolkitChanged,
+                                      priv);
+        dbus_bus_remove_match(sysbus, VIR_ACCESS_DRIVER_POLKIT_CHANGED_MATCH,
+                              NULL);
+    }
+    virHashFree(priv->cache);
+    virMutexDestroy(&priv->lock);
+}
+#else /* ! WITH_DBUS */
+static int virAccessDriverPolkitSetup(virAccessManagerPtr manager ATTRIBUTE_UNUSED)
+{
+    return 0;
+}
+
 
 static void virAccessDriverPolkitCleanup(virAccessManagerPtr manager ATTRIBUTE_UNUSED)
 {
 }
+#endif /* ! WITH_DBUS */
 
 
 static char *
@@ -72,16 +176,18 @@ virAccessDriverPolkitFormatAction(const char *typename,
 
 
 static char *
-virAccessDriverPolkitFormatProcess(const char *actionid)
+virAccessDriverPolkitFormatProcess(const char *actionid,
+                                   pid_t *pid,
+                                   unsigned long long *startTime,
+                                   uid_t *uid)
 {
     virIdentityPtr identity = virIdentityGetCurrent();
     const char *callerPid = NULL;
     const char *callerTime = NULL;
     const char *callerUid = NULL;
+    long long tmpPid;
+    int tmpUid;
     char *ret = NULL;
-#ifndef PKCHECK_SUPPORTS_UID
-    static bool polkitInsecureWarned;
-#endif
 
     if (!identity) {
         virAccessError(VIR_ERR_ACCESS_DENIED,
@@ -112,18 +218,19 @@ virAccessDriverPolkitFormatProcess(const char *actionid)
         goto cleanup;
     }
 
-#ifdef PKCHECK_SUPPORTS_UID
-    if (virAsprintf(&ret, "%s,%s,%s", callerPid, callerTime, callerUid) < 0)
+    if (virStrToLong_ll(callerPid, NULL, 10, &tmpPid) < 0 ||
+        virStrToLong_ull(callerTime, NULL, 10, startTime) < 0 ||
+        virStrToLong_i(callerUid, NULL, 10, &tmpUid) < 0) {
+        virAccessError(VIR_ERR_INTERNAL_ERROR,
+                       _("Malformed caller identity %s,%s,%s"),
+                       callerPid, callerTime, callerUid);
         goto cleanup;
-#else
-    if (!polkitInsecureWarned) {
-        VIR_WARN("No support for caller UID with pkcheck. "
-                 "This deployment is known to be insecure.");
-        polkitInsecureWarned = true;
     }
-    if (virAsprintf(&ret, "%s,%s", callerPid, callerTime) < 0)
+    *pid = tmpPid;
+    *uid = tmpUid;
+
+    if (virAsprintf(&ret, "%s,%s,%s", callerPid, callerTime, callerUid) < 0)
         goto cleanup;
-#endif
 
  cleanup:
     virObjectUnref(identity);
@@ -131,29 +238,63 @@ virAccessDriverPolkitFormatProcess(const char *actionid)
 }
 
 
+#ifdef WITH_DBUS
 static int
-virAccessDriverPolkitCheck(virAccessManagerPtr manager ATTRIBUTE_UNUSED,
-                           const char *typename,
-                           const char *permname,
-                           const char **attrs)
+virAccessDriverPolkitAsk(const char *actionid,
+                         const char *process ATTRIBUTE_UNUSED,
+                         pid_t pid,
+                         unsigned long long startTime,
+                         uid_t uid,
+                         const char **attrs,
+                         bool *cacheable)
+{
+    bool challenge = false;
+    int ret;
+
+    if ((ret = virPolkitCheckAuth(actionid, pid, startTime, uid,
+                                  attrs, &challenge)) < 0)
+        return -1;
+
+    /* An action the caller could authenticate for may be
+     * allowed next time round, so don't remember the denial */
+    *cacheable = !challenge;
+    return ret;
+}
+#else /* ! WITH_DBUS */
+static int
+virAccessDriverPolkitAsk(const char *actionid,
+                         const char *process,
+                         pid_t pid ATTRIBUTE_UNUSED,
+                         unsigned long long startTime ATTRIBUTE_UNUSED,
+                         uid_t uid ATTRIBUTE_UNUSED,
+                         const char **attrs,
+                         bool *cacheable)
 {
-    char *actionid = NULL;
-    char *process = NULL;
     virCommandPtr cmd = NULL;
     int status;
     int ret = -1;
+# ifndef PKCHECK_SUPPORTS_UID
+    static bool polkitInsecureWarned;
+    char *pidtime = NULL;
 
-    if (!(actionid = virAccessDriverPolkitFormatAction(typename, permname)))
-        goto cleanup;
-
-    if (!(process = virAccessDriverPolkitFormatProcess(actionid)))
-        goto cleanup;
+    if (!polkitInsecureWarned) {
+        VIR_WARN("No support for caller UID with pkcheck. "
+                 "This deployment is known to be insecure.");
+        polkitInsecureWarned = true;
+    }
+    if (virAsprintf(&pidtime, "%lld,%llu", (long long) pid, startTime) < 0)
+        return -1;
+# endif
 
-    VIR_DEBUG("Check action '%s' for process '%s'", actionid, process);
+    *cacheable = false;
 
     cmd = virCommandNewArgList(PKCHECK_PATH,
                                "--action-id", actionid,
+# ifdef PKCHECK_SUPPORTS_UID
                                "--process", process,
+# else
+                               "--process", pidtime,
+# endif
                                NULL);
 
     while (attrs && attrs[0] && attrs[1]) {
@@ -183,12 +324,105 @@ virAccessDriverPolkitCheck(virAccessManagerPtr manager ATTRIBUTE_UNUSED,
 
  cleanup:
     virCommandFree(cmd);
+# ifndef PKCHECK_SUPPORTS_UID
+    VIR_FREE(pidtime);
+# endif
+    return ret;
+}
+#endif /* ! WITH_DBUS */
+
+
+static char *
+virAccessDriverPolkitCacheKey(const char *actionid,
+                              const char *process,
+                              const char **attrs)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+
+    virBufferAsprintf(&buf, "%s\n%s", actionid, process);
+    while (attrs && attrs[0] && attrs[1]) {
+        virBufferAsprintf(&buf, "\n%s=%s", attrs[0], attrs[1]);
+        attrs += 2;
+    }
+
+    if (virBufferError(&buf)) {
+        virBufferFreeAndReset(&buf);
+        virReportOOMError();
+        return NULL;
+    }
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+static int
+virAccessDriverPolkitCheck(virAccessManagerPtr manager,
+                           const char *typename,
+                           const char *permname,
+                           const char **attrs)
+{
+    virAccessDriverPolkitPrivatePtr priv = virAccessManagerGetPrivateData(manager);
+    char *actionid = NULL;
+    char *process = NULL;
+    char *key = NULL;
+    pid_t pid;
+    unsigned long long startTime;
+    uid_t uid;
+    bool cacheable = false;
+    int ret = -1;
+
+    if (!(actionid = virAccessDriverPolkitFormatAction(typename, permname)))
+        goto cleanup;
+
+    if (!(process = virAccessDriverPolkitFormatProcess(actionid, &pid,
+                                                       &startTime, &uid)))
+        goto cleanup;
+
+    if (priv->cache) {
+        void *decision;
+
+        if (!(key = virAccessDriverPolkitCacheKey(actionid, process, attrs)))
+            goto cleanup;
+
+        virMutexLock(&priv->lock);
+        decision = virHashLookup(priv->cache, key);
+        virMutexUnlock(&priv->lock);
+
+        if (decision) {
+            ret = (decision == (void *) VIR_ACCESS_DRIVER_POLKIT_ALLOWED);
+            VIR_DEBUG("Cached %s of action '%s' for process '%s'",
+                      ret ? "grant" : "denial", actionid, process);
+            goto cleanup;
+        }
+    }
+
+    VIR_DEBUG("Check action '%s' for process '%s'", actionid, process);
+
+    if ((ret = virAccessDriverPolkitAsk(actionid, process, pid, startTime,
+                                        uid, attrs, &cacheable)) < 0)
+        goto cleanup;
+
+    if (priv->cache && cacheable) {
+        void *decision = ret ?
+            (void *) VIR_ACCESS_DRIVER_POLKIT_ALLOWED :
+            (void *) VIR_ACCESS_DRIVER_POLKIT_DENIED;
+
+        virMutexLock(&priv->lock);
+        if (virHashSize(priv->cache) >= VIR_ACCESS_DRIVER_POLKIT_CACHE_MAX)
+            virHashRemoveAll(priv->cache);
+        /* A failure to remember the decision doesn't change it */
+        if (virHashUpdateEntry(priv->cache, key, decision) < 0)
+            virResetLastError();
+        virMutexUnlock(&priv->lock);
+    }
+
+ cleanup:
     VIR_FREE(actionid);
     VIR_FREE(process);
+    VIR_FREE(key);
     return ret;
 }
 
-
 static int
 virAccessDriverPolkitCheckConnect(virAccessManagerPtr manager,
                                   const char *driverName,
@@ -418,6 +652,7 @@ virAccessDriverPolkitCheckStorageVol(virAccessManagerPtr manager,
 virAccessDriver accessDriverPolkit = {
     .privateDataLen = sizeof(virAccessDriverPolkitPrivate),
     .name = "polkit",
+    .setup = virAccessDriverPolkitSetup,
     .cleanup = virAccessDriverPolkitCleanup,
     .checkConnect = virAccessDriverPolkitCheckConnect,
     .checkDomain = virAccessDriverPolkitCheckDomain,
@@ -1179,7 +1179,7 @@ bhyveStateInitialize(bool priveleged ATTRIBUTE_UNUSED,
     if (!(bhyve_driver->domains = virDomainObjListNew()))
         goto cleanup;
 
-    if (!(bhyve_driver->domainEventState = virObjectEventStateNew()))
+    if (!(bhyve_driver->domainEventState = virObjectEventStateNewFull(true)))
         goto cleanup;
 
     bhyve_driver->hostsysinfo = virSysinfoRead();
@@ -69,6 +69,11 @@ struct _virDomainObjList {
     /* uuid string -> virDomainObj  mapping
      * for O(1), lockless lookup-by-uuid */
     virHashTable *objs;
+
+    /* the keys of @objs in ascending order, so that a page of
+     * domains can be found without sorting them all each time */
+    char **uuids;
+    size_t nuuids;
 };
 
 
@@ -995,8 +1000,76 @@ virDomainObjListPtr virDomainObjListNew(void)
 static void virDomainObjListDispose(void *obj)
 {
     virDomainObjListPtr doms = obj;
+    size_t i;
 
     virHashFree(doms->objs);
+    for (i = 0; i < doms->nuuids; i++)
+        VIR_FREE(doms->uuids[i]);
+    VIR_FREE(doms->uuids);
+}
+
+
+/* Returns the position of the first key in the sorted index which
+ * doesn't sort before @uuidstr */
+static size_t
+virDomainObjListIndexFind(virDomainObjListPtr doms,
+                          const char *uuidstr)
+{
+    size_t lo = 0;
+    size_t hi = doms->nuuids;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (strcmp(doms->uuids[mid], uuidstr) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+
+/* Adds @vm to the list under @uuidstr, keeping the sorted index in
+ * step with the hash table. The caller must hold the list lock. */
+static int
+virDomainObjListInsert(virDomainObjListPtr doms,
+                       const char *uuidstr,
+                       virDomainObjPtr vm)
+{
+    size_t pos = virDomainObjListIndexFind(doms, uuidstr);
+    char *key = NULL;
+
+    if (VIR_STRDUP(key, uuidstr) < 0 ||
+        VIR_INSERT_ELEMENT(doms->uuids, pos, doms->nuuids, key) < 0) {
+        VIR_FREE(key);
+        return -1;
+    }
+
+    if (virHashAddEntry(doms->objs, uuidstr, vm) < 0) {
+        VIR_FREE(doms->uuids[pos]);
+        VIR_DELETE_ELEMENT(doms->uuids, pos, doms->nuuids);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* The caller must hold the list lock */
+static void
+virDomainObjListDelete(virDomainObjListPtr doms,
+                       const char *uuidstr)
+{
+    size_t pos = virDomainObjListIndexFind(doms, uuidstr);
+
+    if (pos < doms->nuuids && STREQ(doms->uuids[pos], uuidstr)) {
+        VIR_FREE(doms->uuids[pos]);
+        VIR_DELETE_ELEMENT(doms->uuids, pos, doms->nuuids);
+    }
+
+    virHashRemoveEntry(doms->objs, uuidstr);
 }
 
 
@@ -2288,7 +2361,7 @@ virDomainObjListAddLocked(virDomainObjListPtr doms,
         vm->def = def;
 
         virUUIDFormat(def->uuid, uuidstr);
-        if (virHashAddEntry(doms->objs, uuidstr, vm) < 0) {
+        if (virDomainObjListInsert(doms, uuidstr, vm) < 0) {
             virObjectUnref(vm);
             return NULL;
         }
@@ -2445,7 +2518,7 @@ void virDomainObjListRemove(virDomainObjListPtr doms,
 
     virObjectLock(doms);
     virObjectLock(dom);
-    virHashRemoveEntry(doms->objs, uuidstr);
+    virDomainObjListDelete(doms, uuidstr);
     virObjectUnlock(dom);
     virObjectUnref(dom);
     virObjectUnlock(doms);
@@ -2465,7 +2538,7 @@ void virDomainObjListRemoveLocked(virDomainObjListPtr doms,
     virUUIDFormat(dom->def->uuid, uuidstr);
     virObjectUnlock(dom);
 
-    virHashRemoveEntry(doms->objs, uuidstr);
+    virDomainObjListDelete(doms, uuidstr);
 }
 
 static int
@@ -18262,7 +18335,7 @@ virDomainObjListLoadStatus(virDomainObjListPtr doms,
         goto error;
     }
 
-    if (virHashAddEntry(doms->objs, uuidstr, obj) < 0)
+    if (virDomainObjListInsert(doms, uuidstr, obj) < 0)
         goto error;
 
     if (notify)
@@ -19327,26 +19400,17 @@ struct virDomainListData {
     bool error;
 };
 
-#define MATCH(FLAG) (data->flags & (FLAG))
-static void
-virDomainListPopulate(void *payload,
-                      const void *name ATTRIBUTE_UNUSED,
-                      void *opaque)
+#define MATCH(FLAG) (flags & (FLAG))
+static bool
+virDomainObjMatchFilter(virDomainObjPtr vm,
+                        virConnectPtr conn,
+                        virDomainObjListFilter filter,
+                        unsigned int flags)
 {
-    struct virDomainListData *data = opaque;
-    virDomainObjPtr vm = payload;
-    virDomainPtr dom;
-
-    if (data->error)
-        return;
-
-    virObjectLock(vm);
-    /* check if the domain matches the filter */
-
     /* filter by the callback function (access control checks) */
-    if (data->filter != NULL &&
-        !data->filter(data->conn, vm->def))
-        goto cleanup;
+    if (filter != NULL &&
+        !filter(conn, vm->def))
+        return false;
 
     /* filter by active state */
     if (MATCH(VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE) &&
@@ -19354,7 +19418,7 @@ virDomainListPopulate(void *payload,
            virDomainObjIsActive(vm)) ||
           (MATCH(VIR_CONNECT_LIST_DOMAINS_INACTIVE) &&
            !virDomainObjIsActive(vm))))
-        goto cleanup;
+        return false;
 
     /* filter by persistence */
     if (MATCH(VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT) &&
@@ -19362,7 +19426,7 @@ virDomainListPopulate(void *payload,
            vm->persistent) ||
           (MATCH(VIR_CONNECT_LIST_DOMAINS_TRANSIENT) &&
            !vm->persistent)))
-        goto cleanup;
+        return false;
 
     /* filter by domain state */
     if (MATCH(VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE)) {
@@ -19377,7 +19441,7 @@ virDomainListPopulate(void *payload,
                (st != VIR_DOMAIN_RUNNING &&
                 st != VIR_DOMAIN_PAUSED &&
                 st != VIR_DOMAIN_SHUTOFF))))
-            goto cleanup;
+            return false;
     }
 
     /* filter by existence of managed save state */
@@ -19386,22 +19450,43 @@ virDomainListPopulate(void *payload,
            vm->hasManagedSave) ||
           (MATCH(VIR_CONNECT_LIST_DOMAINS_NO_MANAGEDSAVE) &&
            !vm->hasManagedSave)))
-            goto cleanup;
+            return false;
 
     /* filter by autostart option */
     if (MATCH(VIR_CONNECT_LIST_DOMAINS_FILTERS_AUTOSTART) &&
         !((MATCH(VIR_CONNECT_LIST_DOMAINS_AUTOSTART) && vm->autostart) ||
           (MATCH(VIR_CONNECT_LIST_DOMAINS_NO_AUTOSTART) && !vm->autostart)))
-        goto cleanup;
+        return false;
 
     /* filter by snapshot existence */
     if (MATCH(VIR_CONNECT_LIST_DOMAINS_FILTERS_SNAPSHOT)) {
         int nsnap = virDomainSnapshotObjListNum(vm->snapshots, NULL, 0);
         if (!((MATCH(VIR_CONNECT_LIST_DOMAINS_HAS_SNAPSHOT) && nsnap > 0) ||
               (MATCH(VIR_CONNECT_LIST_DOMAINS_NO_SNAPSHOT) && nsnap <= 0)))
-            goto cleanup;
+            return false;
     }
 
+    return true;
+}
+#undef MATCH
+
+static void
+virDomainListPopulate(void *payload,
+                      const void *name ATTRIBUTE_UNUSED,
+                      void *opaque)
+{
+    struct virDomainListData *data = opaque;
+    virDomainObjPtr vm = payload;
+    virDomainPtr dom;
+
+    if (data->error)
+        return;
+
+    virObjectLock(vm);
+    /* check if the domain matches the filter */
+    if (!virDomainObjMatchFilter(vm, data->conn, data->filter, data->flags))
+        goto cleanup;
+
     /* just count the machines */
     if (!data->domains) {
         data->ndomains++;
@@ -19421,7 +19506,6 @@ virDomainListPopulate(void *payload,
     virObjectUnlock(vm);
     return;
 }
-#undef MATCH
 
 int
 virDomainObjListExport(virDomainObjListPtr doms,
@@ -19470,6 +19554,95 @@ virDomainObjListExport(virDomainObjListPtr doms,
     return ret;
 }
 
+
+/**
+ * virDomainObjListExportPage:
+ * @doms: the domain list
+ * @conn: connection to create the domain objects for
+ * @after: UUID string of the last domain of the previous page, or NULL
+ * @maxdomains: maximum number of domains to return
+ * @domains: filled with an allocated, NULL terminated array of domains
+ * @filter: access control filter, may be NULL
+ * @flags: bitwise-OR of virConnectListAllDomainsFlags
+ *
+ * Like virDomainObjListExport, but only exports the first @maxdomains
+ * matching domains whose UUID sorts after @after. The list keeps its
+ * UUID strings sorted, so that is the order domains come out in; finding
+ * the page costs a binary search and only the domains on the page are
+ * looked at and get a virDomainPtr.
+ *
+ * Returns the number of domains in @domains, or -1 on error.
+ */
+int
+virDomainObjListExportPage(virDomainObjListPtr doms,
+                           virConnectPtr conn,
+                           const char *after,
+                           unsigned int maxdomains,
+                           virDomainPtr **domains,
+                           virDomainObjListFilter filter,
+                           unsigned int flags)
+{
+    virDomainPtr *tmp_domains = NULL;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    size_t ndomains = 0;
+    size_t i = 0;
+    int ret = -1;
+
+    if (after) {
+        if (virUUIDParse(after, uuid) < 0) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("cannot parse UUID '%s'"), after);
+            return -1;
+        }
+        virUUIDFormat(uuid, uuidstr);
+    }
+
+    virObjectLock(doms);
+
+    if (VIR_ALLOC_N(tmp_domains, MIN(doms->nuuids, maxdomains) + 1) < 0)
+        goto cleanup;
+
+    /* Find the first key after the cursor */
+    if (after) {
+        i = virDomainObjListIndexFind(doms, uuidstr);
+        if (i < doms->nuuids && STREQ(doms->uuids[i], uuidstr))
+            i++;
+    }
+
+    for (; i < doms->nuuids && ndomains < maxdomains; i++) {
+        virDomainObjPtr vm = virHashLookup(doms->objs, doms->uuids[i]);
+        virDomainPtr dom = NULL;
+        bool match;
+
+        virObjectLock(vm);
+        if ((match = virDomainObjMatchFilter(vm, conn, filter, flags)) &&
+            (dom = virGetDomain(conn, vm->def->name, vm->def->uuid)))
+            dom->id = vm->def->id;
+        virObjectUnlock(vm);
+
+        if (!match)
+            continue;
+        if (!dom)
+            goto cleanup;
+
+        tmp_domains[ndomains++] = dom;
+    }
+
+    *domains = tmp_domains;
+    tmp_domains = NULL;
+    ret = ndomains;
+
+ cleanup:
+    if (tmp_domains) {
+        for (i = 0; i < ndomains; i++)
+            virObjectUnref(tmp_domains[i]);
+        VIR_FREE(tmp_domains);
+    }
+    virObjectUnlock(doms);
+    return ret;
+}
+
 virSecurityLabelDefPtr
 virDomainDefGetSecurityLabelDef(virDomainDefPtr def, const char *model)
 {
@@ -2672,6 +2672,14 @@ int virDomainObjListExport(virDomainObjListPtr doms,
                            virDomainObjListFilter filter,
                            unsigned int flags);
 
+int virDomainObjListExportPage(virDomainObjListPtr doms,
+                               virConnectPtr conn,
+                               const char *after,
+                               unsigned int maxdomains,
+                               virDomainPtr **domains,
+                               virDomainObjListFilter filter,
+                               unsigned int flags);
+
 int
 virDomainDefMaybeAddController(virDomainDefPtr def,
                                int type,
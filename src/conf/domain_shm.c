@@ -0,0 +1,699 @@
+/*
+ * domain_shm.c: shared memory snapshot of domain states
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "domain_shm.h"
+#include "viralloc.h"
+#include "viratomic.h"
+#include "virerror.h"
+#include "virevent.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_DOMAIN
+
+VIR_LOG_INIT("conf.domain_shm");
+
+/*
+ * The daemon publishes the state of its domains in a file that local
+ * clients map read-only. Updates are protected by a sequence counter:
+ * the writer makes it odd while it rewrites the records and even again
+ * once it is done, so a reader that saw the same even value before and
+ * after copying what it needs knows the copy is consistent.
+ *
+ * The file never changes size once mapped. When more slots are needed
+ * a bigger file is renamed over the old one, which is flagged as
+ * retired so that readers go and map the new one.
+ */
+
+#define VIR_DOMAIN_SHM_MAGIC 0x4c564453 /* "LVDS" */
+#define VIR_DOMAIN_SHM_VERSION 1
+#define VIR_DOMAIN_SHM_MIN_SLOTS 64
+#define VIR_DOMAIN_SHM_RETRIES 100
+
+typedef struct _virDomainShmHeader virDomainShmHeader;
+typedef virDomainShmHeader *virDomainShmHeaderPtr;
+struct _virDomainShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    int seq;
+    int retired;
+    int32_t pid;
+    uint32_t nslots;
+    uint32_t ndomains;
+    uint32_t padding;
+};
+
+typedef struct _virDomainShmRecord virDomainShmRecord;
+typedef virDomainShmRecord *virDomainShmRecordPtr;
+struct _virDomainShmRecord {
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    int32_t id;
+    int32_t state;
+    int32_t reason;
+    uint32_t nrVirtCpu;
+    uint64_t maxMem;
+    uint64_t memory;
+};
+
+#define VIR_DOMAIN_SHM_SIZE(nslots) \
+    (sizeof(virDomainShmHeader) + (nslots) * sizeof(virDomainShmRecord))
+
+#define VIR_DOMAIN_SHM_RECORDS(hdr) \
+    ((virDomainShmRecordPtr)((char *)(hdr) + sizeof(virDomainShmHeader)))
+
+
+struct _virDomainShmPublisher {
+    virObjectLockable parent;
+
+    char *path;
+    int fd;
+    virDomainShmHeaderPtr hdr;
+    size_t len;
+
+    /* Set up by virDomainShmPublisherSchedule */
+    virDomainObjListPtr doms;
+    int timer;
+    int interval;
+    bool dirty;
+};
+
+struct _virDomainShmReader {
+    char *path;
+    virDomainShmHeaderPtr hdr;
+    size_t len;
+    size_t nslots;
+};
+
+
+static virClassPtr virDomainShmPublisherClass;
+static void virDomainShmPublisherDispose(void *obj);
+
+static int virDomainShmOnceInit(void)
+{
+    if (!(virDomainShmPublisherClass = virClassNew(virClassForObjectLockable(),
+                                                   "virDomainShmPublisher",
+                                                   sizeof(virDomainShmPublisher),
+                                                   virDomainShmPublisherDispose)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virDomainShm)
+
+
+static void
+virDomainShmPublisherUnmap(virDomainShmPublisherPtr pub)
+{
+    if (pub->hdr) {
+        virAtomicIntSet(&pub->hdr->retired, 1);
+        munmap(pub->hdr, pub->len);
+    }
+    pub->hdr = NULL;
+    pub->len = 0;
+    VIR_FORCE_CLOSE(pub->fd);
+}
+
+
+/* Create a file with room for @nslots domains and put it in place of
+ * the current one */
+static int
+virDomainShmPublisherMap(virDomainShmPublisherPtr pub,
+                         size_t nslots)
+{
+    char *tmppath = NULL;
+    size_t len = VIR_DOMAIN_SHM_SIZE(nslots);
+    virDomainShmHeaderPtr hdr = NULL;
+    int fd = -1;
+    int ret = -1;
+
+    if (virAsprintf(&tmppath, "%s.new", pub->path) < 0)
+        goto cleanup;
+
+    if ((fd = open(tmppath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+        virReportSystemError(errno, _("cannot create %s"), tmppath);
+        goto cleanup;
+    }
+
+    if (ftruncate(fd, len) < 0) {
+        virReportSystemError(errno, _("cannot resize %s"), tmppath);
+        goto cleanup;
+    }
+
+    if ((hdr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        hdr = NULL;
+        virReportSystemError(errno, _("cannot map %s"), tmppath);
+        goto cleanup;
+    }
+
+    hdr->magic = VIR_DOMAIN_SHM_MAGIC;
+    hdr->version = VIR_DOMAIN_SHM_VERSION;
+    hdr->pid = getpid();
+    hdr->nslots = nslots;
+
+    if (rename(tmppath, pub->path) < 0) {
+        virReportSystemError(errno, _("cannot rename %s to %s"),
+                             tmppath, pub->path);
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Mapped %s with %zu slots", pub->path, nslots);
+
+    virDomainShmPublisherUnmap(pub);
+    pub->hdr = hdr;
+    pub->len = len;
+    pub->fd = fd;
+    hdr = NULL;
+    fd = -1;
+    ret = 0;
+
+ cleanup:
+    if (hdr)
+        munmap(hdr, len);
+    if (fd >= 0) {
+        unlink(tmppath);
+        VIR_FORCE_CLOSE(fd);
+    }
+    VIR_FREE(tmppath);
+    return ret;
+}
+
+
+virDomainShmPublisherPtr
+virDomainShmPublisherNew(const char *path)
+{
+    virDomainShmPublisherPtr pub;
+
+    if (virDomainShmInitialize() < 0)
+        return NULL;
+
+    if (!(pub = virObjectLockableNew(virDomainShmPublisherClass)))
+        return NULL;
+
+    pub->fd = -1;
+    pub->timer = -1;
+
+    if (VIR_STRDUP(pub->path, path) < 0 ||
+        virDomainShmPublisherMap(pub, VIR_DOMAIN_SHM_MIN_SLOTS) < 0) {
+        virObjectUnref(pub);
+        return NULL;
+    }
+
+    return pub;
+}
+
+
+struct virDomainShmCollectData {
+    virDomainShmRecordPtr recs;
+    size_t nrecs;
+    size_t nalloc;
+};
+
+static int
+virDomainShmPublisherCollect(virDomainObjPtr vm,
+                             void *opaque)
+{
+    struct virDomainShmCollectData *data = opaque;
+    virDomainShmRecordPtr rec;
+    int reason;
+
+    if (VIR_RESIZE_N(data->recs, data->nalloc, data->nrecs, 1) < 0)
+        return -1;
+
+    rec = &data->recs[data->nrecs++];
+
+    virObjectLock(vm);
+    memcpy(rec->uuid, vm->def->uuid, VIR_UUID_BUFLEN);
+    rec->id = virDomainObjIsActive(vm) ? vm->def->id : -1;
+    rec->state = virDomainObjGetState(vm, &reason);
+    rec->reason = reason;
+    rec->nrVirtCpu = vm->def->vcpus;
+    rec->maxMem = vm->def->mem.max_balloon;
+    rec->memory = vm->def->mem.cur_balloon;
+    virObjectUnlock(vm);
+
+    return 0;
+}
+
+
+/**
+ * virDomainShmPublisherUpdate:
+ * @pub: the publisher
+ * @doms: domains to publish
+ *
+ * Replace the published snapshot with the current state of @doms.
+ * Locks each domain in turn, so it must not be called with any
+ * domain locked.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int
+virDomainShmPublisherUpdate(virDomainShmPublisherPtr pub,
+                            virDomainObjListPtr doms)
+{
+    struct virDomainShmCollectData data = { NULL, 0, 0 };
+    int ret = -1;
+
+    if (virDomainObjListForEach(doms, virDomainShmPublisherCollect, &data) < 0)
+        goto cleanup;
+
+    virObjectLock(pub);
+
+    if (!pub->hdr) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("domain state snapshot is closed"));
+        goto unlock;
+    }
+
+    if (data.nrecs > pub->hdr->nslots &&
+        virDomainShmPublisherMap(pub, data.nrecs * 2) < 0)
+        goto unlock;
+
+    virAtomicIntInc(&pub->hdr->seq);
+    if (data.nrecs)
+        memcpy(VIR_DOMAIN_SHM_RECORDS(pub->hdr), data.recs,
+               data.nrecs * sizeof(*data.recs));
+    pub->hdr->ndomains = data.nrecs;
+    virAtomicIntInc(&pub->hdr->seq);
+
+    ret = 0;
+
+ unlock:
+    virObjectUnlock(pub);
+ cleanup:
+    VIR_FREE(data.recs);
+    return ret;
+}
+
+
+static void
+virDomainShmPublisherTimer(int timer ATTRIBUTE_UNUSED,
+                           void *opaque)
+{
+    virDomainShmPublisherPtr pub = opaque;
+
+    virObjectLock(pub);
+    pub->dirty = false;
+    virObjectUnlock(pub);
+
+    if (virDomainShmPublisherUpdate(pub, pub->doms) < 0) {
+        VIR_WARN("Unable to update domain state snapshot %s: %s",
+                 pub->path, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    virObjectLock(pub);
+    if (pub->timer >= 0 && !pub->dirty)
+        virEventUpdateTimeout(pub->timer, pub->interval);
+    virObjectUnlock(pub);
+}
+
+
+/**
+ * virDomainShmPublisherSchedule:
+ * @pub: the publisher
+ * @doms: domains to publish
+ * @interval: refresh period in milliseconds
+ *
+ * Publish @doms from the event loop every @interval milliseconds,
+ * and as soon as possible after virDomainShmPublisherRequestUpdate.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int
+virDomainShmPublisherSchedule(virDomainShmPublisherPtr pub,
+                              virDomainObjListPtr doms,
+                              int interval)
+{
+    int ret = -1;
+
+    virObjectLock(pub);
+
+    if (pub->timer >= 0) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("domain state snapshot is already scheduled"));
+        goto cleanup;
+    }
+
+    pub->doms = virObjectRef(doms);
+    pub->interval = interval;
+
+    virObjectRef(pub);
+    if ((pub->timer = virEventAddTimeout(0, virDomainShmPublisherTimer,
+                                         pub, virObjectFreeCallback)) < 0) {
+        virObjectUnref(pub);
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to register domain state snapshot timer"));
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(pub);
+    return ret;
+}
+
+
+/* Safe to call with domains locked, the update runs later from the
+ * event loop */
+void
+virDomainShmPublisherRequestUpdate(virDomainShmPublisherPtr pub)
+{
+    virObjectLock(pub);
+    if (pub->timer >= 0 && !pub->dirty) {
+        pub->dirty = true;
+        virEventUpdateTimeout(pub->timer, 0);
+    }
+    virObjectUnlock(pub);
+}
+
+
+/* Withdraw the snapshot so that clients go back to asking the daemon */
+void
+virDomainShmPublisherClose(virDomainShmPublisherPtr pub)
+{
+    if (!pub)
+        return;
+
+    virObjectLock(pub);
+    if (pub->timer >= 0) {
+        virEventRemoveTimeout(pub->timer);
+        pub->timer = -1;
+    }
+    if (pub->hdr)
+        unlink(pub->path);
+    virDomainShmPublisherUnmap(pub);
+    virObjectUnlock(pub);
+}
+
+
+static void
+virDomainShmPublisherDispose(void *obj)
+{
+    virDomainShmPublisherPtr pub = obj;
+
+    if (pub->hdr)
+        munmap(pub->hdr, pub->len);
+    VIR_FORCE_CLOSE(pub->fd);
+    virObjectUnref(pub->doms);
+    VIR_FREE(pub->path);
+}
+
+
+static void
+virDomainShmReaderUnmap(virDomainShmReaderPtr reader)
+{
+    if (reader->hdr)
+        munmap(reader->hdr, reader->len);
+    reader->hdr = NULL;
+    reader->len = 0;
+    reader->nslots = 0;
+}
+
+
+static int
+virDomainShmReaderMap(virDomainShmReaderPtr reader)
+{
+    virDomainShmHeaderPtr hdr;
+    struct stat sb;
+    int fd;
+
+    virDomainShmReaderUnmap(reader);
+
+    if ((fd = open(reader->path, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+
+    /* Only trust what root or ourselves wrote */
+    if (fstat(fd, &sb) < 0 ||
+        (sb.st_uid != 0 && sb.st_uid != geteuid()) ||
+        sb.st_size < sizeof(*hdr)) {
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
+
+    hdr = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    VIR_FORCE_CLOSE(fd);
+    if (hdr == MAP_FAILED)
+        return -1;
+
+    if (hdr->magic != VIR_DOMAIN_SHM_MAGIC ||
+        hdr->version != VIR_DOMAIN_SHM_VERSION ||
+        sb.st_size < VIR_DOMAIN_SHM_SIZE(hdr->nslots)) {
+        VIR_DEBUG("Ignoring unexpected domain state snapshot %s",
+                  reader->path);
+        munmap(hdr, sb.st_size);
+        return -1;
+    }
+
+    reader->hdr = hdr;
+    reader->len = sb.st_size;
+    reader->nslots = hdr->nslots;
+    return 0;
+}
+
+
+static bool
+virDomainShmReaderIsCurrent(virDomainShmReaderPtr reader)
+{
+    if (!reader->hdr || virAtomicIntGet(&reader->hdr->retired))
+        return false;
+
+    /* A daemon that went away without cleaning up left stale data */
+    if (kill(reader->hdr->pid, 0) < 0 && errno == ESRCH)
+        return false;
+
+    return true;
+}
+
+
+/* Make sure the mapping is the one the daemon is updating, picking
+ * up a replacement file if needed */
+static int
+virDomainShmReaderCheck(virDomainShmReaderPtr reader)
+{
+    if (virDomainShmReaderIsCurrent(reader))
+        return 0;
+
+    if (virDomainShmReaderMap(reader) < 0 ||
+        !virDomainShmReaderIsCurrent(reader))
+        return -1;
+
+    return 0;
+}
+
+
+virDomainShmReaderPtr
+virDomainShmReaderOpen(const char *path)
+{
+    virDomainShmReaderPtr reader;
+
+    if (VIR_ALLOC_QUIET(reader) < 0)
+        return NULL;
+
+    if (VIR_STRDUP_QUIET(reader->path, path) < 0 ||
+        virDomainShmReaderCheck(reader) < 0) {
+        virDomainShmReaderFree(reader);
+        return NULL;
+    }
+
+    VIR_DEBUG("Using domain state snapshot %s", path);
+    return reader;
+}
+
+
+void
+virDomainShmReaderFree(virDomainShmReaderPtr reader)
+{
+    if (!reader)
+        return;
+
+    virDomainShmReaderUnmap(reader);
+    VIR_FREE(reader->path);
+    VIR_FREE(reader);
+}
+
+
+/* Copies of the records are only valid if the sequence number was
+ * even and did not move while they were taken */
+static int
+virDomainShmReaderBegin(virDomainShmReaderPtr reader,
+                        size_t *ndomains)
+{
+    int seq = virAtomicIntGet(&reader->hdr->seq);
+
+    *ndomains = MIN(reader->hdr->ndomains, reader->nslots);
+    return seq;
+}
+
+
+static bool
+virDomainShmReaderRetry(virDomainShmReaderPtr reader,
+                        int seq)
+{
+    return (seq & 1) || virAtomicIntGet(&reader->hdr->seq) != seq;
+}
+
+
+int
+virDomainShmReaderNumOfDomains(virDomainShmReaderPtr reader)
+{
+    size_t i;
+    size_t n;
+    int count;
+    int seq;
+    int tries;
+
+    if (virDomainShmReaderCheck(reader) < 0)
+        return -1;
+
+    for (tries = 0; tries < VIR_DOMAIN_SHM_RETRIES; tries++) {
+        virDomainShmRecordPtr recs = VIR_DOMAIN_SHM_RECORDS(reader->hdr);
+
+        seq = virDomainShmReaderBegin(reader, &n);
+        count = 0;
+        for (i = 0; i < n; i++) {
+            if (recs[i].id != -1)
+                count++;
+        }
+        if (!virDomainShmReaderRetry(reader, seq))
+            return count;
+    }
+
+    return -1;
+}
+
+
+int
+virDomainShmReaderListDomains(virDomainShmReaderPtr reader,
+                              int *ids,
+                              int maxids)
+{
+    size_t i;
+    size_t n;
+    int count;
+    int seq;
+    int tries;
+
+    if (virDomainShmReaderCheck(reader) < 0)
+        return -1;
+
+    for (tries = 0; tries < VIR_DOMAIN_SHM_RETRIES; tries++) {
+        virDomainShmRecordPtr recs = VIR_DOMAIN_SHM_RECORDS(reader->hdr);
+
+        seq = virDomainShmReaderBegin(reader, &n);
+        count = 0;
+        for (i = 0; i < n && count < maxids; i++) {
+            int id = recs[i].id;
+            if (id != -1)
+                ids[count++] = id;
+        }
+        if (!virDomainShmReaderRetry(reader, seq))
+            return count;
+    }
+
+    return -1;
+}
+
+
+/* Copy the record of the domain with @uuid, returns -1 if it is not
+ * in the snapshot */
+static int
+virDomainShmReaderFind(virDomainShmReaderPtr reader,
+                       const unsigned char *uuid,
+                       virDomainShmRecordPtr rec)
+{
+    size_t i;
+    size_t n;
+    int seq;
+    int tries;
+    bool found;
+
+    if (virDomainShmReaderCheck(reader) < 0)
+        return -1;
+
+    for (tries = 0; tries < VIR_DOMAIN_SHM_RETRIES; tries++) {
+        virDomainShmRecordPtr recs = VIR_DOMAIN_SHM_RECORDS(reader->hdr);
+
+        seq = virDomainShmReaderBegin(reader, &n);
+        found = false;
+        for (i = 0; i < n; i++) {
+            if (memcmp(recs[i].uuid, uuid, VIR_UUID_BUFLEN) == 0) {
+                memcpy(rec, &recs[i], sizeof(*rec));
+                found = true;
+                break;
+            }
+        }
+        if (!virDomainShmReaderRetry(reader, seq))
+            return found ? 0 : -1;
+    }
+
+    return -1;
+}
+
+
+int
+virDomainShmReaderGetState(virDomainShmReaderPtr reader,
+                           const unsigned char *uuid,
+                           int *state,
+                           int *reason)
+{
+    virDomainShmRecord rec;
+
+    if (virDomainShmReaderFind(reader, uuid, &rec) < 0)
+        return -1;
+
+    *state = rec.state;
+    if (reason)
+        *reason = rec.reason;
+    return 0;
+}
+
+
+/* CPU time is not published, running domains have to ask the daemon */
+int
+virDomainShmReaderGetInfo(virDomainShmReaderPtr reader,
+                          const unsigned char *uuid,
+                          virDomainInfoPtr info)
+{
+    virDomainShmRecord rec;
+
+    if (virDomainShmReaderFind(reader, uuid, &rec) < 0 ||
+        rec.id != -1)
+        return -1;
+
+    info->state = rec.state;
+    info->maxMem = rec.maxMem;
+    info->memory = rec.memory;
+    info->nrVirtCpu = rec.nrVirtCpu;
+    info->cpuTime = 0;
+    return 0;
+}
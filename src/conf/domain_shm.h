@@ -0,0 +1,72 @@
+/*
+ * domain_shm.h: shared memory snapshot of domain states
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __DOMAIN_SHM_H__
+# define __DOMAIN_SHM_H__
+
+# include "internal.h"
+# include "domain_conf.h"
+
+/* Name of the snapshot file in a driver's state directory */
+# define VIR_DOMAIN_SHM_FILE "domstate"
+
+typedef struct _virDomainShmPublisher virDomainShmPublisher;
+typedef virDomainShmPublisher *virDomainShmPublisherPtr;
+
+typedef struct _virDomainShmReader virDomainShmReader;
+typedef virDomainShmReader *virDomainShmReaderPtr;
+
+/* Daemon side */
+virDomainShmPublisherPtr virDomainShmPublisherNew(const char *path);
+
+int virDomainShmPublisherUpdate(virDomainShmPublisherPtr pub,
+                                virDomainObjListPtr doms);
+
+int virDomainShmPublisherSchedule(virDomainShmPublisherPtr pub,
+                                  virDomainObjListPtr doms,
+                                  int interval);
+
+void virDomainShmPublisherRequestUpdate(virDomainShmPublisherPtr pub);
+
+void virDomainShmPublisherClose(virDomainShmPublisherPtr pub);
+
+/* Client side. None of these report errors, -1 means the caller has
+ * to ask the daemon instead */
+virDomainShmReaderPtr virDomainShmReaderOpen(const char *path);
+
+void virDomainShmReaderFree(virDomainShmReaderPtr reader);
+
+int virDomainShmReaderNumOfDomains(virDomainShmReaderPtr reader);
+
+int virDomainShmReaderListDomains(virDomainShmReaderPtr reader,
+                                  int *ids,
+                                  int maxids);
+
+int virDomainShmReaderGetState(virDomainShmReaderPtr reader,
+                               const unsigned char *uuid,
+                               int *state,
+                               int *reason);
+
+int virDomainShmReaderGetInfo(virDomainShmReaderPtr reader,
+                              const unsigned char *uuid,
+                              virDomainInfoPtr info);
+
+#endif /* __DOMAIN_SHM_H__ */
@@ -91,34 +91,28 @@ virNodeDeviceObjPtr
 virNodeDeviceFindBySysfsPath(virNodeDeviceObjListPtr devs,
                              const char *sysfs_path)
 {
-    size_t i;
+    virNodeDeviceObjPtr dev;
 
-    for (i = 0; i < devs->count; i++) {
-        virNodeDeviceObjLock(devs->objs[i]);
-        if ((devs->objs[i]->def->sysfs_path != NULL) &&
-            (STREQ(devs->objs[i]->def->sysfs_path, sysfs_path))) {
-            return devs->objs[i];
-        }
-        virNodeDeviceObjUnlock(devs->objs[i]);
-    }
+    if (!devs->bySysfsPath ||
+        !(dev = virHashLookup(devs->bySysfsPath, sysfs_path)))
+        return NULL;
 
-    return NULL;
+    virNodeDeviceObjLock(dev);
+    return dev;
 }
 
 
 virNodeDeviceObjPtr virNodeDeviceFindByName(virNodeDeviceObjListPtr devs,
                                             const char *name)
 {
-    size_t i;
+    virNodeDeviceObjPtr dev;
 
-    for (i = 0; i < devs->count; i++) {
-        virNodeDeviceObjLock(devs->objs[i]);
-        if (STREQ(devs->objs[i]->def->name, name))
-            return devs->objs[i];
-        virNodeDeviceObjUnlock(devs->objs[i]);
-    }
+    if (!devs->byName ||
+        !(dev = virHashLookup(devs->byName, name)))
+        return NULL;
 
-    return NULL;
+    virNodeDeviceObjLock(dev);
+    return dev;
 }
 
 
@@ -166,6 +160,33 @@ void virNodeDeviceObjListFree(virNodeDeviceObjListPtr devs)
         virNodeDeviceObjFree(devs->objs[i]);
     VIR_FREE(devs->objs);
     devs->count = 0;
+    virHashFree(devs->byName);
+    devs->byName = NULL;
+    virHashFree(devs->bySysfsPath);
+    devs->bySysfsPath = NULL;
+}
+
+
+static int
+virNodeDeviceObjListIndexSysfsPath(virNodeDeviceObjListPtr devs,
+                                   virNodeDeviceObjPtr dev,
+                                   virNodeDeviceDefPtr def)
+{
+    if (!def->sysfs_path)
+        return 0;
+
+    return virHashUpdateEntry(devs->bySysfsPath, def->sysfs_path, dev);
+}
+
+
+static void
+virNodeDeviceObjListUnindexSysfsPath(virNodeDeviceObjListPtr devs,
+                                     virNodeDeviceObjPtr dev)
+{
+    /* Another device may have claimed the path since */
+    if (dev->def->sysfs_path &&
+        virHashLookup(devs->bySysfsPath, dev->def->sysfs_path) == dev)
+        virHashRemoveEntry(devs->bySysfsPath, dev->def->sysfs_path);
 }
 
 virNodeDeviceObjPtr virNodeDeviceAssignDef(virNodeDeviceObjListPtr devs,
@@ -173,7 +194,22 @@ virNodeDeviceObjPtr virNodeDeviceAssignDef(virNodeDeviceObjListPtr devs,
 {
     virNodeDeviceObjPtr device;
 
+    if (!devs->byName &&
+        !(devs->byName = virHashCreate(50, NULL)))
+        return NULL;
+
+    if (!devs->bySysfsPath &&
+        !(devs->bySysfsPath = virHashCreate(50, NULL)))
+        return NULL;
+
     if ((device = virNodeDeviceFindByName(devs, def->name))) {
+        virNodeDeviceObjListUnindexSysfsPath(devs, device);
+        if (virNodeDeviceObjListIndexSysfsPath(devs, device, def) < 0) {
+            ignore_value(virNodeDeviceObjListIndexSysfsPath(devs, device,
+                                                            device->def));
+            virNodeDeviceObjUnlock(device);
+            return NULL;
+        }
         virNodeDeviceDefFree(device->def);
         device->def = def;
         return device;
@@ -190,15 +226,31 @@ virNodeDeviceObjPtr virNodeDeviceAssignDef(virNodeDeviceObjListPtr devs,
     }
     virNodeDeviceObjLock(device);
 
-    if (VIR_APPEND_ELEMENT_COPY(devs->objs, devs->count, device) < 0){
-        virNodeDeviceObjUnlock(device);
-        virNodeDeviceObjFree(device);
-        return NULL;
-    }
     device->def = def;
 
+    if (virHashAddEntry(devs->byName, def->name, device) < 0)
+        goto error;
+
+    if (virNodeDeviceObjListIndexSysfsPath(devs, device, def) < 0) {
+        virHashRemoveEntry(devs->byName, def->name);
+        goto error;
+    }
+
+    if (VIR_APPEND_ELEMENT_COPY(devs->objs, devs->count, device) < 0) {
+        virNodeDeviceObjListUnindexSysfsPath(devs, device);
+        virHashRemoveEntry(devs->byName, def->name);
+        goto error;
+    }
+
     return device;
 
+ error:
+    /* The caller owns @def again on failure */
+    device->def = NULL;
+    virNodeDeviceObjUnlock(device);
+    virNodeDeviceObjFree(device);
+    return NULL;
+
 }
 
 void virNodeDeviceObjRemove(virNodeDeviceObjListPtr devs,
@@ -211,6 +263,8 @@ void virNodeDeviceObjRemove(virNodeDeviceObjListPtr devs,
     for (i = 0; i < devs->count; i++) {
         virNodeDeviceObjLock(dev);
         if (devs->objs[i] == dev) {
+            virNodeDeviceObjListUnindexSysfsPath(devs, dev);
+            virHashRemoveEntry(devs->byName, dev->def->name);
             virNodeDeviceObjUnlock(dev);
             virNodeDeviceObjFree(devs->objs[i]);
 
@@ -1834,3 +1888,92 @@ virNodeDeviceObjListExport(virConnectPtr conn,
     VIR_FREE(tmp_devices);
     return ret;
 }
+
+
+static int
+virNodeDeviceObjCompareNames(const void *a,
+                             const void *b)
+{
+    virNodeDeviceObjPtr const *da = a;
+    virNodeDeviceObjPtr const *db = b;
+
+    return strcmp((*da)->def->name, (*db)->def->name);
+}
+
+
+/*
+ * Like virNodeDeviceObjListExport, but only exports the first
+ * @maxdevices matching devices whose name sorts after @after, in order
+ * of their names. The caller must hold the lock of the driver owning
+ * @devobjs, which keeps the device names from changing.
+ */
+int
+virNodeDeviceObjListExportPage(virConnectPtr conn,
+                               virNodeDeviceObjList devobjs,
+                               const char *after,
+                               unsigned int maxdevices,
+                               virNodeDevicePtr **devices,
+                               virNodeDeviceObjListFilter filter,
+                               unsigned int flags)
+{
+    virNodeDeviceObjPtr *sorted = NULL;
+    virNodeDevicePtr *tmp_devices = NULL;
+    size_t ndevices = 0;
+    size_t lo = 0;
+    size_t hi = devobjs.count;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(tmp_devices, MIN(devobjs.count, maxdevices) + 1) < 0)
+        goto cleanup;
+
+    if (devobjs.count) {
+        if (VIR_ALLOC_N(sorted, devobjs.count) < 0)
+            goto cleanup;
+        memcpy(sorted, devobjs.objs, devobjs.count * sizeof(*sorted));
+        qsort(sorted, devobjs.count, sizeof(*sorted),
+              virNodeDeviceObjCompareNames);
+    }
+
+    /* Find the first device after the cursor */
+    while (after && lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (strcmp(sorted[mid]->def->name, after) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (i = lo; i < devobjs.count && ndevices < maxdevices; i++) {
+        virNodeDeviceObjPtr devobj = sorted[i];
+        virNodeDevicePtr device = NULL;
+        bool match;
+
+        virNodeDeviceObjLock(devobj);
+        if ((match = (!filter || filter(conn, devobj->def)) &&
+             virNodeDeviceMatch(devobj, flags)))
+            device = virGetNodeDevice(conn, devobj->def->name);
+        virNodeDeviceObjUnlock(devobj);
+
+        if (!match)
+            continue;
+        if (!device)
+            goto cleanup;
+
+        tmp_devices[ndevices++] = device;
+    }
+
+    *devices = tmp_devices;
+    tmp_devices = NULL;
+    ret = ndevices;
+
+ cleanup:
+    if (tmp_devices) {
+        for (i = 0; i < ndevices; i++)
+            virNodeDeviceFree(tmp_devices[i]);
+        VIR_FREE(tmp_devices);
+    }
+    VIR_FREE(sorted);
+    return ret;
+}
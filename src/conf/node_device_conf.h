@@ -28,6 +28,7 @@
 # include "internal.h"
 # include "virutil.h"
 # include "virthread.h"
+# include "virhash.h"
 # include "virpci.h"
 # include "device_conf.h"
 
@@ -238,6 +239,11 @@ typedef virNodeDeviceObjList *virNodeDeviceObjListPtr;
 struct _virNodeDeviceObjList {
     size_t count;
     virNodeDeviceObjPtr *objs;
+
+    /* Lookup indexes over @objs, they don't own the objects.
+     * Created on first use so that the list can be zero initialized */
+    virHashTablePtr byName;
+    virHashTablePtr bySysfsPath;
 };
 
 typedef struct _virNodeDeviceDriverState virNodeDeviceDriverState;
@@ -321,4 +327,12 @@ int virNodeDeviceObjListExport(virConnectPtr conn,
                                virNodeDeviceObjListFilter filter,
                                unsigned int flags);
 
+int virNodeDeviceObjListExportPage(virConnectPtr conn,
+                                   virNodeDeviceObjList devobjs,
+                                   const char *after,
+                                   unsigned int maxdevices,
+                                   virNodeDevicePtr **devices,
+                                   virNodeDeviceObjListFilter filter,
+                                   unsigned int flags);
+
 #endif /* __VIR_NODE_DEVICE_CONF_H__ */
@@ -32,7 +32,10 @@
 #include "datatypes.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "virhash.h"
 #include "virstring.h"
+#include "virthread.h"
+#include "viruuid.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -42,7 +45,24 @@ struct _virObjectEventCallbackList {
     unsigned int nextID;
     size_t count;
     virObjectEventCallbackPtr *callbacks;
+
+    /* Index of the callbacks by base class, event ID and object
+     * UUID (or "*" for callbacks not filtering on an object), so
+     * that dispatching an event only needs to look at the callbacks
+     * that can possibly match it.  Maps keys from
+     * virObjectEventCallbackIndexKey() to virObjectEventCallbackBucket */
+    virHashTablePtr index;
+    /* Distinct base classes that callbacks were registered for */
+    size_t nklasses;
+    virClassPtr *klasses;
+};
+
+struct _virObjectEventCallbackBucket {
+    size_t count;
+    virObjectEventCallbackPtr *callbacks;
 };
+typedef struct _virObjectEventCallbackBucket virObjectEventCallbackBucket;
+typedef virObjectEventCallbackBucket *virObjectEventCallbackBucketPtr;
 
 struct _virObjectEventQueue {
     size_t count;
@@ -61,6 +81,14 @@ struct _virObjectEventState {
     /* Flag if we're in process of dispatching */
     bool isDispatching;
     virMutex lock;
+
+    /* Set when events are dispatched from a dedicated thread
+     * rather than from a timer on the event loop */
+    bool useThread;
+    bool quit;
+    virThread thread;
+    /* Signalled when events are queued or the thread must quit */
+    virCond cond;
 };
 
 struct _virObjectEventCallback {
@@ -143,10 +171,232 @@ virObjectEventCallbackListFree(virObjectEventCallbackListPtr list)
         VIR_FREE(list->callbacks[i]);
     }
     VIR_FREE(list->callbacks);
+    virHashFree(list->index);
+    VIR_FREE(list->klasses);
     VIR_FREE(list);
 }
 
 
+static void
+virObjectEventCallbackBucketFree(void *payload,
+                                 const void *name ATTRIBUTE_UNUSED)
+{
+    virObjectEventCallbackBucketPtr bucket = payload;
+
+    if (!bucket)
+        return;
+
+    VIR_FREE(bucket->callbacks);
+    VIR_FREE(bucket);
+}
+
+
+static virObjectEventCallbackListPtr
+virObjectEventCallbackListNew(void)
+{
+    virObjectEventCallbackListPtr list;
+
+    if (VIR_ALLOC(list) < 0)
+        return NULL;
+
+    if (!(list->index = virHashCreate(32, virObjectEventCallbackBucketFree))) {
+        VIR_FREE(list);
+        return NULL;
+    }
+
+    return list;
+}
+
+
+/* Room for "<class>/<eventID>/<uuid>"; class names are internal
+ * identifiers, far shorter than this */
+#define VIR_OBJECT_EVENT_INDEX_KEY_BUFLEN 128
+
+/**
+ * virObjectEventCallbackIndexKey:
+ * @klass: the base event class
+ * @eventID: the event ID
+ * @uuid: uuid of the object, or NULL for callbacks on all objects
+ * @key: buffer to fill
+ *
+ * Format the key under which callbacks matching @klass, @eventID
+ * and @uuid are stored in the callback index.
+ */
+static void
+virObjectEventCallbackIndexKey(virClassPtr klass,
+                               int eventID,
+                               const unsigned char *uuid,
+                               char key[VIR_OBJECT_EVENT_INDEX_KEY_BUFLEN])
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    if (uuid)
+        virUUIDFormat(uuid, uuidstr);
+
+    snprintf(key, VIR_OBJECT_EVENT_INDEX_KEY_BUFLEN, "%s/%d/%s",
+             virClassName(klass), eventID, uuid ? uuidstr : "*");
+}
+
+
+/**
+ * virObjectEventCallbackIndexAdd:
+ * @cbList: the list
+ * @cb: the callback to index
+ *
+ * Add @cb to the index of @cbList.  Callbacks in a bucket are kept
+ * in registration order.
+ *
+ * Returns 0 on success, -1 on error
+ */
+static int
+virObjectEventCallbackIndexAdd(virObjectEventCallbackListPtr cbList,
+                               virObjectEventCallbackPtr cb)
+{
+    virObjectEventCallbackBucketPtr bucket;
+    char key[VIR_OBJECT_EVENT_INDEX_KEY_BUFLEN];
+    size_t i;
+
+    virObjectEventCallbackIndexKey(cb->klass, cb->eventID,
+                                   cb->uuid_filter ? cb->uuid : NULL, key);
+
+    for (i = 0; i < cbList->nklasses; i++) {
+        if (cbList->klasses[i] == cb->klass)
+            break;
+    }
+    if (i == cbList->nklasses &&
+        VIR_APPEND_ELEMENT_COPY(cbList->klasses, cbList->nklasses,
+                                cb->klass) < 0)
+        return -1;
+
+    if (!(bucket = virHashLookup(cbList->index, key))) {
+        if (VIR_ALLOC(bucket) < 0)
+            return -1;
+        if (virHashAddEntry(cbList->index, key, bucket) < 0) {
+            virObjectEventCallbackBucketFree(bucket, NULL);
+            return -1;
+        }
+    }
+
+    /* An empty bucket left behind on failure is harmless */
+    if (VIR_APPEND_ELEMENT_COPY(bucket->callbacks, bucket->count, cb) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * virObjectEventCallbackIndexRemove:
+ * @cbList: the list
+ * @cb: the callback to drop from the index
+ *
+ * Remove @cb from the index of @cbList, dropping its bucket once it
+ * becomes empty.
+ */
+static void
+virObjectEventCallbackIndexRemove(virObjectEventCallbackListPtr cbList,
+                                  virObjectEventCallbackPtr cb)
+{
+    virObjectEventCallbackBucketPtr bucket;
+    char key[VIR_OBJECT_EVENT_INDEX_KEY_BUFLEN];
+    size_t i;
+
+    virObjectEventCallbackIndexKey(cb->klass, cb->eventID,
+                                   cb->uuid_filter ? cb->uuid : NULL, key);
+
+    if (!(bucket = virHashLookup(cbList->index, key)))
+        return;
+
+    for (i = 0; i < bucket->count; i++) {
+        if (bucket->callbacks[i] == cb) {
+            VIR_DELETE_ELEMENT(bucket->callbacks, i, bucket->count);
+            break;
+        }
+    }
+    if (bucket->count == 0)
+        ignore_value(virHashRemoveEntry(cbList->index, key));
+}
+
+
+static int
+virObjectEventCallbackCompareID(const void *a,
+                                const void *b)
+{
+    const virObjectEventCallbackPtr *cba = a;
+    const virObjectEventCallbackPtr *cbb = b;
+
+    return (*cba)->callbackID - (*cbb)->callbackID;
+}
+
+
+/**
+ * virObjectEventCallbackIndexCollect:
+ * @cbList: the list
+ * @event: the event about to be dispatched
+ * @callbacks: filled with the candidate callbacks
+ * @ncallbacks: filled with the number of candidate callbacks
+ *
+ * Gather the callbacks in @cbList which were registered for the
+ * class and ID of @event, either for all objects or for the object
+ * @event describes.  The result is a snapshot in registration order,
+ * so that it is not affected by callbacks being added while the
+ * state lock is dropped during dispatch.  Remaining filters are left
+ * to virObjectEventDispatchMatchCallback().
+ *
+ * Returns 0 on success, -1 on error
+ */
+static int
+virObjectEventCallbackIndexCollect(virObjectEventCallbackListPtr cbList,
+                                   virObjectEventPtr event,
+                                   virObjectEventCallbackPtr **callbacks,
+                                   size_t *ncallbacks)
+{
+    virObjectEventCallbackPtr *cbs = NULL;
+    size_t ncbs = 0;
+    size_t nbuckets = 0;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    for (i = 0; i < cbList->nklasses; i++) {
+        const unsigned char *uuids[] = { NULL, event->meta.uuid };
+
+        if (!virObjectIsClass(event, cbList->klasses[i]))
+            continue;
+
+        for (j = 0; j < ARRAY_CARDINALITY(uuids); j++) {
+            virObjectEventCallbackBucketPtr bucket;
+            char key[VIR_OBJECT_EVENT_INDEX_KEY_BUFLEN];
+
+            virObjectEventCallbackIndexKey(cbList->klasses[i], event->eventID,
+                                           uuids[j], key);
+            if (!(bucket = virHashLookup(cbList->index, key)) ||
+                bucket->count == 0)
+                continue;
+
+            if (VIR_EXPAND_N(cbs, ncbs, bucket->count) < 0)
+                goto cleanup;
+            memcpy(cbs + ncbs - bucket->count, bucket->callbacks,
+                   bucket->count * sizeof(*cbs));
+            nbuckets++;
+        }
+    }
+
+    /* Each bucket is already in registration order, only merging
+     * several of them needs sorting */
+    if (nbuckets > 1)
+        qsort(cbs, ncbs, sizeof(*cbs), virObjectEventCallbackCompareID);
+
+    *callbacks = cbs;
+    *ncallbacks = ncbs;
+    cbs = NULL;
+    ret = 0;
+ cleanup:
+    VIR_FREE(cbs);
+    return ret;
+}
+
+
 /**
  * virObjectEventCallbackListCount:
  * @conn: pointer to the connection
@@ -226,6 +476,7 @@ virObjectEventCallbackListRemoveID(virConnectPtr conn,
                                                  cb->uuid_filter ? cb->uuid : NULL,
                                                  cb->remoteID >= 0) - 1);
 
+            virObjectEventCallbackIndexRemove(cbList, cb);
             if (cb->freecb)
                 (*cb->freecb)(cb->opaque);
             virObjectUnref(cb->conn);
@@ -276,6 +527,8 @@ virObjectEventCallbackListPurgeMarked(virObjectEventCallbackListPtr cbList)
     for (n = 0; n < cbList->count; n++) {
         if (cbList->callbacks[n]->deleted) {
             virFreeCallback freecb = cbList->callbacks[n]->freecb;
+
+            virObjectEventCallbackIndexRemove(cbList, cbList->callbacks[n]);
             if (freecb)
                 (*freecb)(cbList->callbacks[n]->opaque);
             virObjectUnref(cbList->callbacks[n]->conn);
@@ -425,8 +678,14 @@ virObjectEventCallbackListAddID(virConnectPtr conn,
     event->filter_opaque = filter_opaque;
     event->legacy = legacy;
 
-    if (VIR_APPEND_ELEMENT(cbList->callbacks, cbList->count, event) < 0)
+    if (virObjectEventCallbackIndexAdd(cbList, event) < 0)
+        goto cleanup;
+
+    if (VIR_APPEND_ELEMENT_COPY(cbList->callbacks, cbList->count, event) < 0) {
+        virObjectEventCallbackIndexRemove(cbList, event);
         goto cleanup;
+    }
+    event = NULL;
 
     /* When additional filtering is being done, every client callback
      * is matched to exactly one server callback.  */
@@ -531,6 +790,16 @@ virObjectEventStateFree(virObjectEventStatePtr state)
     if (!state)
         return;
 
+    if (state->useThread) {
+        virObjectEventStateLock(state);
+        state->quit = true;
+        virCondSignal(&state->cond);
+        virObjectEventStateUnlock(state);
+
+        virThreadJoin(&state->thread);
+        virCondDestroy(&state->cond);
+    }
+
     virObjectEventCallbackListFree(state->callbacks);
     virObjectEventQueueFree(state->queue);
 
@@ -543,6 +812,7 @@ virObjectEventStateFree(virObjectEventStatePtr state)
 
 
 static void virObjectEventStateFlush(virObjectEventStatePtr state);
+static void virObjectEventStateFlushLocked(virObjectEventStatePtr state);
 
 
 /**
@@ -564,12 +834,47 @@ virObjectEventTimer(int timer ATTRIBUTE_UNUSED, void *opaque)
 
 
 /**
- * virObjectEventStateNew:
+ * virObjectEventDispatchThread:
+ * @opaque: the event state object
+ *
+ * Body of the thread flushing the callback queue of an event state
+ * created with a dedicated dispatch thread.
+ */
+static void
+virObjectEventDispatchThread(void *opaque)
+{
+    virObjectEventStatePtr state = opaque;
+
+    virObjectEventStateLock(state);
+    while (!state->quit) {
+        if (state->queue->count == 0) {
+            if (virCondWait(&state->cond, &state->lock) < 0) {
+                VIR_WARN("Unable to wait on event state condition");
+                break;
+            }
+            continue;
+        }
+
+        virObjectEventStateFlushLocked(state);
+    }
+    virObjectEventStateUnlock(state);
+}
+
+
+/**
+ * virObjectEventStateNewFull:
+ * @dispatchThread: dispatch events from a dedicated thread
  *
- * Allocate a new event state object.
+ * Allocate a new event state object.  Queued events are normally
+ * dispatched from a timer on the event loop.  When @dispatchThread is
+ * true they are dispatched from a thread of their own instead, so that
+ * slow or numerous callbacks don't hold up the event loop; this is
+ * only suitable when the callbacks are safe to run outside of the
+ * event loop thread, as is the case for drivers running inside the
+ * daemon.
  */
 virObjectEventStatePtr
-virObjectEventStateNew(void)
+virObjectEventStateNewFull(bool dispatchThread)
 {
     virObjectEventStatePtr state = NULL;
 
@@ -583,13 +888,30 @@ virObjectEventStateNew(void)
         goto error;
     }
 
-    if (VIR_ALLOC(state->callbacks) < 0)
+    state->timer = -1;
+
+    if (!(state->callbacks = virObjectEventCallbackListNew()))
         goto error;
 
     if (!(state->queue = virObjectEventQueueNew()))
         goto error;
 
-    state->timer = -1;
+    if (dispatchThread) {
+        if (virCondInit(&state->cond) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("unable to initialize state condition"));
+            goto error;
+        }
+
+        if (virThreadCreate(&state->thread, true,
+                            virObjectEventDispatchThread, state) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("unable to create event dispatch thread"));
+            virCondDestroy(&state->cond);
+            goto error;
+        }
+        state->useThread = true;
+    }
 
     return state;
 
@@ -599,6 +921,19 @@ virObjectEventStateNew(void)
 }
 
 
+/**
+ * virObjectEventStateNew:
+ *
+ * Allocate a new event state object, dispatching events from the
+ * event loop.
+ */
+virObjectEventStatePtr
+virObjectEventStateNew(void)
+{
+    return virObjectEventStateNewFull(false);
+}
+
+
 /**
  * virObjectEventNew:
  * @klass: subclass of event to be created
@@ -708,13 +1043,22 @@ virObjectEventStateDispatchCallbacks(virObjectEventStatePtr state,
                                      virObjectEventCallbackListPtr callbacks)
 {
     size_t i;
-    /* Cache this now, since we may be dropping the lock,
-       and have more callbacks added. We're guaranteed not
+    virObjectEventCallbackPtr *cbs = NULL;
+    size_t cbCount = 0;
+
+    /* Take a snapshot of the candidates now, since we may be dropping
+       the lock, and have more callbacks added. We're guaranteed not
        to have any removed */
-    size_t cbCount = callbacks->count;
+    if (virObjectEventCallbackIndexCollect(callbacks, event,
+                                           &cbs, &cbCount) < 0) {
+        VIR_WARN("Unable to dispatch event %d for %s",
+                 event->eventID, NULLSTR(event->meta.name));
+        virResetLastError();
+        return;
+    }
 
     for (i = 0; i < cbCount; i++) {
-        virObjectEventCallbackPtr cb = callbacks->callbacks[i];
+        virObjectEventCallbackPtr cb = cbs[i];
 
         if (!virObjectEventDispatchMatchCallback(event, cb))
             continue;
@@ -724,6 +1068,8 @@ virObjectEventStateDispatchCallbacks(virObjectEventStatePtr state,
         event->dispatch(cb->conn, event, cb->cb, cb->opaque);
         virObjectEventStateLock(state);
     }
+
+    VIR_FREE(cbs);
 }
 
 
@@ -761,21 +1107,27 @@ virObjectEventStateQueueRemote(virObjectEventStatePtr state,
                                virObjectEventPtr event,
                                int remoteID)
 {
-    if (state->timer < 0) {
+    virObjectEventStateLock(state);
+
+    /* Nobody is listening */
+    if (state->useThread ? state->callbacks->count == 0 : state->timer < 0) {
+        virObjectEventStateUnlock(state);
         virObjectUnref(event);
         return;
     }
 
-    virObjectEventStateLock(state);
-
     event->remoteID = remoteID;
     if (virObjectEventQueuePush(state->queue, event) < 0) {
         VIR_DEBUG("Error adding event to queue");
         virObjectUnref(event);
     }
 
-    if (state->queue->count == 1)
-        virEventUpdateTimeout(state->timer, 0);
+    if (state->queue->count == 1) {
+        if (state->useThread)
+            virCondSignal(&state->cond);
+        else
+            virEventUpdateTimeout(state->timer, 0);
+    }
     virObjectEventStateUnlock(state);
 }
 
@@ -799,10 +1151,18 @@ virObjectEventStateQueue(virObjectEventStatePtr state,
 
 static void
 virObjectEventStateFlush(virObjectEventStatePtr state)
+{
+    virObjectEventStateLock(state);
+    virObjectEventStateFlushLocked(state);
+    virObjectEventStateUnlock(state);
+}
+
+
+static void
+virObjectEventStateFlushLocked(virObjectEventStatePtr state)
 {
     virObjectEventQueue tempQueue;
 
-    virObjectEventStateLock(state);
     state->isDispatching = true;
 
     /* Copy the queue, so we're reentrant safe when dispatchFunc drops the
@@ -811,7 +1171,8 @@ virObjectEventStateFlush(virObjectEventStatePtr state)
     tempQueue.events = state->queue->events;
     state->queue->count = 0;
     state->queue->events = NULL;
-    virEventUpdateTimeout(state->timer, -1);
+    if (state->timer != -1)
+        virEventUpdateTimeout(state->timer, -1);
 
     virObjectEventStateQueueDispatch(state,
                                      &tempQueue,
@@ -821,7 +1182,6 @@ virObjectEventStateFlush(virObjectEventStatePtr state)
     virObjectEventCallbackListPurgeMarked(state->callbacks);
 
     state->isDispatching = false;
-    virObjectEventStateUnlock(state);
 }
 
 
@@ -878,7 +1238,8 @@ virObjectEventStateRegisterID(virConnectPtr conn,
 
     virObjectEventStateLock(state);
 
-    if ((state->callbacks->count == 0) &&
+    if (!state->useThread &&
+        (state->callbacks->count == 0) &&
         (state->timer == -1) &&
         (state->timer = virEventAddTimeout(-1,
                                            virObjectEventTimer,
@@ -935,10 +1296,11 @@ virObjectEventStateDeregisterID(virConnectPtr conn,
         ret = virObjectEventCallbackListRemoveID(conn,
                                                  state->callbacks, callbackID);
 
-    if (state->callbacks->count == 0 &&
-        state->timer != -1) {
-        virEventRemoveTimeout(state->timer);
-        state->timer = -1;
+    if (state->callbacks->count == 0) {
+        if (state->timer != -1) {
+            virEventRemoveTimeout(state->timer);
+            state->timer = -1;
+        }
         virObjectEventQueueClear(state->queue);
     }
 
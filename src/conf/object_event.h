@@ -46,6 +46,8 @@ typedef virObjectEventState *virObjectEventStatePtr;
 void virObjectEventStateFree(virObjectEventStatePtr state);
 virObjectEventStatePtr
 virObjectEventStateNew(void);
+virObjectEventStatePtr
+virObjectEventStateNewFull(bool dispatchThread);
 
 /**
  * virConnectObjectEventGenericCallback:
@@ -2300,3 +2300,90 @@ virStoragePoolObjListExport(virConnectPtr conn,
     VIR_FREE(tmp_pools);
     return ret;
 }
+
+
+static int
+virStorageVolDefCompareNames(const void *a,
+                             const void *b)
+{
+    virStorageVolDefPtr const *va = a;
+    virStorageVolDefPtr const *vb = b;
+
+    return strcmp((*va)->name, (*vb)->name);
+}
+
+
+/*
+ * Export the first @maxvols volumes of the locked pool @obj whose name
+ * sorts after @after, in order of their names. Only the volumes on the
+ * page get a virStorageVolPtr, but volumes are kept in an unsorted array
+ * that every storage backend appends to directly, so each page still
+ * costs a copy and sort of the whole array: O(n log n) per page and
+ * O(n^2 log n / @maxvols) to walk a pool of n volumes. That is still far
+ * cheaper than the RPC traffic of listing a large pool in one go.
+ *
+ * Returns the number of volumes in @vols, or -1 on error.
+ */
+int
+virStoragePoolObjVolumeListExportPage(virConnectPtr conn,
+                                      virStoragePoolObjPtr obj,
+                                      const char *after,
+                                      unsigned int maxvols,
+                                      virStorageVolPtr **vols,
+                                      virStorageVolDefListFilter filter)
+{
+    virStorageVolDefPtr *sorted = NULL;
+    virStorageVolPtr *tmp_vols = NULL;
+    size_t count = obj->volumes.count;
+    size_t nvols = 0;
+    size_t lo = 0;
+    size_t hi = count;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(tmp_vols, MIN(count, maxvols) + 1) < 0)
+        goto cleanup;
+
+    if (count) {
+        if (VIR_ALLOC_N(sorted, count) < 0)
+            goto cleanup;
+        memcpy(sorted, obj->volumes.objs, count * sizeof(*sorted));
+        qsort(sorted, count, sizeof(*sorted), virStorageVolDefCompareNames);
+    }
+
+    /* Find the first volume after the cursor */
+    while (after && lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (strcmp(sorted[mid]->name, after) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (i = lo; i < count && nvols < maxvols; i++) {
+        virStorageVolDefPtr def = sorted[i];
+
+        if (filter && !filter(conn, obj->def, def))
+            continue;
+
+        if (!(tmp_vols[nvols] = virGetStorageVol(conn, obj->def->name,
+                                                 def->name, def->key,
+                                                 NULL, NULL)))
+            goto cleanup;
+        nvols++;
+    }
+
+    *vols = tmp_vols;
+    tmp_vols = NULL;
+    ret = nvols;
+
+ cleanup:
+    if (tmp_vols) {
+        for (i = 0; i < nvols; i++)
+            virStorageVolFree(tmp_vols[i]);
+        VIR_FREE(tmp_vols);
+    }
+    VIR_FREE(sorted);
+    return ret;
+}
@@ -332,6 +332,10 @@ struct _virStoragePoolSourceList {
 typedef bool (*virStoragePoolObjListFilter)(virConnectPtr conn,
                                             virStoragePoolDefPtr def);
 
+typedef bool (*virStorageVolDefListFilter)(virConnectPtr conn,
+                                           virStoragePoolDefPtr pool,
+                                           virStorageVolDefPtr def);
+
 static inline int
 virStoragePoolObjIsActive(virStoragePoolObjPtr pool)
 {
@@ -552,4 +556,11 @@ int virStoragePoolObjListExport(virConnectPtr conn,
                                 virStoragePoolObjListFilter filter,
                                 unsigned int flags);
 
+int virStoragePoolObjVolumeListExportPage(virConnectPtr conn,
+                                          virStoragePoolObjPtr obj,
+                                          const char *after,
+                                          unsigned int maxvols,
+                                          virStorageVolPtr **vols,
+                                          virStorageVolDefListFilter filter);
+
 #endif /* __VIR_STORAGE_CONF_H__ */
@@ -32,6 +32,7 @@
 #include "cpu_x86.h"
 #include "virbuffer.h"
 #include "virendian.h"
+#include "virhash.h"
 #include "virstring.h"
 
 #define VIR_FROM_THIS VIR_FROM_CPU
@@ -89,6 +90,10 @@ struct x86_map {
     struct x86_vendor *vendors;
     struct x86_feature *features;
     struct x86_model *models;
+
+    /* name -> struct x86_feature / x86_model, the lists own the objects */
+    virHashTablePtr featureIndex;
+    virHashTablePtr modelIndex;
 };
 
 static struct x86_map* virCPUx86Map = NULL;
@@ -177,18 +182,32 @@ x86cpuidAndBits(virCPUx86CPUID *cpuid,
     cpuid->edx &= mask->edx;
 }
 
-static int
-virCPUx86CPUIDSorter(const void *a, const void *b)
+
+/* CPUID leafs in virCPUx86Data are kept sorted by function with no
+ * duplicates (see virCPUx86DataAddCPUID), which lets lookups use a binary
+ * search and lets the set operations below walk two data sets in step.
+ *
+ * Returns true if @function is present in @data. In either case @pos is
+ * set to the index where the leaf is or should be inserted. */
+static bool
+x86DataCpuidPos(const virCPUx86Data *data,
+                uint32_t function,
+                size_t *pos)
 {
-    virCPUx86CPUID *da = (virCPUx86CPUID *) a;
-    virCPUx86CPUID *db = (virCPUx86CPUID *) b;
+    size_t lo = 0;
+    size_t hi = data->len;
 
-    if (da->function > db->function)
-        return 1;
-    else if (da->function < db->function)
-        return -1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
 
-    return 0;
+        if (data->data[mid].function < function)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    *pos = lo;
+    return lo < data->len && data->data[lo].function == function;
 }
 
 
@@ -214,14 +233,12 @@ static virCPUx86CPUID *
 x86DataCpuid(const virCPUx86Data *data,
              uint32_t function)
 {
-    size_t i;
+    size_t pos;
 
-    for (i = 0; i < data->len; i++) {
-        if (data->data[i].function == function)
-            return data->data + i;
-    }
+    if (!x86DataCpuidPos(data, function, &pos))
+        return NULL;
 
-    return NULL;
+    return data->data + pos;
 }
 
 void
@@ -285,17 +302,14 @@ int
 virCPUx86DataAddCPUID(virCPUx86Data *data,
                       const virCPUx86CPUID *cpuid)
 {
-    virCPUx86CPUID *existing;
+    size_t pos;
 
-    if ((existing = x86DataCpuid(data, cpuid->function))) {
-        x86cpuidSetBits(existing, cpuid);
+    if (x86DataCpuidPos(data, cpuid->function, &pos)) {
+        x86cpuidSetBits(data->data + pos, cpuid);
     } else {
-        if (VIR_APPEND_ELEMENT_COPY(data->data, data->len,
+        if (VIR_INSERT_ELEMENT_COPY(data->data, pos, data->len,
                                     *((virCPUx86CPUID *)cpuid)) < 0)
             return -1;
-
-        qsort(data->data, data->len,
-              sizeof(virCPUx86CPUID), virCPUx86CPUIDSorter);
     }
 
     return 0;
@@ -371,14 +385,25 @@ static bool
 x86DataIsSubset(const virCPUx86Data *data,
                 const virCPUx86Data *subset)
 {
+    size_t i = 0;
+    size_t j;
+
+    /* Both sets are sorted by function, so walk them in step rather than
+     * looking up every leaf of @subset in @data. This is called for every
+     * feature in the map whenever a CPU is decoded or compared. */
+    for (j = 0; j < subset->len; j++) {
+        const virCPUx86CPUID *cpuidSubset = subset->data + j;
+
+        if (x86cpuidMatch(cpuidSubset, &cpuidNull))
+            continue;
 
-    struct virCPUx86DataIterator iter = virCPUx86DataIteratorInit((virCPUx86Data *)subset);
-    const virCPUx86CPUID *cpuid;
-    const virCPUx86CPUID *cpuidSubset;
+        while (i < data->len &&
+               data->data[i].function < cpuidSubset->function)
+            i++;
 
-    while ((cpuidSubset = x86DataCpuidNext(&iter))) {
-        if (!(cpuid = x86DataCpuid(data, cpuidSubset->function)) ||
-            !x86cpuidMatchMasked(cpuid, cpuidSubset))
+        if (i == data->len ||
+            data->data[i].function != cpuidSubset->function ||
+            !x86cpuidMatchMasked(data->data + i, cpuidSubset))
             return false;
     }
 
@@ -595,17 +620,21 @@ static struct x86_feature *
 x86FeatureFind(const struct x86_map *map,
                const char *name)
 {
-    struct x86_feature *feature;
+    return virHashLookup(map->featureIndex, name);
+}
 
-    feature = map->features;
-    while (feature != NULL) {
-        if (STREQ(feature->name, name))
-            return feature;
 
-        feature = feature->next;
-    }
+static int
+x86FeatureAdd(struct x86_map *map,
+              struct x86_feature *feature)
+{
+    if (virHashAddEntry(map->featureIndex, feature->name, feature) < 0)
+        return -1;
 
-    return NULL;
+    feature->next = map->features;
+    map->features = feature;
+
+    return 0;
 }
 
 
@@ -710,12 +739,8 @@ x86FeatureLoad(xmlXPathContextPtr ctxt,
             goto error;
     }
 
-    if (map->features == NULL)
-        map->features = feature;
-    else {
-        feature->next = map->features;
-        map->features = feature;
-    }
+    if (x86FeatureAdd(map, feature) < 0)
+        goto error;
 
  out:
     ctxt->node = ctxt_node;
@@ -813,17 +838,7 @@ static struct x86_model *
 x86ModelFind(const struct x86_map *map,
              const char *name)
 {
-    struct x86_model *model;
-
-    model = map->models;
-    while (model != NULL) {
-        if (STREQ(model->name, name))
-            return model;
-
-        model = model->next;
-    }
-
-    return NULL;
+    return virHashLookup(map->modelIndex, name);
 }
 
 
@@ -1048,13 +1063,18 @@ x86ModelLoad(xmlXPathContextPtr ctxt,
             goto error;
     }
 
-    if (map->models == NULL)
-        map->models = model;
-    else {
-        model->next = map->models;
-        map->models = model;
+    if (x86ModelFind(map, model->name)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("CPU model %s already defined"), model->name);
+        goto ignore;
     }
 
+    if (virHashAddEntry(map->modelIndex, model->name, model) < 0)
+        goto error;
+
+    model->next = map->models;
+    map->models = model;
+
  out:
     VIR_FREE(vendor);
     VIR_FREE(nodes);
@@ -1093,6 +1113,8 @@ x86MapFree(struct x86_map *map)
         x86VendorFree(vendor);
     }
 
+    virHashFree(map->featureIndex);
+    virHashFree(map->modelIndex);
     VIR_FREE(map);
 }
 
@@ -1143,12 +1165,8 @@ x86MapLoadInternalFeatures(struct x86_map *map)
         if (virCPUx86DataAddCPUID(feature->data, &x86_kvm_features[i].cpuid))
             goto error;
 
-        if (map->features == NULL) {
-            map->features = feature;
-        } else {
-            feature->next = map->features;
-            map->features = feature;
-        }
+        if (x86FeatureAdd(map, feature) < 0)
+            goto error;
 
         feature = NULL;
     }
@@ -1169,6 +1187,10 @@ virCPUx86LoadMap(void)
     if (VIR_ALLOC(map) < 0)
         return NULL;
 
+    if (!(map->featureIndex = virHashCreate(256, NULL)) ||
+        !(map->modelIndex = virHashCreate(64, NULL)))
+        goto error;
+
     if (cpuMapLoad("x86", x86MapLoadCallback, map) < 0)
         goto error;
 
@@ -1182,6 +1182,27 @@ typedef int
                           unsigned long long *counts,
                           unsigned int flags);
 
+typedef int
+(*virDrvDomainListEvacuate)(virDomainPtr *doms,
+                            unsigned int ndoms,
+                            virTypedParameterPtr params,
+                            int nparams,
+                            unsigned int flags);
+
+typedef int
+(*virDrvDomainGetBlockJobStats)(virDomainPtr dom,
+                                const char *disk,
+                                virTypedParameterPtr *params,
+                                int *nparams,
+                                unsigned int flags);
+
+typedef int
+(*virDrvConnectListDomainsPage)(virConnectPtr conn,
+                                const char *after,
+                                unsigned int maxdomains,
+                                virDomainPtr **domains,
+                                unsigned int flags);
+
 typedef int
 (*virDrvNetworkGetDHCPLeases)(virNetworkPtr network,
                               virNetworkDHCPLeasePtr **leases,
@@ -1412,6 +1433,9 @@ struct _virDriver {
     virDrvDomainGetTime domainGetTime;
     virDrvDomainSetTime domainSetTime;
     virDrvNodeGetFreePages nodeGetFreePages;
+    virDrvDomainListEvacuate domainListEvacuate;
+    virDrvDomainGetBlockJobStats domainGetBlockJobStats;
+    virDrvConnectListDomainsPage connectListDomainsPage;
 };
 
 
@@ -1756,6 +1780,13 @@ typedef int
                                    virStorageVolPtr **vols,
                                    unsigned int flags);
 
+typedef int
+(*virDrvStoragePoolListVolumesPage)(virStoragePoolPtr pool,
+                                    const char *after,
+                                    unsigned int maxvols,
+                                    virStorageVolPtr **vols,
+                                    unsigned int flags);
+
 typedef virStorageVolPtr
 (*virDrvStorageVolLookupByName)(virStoragePoolPtr pool,
                                 const char *name);
@@ -1887,6 +1918,7 @@ struct _virStorageDriver {
     virDrvStorageVolResize storageVolResize;
     virDrvStoragePoolIsActive storagePoolIsActive;
     virDrvStoragePoolIsPersistent storagePoolIsPersistent;
+    virDrvStoragePoolListVolumesPage storagePoolListVolumesPage;
 };
 
 # ifdef WITH_LIBVIRTD
@@ -1943,6 +1975,13 @@ typedef int
                                    virNodeDevicePtr **devices,
                                    unsigned int flags);
 
+typedef int
+(*virDrvConnectListNodeDevicesPage)(virConnectPtr conn,
+                                    const char *after,
+                                    unsigned int maxdevices,
+                                    virNodeDevicePtr **devices,
+                                    unsigned int flags);
+
 typedef virNodeDevicePtr
 (*virDrvNodeDeviceLookupByName)(virConnectPtr conn,
                                 const char *name);
@@ -2003,6 +2042,7 @@ struct _virNodeDeviceDriver {
     virDrvNodeDeviceListCaps nodeDeviceListCaps;
     virDrvNodeDeviceCreateXML nodeDeviceCreateXML;
     virDrvNodeDeviceDestroy nodeDeviceDestroy;
+    virDrvConnectListNodeDevicesPage connectListNodeDevicesPage;
 };
 
 enum {
@@ -4193,6 +4193,12 @@ virDomainGetBlkioParameters(virDomainPtr domain,
  * used to get the domain is limited only a partial set of the information
  * can be extracted.
  *
+ * The memory currently used by a running domain may be a value the
+ * driver sampled recently in the background rather than queried from
+ * the hypervisor. The QEMU driver does so, when statistics sampling is
+ * enabled, for QEMU versions which do not report balloon changes as
+ * events; the value is then at most twice the sampling period old.
+ *
  * Returns 0 in case of success and -1 in case of failure.
  */
 int
@@ -4510,7 +4516,8 @@ virDomainMigrateVersion1(virDomainPtr domain,
         flags |= VIR_MIGRATE_PAUSED;
 
     destflags = flags & ~(VIR_MIGRATE_ABORT_ON_ERROR |
-                          VIR_MIGRATE_AUTO_CONVERGE);
+                          VIR_MIGRATE_AUTO_CONVERGE |
+                          VIR_MIGRATE_AUTO_TUNE);
 
     /* Prepare the migration.
      *
@@ -4641,7 +4648,8 @@ virDomainMigrateVersion2(virDomainPtr domain,
         flags |= VIR_MIGRATE_PAUSED;
 
     destflags = flags & ~(VIR_MIGRATE_ABORT_ON_ERROR |
-                          VIR_MIGRATE_AUTO_CONVERGE);
+                          VIR_MIGRATE_AUTO_CONVERGE |
+                          VIR_MIGRATE_AUTO_TUNE);
 
     VIR_DEBUG("Prepare2 %p flags=%lx", dconn, destflags);
     ret = dconn->driver->domainMigratePrepare2
@@ -4814,7 +4822,8 @@ virDomainMigrateVersion3Full(virDomainPtr domain,
         flags |= VIR_MIGRATE_PAUSED;
 
     destflags = flags & ~(VIR_MIGRATE_ABORT_ON_ERROR |
-                          VIR_MIGRATE_AUTO_CONVERGE);
+                          VIR_MIGRATE_AUTO_CONVERGE |
+                          VIR_MIGRATE_AUTO_TUNE);
 
     VIR_DEBUG("Prepare3 %p flags=%x", dconn, destflags);
     cookiein = cookieout;
@@ -7918,7 +7927,7 @@ virDomainBlockStats(virDomainPtr dom, const char *disk,
  * @params: pointer to block stats parameter object
  *          (return value)
  * @nparams: pointer to number of block stats; input and output
- * @flags: bitwise-OR of virTypedParameterFlags
+ * @flags: bitwise-OR of virTypedParameterFlags and virDomainStatsFlags
  *
  * This function is to get block stats parameters for block
  * devices attached to the domain.
@@ -7948,6 +7957,12 @@ virDomainBlockStats(virDomainPtr dom, const char *disk,
  * array, i.e. (sizeof(@virTypedParameter) * @nparams) bytes and call the API
  * again. See virDomainGetMemoryParameters() for more details.
  *
+ * If @flags includes VIR_DOMAIN_STATS_CACHED, the driver may answer
+ * from statistics it sampled recently in the background instead of
+ * querying the hypervisor, which avoids waiting for other operations
+ * in progress on the domain.  Drivers that keep no such samples, or
+ * whose samples are too old, fall back to a live query.
+ *
  * Returns -1 in case of error, 0 in case of success.
  */
 int
@@ -8187,7 +8202,7 @@ virDomainGetInterfaceParameters(virDomainPtr domain,
  * @dom: pointer to the domain object
  * @stats: nr_stats-sized array of stat structures (returned)
  * @nr_stats: number of memory statistics requested
- * @flags: extra flags; not used yet, so callers should always pass 0
+ * @flags: bitwise-OR of virDomainStatsFlags
  *
  * This function provides memory statistics for the domain.
  *
@@ -8212,6 +8227,10 @@ virDomainGetInterfaceParameters(virDomainPtr domain,
  * VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON:
  *     Current balloon value (in kb).
  *
+ * If @flags includes VIR_DOMAIN_STATS_CACHED, the driver may answer
+ * from statistics it sampled recently in the background instead of
+ * querying the guest, in the same way as virDomainBlockStatsFlags().
+ *
  * Returns: The number of stats provided or -1 in case of failure.
  */
 int
@@ -8938,6 +8957,96 @@ virConnectListAllDomains(virConnectPtr conn,
 }
 
 
+/**
+ * virConnectListDomainsPage:
+ * @conn: Pointer to the hypervisor connection.
+ * @after: UUID string of the last domain of the previous page, or NULL
+ *         to start with the first domain
+ * @maxdomains: maximum number of domains to return
+ * @domains: Pointer to a variable to store the array containing domain objects
+ * @flags: bitwise-OR of virConnectListAllDomainsFlags
+ *
+ * Collect one page of the possibly-filtered list of domains. Domains are
+ * ordered by UUID and the page starts with the first domain whose UUID
+ * sorts after @after, so that walking the list page by page visits each
+ * domain that exists during the whole walk exactly once, no matter how
+ * many domains are defined or undefined in between. The filtering @flags
+ * are the same as for virConnectListAllDomains().
+ *
+ * Unlike virConnectListAllDomains(), the size of the reply does not grow
+ * with the number of domains on the host, which makes this the API of
+ * choice for hosts with very many domains.
+ *
+ * Example of usage:
+ *
+ *   virDomainPtr *domains;
+ *   char after[VIR_UUID_STRING_BUFLEN];
+ *   bool first = true;
+ *   size_t i;
+ *   int ret;
+ *
+ *   do {
+ *       ret = virConnectListDomainsPage(conn, first ? NULL : after,
+ *                                       100, &domains, 0);
+ *       if (ret < 0) {
+ *           error();
+ *           break;
+ *       }
+ *       for (i = 0; i < ret; i++)
+ *           do_something_with_domain(domains[i]);
+ *       if (ret > 0)
+ *           virDomainGetUUIDString(domains[ret - 1], after);
+ *       first = false;
+ *       for (i = 0; i < ret; i++)
+ *           virDomainFree(domains[i]);
+ *       free(domains);
+ *   } while (ret > 0);
+ *
+ * Returns the number of domains stored in @domains, 0 if there are no
+ * more domains after @after, or -1 and sets @domains to NULL in case of
+ * error. A page may hold fewer than @maxdomains domains even if more
+ * follow, callers have to go on until 0 is returned. On success, the
+ * array stored into @domains is guaranteed to have an extra allocated
+ * element set to NULL but not included in the return count. The caller
+ * is responsible for calling virDomainFree() on each array element, then
+ * calling free() on @domains.
+ */
+int
+virConnectListDomainsPage(virConnectPtr conn,
+                          const char *after,
+                          unsigned int maxdomains,
+                          virDomainPtr **domains,
+                          unsigned int flags)
+{
+    VIR_DEBUG("conn=%p, after=%s, maxdomains=%u, domains=%p, flags=%x",
+              conn, NULLSTR(after), maxdomains, domains, flags);
+
+    virResetLastError();
+
+    if (domains)
+        *domains = NULL;
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(domains, error);
+    virCheckNonZeroArgGoto(maxdomains, error);
+
+    if (conn->driver->connectListDomainsPage) {
+        int ret;
+        ret = conn->driver->connectListDomainsPage(conn, after, maxdomains,
+                                                   domains, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /**
  * virDomainCreate:
  * @domain: pointer to a defined domain
@@ -13432,6 +13541,66 @@ virStoragePoolListAllVolumes(virStoragePoolPtr pool,
 }
 
 
+/**
+ * virStoragePoolListVolumesPage:
+ * @pool: Pointer to storage pool
+ * @after: name of the last volume of the previous page, or NULL to start
+ *         with the first volume
+ * @maxvols: maximum number of volumes to return
+ * @vols: Pointer to a variable to store the array containing storage volume
+ *        objects
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Collect one page of the list of storage volumes. Volumes are ordered by
+ * name and the page starts with the first volume whose name sorts after
+ * @after, see virConnectListDomainsPage() for how to walk the whole list.
+ *
+ * Returns the number of storage volumes stored in @vols, 0 if there are
+ * no more volumes after @after, or -1 and sets @vols to NULL in case of
+ * error. A page may hold fewer than @maxvols volumes even if more follow.
+ * On success, the array stored into @vols is guaranteed to have an extra
+ * allocated element set to NULL but not included in the return count.
+ * The caller is responsible for calling virStorageVolFree() on each array
+ * element, then calling free() on @vols.
+ */
+int
+virStoragePoolListVolumesPage(virStoragePoolPtr pool,
+                              const char *after,
+                              unsigned int maxvols,
+                              virStorageVolPtr **vols,
+                              unsigned int flags)
+{
+    VIR_DEBUG("pool=%p, after=%s, maxvols=%u, vols=%p, flags=%x",
+              pool, NULLSTR(after), maxvols, vols, flags);
+
+    virResetLastError();
+
+    if (vols)
+        *vols = NULL;
+
+    virCheckStoragePoolReturn(pool, -1);
+    virCheckNonNullArgGoto(vols, error);
+    virCheckNonZeroArgGoto(maxvols, error);
+
+    if (pool->conn->storageDriver &&
+        pool->conn->storageDriver->storagePoolListVolumesPage) {
+        int ret;
+        ret = pool->conn->storageDriver->storagePoolListVolumesPage(pool, after,
+                                                                    maxvols,
+                                                                    vols, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(pool->conn);
+    return -1;
+}
+
+
 /**
  * virStoragePoolNumOfVolumes:
  * @pool: pointer to storage pool
@@ -14399,6 +14568,68 @@ virConnectListAllNodeDevices(virConnectPtr conn,
 }
 
 
+/**
+ * virConnectListNodeDevicesPage:
+ * @conn: Pointer to the hypervisor connection.
+ * @after: name of the last node device of the previous page, or NULL to
+ *         start with the first device
+ * @maxdevices: maximum number of node devices to return
+ * @devices: Pointer to a variable to store the array containing the node
+ *           device objects
+ * @flags: bitwise-OR of virConnectListAllNodeDeviceFlags.
+ *
+ * Collect one page of the possibly-filtered list of node devices. Devices
+ * are ordered by name and the page starts with the first device whose
+ * name sorts after @after, see virConnectListDomainsPage() for how to walk
+ * the whole list. The filtering @flags are the same as for
+ * virConnectListAllNodeDevices().
+ *
+ * Returns the number of node devices stored in @devices, 0 if there are
+ * no more devices after @after, or -1 and sets @devices to NULL in case
+ * of error. A page may hold fewer than @maxdevices devices even if more
+ * follow. On success, the array stored into @devices is guaranteed to
+ * have an extra allocated element set to NULL but not included in the
+ * return count. The caller is responsible for calling virNodeDeviceFree()
+ * on each array element, then calling free() on @devices.
+ */
+int
+virConnectListNodeDevicesPage(virConnectPtr conn,
+                              const char *after,
+                              unsigned int maxdevices,
+                              virNodeDevicePtr **devices,
+                              unsigned int flags)
+{
+    VIR_DEBUG("conn=%p, after=%s, maxdevices=%u, devices=%p, flags=%x",
+              conn, NULLSTR(after), maxdevices, devices, flags);
+
+    virResetLastError();
+
+    if (devices)
+        *devices = NULL;
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(devices, error);
+    virCheckNonZeroArgGoto(maxdevices, error);
+
+    if (conn->nodeDeviceDriver &&
+        conn->nodeDeviceDriver->connectListNodeDevicesPage) {
+        int ret;
+        ret = conn->nodeDeviceDriver->connectListNodeDevicesPage(conn, after,
+                                                                 maxdevices,
+                                                                 devices, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /**
  * virNodeListDevices:
  * @conn: pointer to the hypervisor connection
@@ -19572,6 +19803,75 @@ virDomainGetBlockJobInfo(virDomainPtr dom, const char *disk,
 }
 
 
+/**
+ * virDomainGetBlockJobStats:
+ * @dom: pointer to domain object
+ * @disk: path to the block device, or device shorthand
+ * @params: where to store block job statistics
+ * @nparams: number of items in @params
+ * @flags: bitwise-OR of virDomainBlockJobStatsFlags
+ *
+ * Request progress information about a block job on the given disk. Unlike
+ * virDomainGetBlockJobInfo(), the statistics include the rate at which the
+ * job advances and the expected time to its completion, and they stay
+ * available after the job finished (reporting how it ended in the "status"
+ * field) until another job is started on the same disk. Possible fields
+ * returned in @params are defined by VIR_DOMAIN_BLOCK_JOB_STATS_* macros;
+ * the caller must free them with virTypedParamsFree().
+ *
+ * With VIR_DOMAIN_BLOCK_JOB_STATS_WAIT the call blocks until the job either
+ * finishes or, for a copy or active commit, becomes ready to be pivoted.
+ * Other jobs, including virDomainBlockJobAbort() on the same disk, may
+ * proceed while the call is waiting.
+ *
+ * The @disk parameter is either an unambiguous source name of the
+ * block device (the <source file='...'/> sub-element, such as
+ * "/path/to/image"), or the device target shorthand
+ * (the <target dev='...'/> sub-element, such as "vda").  Valid names
+ * can be found by calling virDomainGetXMLDesc() and inspecting
+ * elements within //domain/devices/disk.
+ *
+ * Returns -1 in case of failure, 0 when no block job is known for the
+ * disk, 1 when @params were filled in.
+ */
+int
+virDomainGetBlockJobStats(virDomainPtr dom,
+                          const char *disk,
+                          virTypedParameterPtr *params,
+                          int *nparams,
+                          unsigned int flags)
+{
+    virConnectPtr conn;
+
+    VIR_DOMAIN_DEBUG(dom, "disk=%s, params=%p, nparams=%p, flags=%x",
+                     disk, params, nparams, flags);
+
+    virResetLastError();
+
+    virCheckDomainReturn(dom, -1);
+    conn = dom->conn;
+
+    virCheckNonNullArgGoto(disk, error);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if (conn->driver->domainGetBlockJobStats) {
+        int ret;
+        ret = conn->driver->domainGetBlockJobStats(dom, disk, params,
+                                                   nparams, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(dom->conn);
+    return -1;
+}
+
+
 /**
  * virDomainBlockJobSetSpeed:
  * @dom: pointer to domain object
@@ -20912,6 +21212,89 @@ virDomainSetTime(virDomainPtr dom,
 }
 
 
+/**
+ * virDomainListEvacuate:
+ * @doms: array of domains to evacuate
+ * @ndoms: number of items in @doms
+ * @params: pointer to evacuation parameters
+ * @nparams: number of evacuation parameters
+ * @flags: bitwise-OR of virDomainEvacuateFlags
+ *
+ * Move all of the running domains in @doms off the host, either by
+ * saving them to their managed save image (see virDomainManagedSave)
+ * or, with VIR_DOMAIN_EVACUATE_MIGRATE, by live migrating them to the
+ * host given by VIR_DOMAIN_EVACUATE_PARAM_URI the same way a
+ * peer-to-peer virDomainMigrateToURI3 would, with the domains made
+ * persistent on the destination and undefined on this host.
+ *
+ * Unlike issuing a save or migration per domain, this lets the
+ * hypervisor schedule them together: at most
+ * VIR_DOMAIN_EVACUATE_PARAM_CONCURRENCY domains are in flight at any
+ * time and they share the aggregate VIR_DOMAIN_EVACUATE_PARAM_BANDWIDTH,
+ * so that evacuating many domains does not saturate the disk or
+ * network and slow every one of them down. All domains must belong
+ * to the same connection.
+ *
+ * The call returns once every domain has been dealt with. While it is
+ * running, virDomainGetJobStats on any of the domains reports the
+ * progress of the whole evacuation in the VIR_DOMAIN_JOB_EVACUATE_*
+ * fields. A domain failing to be evacuated does not stop the others.
+ *
+ * Returns 0 if all domains were evacuated, -1 if any of them failed,
+ * in which case the error of the first failure is reported.
+ */
+int
+virDomainListEvacuate(virDomainPtr *doms,
+                      unsigned int ndoms,
+                      virTypedParameterPtr params,
+                      int nparams,
+                      unsigned int flags)
+{
+    virConnectPtr conn = NULL;
+    size_t i;
+
+    VIR_DEBUG("doms=%p, ndoms=%u, params=%p, nparams=%d, flags=%x",
+              doms, ndoms, params, nparams, flags);
+    VIR_TYPED_PARAMS_DEBUG(params, nparams);
+
+    virResetLastError();
+
+    virCheckNonNullArgGoto(doms, error);
+    virCheckNonZeroArgGoto(ndoms, error);
+    virCheckNonNegativeArgGoto(nparams, error);
+
+    for (i = 0; i < ndoms; i++) {
+        virCheckDomainGoto(doms[i], error);
+
+        if (!conn) {
+            conn = doms[i]->conn;
+        } else if (doms[i]->conn != conn) {
+            virReportError(VIR_ERR_INVALID_ARG, "%s",
+                           _("domains from multiple connections are "
+                             "not supported"));
+            goto error;
+        }
+    }
+
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    if (conn->driver->domainListEvacuate) {
+        int ret;
+        ret = conn->driver->domainListEvacuate(doms, ndoms, params, nparams,
+                                               flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /**
  * virNodeGetFreePages:
  * @conn: pointer to the hypervisor connection
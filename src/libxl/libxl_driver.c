@@ -352,7 +352,7 @@ libxlStateInitialize(bool privileged,
     /* read the host sysinfo */
     libxl_driver->hostsysinfo = virSysinfoRead();
 
-    libxl_driver->domainEventState = virObjectEventStateNew();
+    libxl_driver->domainEventState = virObjectEventStateNewFull(true);
     if (!libxl_driver->domainEventState)
         goto error;
 
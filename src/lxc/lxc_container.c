@@ -901,25 +901,36 @@ static int lxcContainerMountBasicFS(bool userns_enabled)
 static int lxcContainerMountProcFuse(virDomainDefPtr def,
                                      const char *stateDir)
 {
-    int ret;
-    char *meminfo_path = NULL;
+    static const char *const files[] = { "meminfo", "uptime" };
+    int ret = 0;
+    char *fuse_path = NULL;
+    char *proc_path = NULL;
+    size_t i;
 
-    VIR_DEBUG("Mount /proc/meminfo stateDir=%s", stateDir);
+    for (i = 0; i < ARRAY_CARDINALITY(files) && ret == 0; i++) {
+        VIR_DEBUG("Mount /proc/%s stateDir=%s", files[i], stateDir);
 
-    if ((ret = virAsprintf(&meminfo_path,
-                           "/.oldroot/%s/%s.fuse/meminfo",
-                           stateDir,
-                           def->name)) < 0)
-        return ret;
+        if ((ret = virAsprintf(&fuse_path,
+                               "/.oldroot/%s/%s.fuse/%s",
+                               stateDir,
+                               def->name,
+                               files[i])) < 0 ||
+            (ret = virAsprintf(&proc_path, "/proc/%s", files[i])) < 0)
+            break;
 
-    if ((ret = mount(meminfo_path, "/proc/meminfo",
-                     NULL, MS_BIND, NULL)) < 0) {
-        virReportSystemError(errno,
-                             _("Failed to mount %s on /proc/meminfo"),
-                             meminfo_path);
+        if ((ret = mount(fuse_path, proc_path,
+                         NULL, MS_BIND, NULL)) < 0) {
+            virReportSystemError(errno,
+                                 _("Failed to mount %s on %s"),
+                                 fuse_path, proc_path);
+        }
+
+        VIR_FREE(fuse_path);
+        VIR_FREE(proc_path);
     }
 
-    VIR_FREE(meminfo_path);
+    VIR_FREE(fuse_path);
+    VIR_FREE(proc_path);
     return ret;
 }
 #else
@@ -1551,7 +1551,7 @@ static int lxcStateInitialize(bool privileged,
     if (!(lxc_driver->domains = virDomainObjListNew()))
         goto cleanup;
 
-    lxc_driver->domainEventState = virObjectEventStateNew();
+    lxc_driver->domainEventState = virObjectEventStateNewFull(true);
     if (!lxc_driver->domainEventState)
         goto cleanup;
 
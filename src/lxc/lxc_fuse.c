@@ -35,12 +35,283 @@
 #include "virfile.h"
 #include "virbuffer.h"
 #include "virstring.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_LXC
 
-#if WITH_FUSE
+/*
+ * Generate the container's view of /proc/meminfo from the host file
+ * at @hostpath and the container's cgroup memory accounting.
+ *
+ * Returns 0 and sets @content and @len on success, -1 with an error
+ * reported otherwise.
+ */
+int lxcFuseFormatMeminfo(const char *hostpath,
+                         virDomainDefPtr def,
+                         virLXCMeminfoPtr meminfo,
+                         char **content,
+                         size_t *len)
+{
+    int ret = -1;
+    FILE *fd = NULL;
+    char *line = NULL;
+    size_t n;
+    virBuffer buffer = VIR_BUFFER_INITIALIZER;
+    virBufferPtr new_meminfo = &buffer;
+
+    fd = fopen(hostpath, "r");
+    if (fd == NULL) {
+        virReportSystemError(errno, _("Cannot open %s"), hostpath);
+        goto cleanup;
+    }
+
+    while (getline(&line, &n, fd) > 0) {
+        char *ptr = strchr(line, ':');
+        if (!ptr)
+            continue;
+
+        *ptr = '\0';
+
+        if (STREQ(line, "MemTotal") &&
+            (def->mem.hard_limit || def->mem.max_balloon))
+            virBufferAsprintf(new_meminfo, "MemTotal:       %8llu kB\n",
+                              meminfo->memtotal);
+        else if (STREQ(line, "MemFree") &&
+                   (def->mem.hard_limit || def->mem.max_balloon))
+            virBufferAsprintf(new_meminfo, "MemFree:        %8llu kB\n",
+                              (meminfo->memtotal - meminfo->memusage));
+        else if (STREQ(line, "Buffers"))
+            virBufferAsprintf(new_meminfo, "Buffers:        %8d kB\n", 0);
+        else if (STREQ(line, "Cached"))
+            virBufferAsprintf(new_meminfo, "Cached:         %8llu kB\n",
+                              meminfo->cached);
+        else if (STREQ(line, "Active"))
+            virBufferAsprintf(new_meminfo, "Active:         %8llu kB\n",
+                              (meminfo->active_anon + meminfo->active_file));
+        else if (STREQ(line, "Inactive"))
+            virBufferAsprintf(new_meminfo, "Inactive:       %8llu kB\n",
+                              (meminfo->inactive_anon + meminfo->inactive_file));
+        else if (STREQ(line, "Active(anon)"))
+            virBufferAsprintf(new_meminfo, "Active(anon):   %8llu kB\n",
+                              meminfo->active_anon);
+        else if (STREQ(line, "Inactive(anon)"))
+            virBufferAsprintf(new_meminfo, "Inactive(anon): %8llu kB\n",
+                              meminfo->inactive_anon);
+        else if (STREQ(line, "Active(file)"))
+            virBufferAsprintf(new_meminfo, "Active(file):   %8llu kB\n",
+                              meminfo->active_file);
+        else if (STREQ(line, "Inactive(file)"))
+            virBufferAsprintf(new_meminfo, "Inactive(file): %8llu kB\n",
+                              meminfo->inactive_file);
+        else if (STREQ(line, "Unevictable"))
+            virBufferAsprintf(new_meminfo, "Unevictable:    %8llu kB\n",
+                              meminfo->unevictable);
+        else if (STREQ(line, "SwapTotal") && def->mem.swap_hard_limit)
+            virBufferAsprintf(new_meminfo, "SwapTotal:      %8llu kB\n",
+                              (meminfo->swaptotal - meminfo->memtotal));
+        else if (STREQ(line, "SwapFree") && def->mem.swap_hard_limit)
+            virBufferAsprintf(new_meminfo, "SwapFree:       %8llu kB\n",
+                              (meminfo->swaptotal - meminfo->memtotal -
+                               meminfo->swapusage + meminfo->memusage));
+        else {
+            *ptr = ':';
+            virBufferAdd(new_meminfo, line, -1);
+        }
+    }
+
+    if (ferror(fd)) {
+        virReportSystemError(errno, _("Cannot read %s"), hostpath);
+        goto cleanup;
+    }
+
+    if (virBufferError(new_meminfo)) {
+        virReportOOMError();
+        goto cleanup;
+    }
+
+    *len = virBufferUse(new_meminfo);
+    *content = virBufferContentAndReset(new_meminfo);
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(line);
+    virBufferFreeAndReset(new_meminfo);
+    VIR_FORCE_FCLOSE(fd);
+    return ret;
+}
+
+/*
+ * Copy up to @size bytes of cached file content starting at @offset
+ * into @buf, returning the number of bytes copied.
+ */
+int lxcFuseCacheRead(virLXCFuseCachePtr cache,
+                     char *buf, size_t size, off_t offset)
+{
+    if (offset < 0 || !cache->data || (size_t) offset >= cache->len)
+        return 0;
+
+    if (size > cache->len - offset)
+        size = cache->len - offset;
+
+    memcpy(buf, cache->data + offset, size);
+    return size;
+}
+
+void lxcFuseCacheClear(virLXCFuseCachePtr cache)
+{
+    VIR_FREE(cache->data);
+    cache->len = 0;
+    cache->stamp = 0;
+}
+
+/*
+ * Generate the container's view of /proc/uptime from the @uptime in
+ * ms the container has been running. Idle time isn't accounted per
+ * container, so it is reported as zero.
+ *
+ * Returns 0 and sets @content and @len on success, -1 with an error
+ * reported otherwise.
+ */
+int lxcFuseFormatUptime(unsigned long long uptime,
+                        char **content,
+                        size_t *len)
+{
+    if (virAsprintf(content, "%llu.%02llu 0.00\n",
+                    uptime / 1000, (uptime % 1000) / 10) < 0)
+        return -1;
+
+    *len = strlen(*content);
+    return 0;
+}
 
 static const char *fuse_meminfo_path = "/meminfo";
+static const char *fuse_uptime_path = "/uptime";
+
+typedef int (*lxcFuseGenerateFunc)(virLXCFusePtr fuse,
+                                   const char *hostpath,
+                                   unsigned long long now,
+                                   char **content,
+                                   size_t *len);
+
+static int lxcFuseGenerateMeminfo(virLXCFusePtr fuse,
+                                  const char *hostpath,
+                                  unsigned long long now ATTRIBUTE_UNUSED,
+                                  char **content,
+                                  size_t *len)
+{
+    struct virLXCMeminfo meminfo;
+
+    if (virLXCCgroupGetMeminfo(&meminfo) < 0)
+        return -1;
+
+    return lxcFuseFormatMeminfo(hostpath, fuse->def, &meminfo, content, len);
+}
+
+static int lxcFuseGenerateUptime(virLXCFusePtr fuse,
+                                 const char *hostpath ATTRIBUTE_UNUSED,
+                                 unsigned long long now,
+                                 char **content,
+                                 size_t *len)
+{
+    return lxcFuseFormatUptime(now > fuse->start ? now - fuse->start : 0,
+                               content, len);
+}
+
+static int lxcProcHostRead(char *path, char *buf, size_t size, off_t offset)
+{
+    int fd;
+    int res;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -errno;
+
+    if ((res = pread(fd, buf, size, offset)) < 0)
+        res = -errno;
+
+    VIR_FORCE_CLOSE(fd);
+    return res;
+}
+
+static int lxcProcReadCached(virLXCFusePtr fuse,
+                             virLXCFuseCachePtr cache,
+                             lxcFuseGenerateFunc generate,
+                             char *hostpath,
+                             char *buf, size_t size, off_t offset)
+{
+    unsigned long long now;
+    int res;
+
+    virMutexLock(&fuse->lock);
+
+    if (virTimeMillisNow(&now) < 0) {
+        virErrorSetErrnoFromLastError();
+        res = -errno;
+        goto cleanup;
+    }
+
+    /* Monitoring agents in the container tend to poll these files,
+     * so only go to the cgroup and host files once per TTL */
+    if (!cache->data || now - cache->stamp >= LXC_FUSE_CACHE_TTL_MS) {
+        char *content = NULL;
+        size_t len;
+
+        if (generate(fuse, hostpath, now, &content, &len) < 0) {
+            virErrorSetErrnoFromLastError();
+            res = -errno;
+            goto cleanup;
+        }
+
+        lxcFuseCacheClear(cache);
+        cache->data = content;
+        cache->len = len;
+        cache->stamp = now;
+    }
+
+    res = lxcFuseCacheRead(cache, buf, size, offset);
+
+ cleanup:
+    virMutexUnlock(&fuse->lock);
+    return res;
+}
+
+/*
+ * Serve a read() of @path in the container's virtualized /proc,
+ * falling back to the host's file when its content can't be
+ * generated.
+ *
+ * Returns the number of bytes read, or a negative errno value.
+ */
+int lxcFuseRead(virLXCFusePtr fuse, const char *path,
+                char *buf, size_t size, off_t offset)
+{
+    int res = -ENOENT;
+    char *hostpath = NULL;
+    virLXCFuseCachePtr cache = NULL;
+    lxcFuseGenerateFunc generate = NULL;
+
+    if (STREQ(path, fuse_meminfo_path)) {
+        cache = &fuse->meminfo;
+        generate = lxcFuseGenerateMeminfo;
+    } else if (STREQ(path, fuse_uptime_path)) {
+        cache = &fuse->uptime;
+        generate = lxcFuseGenerateUptime;
+    } else {
+        return res;
+    }
+
+    if (virAsprintf(&hostpath, "/proc/%s", path) < 0)
+        return -errno;
+
+    if ((res = lxcProcReadCached(fuse, cache, generate, hostpath,
+                                 buf, size, offset)) < 0)
+        res = lxcProcHostRead(hostpath, buf, size, offset);
+
+    VIR_FREE(hostpath);
+    return res;
+}
+
+#if WITH_FUSE
 
 static int lxcProcGetattr(const char *path, struct stat *stbuf)
 {
@@ -48,7 +319,8 @@ static int lxcProcGetattr(const char *path, struct stat *stbuf)
     char *mempath = NULL;
     struct stat sb;
     struct fuse_context *context = fuse_get_context();
-    virDomainDefPtr def = (virDomainDefPtr)context->private_data;
+    virLXCFusePtr fuse = (virLXCFusePtr)context->private_data;
+    virDomainDefPtr def = fuse->def;
 
     memset(stbuf, 0, sizeof(struct stat));
     if (virAsprintf(&mempath, "/proc/%s", path) < 0)
@@ -59,7 +331,8 @@ static int lxcProcGetattr(const char *path, struct stat *stbuf)
     if (STREQ(path, "/")) {
         stbuf->st_mode = S_IFDIR | 0755;
         stbuf->st_nlink = 2;
-    } else if (STREQ(path, fuse_meminfo_path)) {
+    } else if (STREQ(path, fuse_meminfo_path) ||
+               STREQ(path, fuse_uptime_path)) {
         if (stat(mempath, &sb) < 0) {
             res = -errno;
             goto cleanup;
@@ -94,6 +367,7 @@ static int lxcProcReaddir(const char *path, void *buf,
     filler(buf, ".", NULL, 0);
     filler(buf, "..", NULL, 0);
     filler(buf, fuse_meminfo_path + 1, NULL, 0);
+    filler(buf, fuse_uptime_path + 1, NULL, 0);
 
     return 0;
 }
@@ -101,7 +375,8 @@ static int lxcProcReaddir(const char *path, void *buf,
 static int lxcProcOpen(const char *path ATTRIBUTE_UNUSED,
                        struct fuse_file_info *fi ATTRIBUTE_UNUSED)
 {
-    if (!STREQ(path, fuse_meminfo_path))
+    if (!STREQ(path, fuse_meminfo_path) &&
+        !STREQ(path, fuse_uptime_path))
         return -ENOENT;
 
     if ((fi->flags & 3) != O_RDONLY)
@@ -110,146 +385,16 @@ static int lxcProcOpen(const char *path ATTRIBUTE_UNUSED,
     return 0;
 }
 
-static int lxcProcHostRead(char *path, char *buf, size_t size, off_t offset)
-{
-    int fd;
-    int res;
-
-    fd = open(path, O_RDONLY);
-    if (fd == -1)
-        return -errno;
-
-    if ((res = pread(fd, buf, size, offset)) < 0)
-        res = -errno;
-
-    VIR_FORCE_CLOSE(fd);
-    return res;
-}
-
-static int lxcProcReadMeminfo(char *hostpath, virDomainDefPtr def,
-                              char *buf, size_t size, off_t offset)
-{
-    int copied = 0;
-    int res;
-    FILE *fd = NULL;
-    char *line = NULL;
-    size_t n;
-    struct virLXCMeminfo meminfo;
-    virBuffer buffer = VIR_BUFFER_INITIALIZER;
-    virBufferPtr new_meminfo = &buffer;
-
-    if (virLXCCgroupGetMeminfo(&meminfo) < 0) {
-        virErrorSetErrnoFromLastError();
-        return -errno;
-    }
-
-    fd = fopen(hostpath, "r");
-    if (fd == NULL) {
-        virReportSystemError(errno, _("Cannot open %s"), hostpath);
-        res = -errno;
-        goto cleanup;
-    }
-
-    if (fseek(fd, offset, SEEK_SET) < 0) {
-        virReportSystemError(errno, "%s", _("fseek failed"));
-        res = -errno;
-        goto cleanup;
-    }
-
-    res = -1;
-    while (copied < size && getline(&line, &n, fd) > 0) {
-        char *ptr = strchr(line, ':');
-        if (ptr) {
-            *ptr = '\0';
-
-            if (STREQ(line, "MemTotal") &&
-                (def->mem.hard_limit || def->mem.max_balloon))
-                virBufferAsprintf(new_meminfo, "MemTotal:       %8llu kB\n",
-                                  meminfo.memtotal);
-            else if (STREQ(line, "MemFree") &&
-                       (def->mem.hard_limit || def->mem.max_balloon))
-                virBufferAsprintf(new_meminfo, "MemFree:        %8llu kB\n",
-                                  (meminfo.memtotal - meminfo.memusage));
-            else if (STREQ(line, "Buffers"))
-                virBufferAsprintf(new_meminfo, "Buffers:        %8d kB\n", 0);
-            else if (STREQ(line, "Cached"))
-                virBufferAsprintf(new_meminfo, "Cached:         %8llu kB\n",
-                                  meminfo.cached);
-            else if (STREQ(line, "Active"))
-                virBufferAsprintf(new_meminfo, "Active:         %8llu kB\n",
-                                  (meminfo.active_anon + meminfo.active_file));
-            else if (STREQ(line, "Inactive"))
-                virBufferAsprintf(new_meminfo, "Inactive:       %8llu kB\n",
-                                  (meminfo.inactive_anon + meminfo.inactive_file));
-            else if (STREQ(line, "Active(anon)"))
-                virBufferAsprintf(new_meminfo, "Active(anon):   %8llu kB\n",
-                                  meminfo.active_anon);
-            else if (STREQ(line, "Inactive(anon)"))
-                virBufferAsprintf(new_meminfo, "Inactive(anon): %8llu kB\n",
-                                  meminfo.inactive_anon);
-            else if (STREQ(line, "Active(file)"))
-                virBufferAsprintf(new_meminfo, "Active(file):   %8llu kB\n",
-                                  meminfo.active_file);
-            else if (STREQ(line, "Inactive(file)"))
-                virBufferAsprintf(new_meminfo, "Inactive(file): %8llu kB\n",
-                                  meminfo.inactive_file);
-            else if (STREQ(line, "Unevictable"))
-                virBufferAsprintf(new_meminfo, "Unevictable:    %8llu kB\n",
-                                  meminfo.unevictable);
-            else if (STREQ(line, "SwapTotal") && def->mem.swap_hard_limit)
-                virBufferAsprintf(new_meminfo, "SwapTotal:      %8llu kB\n",
-                                  (meminfo.swaptotal - meminfo.memtotal));
-            else if (STREQ(line, "SwapFree") && def->mem.swap_hard_limit)
-                virBufferAsprintf(new_meminfo, "SwapFree:       %8llu kB\n",
-                                  (meminfo.swaptotal - meminfo.memtotal -
-                                   meminfo.swapusage + meminfo.memusage));
-            else {
-                *ptr = ':';
-                virBufferAdd(new_meminfo, line, -1);
-            }
-
-            if (virBufferError(new_meminfo))
-                goto cleanup;
-
-            copied += strlen(line);
-            if (copied > size)
-                copied = size;
-        }
-    }
-    res = copied;
-    memcpy(buf, virBufferCurrentContent(new_meminfo), copied);
-
- cleanup:
-    VIR_FREE(line);
-    virBufferFreeAndReset(new_meminfo);
-    VIR_FORCE_FCLOSE(fd);
-    return res;
-}
-
-static int lxcProcRead(const char *path ATTRIBUTE_UNUSED,
-                       char *buf ATTRIBUTE_UNUSED,
-                       size_t size ATTRIBUTE_UNUSED,
-                       off_t offset ATTRIBUTE_UNUSED,
+static int lxcProcRead(const char *path,
+                       char *buf,
+                       size_t size,
+                       off_t offset,
                        struct fuse_file_info *fi ATTRIBUTE_UNUSED)
 {
-    int res = -ENOENT;
-    char *hostpath = NULL;
-    struct fuse_context *context = NULL;
-    virDomainDefPtr def = NULL;
-
-    if (virAsprintf(&hostpath, "/proc/%s", path) < 0)
-        return -errno;
-
-    context = fuse_get_context();
-    def = (virDomainDefPtr)context->private_data;
-
-    if (STREQ(path, fuse_meminfo_path)) {
-        if ((res = lxcProcReadMeminfo(hostpath, def, buf, size, offset)) < 0)
-            res = lxcProcHostRead(hostpath, buf, size, offset);
-    }
+    struct fuse_context *context = fuse_get_context();
 
-    VIR_FREE(hostpath);
-    return res;
+    return lxcFuseRead((virLXCFusePtr)context->private_data,
+                       path, buf, size, offset);
 }
 
 static struct fuse_operations lxcProcOper = {
@@ -272,9 +417,11 @@ static void lxcFuseRun(void *opaque)
 {
     virLXCFusePtr fuse = opaque;
 
-    if (fuse_loop(fuse->fuse) < 0)
+    /* Requests for different files, or from several readers of the
+     * same file, don't need to wait on each other */
+    if (fuse_loop_mt(fuse->fuse) < 0)
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("fuse_loop failed"));
+                       _("fuse_loop_mt failed"));
 
     lxcFuseDestroy(fuse);
 }
@@ -290,6 +437,9 @@ int lxcSetupFuse(virLXCFusePtr *f, virDomainDefPtr def)
 
     fuse->def = def;
 
+    if (virTimeMillisNow(&fuse->start) < 0)
+        goto cleanup2;
+
     if (virMutexInit(&fuse->lock) < 0)
         goto cleanup2;
 
@@ -315,7 +465,7 @@ int lxcSetupFuse(virLXCFusePtr *f, virDomainDefPtr def)
         goto cleanup1;
 
     fuse->fuse = fuse_new(fuse->ch, &args, &lxcProcOper,
-                          sizeof(lxcProcOper), fuse->def);
+                          sizeof(lxcProcOper), fuse);
     if (fuse->fuse == NULL) {
         fuse_unmount(fuse->mountpoint, fuse->ch);
         goto cleanup1;
@@ -336,27 +486,49 @@ int lxcSetupFuse(virLXCFusePtr *f, virDomainDefPtr def)
 
 int lxcStartFuse(virLXCFusePtr fuse)
 {
-    if (virThreadCreate(&fuse->thread, false, lxcFuseRun,
+    if (virThreadCreate(&fuse->thread, true, lxcFuseRun,
                         (void *)fuse) < 0) {
         lxcFuseDestroy(fuse);
         return -1;
     }
 
+    fuse->running = true;
     return 0;
 }
 
 void lxcFreeFuse(virLXCFusePtr *f)
 {
     virLXCFusePtr fuse = *f;
-    /* lxcFuseRun thread create success */
+    bool stop = false;
+
     if (fuse) {
         /* exit fuse_loop, lxcFuseRun thread may try to destroy
          * fuse->fuse at the same time,so add a lock here. */
         virMutexLock(&fuse->lock);
-        if (fuse->fuse)
+        if (fuse->fuse) {
             fuse_exit(fuse->fuse);
+            stop = true;
+        }
+        virMutexUnlock(&fuse->lock);
+
+        if (fuse->running) {
+            /* fuse_exit only flags the loop, its worker threads stay
+             * blocked reading requests until the mount goes away */
+            if (stop)
+                fuse_unmount(fuse->mountpoint, NULL);
+
+            /* No reader may still be using the caches freed below */
+            virThreadJoin(&fuse->thread);
+        } else if (stop) {
+            lxcFuseDestroy(fuse);
+        }
+
+        virMutexLock(&fuse->lock);
+        lxcFuseCacheClear(&fuse->meminfo);
+        lxcFuseCacheClear(&fuse->uptime);
         virMutexUnlock(&fuse->lock);
 
+        virMutexDestroy(&fuse->lock);
         VIR_FREE(fuse->mountpoint);
         VIR_FREE(*f);
     }
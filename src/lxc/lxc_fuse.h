@@ -47,16 +47,46 @@ struct virLXCMeminfo {
 };
 typedef struct virLXCMeminfo *virLXCMeminfoPtr;
 
+/* How long generated file content is served before being regenerated */
+# define LXC_FUSE_CACHE_TTL_MS 500
+
+struct virLXCFuseCache {
+    char *data;
+    size_t len;
+    unsigned long long stamp; /* when data was generated, in ms */
+};
+typedef struct virLXCFuseCache *virLXCFuseCachePtr;
+
 struct virLXCFuse {
     virDomainDefPtr def;
     virThread thread;
+    bool running;             /* thread was started and must be joined */
+    unsigned long long start; /* when the container was started, in ms */
     char *mountpoint;
     struct fuse *fuse;
     struct fuse_chan *ch;
     virMutex lock;
+
+    /* protected by lock */
+    struct virLXCFuseCache meminfo;
+    struct virLXCFuseCache uptime;
 };
 typedef struct virLXCFuse *virLXCFusePtr;
 
+extern int lxcFuseFormatMeminfo(const char *hostpath,
+                                virDomainDefPtr def,
+                                virLXCMeminfoPtr meminfo,
+                                char **content,
+                                size_t *len);
+extern int lxcFuseFormatUptime(unsigned long long uptime,
+                               char **content,
+                               size_t *len);
+extern int lxcFuseCacheRead(virLXCFuseCachePtr cache,
+                            char *buf, size_t size, off_t offset);
+extern void lxcFuseCacheClear(virLXCFuseCachePtr cache);
+extern int lxcFuseRead(virLXCFusePtr fuse, const char *path,
+                       char *buf, size_t size, off_t offset);
+
 extern int lxcSetupFuse(virLXCFusePtr *f, virDomainDefPtr def);
 extern int lxcStartFuse(virLXCFusePtr f);
 extern void lxcFreeFuse(virLXCFusePtr *f);
@@ -643,7 +643,7 @@ networkStateInitialize(bool privileged,
     networkReloadFirewallRules(driverState);
     networkRefreshDaemons(driverState);
 
-    driverState->networkEventState = virObjectEventStateNew();
+    driverState->networkEventState = virObjectEventStateNewFull(true);
 
     networkDriverUnlock(driverState);
 
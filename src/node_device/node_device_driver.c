@@ -215,6 +215,30 @@ nodeConnectListAllNodeDevices(virConnectPtr conn,
     return ret;
 }
 
+int
+nodeConnectListNodeDevicesPage(virConnectPtr conn,
+                               const char *after,
+                               unsigned int maxdevices,
+                               virNodeDevicePtr **devices,
+                               unsigned int flags)
+{
+    virNodeDeviceDriverStatePtr driver = conn->nodeDevicePrivateData;
+    int ret = -1;
+
+    virCheckFlags(VIR_CONNECT_LIST_NODE_DEVICES_FILTERS_CAP, -1);
+
+    if (virConnectListNodeDevicesPageEnsureACL(conn) < 0)
+        return -1;
+
+    nodeDeviceLock(driver);
+    ret = virNodeDeviceObjListExportPage(conn, driver->devs, after,
+                                         maxdevices, devices,
+                                         virConnectListNodeDevicesPageCheckACL,
+                                         flags);
+    nodeDeviceUnlock(driver);
+    return ret;
+}
+
 virNodeDevicePtr
 nodeDeviceLookupByName(virConnectPtr conn, const char *name)
 {
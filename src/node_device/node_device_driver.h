@@ -50,6 +50,11 @@ int nodeListDevices(virConnectPtr conn, const char *cap, char **const names,
 int nodeConnectListAllNodeDevices(virConnectPtr conn,
                                   virNodeDevicePtr **devices,
                                   unsigned int flags);
+int nodeConnectListNodeDevicesPage(virConnectPtr conn,
+                                   const char *after,
+                                   unsigned int maxdevices,
+                                   virNodeDevicePtr **devices,
+                                   unsigned int flags);
 virNodeDevicePtr nodeDeviceLookupByName(virConnectPtr conn, const char *name);
 virNodeDevicePtr nodeDeviceLookupSCSIHostByWWN(virConnectPtr conn,
                                                const char *wwnn,
@@ -507,18 +507,16 @@ dev_create(const char *udi)
 
     /* Some devices don't have a path in sysfs, so ignore failure */
     (void)get_str_prop(ctx, udi, "linux.sysfs_path", &devicePath);
+    def->sysfs_path = devicePath;
 
     dev = virNodeDeviceAssignDef(&driverState->devs,
                                  def);
 
-    if (!dev) {
-        VIR_FREE(devicePath);
+    if (!dev)
         goto failure;
-    }
 
     dev->privateData = privData;
     dev->privateFree = free_udi;
-    dev->def->sysfs_path = devicePath;
 
     virNodeDeviceObjUnlock(dev);
 
@@ -821,6 +819,7 @@ static virNodeDeviceDriver halNodeDeviceDriver = {
     .nodeDeviceListCaps = nodeDeviceListCaps, /* 0.5.0 */
     .nodeDeviceCreateXML = nodeDeviceCreateXML, /* 0.6.5 */
     .nodeDeviceDestroy = nodeDeviceDestroy, /* 0.6.5 */
+    .connectListNodeDevicesPage = nodeConnectListNodeDevicesPage, /* 1.2.7 */
 };
 
 
@@ -41,6 +41,7 @@
 #include "virpci.h"
 #include "virstring.h"
 #include "virnetdev.h"
+#include "virhash.h"
 
 #define VIR_FROM_THIS VIR_FROM_NODEDEV
 
@@ -53,6 +54,15 @@ VIR_LOG_INIT("node_device.node_device_udev");
 struct _udevPrivate {
     struct udev_monitor *udev_monitor;
     int watch;
+    /* libpciaccess name lookups, keyed on "vendor:product" */
+    virHashTablePtr pciNames;
+};
+
+typedef struct _udevPCIIdNames udevPCIIdNames;
+typedef udevPCIIdNames *udevPCIIdNamesPtr;
+struct _udevPCIIdNames {
+    char *vendor;
+    char *product;
 };
 
 static virNodeDeviceDriverStatePtr driverState = NULL;
@@ -385,10 +395,24 @@ udevLogFunction(struct udev *udev ATTRIBUTE_UNUSED,
 }
 
 
-static int udevTranslatePCIIds(unsigned int vendor,
-                               unsigned int product,
-                               char **vendor_string,
-                               char **product_string)
+static void udevPCIIdNamesFree(void *payload,
+                               const void *name ATTRIBUTE_UNUSED)
+{
+    udevPCIIdNamesPtr names = payload;
+
+    if (!names)
+        return;
+
+    VIR_FREE(names->vendor);
+    VIR_FREE(names->product);
+    VIR_FREE(names);
+}
+
+
+static int udevLookupPCIIds(unsigned int vendor,
+                            unsigned int product,
+                            char **vendor_string,
+                            char **product_string)
 {
     int ret = -1;
     struct pci_id_match m;
@@ -420,6 +444,39 @@ static int udevTranslatePCIIds(unsigned int vendor,
 }
 
 
+/* Hosts with many SR-IOV virtual functions report the same IDs over
+ * and over, so remember what libpciaccess told us for each pair. */
+static int udevTranslatePCIIds(unsigned int vendor,
+                               unsigned int product,
+                               char **vendor_string,
+                               char **product_string)
+{
+    udevPrivate *priv = driverState->privateData;
+    udevPCIIdNamesPtr names = NULL;
+    char key[sizeof("ffffffff:ffffffff")];
+
+    snprintf(key, sizeof(key), "%x:%x", vendor, product);
+
+    if (!(names = virHashLookup(priv->pciNames, key))) {
+        if (VIR_ALLOC(names) < 0)
+            return -1;
+
+        if (udevLookupPCIIds(vendor, product,
+                             &names->vendor, &names->product) < 0 ||
+            virHashAddEntry(priv->pciNames, key, names) < 0) {
+            udevPCIIdNamesFree(names, NULL);
+            return -1;
+        }
+    }
+
+    if (VIR_STRDUP(*vendor_string, names->vendor) < 0 ||
+        VIR_STRDUP(*product_string, names->product) < 0)
+        return -1;
+
+    return 0;
+}
+
+
 static int udevProcessPCI(struct udev_device *device,
                           virNodeDeviceDefPtr def)
 {
@@ -1535,6 +1592,7 @@ static int nodeStateCleanup(void)
         }
 
         virNodeDeviceObjListFree(&driverState->devs);
+        virHashFree(priv->pciNames);
         nodeDeviceUnlock(driverState);
         virMutexDestroy(&driverState->lock);
         VIR_FREE(driverState);
@@ -1747,7 +1805,14 @@ static int nodeStateInitialize(bool privileged ATTRIBUTE_UNUSED,
 
     priv->watch = -1;
 
+    if (!(priv->pciNames = virHashCreate(50, udevPCIIdNamesFree))) {
+        VIR_FREE(priv);
+        ret = -1;
+        goto out;
+    }
+
     if (VIR_ALLOC(driverState) < 0) {
+        virHashFree(priv->pciNames);
         VIR_FREE(priv);
         ret = -1;
         goto out;
@@ -1755,6 +1820,7 @@ static int nodeStateInitialize(bool privileged ATTRIBUTE_UNUSED,
 
     if (virMutexInit(&driverState->lock) < 0) {
         VIR_ERROR(_("Failed to initialize mutex for driverState"));
+        virHashFree(priv->pciNames);
         VIR_FREE(priv);
         VIR_FREE(driverState);
         ret = -1;
@@ -1775,6 +1841,7 @@ static int nodeStateInitialize(bool privileged ATTRIBUTE_UNUSED,
 
     priv->udev_monitor = udev_monitor_new_from_netlink(udev, "udev");
     if (priv->udev_monitor == NULL) {
+        virHashFree(priv->pciNames);
         VIR_FREE(priv);
         VIR_ERROR(_("udev_monitor_new_from_netlink returned NULL"));
         ret = -1;
@@ -1868,6 +1935,7 @@ static virNodeDeviceDriver udevNodeDeviceDriver = {
     .nodeDeviceListCaps = nodeDeviceListCaps, /* 0.7.3 */
     .nodeDeviceCreateXML = nodeDeviceCreateXML, /* 0.7.3 */
     .nodeDeviceDestroy = nodeDeviceDestroy, /* 0.7.3 */
+    .connectListNodeDevicesPage = nodeConnectListNodeDevicesPage, /* 1.2.7 */
 };
 
 static virStateDriver udevStateDriver = {
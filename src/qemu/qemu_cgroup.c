@@ -670,11 +670,15 @@ qemuInitCgroup(virQEMUDriverPtr driver,
     int ret = -1;
     qemuDomainObjPrivatePtr priv = vm->privateData;
     virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    virQEMUDriverHostDataPtr hostData = NULL;
 
     if (!cfg->privileged)
         goto done;
 
-    if (!virCgroupAvailable())
+    if (!(hostData = qemuDomainGetHostData(driver, vm)))
+        goto cleanup;
+
+    if (!hostData->cgroups)
         goto done;
 
     virCgroupFree(&priv->cgroup);
@@ -719,6 +723,7 @@ qemuInitCgroup(virQEMUDriverPtr driver,
  done:
     ret = 0;
  cleanup:
+    virObjectUnref(hostData);
     virObjectUnref(cfg);
     return ret;
 }
@@ -730,12 +735,16 @@ qemuConnectCgroup(virQEMUDriverPtr driver,
 {
     virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverHostDataPtr hostData = NULL;
     int ret = -1;
 
     if (!cfg->privileged)
         goto done;
 
-    if (!virCgroupAvailable())
+    if (!(hostData = qemuDomainGetHostData(driver, vm)))
+        goto cleanup;
+
+    if (!hostData->cgroups)
         goto done;
 
     virCgroupFree(&priv->cgroup);
@@ -753,6 +762,7 @@ qemuConnectCgroup(virQEMUDriverPtr driver,
  done:
     ret = 0;
  cleanup:
+    virObjectUnref(hostData);
     virObjectUnref(cfg);
     return ret;
 }
@@ -982,7 +992,7 @@ qemuSetupCgroupForEmulator(virQEMUDriverPtr driver,
         goto cleanup;
 
     if (def->placement_mode == VIR_DOMAIN_CPU_PLACEMENT_MODE_AUTO) {
-        if (!(cpumap = qemuPrepareCpumap(driver, nodemask)))
+        if (!(cpumap = qemuPrepareCpumap(driver, vm, nodemask)))
             goto cleanup;
         cpumask = cpumap;
     } else if (def->cputune.emulatorpin) {
@@ -52,6 +52,7 @@
 #include "virstring.h"
 #include "viratomic.h"
 #include "storage_conf.h"
+#include "vircgroup.h"
 #include "configmake.h"
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
@@ -59,6 +60,7 @@
 VIR_LOG_INIT("qemu.qemu_conf");
 
 static virClassPtr virQEMUDriverConfigClass;
+static virClassPtr virQEMUDriverHostDataClass;
 static void virQEMUDriverConfigDispose(void *obj);
 
 static int virQEMUConfigOnceInit(void)
@@ -68,7 +70,12 @@ static int virQEMUConfigOnceInit(void)
                                            sizeof(virQEMUDriverConfig),
                                            virQEMUDriverConfigDispose);
 
-    if (!virQEMUDriverConfigClass)
+    virQEMUDriverHostDataClass = virClassNew(virClassForObject(),
+                                             "virQEMUDriverHostData",
+                                             sizeof(virQEMUDriverHostData),
+                                             NULL);
+
+    if (!virQEMUDriverConfigClass || !virQEMUDriverHostDataClass)
         return -1;
     else
         return 0;
@@ -230,6 +237,8 @@ virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged)
     cfg->migrationPortMin = QEMU_MIGRATION_PORT_MIN;
     cfg->migrationPortMax = QEMU_MIGRATION_PORT_MAX;
 
+    cfg->migrationAutoTuneMaxDowntime = QEMU_MIGRATION_AUTO_TUNE_MAX_DOWNTIME;
+
 #if defined HAVE_MNTENT_H && defined HAVE_GETMNTENT_R
     /* For privileged driver, try and find hugepage mount automatically.
      * Non-privileged driver requires admin to create a dir for the
@@ -487,6 +496,13 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
         goto cleanup;
     }
 
+    GET_VALUE_LONG("migration_auto_tune_max_downtime",
+                   cfg->migrationAutoTuneMaxDowntime);
+    GET_VALUE_LONG("migration_auto_tune_max_bandwidth",
+                   cfg->migrationAutoTuneMaxBandwidth);
+    GET_VALUE_BOOL("migration_auto_tune_auto_converge",
+                   cfg->migrationAutoTuneAutoConverge);
+
     p = virConfGetValue(conf, "user");
     CHECK_TYPE("user", VIR_CONF_STRING);
     if (p && p->str &&
@@ -570,6 +586,7 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
     GET_VALUE_STR("lock_manager", cfg->lockManagerName);
 
     GET_VALUE_LONG("max_queued", cfg->maxQueuedJobs);
+    GET_VALUE_LONG("stats_period", cfg->statsPeriod);
 
     GET_VALUE_LONG("keepalive_interval", cfg->keepAliveInterval);
     GET_VALUE_LONG("keepalive_count", cfg->keepAliveCount);
@@ -581,6 +598,10 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
 
     GET_VALUE_BOOL("log_timestamp", cfg->logTimestamp);
 
+    GET_VALUE_BOOL("startup_host_cache", cfg->startupHostCache);
+
+    GET_VALUE_BOOL("publish_domain_state", cfg->publishDomainState);
+
     ret = 0;
 
  cleanup:
@@ -698,6 +719,9 @@ virCapsPtr virQEMUDriverGetCapabilities(virQEMUDriverPtr driver,
         qemuDriverLock(driver);
         virObjectUnref(driver->caps);
         driver->caps = caps;
+        /* Whatever changed the host caps may have changed these too */
+        virObjectUnref(driver->hostData);
+        driver->hostData = NULL;
     } else {
         qemuDriverLock(driver);
     }
@@ -707,6 +731,77 @@ virCapsPtr virQEMUDriverGetCapabilities(virQEMUDriverPtr driver,
     return ret;
 }
 
+
+static virQEMUDriverHostDataPtr
+virQEMUDriverHostDataNew(void)
+{
+    virQEMUDriverHostDataPtr data;
+
+    if (virQEMUConfigInitialize() < 0)
+        return NULL;
+
+    if (!(data = virObjectNew(virQEMUDriverHostDataClass)))
+        return NULL;
+
+    if ((data->ncpus = nodeGetCPUCount()) < 0) {
+        virObjectUnref(data);
+        return NULL;
+    }
+    data->kvm = virFileExists("/dev/kvm");
+    data->cgroups = virCgroupAvailable();
+
+    return data;
+}
+
+
+/**
+ * virQEMUDriverGetHostData:
+ *
+ * Get a reference to the host details needed while starting a
+ * domain. With startup_host_cache enabled they are computed once
+ * and shared by all callers, otherwise each call probes the host
+ * afresh.
+ *
+ * The caller must release the reference with virObjectUnref
+ *
+ * Returns: a reference to a virQEMUDriverHostDataPtr or NULL
+ */
+virQEMUDriverHostDataPtr
+virQEMUDriverGetHostData(virQEMUDriverPtr driver)
+{
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    virQEMUDriverHostDataPtr data = NULL;
+    virQEMUDriverHostDataPtr ret = NULL;
+
+    if (!cfg->startupHostCache) {
+        ret = virQEMUDriverHostDataNew();
+        goto cleanup;
+    }
+
+    qemuDriverLock(driver);
+    ret = virObjectRef(driver->hostData);
+    qemuDriverUnlock(driver);
+
+    if (ret)
+        goto cleanup;
+
+    /* Probe without the lock held, racing callers may both probe
+     * but only the first result is kept */
+    if (!(data = virQEMUDriverHostDataNew()))
+        goto cleanup;
+
+    qemuDriverLock(driver);
+    if (!driver->hostData)
+        driver->hostData = virObjectRef(data);
+    ret = virObjectRef(driver->hostData);
+    qemuDriverUnlock(driver);
+
+ cleanup:
+    virObjectUnref(data);
+    virObjectUnref(cfg);
+    return ret;
+}
+
 struct _qemuSharedDeviceEntry {
     size_t ref;
     char **domains; /* array of domain names */
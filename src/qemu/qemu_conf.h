@@ -31,6 +31,7 @@
 # include "domain_conf.h"
 # include "snapshot_conf.h"
 # include "domain_event.h"
+# include "domain_shm.h"
 # include "virthread.h"
 # include "security/security_manager.h"
 # include "virpci.h"
@@ -143,6 +144,7 @@ struct _virQEMUDriverConfig {
     int maxFiles;
 
     int maxQueuedJobs;
+    unsigned int statsPeriod;
 
     char **securityDriverNames;
     bool securityDefaultConfined;
@@ -169,7 +171,28 @@ struct _virQEMUDriverConfig {
     int migrationPortMin;
     int migrationPortMax;
 
+    /* Limits for migrations started with VIR_MIGRATE_AUTO_TUNE */
+    unsigned long long migrationAutoTuneMaxDowntime;
+    unsigned long migrationAutoTuneMaxBandwidth;
+    bool migrationAutoTuneAutoConverge;
+
     bool logTimestamp;
+
+    bool startupHostCache;
+
+    bool publishDomainState;
+};
+
+/* Host details every domain startup needs, computed once and shared
+ * read-only when startup_host_cache is enabled */
+typedef struct _virQEMUDriverHostData virQEMUDriverHostData;
+typedef virQEMUDriverHostData *virQEMUDriverHostDataPtr;
+struct _virQEMUDriverHostData {
+    virObject parent;
+
+    int ncpus;      /* as reported by nodeGetCPUCount */
+    bool kvm;       /* /dev/kvm is present */
+    bool cgroups;   /* cgroup controllers are mounted */
 };
 
 /* Main driver state */
@@ -183,6 +206,15 @@ struct _virQEMUDriver {
     /* Immutable pointer, self-locking APIs */
     virThreadPoolPtr workerPool;
 
+    /* Immutable value, -1 if background stats sampling is off */
+    int statsTimer;
+
+    /* Immutable pointer, self-locking APIs, NULL if sampling is off */
+    virThreadPoolPtr statsPool;
+
+    /* Immutable pointer, self-locking APIs */
+    virThreadPoolPtr reconnectPool;
+
     /* Atomic increment only */
     int nextvmid;
 
@@ -207,6 +239,12 @@ struct _virQEMUDriver {
      */
     virCapsPtr caps;
 
+    /* Require lock to get a reference on the object,
+     * lockless access thereafter. NULL until first
+     * needed, dropped whenever caps are refreshed
+     */
+    virQEMUDriverHostDataPtr hostData;
+
     /* Immutable pointer, Immutable object */
     virDomainXMLOptionPtr xmlopt;
 
@@ -216,6 +254,10 @@ struct _virQEMUDriver {
     /* Immutable pointer, self-locking APIs */
     virObjectEventStatePtr domainEventState;
 
+    /* Immutable pointer, self-locking APIs. NULL unless
+     * publish_domain_state is enabled */
+    virDomainShmPublisherPtr domainShm;
+
     /* Immutable pointer. self-locking APIs */
     virSecurityManagerPtr securityManager;
 
@@ -269,6 +311,8 @@ virCapsPtr virQEMUDriverCreateCapabilities(virQEMUDriverPtr driver);
 virCapsPtr virQEMUDriverGetCapabilities(virQEMUDriverPtr driver,
                                         bool refresh);
 
+virQEMUDriverHostDataPtr virQEMUDriverGetHostData(virQEMUDriverPtr driver);
+
 struct qemuDomainDiskInfo {
     bool removable;
     bool locked;
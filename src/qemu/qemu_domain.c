@@ -27,6 +27,7 @@
 #include "qemu_command.h"
 #include "qemu_capabilities.h"
 #include "qemu_migration.h"
+#include "qemu_process.h"
 #include "viralloc.h"
 #include "virlog.h"
 #include "virerror.h"
@@ -125,6 +126,10 @@ qemuDomainAsyncJobPhaseFromString(qemuDomainAsyncJob job,
 void qemuDomainEventQueue(virQEMUDriverPtr driver,
                           virObjectEventPtr event)
 {
+    /* Any event may come with a state change */
+    if (event && driver->domainShm)
+        virDomainShmPublisherRequestUpdate(driver->domainShm);
+
     virObjectEventStateQueue(driver->domainEventState, event);
 }
 
@@ -142,6 +147,12 @@ qemuDomainObjInitJob(qemuDomainObjPrivatePtr priv)
         return -1;
     }
 
+    if (virCondInit(&priv->job.migCond) < 0) {
+        virCondDestroy(&priv->job.cond);
+        virCondDestroy(&priv->job.asyncCond);
+        return -1;
+    }
+
     return 0;
 }
 
@@ -166,8 +177,10 @@ qemuDomainObjResetAsyncJob(qemuDomainObjPrivatePtr priv)
     job->start = 0;
     job->dump_memory_only = false;
     job->asyncAbort = false;
+    job->migEvent = false;
     memset(&job->status, 0, sizeof(job->status));
     memset(&job->info, 0, sizeof(job->info));
+    memset(&job->tune, 0, sizeof(job->tune));
 }
 
 void
@@ -202,6 +215,7 @@ qemuDomainObjFreeJob(qemuDomainObjPrivatePtr priv)
 {
     virCondDestroy(&priv->job.cond);
     virCondDestroy(&priv->job.asyncCond);
+    virCondDestroy(&priv->job.migCond);
 }
 
 static bool
@@ -228,6 +242,9 @@ qemuDomainObjPrivateAlloc(void)
     if (virCondInit(&priv->unplugFinished) < 0)
         goto error;
 
+    if (virCondInit(&priv->blockJobCond) < 0)
+        goto error;
+
     if (!(priv->devs = virChrdevAlloc()))
         goto error;
 
@@ -246,6 +263,7 @@ qemuDomainObjPrivateFree(void *data)
     qemuDomainObjPrivatePtr priv = data;
 
     virObjectUnref(priv->qemuCaps);
+    virObjectUnref(priv->hostData);
 
     virCgroupFree(&priv->cgroup);
     virDomainPCIAddressSetFree(priv->pciaddrs);
@@ -255,8 +273,11 @@ qemuDomainObjPrivateFree(void *data)
     VIR_FREE(priv->vcpupids);
     VIR_FREE(priv->lockState);
     VIR_FREE(priv->origname);
+    qemuDomainStatsCacheClear(&priv->stats);
 
     virCondDestroy(&priv->unplugFinished);
+    qemuDomainBlockJobClear(priv);
+    virCondDestroy(&priv->blockJobCond);
     virChrdevFree(priv->devs);
 
     /* This should never be non-NULL if we get here, but just in case... */
@@ -269,6 +290,7 @@ qemuDomainObjPrivateFree(void *data)
         qemuAgentClose(priv->agent);
     }
     VIR_FREE(priv->cleanupCallbacks);
+    virObjectUnref(priv->evac);
     VIR_FREE(priv);
 }
 
@@ -1049,12 +1071,16 @@ qemuDomainJobAllowed(qemuDomainObjPrivatePtr priv, qemuDomainJob job)
 
 /*
  * obj must be locked before calling
+ *
+ * With @nowait, fail without reporting an error instead of waiting
+ * for the job to become available.
  */
 static int ATTRIBUTE_NONNULL(1)
 qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
                               virDomainObjPtr obj,
                               qemuDomainJob job,
-                              qemuDomainAsyncJob asyncJob)
+                              qemuDomainAsyncJob asyncJob,
+                              bool nowait)
 {
     qemuDomainObjPrivatePtr priv = obj->privateData;
     unsigned long long now;
@@ -1087,12 +1113,19 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     }
 
     while (!nested && !qemuDomainNestedJobAllowed(priv, job)) {
+        if (nowait)
+            goto busy;
         VIR_DEBUG("Waiting for async job (vm=%p name=%s)", obj, obj->def->name);
         if (virCondWaitUntil(&priv->job.asyncCond, &obj->parent.lock, then) < 0)
             goto error;
     }
 
+    if (priv->job.active)
+        qemuProcessReconnectPrioritize(driver, obj);
+
     while (priv->job.active) {
+        if (nowait)
+            goto busy;
         VIR_DEBUG("Waiting for job (vm=%p name=%s)", obj, obj->def->name);
         if (virCondWaitUntil(&priv->job.cond, &obj->parent.lock, then) < 0)
             goto error;
@@ -1128,6 +1161,14 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     virObjectUnref(cfg);
     return 0;
 
+ busy:
+    VIR_DEBUG("Job (%s) for domain %s not available right now",
+              qemuDomainJobTypeToString(job), obj->def->name);
+    priv->jobs_queued--;
+    virObjectUnref(obj);
+    virObjectUnref(cfg);
+    return -1;
+
  error:
     VIR_WARN("Cannot start job (%s, %s) for domain %s;"
              " current job is (%s, %s) owned by (%llu, %llu)",
@@ -1173,7 +1214,24 @@ int qemuDomainObjBeginJob(virQEMUDriverPtr driver,
                           qemuDomainJob job)
 {
     if (qemuDomainObjBeginJobInternal(driver, obj, job,
-                                      QEMU_ASYNC_JOB_NONE) < 0)
+                                      QEMU_ASYNC_JOB_NONE, false) < 0)
+        return -1;
+    else
+        return 0;
+}
+
+/*
+ * obj must be locked before calling
+ *
+ * Like qemuDomainObjBeginJob, but fails without reporting an error
+ * when another job is running rather than waiting for it to finish.
+ */
+int qemuDomainObjBeginJobNowait(virQEMUDriverPtr driver,
+                                virDomainObjPtr obj,
+                                qemuDomainJob job)
+{
+    if (qemuDomainObjBeginJobInternal(driver, obj, job,
+                                      QEMU_ASYNC_JOB_NONE, true) < 0)
         return -1;
     else
         return 0;
@@ -1184,7 +1242,7 @@ int qemuDomainObjBeginAsyncJob(virQEMUDriverPtr driver,
                                qemuDomainAsyncJob asyncJob)
 {
     if (qemuDomainObjBeginJobInternal(driver, obj, QEMU_JOB_ASYNC,
-                                      asyncJob) < 0)
+                                      asyncJob, false) < 0)
         return -1;
     else
         return 0;
@@ -1210,7 +1268,8 @@ qemuDomainObjBeginNestedJob(virQEMUDriverPtr driver,
 
     return qemuDomainObjBeginJobInternal(driver, obj,
                                          QEMU_JOB_ASYNC_NESTED,
-                                         QEMU_ASYNC_JOB_NONE);
+                                         QEMU_ASYNC_JOB_NONE,
+                                         false);
 }
 
 
@@ -1273,6 +1332,53 @@ qemuDomainObjAbortAsyncJob(virDomainObjPtr obj)
     priv->job.asyncAbort = true;
 }
 
+/*
+ * obj must be locked before calling
+ *
+ * Records that QEMU sent a MIGRATION event and wakes up the thread
+ * waiting in qemuDomainObjMigrationEventWait(), if any. The event is
+ * kept until that thread sees it, so that nothing is lost while it has
+ * @obj unlocked to talk to the monitor.
+ */
+void
+qemuDomainObjMigrationEventNotify(virDomainObjPtr obj)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+
+    priv->job.migEvent = true;
+    virCondSignal(&priv->job.migCond);
+}
+
+/*
+ * obj must be locked before calling
+ *
+ * Waits until a MIGRATION event arrives or @until (milliseconds since
+ * the epoch) passes. An event which arrived since the previous call
+ * returns immediately.
+ *
+ * Returns 1 if an event arrived, 0 on timeout, -1 on error.
+ */
+int
+qemuDomainObjMigrationEventWait(virDomainObjPtr obj,
+                                unsigned long long until)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+
+    while (!priv->job.migEvent) {
+        if (virCondWaitUntil(&priv->job.migCond,
+                             &obj->parent.lock, until) < 0) {
+            if (errno == ETIMEDOUT)
+                return 0;
+            virReportSystemError(errno, "%s",
+                                 _("Unable to wait for migration events"));
+            return -1;
+        }
+    }
+
+    priv->job.migEvent = false;
+    return 1;
+}
+
 /*
  * obj must be locked before calling
  *
@@ -2519,3 +2625,465 @@ qemuDomainAgentAvailable(qemuDomainObjPrivatePtr priv,
     }
     return true;
 }
+
+
+/**
+ * qemuDomainStatsCacheClear:
+ * @stats: the statistics cache
+ *
+ * Drops all sampled values, leaving the sampling state alone.
+ */
+void
+qemuDomainStatsCacheClear(qemuDomainStatsCachePtr stats)
+{
+    size_t i;
+
+    for (i = 0; i < stats->nblock; i++)
+        VIR_FREE(stats->block[i].alias);
+    VIR_FREE(stats->block);
+    stats->nblock = 0;
+    stats->nmem = 0;
+    stats->balloon = 0;
+    stats->stamp = 0;
+}
+
+
+/**
+ * qemuDomainStatsCacheFresh:
+ * @driver: qemu driver
+ * @vm: domain object, locked
+ *
+ * Returns true if the statistics sampled for @vm are recent enough to
+ * be handed out instead of querying the monitor, that is no older than
+ * two sampling periods.
+ */
+bool
+qemuDomainStatsCacheFresh(virQEMUDriverPtr driver,
+                          virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    unsigned long long maxAge = cfg->statsPeriod * 2ULL * 1000;
+    unsigned long long now;
+    bool ret = false;
+
+    if (!maxAge || !priv->stats.stamp ||
+        virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    ret = now - priv->stats.stamp <= maxAge;
+
+ cleanup:
+    virObjectUnref(cfg);
+    return ret;
+}
+
+
+/**
+ * qemuDomainStatsCacheUpdateBalloon:
+ * @vm: domain object, locked
+ * @actual: new balloon size in KiB
+ *
+ * Keeps the sampled balloon size in sync with BALLOON_CHANGE events
+ * so it never goes stale between two samples.
+ */
+void
+qemuDomainStatsCacheUpdateBalloon(virDomainObjPtr vm,
+                                  unsigned long long actual)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    size_t i;
+
+    if (!priv->stats.stamp)
+        return;
+
+    priv->stats.balloon = actual;
+    for (i = 0; i < priv->stats.nmem; i++) {
+        if (priv->stats.mem[i].tag == VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON)
+            priv->stats.mem[i].val = actual;
+    }
+}
+
+
+/* Rate of a block job is recomputed at most this often (ms), so that
+ * callers polling in a tight loop still get a meaningful value */
+#define QEMU_DOMAIN_BLOCK_JOB_RATE_INTERVAL 1000
+
+/* How long to wait for a block job event before asking QEMU about the
+ * job (ms), in case the event got lost */
+#define QEMU_DOMAIN_BLOCK_JOB_POLL_INTERVAL 500
+
+static void
+qemuDomainBlockJobFree(qemuDomainBlockJobPtr job)
+{
+    if (!job)
+        return;
+
+    VIR_FREE(job->dst);
+    VIR_FREE(job);
+}
+
+
+/**
+ * qemuDomainBlockJobFind:
+ * @priv: domain private data
+ * @dst: target of the disk
+ *
+ * Returns the block job tracked for the disk, or NULL if there's none.
+ */
+qemuDomainBlockJobPtr
+qemuDomainBlockJobFind(qemuDomainObjPrivatePtr priv,
+                       const char *dst)
+{
+    size_t i;
+
+    for (i = 0; i < priv->nblockjobs; i++) {
+        if (STREQ(priv->blockjobs[i]->dst, dst))
+            return priv->blockjobs[i];
+    }
+
+    return NULL;
+}
+
+
+/**
+ * qemuDomainBlockJobAdd:
+ * @priv: domain private data
+ * @dst: target of the disk
+ *
+ * Returns the block job tracked for the disk, starting to track a running
+ * job if there's none yet, or NULL on OOM. The latter is what happens for
+ * jobs that were started before libvirtd.
+ */
+qemuDomainBlockJobPtr
+qemuDomainBlockJobAdd(qemuDomainObjPrivatePtr priv,
+                      const char *dst)
+{
+    qemuDomainBlockJobPtr job;
+
+    if ((job = qemuDomainBlockJobFind(priv, dst)))
+        return job;
+
+    if (VIR_ALLOC(job) < 0 ||
+        VIR_STRDUP(job->dst, dst) < 0)
+        goto error;
+
+    job->id = ++priv->lastBlockJobId;
+    job->status = -1;
+    if (virTimeMillisNow(&job->started) < 0)
+        goto error;
+
+    if (VIR_APPEND_ELEMENT(priv->blockjobs, priv->nblockjobs, job) < 0)
+        goto error;
+
+    return priv->blockjobs[priv->nblockjobs - 1];
+
+ error:
+    qemuDomainBlockJobFree(job);
+    return NULL;
+}
+
+
+/**
+ * qemuDomainBlockJobStart:
+ * @priv: domain private data
+ * @dst: target of the disk
+ * @type: virDomainBlockJobType of the new job
+ *
+ * Forgets about any previous job on the disk and starts tracking a new
+ * one. Must be called before the job is started in QEMU, since the job
+ * may finish before the command starting it returns.
+ *
+ * Returns the job or NULL on OOM.
+ */
+qemuDomainBlockJobPtr
+qemuDomainBlockJobStart(qemuDomainObjPrivatePtr priv,
+                        const char *dst,
+                        int type)
+{
+    qemuDomainBlockJobPtr job;
+
+    if (!(job = qemuDomainBlockJobAdd(priv, dst)))
+        return NULL;
+
+    job->id = ++priv->lastBlockJobId;
+    job->type = type;
+    job->status = -1;
+    job->bandwidth = 0;
+    job->cur = job->end = 0;
+    job->sampled = job->sampledCur = job->rate = 0;
+    if (virTimeMillisNow(&job->started) < 0)
+        job->started = 0;
+
+    return job;
+}
+
+
+/**
+ * qemuDomainBlockJobRemove:
+ * @priv: domain private data
+ * @dst: target of the disk
+ *
+ * Stops tracking the block job of the disk, waking up anyone waiting
+ * for it to finish.
+ */
+void
+qemuDomainBlockJobRemove(qemuDomainObjPrivatePtr priv,
+                         const char *dst)
+{
+    size_t i;
+
+    for (i = 0; i < priv->nblockjobs; i++) {
+        if (STREQ(priv->blockjobs[i]->dst, dst)) {
+            qemuDomainBlockJobFree(priv->blockjobs[i]);
+            VIR_DELETE_ELEMENT(priv->blockjobs, i, priv->nblockjobs);
+            virCondBroadcast(&priv->blockJobCond);
+            return;
+        }
+    }
+}
+
+
+/**
+ * qemuDomainBlockJobUpdate:
+ * @job: tracked block job
+ * @info: what QEMU currently reports about the job
+ *
+ * Records the progress of the job and, once enough time passed since the
+ * previous sample, recomputes its rate.
+ */
+void
+qemuDomainBlockJobUpdate(qemuDomainBlockJobPtr job,
+                         virDomainBlockJobInfoPtr info)
+{
+    unsigned long long now;
+
+    if (virTimeMillisNow(&now) < 0) {
+        now = 0;
+        virResetLastError();
+    }
+
+    qemuDomainBlockJobUpdateAt(job, info, now);
+}
+
+
+/**
+ * qemuDomainBlockJobUpdateAt:
+ * @job: tracked block job
+ * @info: what QEMU currently reports about the job
+ * @now: time of the report in ms, or 0 if unknown
+ *
+ * Same as qemuDomainBlockJobUpdate for a report made at @now.
+ */
+void
+qemuDomainBlockJobUpdateAt(qemuDomainBlockJobPtr job,
+                           virDomainBlockJobInfoPtr info,
+                           unsigned long long now)
+{
+    job->type = info->type;
+    job->bandwidth = info->bandwidth;
+    job->cur = info->cur;
+    job->end = info->end;
+
+    if (!now)
+        return;
+
+    if (job->sampled && job->cur >= job->sampledCur) {
+        if (now - job->sampled < QEMU_DOMAIN_BLOCK_JOB_RATE_INTERVAL)
+            return;
+        job->rate = (job->cur - job->sampledCur) * 1000 /
+            (now - job->sampled);
+    } else {
+        job->rate = 0;
+    }
+
+    job->sampled = now;
+    job->sampledCur = job->cur;
+}
+
+
+/**
+ * qemuDomainBlockJobGetETA:
+ * @job: tracked block job
+ * @eta: filled with the expected time until the job is done, in ms
+ *
+ * Returns true if @eta was filled, false if the job is over or its rate
+ * is not known yet.
+ */
+bool
+qemuDomainBlockJobGetETA(qemuDomainBlockJobPtr job,
+                         unsigned long long *eta)
+{
+    if (job->status != -1 || !job->rate)
+        return false;
+
+    *eta = (job->end - MIN(job->cur, job->end)) * 1000 / job->rate;
+    return true;
+}
+
+
+/**
+ * qemuDomainBlockJobSetStatus:
+ * @priv: domain private data
+ * @job: tracked block job
+ * @status: virConnectDomainEventBlockJobStatus or -1
+ *
+ * Changes the status of the job and wakes up anyone waiting for it.
+ */
+void
+qemuDomainBlockJobSetStatus(qemuDomainObjPrivatePtr priv,
+                            qemuDomainBlockJobPtr job,
+                            int status)
+{
+    job->status = status;
+    if (status == VIR_DOMAIN_BLOCK_JOB_COMPLETED)
+        job->cur = job->end;
+    virCondBroadcast(&priv->blockJobCond);
+}
+
+
+/**
+ * qemuDomainBlockJobClear:
+ * @priv: domain private data
+ *
+ * Forgets all block jobs, e.g., when the domain stops.
+ */
+void
+qemuDomainBlockJobClear(qemuDomainObjPrivatePtr priv)
+{
+    size_t i;
+
+    for (i = 0; i < priv->nblockjobs; i++)
+        qemuDomainBlockJobFree(priv->blockjobs[i]);
+    VIR_FREE(priv->blockjobs);
+    priv->nblockjobs = 0;
+    virCondBroadcast(&priv->blockJobCond);
+}
+
+
+/* Asks QEMU about block job @id, unless the domain is busy. A job QEMU
+ * no longer knows about ended without us seeing the event, so it is
+ * forgotten like qemuDomainGetBlockJobStats does. */
+static void
+qemuDomainBlockJobPoll(virQEMUDriverPtr driver,
+                       virDomainObjPtr vm,
+                       const char *dst,
+                       unsigned int id)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainBlockJobPtr job;
+    virDomainBlockJobInfo info;
+    char *device = NULL;
+    int idx;
+    int rc;
+
+    if (qemuDomainObjBeginJobNowait(driver, vm, QEMU_JOB_QUERY) < 0)
+        return;
+
+    if (!virDomainObjIsActive(vm) ||
+        (idx = virDomainDiskIndexByName(vm->def, dst, false)) < 0 ||
+        !vm->def->disks[idx]->info.alias ||
+        virAsprintf(&device, "drive-%s", vm->def->disks[idx]->info.alias) < 0)
+        goto endjob;
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    rc = qemuMonitorBlockJob(priv->mon, device, NULL, 0, &info,
+                             BLOCK_JOB_INFO, true);
+    qemuDomainObjExitMonitor(driver, vm);
+    if (rc < 0)
+        goto endjob;
+
+    if (!(job = qemuDomainBlockJobFind(priv, dst)) ||
+        job->id != id || job->status != -1)
+        goto endjob;
+
+    if (rc == 1) {
+        qemuDomainBlockJobUpdate(job, &info);
+    } else {
+        VIR_DEBUG("Block job %u on disk %s of domain %s ended unnoticed",
+                  id, dst, vm->def->name);
+        qemuDomainBlockJobRemove(priv, dst);
+    }
+
+ endjob:
+    virResetLastError();
+    ignore_value(qemuDomainObjEndJob(driver, vm));
+    VIR_FREE(device);
+}
+
+
+/**
+ * qemuDomainBlockJobWait:
+ * @driver: qemu driver data
+ * @vm: domain object, locked
+ * @dst: target of the disk
+ * @id: the job to wait for
+ *
+ * Waits until job @id on the disk leaves the running state, is replaced
+ * by another job or is forgotten. The BLOCK_JOB events normally end the
+ * wait; should one get lost, QEMU is asked about the job periodically.
+ * The caller must not hold a job so that others can use the domain
+ * meanwhile, and must hold a reference on @vm.
+ *
+ * Returns 0 on success, -1 on error or if the domain stopped meanwhile.
+ */
+int
+qemuDomainBlockJobWait(virQEMUDriverPtr driver,
+                       virDomainObjPtr vm,
+                       const char *dst,
+                       unsigned int id)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainBlockJobPtr job;
+    unsigned long long now;
+
+    while (virDomainObjIsActive(vm) &&
+           (job = qemuDomainBlockJobFind(priv, dst)) &&
+           job->id == id && job->status == -1) {
+        VIR_DEBUG("Waiting for block job %u on disk %s of domain %s",
+                  id, dst, vm->def->name);
+        if (virTimeMillisNow(&now) < 0)
+            return -1;
+        if (virCondWaitUntil(&priv->blockJobCond, &vm->parent.lock,
+                             now + QEMU_DOMAIN_BLOCK_JOB_POLL_INTERVAL) < 0) {
+            if (errno != ETIMEDOUT) {
+                virReportSystemError(errno, "%s",
+                                     _("Unable to wait for block job"));
+                return -1;
+            }
+            qemuDomainBlockJobPoll(driver, vm, dst, id);
+        }
+    }
+
+    if (!virDomainObjIsActive(vm)) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("domain is not running"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * qemuDomainGetHostData:
+ * @driver: qemu driver data
+ * @vm: domain object
+ *
+ * Like virQEMUDriverGetHostData, but while @vm is being started returns
+ * the details qemuProcessStart already probed, so that the host is
+ * probed only once per startup even without startup_host_cache.
+ *
+ * Returns: a reference to a virQEMUDriverHostDataPtr or NULL
+ */
+virQEMUDriverHostDataPtr
+qemuDomainGetHostData(virQEMUDriverPtr driver,
+                      virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    if (priv->hostData)
+        return virObjectRef(priv->hostData);
+
+    return virQEMUDriverGetHostData(driver);
+}
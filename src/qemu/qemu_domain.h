@@ -100,6 +100,28 @@ typedef enum {
 } qemuDomainAsyncJob;
 VIR_ENUM_DECL(qemuDomainAsyncJob)
 
+/* State of the controller tuning a migration started with
+ * VIR_MIGRATE_AUTO_TUNE, see qemuMigrationAutoTune */
+typedef struct _qemuDomainJobTune qemuDomainJobTune;
+struct _qemuDomainJobTune {
+    bool enabled;
+    unsigned long long maxDowntime;     /* limits from qemu.conf */
+    unsigned long maxBandwidth;
+
+    unsigned long long sampled;         /* when the rates were last computed */
+    unsigned long long transferred;     /* ram_transferred at that time */
+    unsigned long long remaining;       /* ram_remaining at that time */
+    unsigned long long cacheMisses;     /* xbzrle_cache_miss at that time */
+    unsigned long long rate;            /* bytes/s sent */
+    unsigned long long dirtyRate;       /* bytes/s dirtied again */
+    unsigned int stalls;                /* consecutive samples not converging */
+
+    unsigned long long downtime;        /* current limits, ms and MiB/s */
+    unsigned long bandwidth;
+    unsigned int adjustments;
+    const char *lastAction;
+};
+
 struct qemuDomainJobObj {
     virCond cond;                       /* Use to coordinate jobs */
     qemuDomainJob active;               /* Currently running job */
@@ -113,13 +135,74 @@ struct qemuDomainJobObj {
     unsigned long long start;           /* When the async job started */
     bool dump_memory_only;              /* use dump-guest-memory to do dump */
     qemuMonitorMigrationStatus status;  /* Raw async job progress data */
+    virCond migCond;                    /* Signalled on migration events */
+    bool migEvent;                      /* Migration event not seen yet */
     virDomainJobInfo info;              /* Processed async job progress data */
     bool asyncAbort;                    /* abort of async job requested */
+    qemuDomainJobTune tune;             /* Migration auto-tuning */
 };
 
 typedef void (*qemuDomainCleanupCallback)(virQEMUDriverPtr driver,
                                           virDomainObjPtr vm);
 
+typedef struct _qemuDomainBlockStatsCache qemuDomainBlockStatsCache;
+typedef qemuDomainBlockStatsCache *qemuDomainBlockStatsCachePtr;
+struct _qemuDomainBlockStatsCache {
+    char *alias;
+    long long rd_req;
+    long long rd_bytes;
+    long long rd_total_times;
+    long long wr_req;
+    long long wr_bytes;
+    long long wr_total_times;
+    long long flush_req;
+    long long flush_total_times;
+    long long errs;
+};
+
+/* Statistics sampled in the background so that callers passing
+ * VIR_DOMAIN_STATS_CACHED don't need a job. Protected by the domain
+ * object lock. */
+typedef struct _qemuDomainStatsCache qemuDomainStatsCache;
+typedef qemuDomainStatsCache *qemuDomainStatsCachePtr;
+struct _qemuDomainStatsCache {
+    unsigned long long stamp; /* when the last sample was taken, 0 if never */
+    bool sampling; /* a sample is queued in the worker pool */
+
+    virDomainMemoryStatStruct mem[VIR_DOMAIN_MEMORY_STAT_NR];
+    size_t nmem;
+    unsigned long long balloon; /* 0 if unknown */
+
+    qemuDomainBlockStatsCachePtr block;
+    size_t nblock;
+};
+
+/* Progress of the block job on one disk, kept from the start of the job
+ * until another one is started on the same disk so that its outcome can
+ * still be reported. Protected by the domain object lock. */
+typedef struct _qemuDomainBlockJob qemuDomainBlockJob;
+typedef qemuDomainBlockJob *qemuDomainBlockJobPtr;
+struct _qemuDomainBlockJob {
+    char *dst;                      /* target of the disk */
+    unsigned int id;                /* unique within the domain */
+    int type;                       /* virDomainBlockJobType */
+    int status;                     /* virConnectDomainEventBlockJobStatus,
+                                       -1 while running */
+    unsigned long long started;     /* ms since epoch */
+
+    unsigned long bandwidth;        /* MiB/s, as last queried */
+    unsigned long long cur;
+    unsigned long long end;
+
+    unsigned long long sampled;     /* when the rate was last computed */
+    unsigned long long sampledCur;  /* and where the job was at that time */
+    unsigned long long rate;        /* units of @cur per second, 0 if unknown */
+};
+
+/* Defined in qemu_driver.c, a virObjectLockable */
+typedef struct _qemuEvacuation qemuEvacuation;
+typedef qemuEvacuation *qemuEvacuationPtr;
+
 typedef struct _qemuDomainObjPrivate qemuDomainObjPrivate;
 typedef qemuDomainObjPrivate *qemuDomainObjPrivatePtr;
 struct _qemuDomainObjPrivate {
@@ -167,6 +250,9 @@ struct _qemuDomainObjPrivate {
 
     virCgroupPtr cgroup;
 
+    /* Host details probed once for the startup in progress */
+    virQEMUDriverHostDataPtr hostData;
+
     virCond unplugFinished; /* signals that unpluggingDevice was unplugged */
     const char *unpluggingDevice; /* alias of the device that is being unplugged */
     char **qemuDevices; /* NULL-terminated list of devices aliases known to QEMU */
@@ -174,12 +260,28 @@ struct _qemuDomainObjPrivate {
     bool hookRun;  /* true if there was a hook run over this domain */
 
     bool quiesced; /* true if filesystems are quiesced */
+
+    qemuDomainStatsCache stats;
+
+    qemuDomainBlockJobPtr *blockjobs;
+    size_t nblockjobs;
+    unsigned int lastBlockJobId;
+    virCond blockJobCond; /* signalled when a block job changes status */
+
+    /* Reconnect queued at daemon startup that didn't run yet */
+    struct qemuProcessReconnectData *reconnect;
+    bool reconnectUrgent; /* also queued with priority */
+
+    /* Evacuation (virDomainListEvacuate) the domain is part of */
+    qemuEvacuationPtr evac;
+    unsigned long evacBandwidth; /* MiB/s, share of its cap or 0 */
 };
 
 typedef enum {
     QEMU_PROCESS_EVENT_WATCHDOG = 0,
     QEMU_PROCESS_EVENT_GUESTPANIC,
     QEMU_PROCESS_EVENT_DEVICE_DELETED,
+    QEMU_PROCESS_EVENT_STATS_SAMPLE,
 
     QEMU_PROCESS_EVENT_LAST
 } qemuProcessEventType;
@@ -205,6 +307,10 @@ int qemuDomainObjBeginJob(virQEMUDriverPtr driver,
                           virDomainObjPtr obj,
                           qemuDomainJob job)
     ATTRIBUTE_RETURN_CHECK;
+int qemuDomainObjBeginJobNowait(virQEMUDriverPtr driver,
+                                virDomainObjPtr obj,
+                                qemuDomainJob job)
+    ATTRIBUTE_RETURN_CHECK;
 int qemuDomainObjBeginAsyncJob(virQEMUDriverPtr driver,
                                virDomainObjPtr obj,
                                qemuDomainAsyncJob asyncJob)
@@ -217,6 +323,10 @@ bool qemuDomainObjEndAsyncJob(virQEMUDriverPtr driver,
                               virDomainObjPtr obj)
     ATTRIBUTE_RETURN_CHECK;
 void qemuDomainObjAbortAsyncJob(virDomainObjPtr obj);
+void qemuDomainObjMigrationEventNotify(virDomainObjPtr obj);
+int qemuDomainObjMigrationEventWait(virDomainObjPtr obj,
+                                    unsigned long long until)
+    ATTRIBUTE_RETURN_CHECK;
 void qemuDomainObjSetJobPhase(virQEMUDriverPtr driver,
                               virDomainObjPtr obj,
                               int phase);
@@ -374,4 +484,38 @@ bool qemuDomainDefCheckABIStability(virQEMUDriverPtr driver,
 bool qemuDomainAgentAvailable(qemuDomainObjPrivatePtr priv,
                               bool reportError);
 
+void qemuDomainStatsCacheClear(qemuDomainStatsCachePtr stats);
+bool qemuDomainStatsCacheFresh(virQEMUDriverPtr driver,
+                               virDomainObjPtr vm);
+void qemuDomainStatsCacheUpdateBalloon(virDomainObjPtr vm,
+                                       unsigned long long actual);
+
+qemuDomainBlockJobPtr qemuDomainBlockJobFind(qemuDomainObjPrivatePtr priv,
+                                             const char *dst);
+qemuDomainBlockJobPtr qemuDomainBlockJobAdd(qemuDomainObjPrivatePtr priv,
+                                            const char *dst);
+qemuDomainBlockJobPtr qemuDomainBlockJobStart(qemuDomainObjPrivatePtr priv,
+                                              const char *dst,
+                                              int type);
+void qemuDomainBlockJobRemove(qemuDomainObjPrivatePtr priv,
+                              const char *dst);
+void qemuDomainBlockJobUpdate(qemuDomainBlockJobPtr job,
+                              virDomainBlockJobInfoPtr info);
+void qemuDomainBlockJobUpdateAt(qemuDomainBlockJobPtr job,
+                                virDomainBlockJobInfoPtr info,
+                                unsigned long long now);
+bool qemuDomainBlockJobGetETA(qemuDomainBlockJobPtr job,
+                              unsigned long long *eta);
+void qemuDomainBlockJobSetStatus(qemuDomainObjPrivatePtr priv,
+                                 qemuDomainBlockJobPtr job,
+                                 int status);
+void qemuDomainBlockJobClear(qemuDomainObjPrivatePtr priv);
+virQEMUDriverHostDataPtr qemuDomainGetHostData(virQEMUDriverPtr driver,
+                                               virDomainObjPtr vm);
+
+int qemuDomainBlockJobWait(virQEMUDriverPtr driver,
+                           virDomainObjPtr vm,
+                           const char *dst,
+                           unsigned int id);
+
 #endif /* __QEMU_DOMAIN_H__ */
@@ -45,6 +45,7 @@
 
 
 #include "qemu_driver.h"
+#include "qemu_driverpriv.h"
 #include "qemu_agent.h"
 #include "qemu_conf.h"
 #include "qemu_capabilities.h"
@@ -80,6 +81,7 @@
 #include "virhook.h"
 #include "virstoragefile.h"
 #include "virfile.h"
+#include "vircompress.h"
 #include "fdstream.h"
 #include "configmake.h"
 #include "virthreadpool.h"
@@ -95,6 +97,7 @@
 #include "viraccessapicheckqemu.h"
 #include "storage/storage_driver.h"
 #include "virhostdev.h"
+#include "viridentity.h"
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
@@ -563,6 +566,90 @@ qemuDomainFindMaxID(virDomainObjPtr vm,
 }
 
 
+/* Upper bound of threads sampling domain stats at once */
+#define QEMU_STATS_MAX_WORKERS 4
+
+static int
+qemuDomainStatsSampleQueue(virDomainObjPtr vm,
+                           void *opaque)
+{
+    virQEMUDriverPtr driver = opaque;
+    qemuDomainObjPrivatePtr priv;
+    struct qemuProcessEvent *processEvent = NULL;
+
+    virObjectLock(vm);
+    priv = vm->privateData;
+
+    if (!virDomainObjIsActive(vm) ||
+        priv->stats.sampling ||
+        priv->job.active != QEMU_JOB_NONE)
+        goto cleanup;
+
+    if (VIR_ALLOC(processEvent) < 0)
+        goto cleanup;
+
+    processEvent->eventType = QEMU_PROCESS_EVENT_STATS_SAMPLE;
+    processEvent->vm = vm;
+    virObjectRef(vm);
+    if (virThreadPoolSendJob(driver->statsPool, 0, processEvent) < 0) {
+        virObjectUnref(vm);
+        VIR_FREE(processEvent);
+        goto cleanup;
+    }
+    priv->stats.sampling = true;
+
+ cleanup:
+    virObjectUnlock(vm);
+    return 0;
+}
+
+
+static void
+qemuDomainStatsTimer(int timer ATTRIBUTE_UNUSED,
+                     void *opaque)
+{
+    virQEMUDriverPtr driver = opaque;
+
+    virDomainObjListForEach(driver->domains,
+                            qemuDomainStatsSampleQueue,
+                            driver);
+}
+
+
+/* Refresh period of the published domain states, on top of the
+ * updates triggered by domain events */
+#define QEMU_DOMAIN_SHM_INTERVAL 1000
+
+/* The snapshot only saves clients a round trip, failing to set it up
+ * is not fatal */
+static void
+qemuDomainShmStart(virQEMUDriverPtr driver,
+                   virQEMUDriverConfigPtr cfg)
+{
+    char *path = NULL;
+
+    if (virAsprintf(&path, "%s/%s", cfg->stateDir, VIR_DOMAIN_SHM_FILE) < 0)
+        goto error;
+
+    if (!(driver->domainShm = virDomainShmPublisherNew(path)) ||
+        virDomainShmPublisherSchedule(driver->domainShm, driver->domains,
+                                      QEMU_DOMAIN_SHM_INTERVAL) < 0)
+        goto error;
+
+    VIR_FREE(path);
+    return;
+
+ error:
+    VIR_WARN("Unable to publish domain states: %s",
+             virGetLastErrorMessage());
+    virResetLastError();
+    virDomainShmPublisherClose(driver->domainShm);
+    virObjectUnref(driver->domainShm);
+    driver->domainShm = NULL;
+    VIR_FREE(path);
+}
+
+
 /**
  * qemuStateInitialize:
  *
@@ -593,6 +680,7 @@ qemuStateInitialize(bool privileged,
 
     qemu_driver->inhibitCallback = callback;
     qemu_driver->inhibitOpaque = opaque;
+    qemu_driver->statsTimer = -1;
 
     /* Don't have a dom0 so start from 1 */
     qemu_driver->nextvmid = 1;
@@ -601,7 +689,7 @@ qemuStateInitialize(bool privileged,
         goto error;
 
     /* Init domain events */
-    qemu_driver->domainEventState = virObjectEventStateNew();
+    qemu_driver->domainEventState = virObjectEventStateNewFull(true);
     if (!qemu_driver->domainEventState)
         goto error;
 
@@ -835,6 +923,27 @@ qemuStateInitialize(bool privileged,
     if (!qemu_driver->workerPool)
         goto error;
 
+    /* Samples get their own threads, so that a domain with a hung
+     * monitor neither holds up the others nor the events handled by
+     * workerPool */
+    if (cfg->statsPeriod) {
+        if (!(qemu_driver->statsPool = virThreadPoolNew(0,
+                                                        QEMU_STATS_MAX_WORKERS,
+                                                        0,
+                                                        qemuProcessEventHandler,
+                                                        qemu_driver)))
+            goto error;
+
+        if ((qemu_driver->statsTimer = virEventAddTimeout(cfg->statsPeriod * 1000,
+                                                          qemuDomainStatsTimer,
+                                                          qemu_driver,
+                                                          NULL)) < 0)
+            goto error;
+    }
+
+    if (privileged && cfg->publishDomainState)
+        qemuDomainShmStart(qemu_driver, cfg);
+
     virObjectUnref(conn);
 
     virNWFilterRegisterCallbackDriver(&qemuCallbackDriver);
@@ -980,10 +1089,15 @@ qemuStateCleanup(void)
         return -1;
 
     virNWFilterUnRegisterCallbackDriver(&qemuCallbackDriver);
+    if (qemu_driver->statsTimer != -1)
+        virEventRemoveTimeout(qemu_driver->statsTimer);
+    virDomainShmPublisherClose(qemu_driver->domainShm);
+    virObjectUnref(qemu_driver->domainShm);
     virObjectUnref(qemu_driver->config);
     virObjectUnref(qemu_driver->hostdevMgr);
     virHashFree(qemu_driver->sharedDevices);
     virObjectUnref(qemu_driver->caps);
+    virObjectUnref(qemu_driver->hostData);
     virQEMUCapsCacheFree(qemu_driver->qemuCapsCache);
 
     virObjectUnref(qemu_driver->domains);
@@ -1010,6 +1124,8 @@ qemuStateCleanup(void)
 
     virMutexDestroy(&qemu_driver->lock);
     virThreadPoolFree(qemu_driver->workerPool);
+    virThreadPoolFree(qemu_driver->statsPool);
+    virThreadPoolFree(qemu_driver->reconnectPool);
     VIR_FREE(qemu_driver);
 
     return 0;
@@ -2505,6 +2621,9 @@ static int qemuDomainGetInfo(virDomainPtr dom,
             info->memory = vm->def->mem.max_balloon;
         } else if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BALLOON_EVENT)) {
             info->memory = vm->def->mem.cur_balloon;
+        } else if (priv->stats.balloon &&
+                   qemuDomainStatsCacheFresh(driver, vm)) {
+            info->memory = priv->stats.balloon;
         } else if (qemuDomainJobAllowed(priv, QEMU_JOB_QUERY)) {
             if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
                 goto cleanup;
@@ -2647,6 +2766,7 @@ typedef enum {
      */
     QEMU_SAVE_FORMAT_XZ = 3,
     QEMU_SAVE_FORMAT_LZOP = 4,
+    QEMU_SAVE_FORMAT_ZLIB = 5, /* built-in, see vircompress.c */
     /* Note: add new members only at the end.
        These values are used in the on-disk format.
        Do not change or re-use numbers. */
@@ -2660,7 +2780,8 @@ VIR_ENUM_IMPL(qemuSaveCompression, QEMU_SAVE_FORMAT_LAST,
               "gzip",
               "bzip2",
               "xz",
-              "lzop")
+              "lzop",
+              "zlib")
 
 VIR_ENUM_DECL(qemuDumpFormat)
 VIR_ENUM_IMPL(qemuDumpFormat, VIR_DOMAIN_CORE_DUMP_FORMAT_LAST,
@@ -2677,7 +2798,8 @@ struct _virQEMUSaveHeader {
     uint32_t xml_len;
     uint32_t was_running;
     uint32_t compressed;
-    uint32_t unused[15];
+    uint32_t chunk_size;  /* QEMU_SAVE_FORMAT_ZLIB only */
+    uint32_t unused[14];
 };
 
 static inline void
@@ -2687,6 +2809,7 @@ bswap_header(virQEMUSaveHeaderPtr hdr)
     hdr->xml_len = bswap_32(hdr->xml_len);
     hdr->was_running = bswap_32(hdr->was_running);
     hdr->compressed = bswap_32(hdr->compressed);
+    hdr->chunk_size = bswap_32(hdr->chunk_size);
 }
 
 
@@ -2720,10 +2843,36 @@ qemuDomainSaveHeader(int fd, const char *path, const char *xml,
 static const char *
 qemuCompressProgramName(int compress)
 {
-    return (compress == QEMU_SAVE_FORMAT_RAW ? NULL :
+    return (compress == QEMU_SAVE_FORMAT_RAW ||
+            compress == QEMU_SAVE_FORMAT_ZLIB ? NULL :
             qemuSaveCompressionTypeToString(compress));
 }
 
+/* Chunk size and maximum number of threads used for QEMU_SAVE_FORMAT_ZLIB.
+ * The chunk size is recorded in the image header, so restore doesn't
+ * depend on these staying the same. */
+#define QEMU_SAVE_ZLIB_CHUNK_SIZE (1024 * 1024)
+#define QEMU_SAVE_ZLIB_MAX_WORKERS 16
+
+static size_t
+qemuCompressWorkers(void)
+{
+    virBitmapPtr cpus = NULL;
+    int ncpus = nodeGetCPUCount();
+    size_t ret = 1;
+
+    /* More threads than the CPUs libvirtd may run on only compete with
+     * each other, and the daemon is often confined to a few of them */
+    if (ncpus > 0 &&
+        virProcessGetAffinity(getpid(), &cpus, ncpus) == 0)
+        ret = virBitmapCountBits(cpus);
+    else
+        virResetLastError();
+
+    virBitmapFree(cpus);
+    return MAX(1, MIN(ret, QEMU_SAVE_ZLIB_MAX_WORKERS));
+}
+
 static virCommandPtr
 qemuCompressGetCommand(virQEMUSaveFormat compression)
 {
@@ -2897,6 +3046,66 @@ qemuOpenFileAs(uid_t fallback_uid, gid_t fallback_gid,
     goto cleanup;
 }
 
+/* Like qemuMigrationToFile, but compress the stream ourselves on its
+ * way from qemu to @fd and record the layout of the result in @header */
+static int
+qemuMigrationToFileZlib(virQEMUDriverPtr driver,
+                        virDomainObjPtr vm,
+                        int fd,
+                        const char *path,
+                        bool bypassSecurityDriver,
+                        qemuDomainAsyncJob asyncJob,
+                        virQEMUSaveHeaderPtr header)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virCompressJobPtr job = NULL;
+    virErrorPtr orig_err = NULL;
+    int pipeFD[2] = { -1, -1 };
+    int ret = -1;
+
+    /* qemu has to be handed the pipe, it can't open() it by name */
+    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATE_QEMU_FD) ||
+        priv->monConfig->type != VIR_DOMAIN_CHR_TYPE_UNIX) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("zlib save image format is not supported "
+                         "with this QEMU binary"));
+        return -1;
+    }
+
+    if (pipe2(pipeFD, O_CLOEXEC) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to create pipe"));
+        return -1;
+    }
+
+    if (!(job = virCompressJobStart(pipeFD[0], fd, false,
+                                    qemuCompressWorkers(),
+                                    QEMU_SAVE_ZLIB_CHUNK_SIZE)))
+        goto cleanup;
+
+    ret = qemuMigrationToFile(driver, vm, pipeFD[1], 0, path, NULL,
+                              bypassSecurityDriver, asyncJob);
+    if (ret < 0)
+        orig_err = virSaveLastError();
+
+    /* Let the job see the end of the stream whether qemu finished or not */
+    VIR_FORCE_CLOSE(pipeFD[1]);
+    if (virCompressJobFinish(job) < 0)
+        ret = -1;
+
+    if (ret == 0)
+        header->chunk_size = QEMU_SAVE_ZLIB_CHUNK_SIZE;
+
+ cleanup:
+    VIR_FORCE_CLOSE(pipeFD[0]);
+    VIR_FORCE_CLOSE(pipeFD[1]);
+    if (orig_err) {
+        virSetError(orig_err);
+        virFreeError(orig_err);
+    }
+    return ret;
+}
+
 /* Helper function to execute a migration to file with a correct save header
  * the caller needs to make sure that the processors are stopped and do all other
  * actions besides saving memory */
@@ -2978,11 +3187,17 @@ qemuDomainSaveMemory(virQEMUDriverPtr driver,
         goto cleanup;
 
     /* Perform the migration */
-    if (qemuMigrationToFile(driver, vm, fd, offset, path,
-                            qemuCompressProgramName(compressed),
-                            bypassSecurityDriver,
-                            asyncJob) < 0)
+    if (compressed == QEMU_SAVE_FORMAT_ZLIB) {
+        if (qemuMigrationToFileZlib(driver, vm, fd, path,
+                                    bypassSecurityDriver,
+                                    asyncJob, &header) < 0)
+            goto cleanup;
+    } else if (qemuMigrationToFile(driver, vm, fd, offset, path,
+                                   qemuCompressProgramName(compressed),
+                                   bypassSecurityDriver,
+                                   asyncJob) < 0) {
         goto cleanup;
+    }
 
     /* Touch up file header to mark image complete. */
 
@@ -3157,6 +3372,9 @@ qemuCompressProgramAvailable(virQEMUSaveFormat compress)
     if (compress == QEMU_SAVE_FORMAT_RAW)
         return true;
 
+    if (compress == QEMU_SAVE_FORMAT_ZLIB)
+        return virCompressAvailable();
+
     if (!(path = virFindFileInPath(qemuSaveCompressionTypeToString(compress))))
         return false;
 
@@ -3531,6 +3749,13 @@ getCompressionType(virQEMUDriverPtr driver)
             ret = QEMU_SAVE_FORMAT_RAW;
             goto cleanup;
         }
+        /* Nothing but libvirt could read a dump in our own format */
+        if (ret == QEMU_SAVE_FORMAT_ZLIB) {
+            VIR_WARN("%s", _("zlib dump image format is not supported, "
+                             "using raw"));
+            ret = QEMU_SAVE_FORMAT_RAW;
+            goto cleanup;
+        }
         if (!qemuCompressProgramAvailable(ret)) {
             VIR_WARN("%s", _("Compression program for dump image format "
                              "in configuration file isn't available, "
@@ -4000,6 +4225,102 @@ processDeviceDeletedEvent(virQEMUDriverPtr driver,
 }
 
 
+static void
+processStatsSampleEvent(virQEMUDriverPtr driver,
+                        virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virDomainMemoryStatStruct mem[VIR_DOMAIN_MEMORY_STAT_NR];
+    qemuDomainBlockStatsCachePtr block = NULL;
+    size_t nblock = 0;
+    qemuMonitorBlockStatsPtr blockstats = NULL;
+    const char **devs = NULL;
+    size_t ndevs = 0;
+    unsigned long long balloon = 0;
+    int nmem;
+    size_t i;
+
+    priv->stats.sampling = false;
+
+    /* Don't queue up behind whatever job is running, the domain will be
+     * sampled again in the next period */
+    if (!virDomainObjIsActive(vm) ||
+        qemuDomainObjBeginJobNowait(driver, vm, QEMU_JOB_QUERY) < 0)
+        return;
+
+    if (!virDomainObjIsActive(vm))
+        goto endjob;
+
+    if (VIR_ALLOC_N(block, vm->def->ndisks) < 0 ||
+        VIR_ALLOC_N(blockstats, vm->def->ndisks) < 0 ||
+        VIR_ALLOC_N(devs, vm->def->ndisks) < 0)
+        goto endjob;
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        if (vm->def->disks[i]->info.alias)
+            devs[ndevs++] = vm->def->disks[i]->info.alias;
+    }
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    nmem = qemuMonitorGetStatsSample(priv->mon, mem,
+                                     VIR_DOMAIN_MEMORY_STAT_NR, &balloon,
+                                     devs, blockstats, ndevs);
+    qemuDomainObjExitMonitor(driver, vm);
+
+    if (nmem < 0) {
+        virResetLastError();
+        goto endjob;
+    }
+
+    for (i = 0; i < ndevs; i++) {
+        qemuDomainBlockStatsCachePtr entry = &block[nblock];
+        qemuMonitorBlockStatsPtr stats = &blockstats[i];
+
+        /* e.g. empty CD-ROM drives have no statistics to report */
+        if (stats->rd_req < 0 ||
+            VIR_STRDUP(entry->alias, devs[i]) < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        entry->rd_req = stats->rd_req;
+        entry->rd_bytes = stats->rd_bytes;
+        entry->rd_total_times = stats->rd_total_times;
+        entry->wr_req = stats->wr_req;
+        entry->wr_bytes = stats->wr_bytes;
+        entry->wr_total_times = stats->wr_total_times;
+        entry->flush_req = stats->flush_req;
+        entry->flush_total_times = stats->flush_total_times;
+        entry->errs = stats->errs;
+        nblock++;
+    }
+
+    if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BALLOON_EVENT))
+        balloon = vm->def->mem.cur_balloon;
+
+    qemuDomainStatsCacheClear(&priv->stats);
+    memcpy(priv->stats.mem, mem, nmem * sizeof(mem[0]));
+    priv->stats.nmem = nmem;
+    priv->stats.balloon = balloon;
+    priv->stats.block = block;
+    priv->stats.nblock = nblock;
+    block = NULL;
+    nblock = 0;
+
+    if (virTimeMillisNow(&priv->stats.stamp) < 0)
+        priv->stats.stamp = 0;
+
+ endjob:
+    ignore_value(qemuDomainObjEndJob(driver, vm));
+
+    for (i = 0; i < nblock; i++)
+        VIR_FREE(block[i].alias);
+    VIR_FREE(block);
+    VIR_FREE(blockstats);
+    VIR_FREE(devs);
+}
+
+
 static void qemuProcessEventHandler(void *data, void *opaque)
 {
     struct qemuProcessEvent *processEvent = data;
@@ -4020,6 +4341,9 @@ static void qemuProcessEventHandler(void *data, void *opaque)
     case QEMU_PROCESS_EVENT_DEVICE_DELETED:
         processDeviceDeletedEvent(driver, vm, processEvent->data);
         break;
+    case QEMU_PROCESS_EVENT_STATS_SAMPLE:
+        processStatsSampleEvent(driver, vm);
+        break;
     case QEMU_PROCESS_EVENT_LAST:
         break;
     }
@@ -5420,12 +5744,44 @@ qemuDomainSaveImageStartVM(virConnectPtr conn,
     int ret = -1;
     virObjectEventPtr event;
     int intermediatefd = -1;
+    int jobfd = -1;
     virCommandPtr cmd = NULL;
+    virCompressJobPtr job = NULL;
     char *errbuf = NULL;
     virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     if ((header->version == 2) &&
-        (header->compressed != QEMU_SAVE_FORMAT_RAW)) {
+        (header->compressed == QEMU_SAVE_FORMAT_ZLIB)) {
+        int pipeFD[2];
+
+        /* Don't let a corrupt header make us allocate gigabytes */
+        if (header->chunk_size > 64 * QEMU_SAVE_ZLIB_CHUNK_SIZE) {
+            virReportError(VIR_ERR_OPERATION_FAILED,
+                           _("invalid chunk size %u in save image"),
+                           header->chunk_size);
+            goto cleanup;
+        }
+
+        if (pipe2(pipeFD, O_CLOEXEC) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("unable to create pipe"));
+            goto cleanup;
+        }
+
+        if (!(job = virCompressJobStart(*fd, pipeFD[1], true,
+                                        qemuCompressWorkers(),
+                                        header->chunk_size))) {
+            VIR_FORCE_CLOSE(pipeFD[0]);
+            VIR_FORCE_CLOSE(pipeFD[1]);
+            goto cleanup;
+        }
+
+        /* The job keeps reading the image, qemu gets the pipe */
+        intermediatefd = *fd;
+        *fd = pipeFD[0];
+        jobfd = pipeFD[1];
+    } else if ((header->version == 2) &&
+               (header->compressed != QEMU_SAVE_FORMAT_RAW)) {
         if (!(cmd = qemuCompressGetCommand(header->compressed)))
             goto cleanup;
 
@@ -5448,7 +5804,18 @@ qemuDomainSaveImageStartVM(virConnectPtr conn,
                            VIR_NETDEV_VPORT_PROFILE_OP_RESTORE,
                            VIR_QEMU_PROCESS_START_PAUSED);
 
-    if (intermediatefd != -1) {
+    if (job) {
+        /* qemu holds its own copy of the pipe now; drop ours so that
+         * the job fails rather than blocks should qemu stop reading */
+        VIR_FORCE_CLOSE(*fd);
+
+        if (virCompressJobFinish(job) < 0 && ret == 0) {
+            qemuProcessStop(driver, vm, VIR_DOMAIN_SHUTOFF_FAILED, 0);
+            ret = -1;
+        }
+        job = NULL;
+        VIR_FORCE_CLOSE(jobfd);
+    } else if (intermediatefd != -1) {
         if (ret < 0) {
             /* if there was an error setting up qemu, the intermediate
              * process will wait forever to write to stdout, so we
@@ -9621,11 +9988,14 @@ qemuDomainBlockStatsFlags(virDomainPtr dom,
     virDomainObjPtr vm;
     virDomainDiskDefPtr disk = NULL;
     qemuDomainObjPrivatePtr priv;
+    qemuDomainBlockStatsCachePtr cache = NULL;
     long long rd_req, rd_bytes, wr_req, wr_bytes, rd_total_times;
     long long wr_total_times, flush_req, flush_total_times, errs;
     virTypedParameterPtr param;
+    size_t i;
 
-    virCheckFlags(VIR_TYPED_PARAM_STRING_OKAY, -1);
+    virCheckFlags(VIR_TYPED_PARAM_STRING_OKAY |
+                  VIR_DOMAIN_STATS_CACHED, -1);
 
     if (!*path) {
         virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
@@ -9642,7 +10012,24 @@ qemuDomainBlockStatsFlags(virDomainPtr dom,
     if (virDomainBlockStatsFlagsEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    priv = vm->privateData;
+
+    if ((flags & VIR_DOMAIN_STATS_CACHED) &&
+        virDomainObjIsActive(vm) &&
+        qemuDomainStatsCacheFresh(driver, vm) &&
+        (idx = virDomainDiskIndexByName(vm->def, path, false)) >= 0 &&
+        vm->def->disks[idx]->info.alias) {
+        for (i = 0; i < priv->stats.nblock; i++) {
+            if (STREQ(priv->stats.block[i].alias,
+                      vm->def->disks[idx]->info.alias)) {
+                cache = &priv->stats.block[i];
+                break;
+            }
+        }
+    }
+
+    if (!cache &&
+        qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
         goto cleanup;
 
     if (!virDomainObjIsActive(vm)) {
@@ -9667,34 +10054,55 @@ qemuDomainBlockStatsFlags(virDomainPtr dom,
         }
     }
 
-    priv = vm->privateData;
     VIR_DEBUG("priv=%p, params=%p, flags=%x", priv, params, flags);
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    tmp = *nparams;
-    ret = qemuMonitorGetBlockStatsParamsNumber(priv->mon, nparams);
+    if (cache) {
+        rd_req = cache->rd_req;
+        rd_bytes = cache->rd_bytes;
+        rd_total_times = cache->rd_total_times;
+        wr_req = cache->wr_req;
+        wr_bytes = cache->wr_bytes;
+        wr_total_times = cache->wr_total_times;
+        flush_req = cache->flush_req;
+        flush_total_times = cache->flush_total_times;
+        errs = cache->errs;
+
+        if (*nparams == 0) {
+            /* Count what the last sample had, 'errs' excluded as below */
+            *nparams = (rd_req != -1) + (rd_bytes != -1) +
+                (rd_total_times != -1) + (wr_req != -1) +
+                (wr_bytes != -1) + (wr_total_times != -1) +
+                (flush_req != -1) + (flush_total_times != -1);
+            ret = 0;
+            goto endjob;
+        }
+    } else {
+        qemuDomainObjEnterMonitor(driver, vm);
+        tmp = *nparams;
+        ret = qemuMonitorGetBlockStatsParamsNumber(priv->mon, nparams);
 
-    if (tmp == 0 || ret < 0) {
-        qemuDomainObjExitMonitor(driver, vm);
-        goto endjob;
-    }
+        if (tmp == 0 || ret < 0) {
+            qemuDomainObjExitMonitor(driver, vm);
+            goto endjob;
+        }
 
-    ret = qemuMonitorGetBlockStatsInfo(priv->mon,
-                                       disk->info.alias,
-                                       &rd_req,
-                                       &rd_bytes,
-                                       &rd_total_times,
-                                       &wr_req,
-                                       &wr_bytes,
-                                       &wr_total_times,
-                                       &flush_req,
-                                       &flush_total_times,
-                                       &errs);
+        ret = qemuMonitorGetBlockStatsInfo(priv->mon,
+                                           disk->info.alias,
+                                           &rd_req,
+                                           &rd_bytes,
+                                           &rd_total_times,
+                                           &wr_req,
+                                           &wr_bytes,
+                                           &wr_total_times,
+                                           &flush_req,
+                                           &flush_total_times,
+                                           &errs);
 
-    qemuDomainObjExitMonitor(driver, vm);
+        qemuDomainObjExitMonitor(driver, vm);
 
-    if (ret < 0)
-        goto endjob;
+        if (ret < 0)
+            goto endjob;
+    }
 
     tmp = 0;
     ret = -1;
@@ -9773,7 +10181,7 @@ qemuDomainBlockStatsFlags(virDomainPtr dom,
     *nparams = tmp;
 
  endjob:
-    if (!qemuDomainObjEndJob(driver, vm))
+    if (!cache && !qemuDomainObjEndJob(driver, vm))
         vm = NULL;
 
  cleanup:
@@ -10139,9 +10547,11 @@ qemuDomainMemoryStats(virDomainPtr dom,
 {
     virQEMUDriverPtr driver = dom->conn->privateData;
     virDomainObjPtr vm;
+    qemuDomainObjPrivatePtr priv;
+    bool cached = false;
     int ret = -1;
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_DOMAIN_STATS_CACHED, -1);
 
     if (!(vm = qemuDomObjFromDomain(dom)))
         goto cleanup;
@@ -10149,17 +10559,29 @@ qemuDomainMemoryStats(virDomainPtr dom,
     if (virDomainMemoryStatsEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    priv = vm->privateData;
+
+    if ((flags & VIR_DOMAIN_STATS_CACHED) &&
+        virDomainObjIsActive(vm) &&
+        qemuDomainStatsCacheFresh(driver, vm))
+        cached = true;
+
+    if (!cached &&
+        qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
         goto cleanup;
 
     if (!virDomainObjIsActive(vm)) {
         virReportError(VIR_ERR_OPERATION_INVALID,
                        "%s", _("domain is not running"));
     } else {
-        qemuDomainObjPrivatePtr priv = vm->privateData;
-        qemuDomainObjEnterMonitor(driver, vm);
-        ret = qemuMonitorGetMemoryStats(priv->mon, stats, nr_stats);
-        qemuDomainObjExitMonitor(driver, vm);
+        if (cached) {
+            ret = MIN(nr_stats, priv->stats.nmem);
+            memcpy(stats, priv->stats.mem, ret * sizeof(*stats));
+        } else {
+            qemuDomainObjEnterMonitor(driver, vm);
+            ret = qemuMonitorGetMemoryStats(priv->mon, stats, nr_stats);
+            qemuDomainObjExitMonitor(driver, vm);
+        }
 
         if (ret >= 0 && ret < nr_stats) {
             long rss;
@@ -10175,7 +10597,7 @@ qemuDomainMemoryStats(virDomainPtr dom,
         }
     }
 
-    if (!qemuDomainObjEndJob(driver, vm))
+    if (!cached && !qemuDomainObjEndJob(driver, vm))
         vm = NULL;
 
  cleanup:
@@ -11557,68 +11979,486 @@ qemuConnectBaselineCPU(virConnectPtr conn ATTRIBUTE_UNUSED,
 }
 
 
-static int qemuDomainGetJobInfo(virDomainPtr dom,
-                                virDomainJobInfoPtr info)
+/* Domains saved or migrated at once by virDomainListEvacuate when the
+ * caller doesn't say */
+#define QEMU_EVACUATE_CONCURRENCY 4
+
+static virClassPtr qemuEvacuationClass;
+static void qemuEvacuationDispose(void *obj);
+
+static int
+qemuEvacuationOnceInit(void)
 {
-    virDomainObjPtr vm;
-    int ret = -1;
-    qemuDomainObjPrivatePtr priv;
+    if (!(qemuEvacuationClass = virClassNew(virClassForObjectLockable(),
+                                            "qemuEvacuation",
+                                            sizeof(qemuEvacuation),
+                                            qemuEvacuationDispose)))
+        return -1;
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        goto cleanup;
+    return 0;
+}
 
-    priv = vm->privateData;
+VIR_ONCE_GLOBAL_INIT(qemuEvacuation)
 
-    if (virDomainGetJobInfoEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+static void
+qemuEvacuationDispose(void *obj)
+{
+    qemuEvacuationPtr evac = obj;
 
-    if (virDomainObjIsActive(vm)) {
-        if (priv->job.asyncJob && !priv->job.dump_memory_only) {
-            memcpy(info, &priv->job.info, sizeof(*info));
+    VIR_FREE(evac->running);
+    virFreeError(evac->err);
+    virObjectUnref(evac->identity);
+}
 
-            /* Refresh elapsed time again just to ensure it
-             * is fully updated. This is primarily for benefit
-             * of incoming migration which we don't currently
-             * monitor actively in the background thread
-             */
-            if (virTimeMillisNow(&info->timeElapsed) < 0)
-                goto cleanup;
-            info->timeElapsed -= priv->job.start;
-        } else {
-            memset(info, 0, sizeof(*info));
-            info->type = VIR_DOMAIN_JOB_NONE;
-        }
-    } else {
-        virReportError(VIR_ERR_OPERATION_INVALID,
-                       "%s", _("domain is not running"));
-        goto cleanup;
+
+static int qemuEvacuationRunOne(qemuEvacuationPtr evac, virDomainPtr dom);
+
+qemuEvacuationPtr
+qemuEvacuationNew(virQEMUDriverPtr driver,
+                  virDomainPtr *doms,
+                  size_t ndoms)
+{
+    qemuEvacuationPtr evac;
+
+    if (qemuEvacuationInitialize() < 0 ||
+        !(evac = virObjectLockableNew(qemuEvacuationClass)))
+        return NULL;
+
+    if (VIR_ALLOC_N(evac->running, ndoms) < 0) {
+        virObjectUnref(evac);
+        return NULL;
     }
 
-    ret = 0;
+    evac->driver = driver;
+    evac->identity = virIdentityGetCurrent();
+    evac->doms = doms;
+    evac->ndoms = ndoms;
+    evac->run = qemuEvacuationRunOne;
+    evac->concurrency = QEMU_EVACUATE_CONCURRENCY;
 
- cleanup:
-    if (vm)
-        virObjectUnlock(vm);
-    return ret;
+    return evac;
 }
 
 
+/* Attach @evac to the domain behind @dom, checking it can be evacuated
+ * at all so that obvious mistakes are caught before anything starts */
 static int
-qemuDomainGetJobStats(virDomainPtr dom,
-                      int *type,
-                      virTypedParameterPtr *params,
-                      int *nparams,
-                      unsigned int flags)
+qemuEvacuationAttach(qemuEvacuationPtr evac,
+                     virDomainPtr dom)
 {
     virDomainObjPtr vm;
     qemuDomainObjPrivatePtr priv;
-    virTypedParameterPtr par = NULL;
-    int maxpar = 0;
-    int npar = 0;
     int ret = -1;
 
-    virCheckFlags(0, -1);
-
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        return -1;
+
+    priv = vm->privateData;
+
+    if (virDomainListEvacuateEnsureACL(dom->conn, vm->def, evac->flags) < 0)
+        goto cleanup;
+
+    if (!virDomainObjIsActive(vm)) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("domain '%s' is not running"), vm->def->name);
+        goto cleanup;
+    }
+
+    if (!(evac->flags & VIR_DOMAIN_EVACUATE_MIGRATE) && !vm->persistent) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("cannot do managed save for transient domain '%s'"),
+                       vm->def->name);
+        goto cleanup;
+    }
+
+    if (priv->evac) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("domain '%s' is already being evacuated"),
+                       vm->def->name);
+        goto cleanup;
+    }
+
+    priv->evac = virObjectRef(evac);
+    priv->evacBandwidth = 0;
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(vm);
+    return ret;
+}
+
+
+static void
+qemuEvacuationDetach(qemuEvacuationPtr evac,
+                     virDomainPtr dom)
+{
+    virDomainObjPtr vm;
+    qemuDomainObjPrivatePtr priv;
+
+    /* The domain may be long gone, that's not an error */
+    if (!(vm = virDomainObjListFindByUUID(evac->driver->domains, dom->uuid)))
+        return;
+
+    priv = vm->privateData;
+    if (priv->evac == evac) {
+        priv->evac = NULL;
+        priv->evacBandwidth = 0;
+        virObjectUnref(evac);
+    }
+    virObjectUnlock(vm);
+}
+
+
+/* Split the bandwidth cap evenly between the domains in flight. The
+ * jobs themselves pick the new value up from their private data. */
+void
+qemuEvacuationRebalance(qemuEvacuationPtr evac)
+{
+    unsigned long long share;
+    virDomainPtr *doms = NULL;
+    size_t ndoms = 0;
+    size_t i;
+
+    if (!evac->bandwidth)
+        return;
+
+    virObjectLock(evac);
+    share = evac->bandwidth / MAX(evac->active, 1);
+    if (VIR_ALLOC_N_QUIET(doms, evac->active) == 0) {
+        for (i = 0; i < evac->ndoms; i++) {
+            if (evac->running[i])
+                doms[ndoms++] = evac->doms[i];
+        }
+    }
+    virObjectUnlock(evac);
+
+    VIR_DEBUG("Evacuation %p: %zu domains in flight, %llu MiB/s each",
+              evac, ndoms, share);
+
+    /* Domain locks can't be taken with the evacuation locked */
+    for (i = 0; i < ndoms; i++) {
+        virDomainObjPtr vm;
+        qemuDomainObjPrivatePtr priv;
+
+        if (!(vm = virDomainObjListFindByUUID(evac->driver->domains,
+                                              doms[i]->uuid)))
+            continue;
+
+        priv = vm->privateData;
+        if (priv->evac == evac)
+            priv->evacBandwidth = MAX(share, 1);
+        virObjectUnlock(vm);
+    }
+
+    VIR_FREE(doms);
+}
+
+
+static int
+qemuEvacuationRunOne(qemuEvacuationPtr evac,
+                     virDomainPtr dom)
+{
+    unsigned int migflags = VIR_MIGRATE_LIVE | VIR_MIGRATE_PEER2PEER;
+    virDomainObjPtr vm;
+
+    if (!(evac->flags & VIR_DOMAIN_EVACUATE_MIGRATE)) {
+        unsigned int saveflags = 0;
+
+        if (evac->flags & VIR_DOMAIN_EVACUATE_BYPASS_CACHE)
+            saveflags |= VIR_DOMAIN_SAVE_BYPASS_CACHE;
+
+        return qemuDomainManagedSave(dom, saveflags);
+    }
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        return -1;
+    if (vm->persistent)
+        migflags |= VIR_MIGRATE_PERSIST_DEST | VIR_MIGRATE_UNDEFINE_SOURCE;
+    virObjectUnlock(vm);
+
+    return qemuDomainMigratePerform3Params(dom, evac->uri, NULL, 0,
+                                           NULL, 0, NULL, NULL, migflags);
+}
+
+
+void
+qemuEvacuationWorker(void *opaque)
+{
+    qemuEvacuationPtr evac = opaque;
+
+    /* Leave the domains to the other workers */
+    if (virIdentitySetCurrent(evac->identity) < 0) {
+        virObjectLock(evac);
+        if (!evac->err)
+            evac->err = virSaveLastError();
+        virObjectUnlock(evac);
+        return;
+    }
+
+    for (;;) {
+        size_t i;
+        int rc;
+
+        virObjectLock(evac);
+        if (evac->next == evac->ndoms) {
+            virObjectUnlock(evac);
+            break;
+        }
+        i = evac->next++;
+        evac->running[i] = true;
+        evac->active++;
+        virObjectUnlock(evac);
+
+        qemuEvacuationRebalance(evac);
+
+        VIR_DEBUG("Evacuating domain %s", evac->doms[i]->name);
+        rc = evac->run(evac, evac->doms[i]);
+
+        virObjectLock(evac);
+        evac->running[i] = false;
+        evac->active--;
+        if (rc < 0) {
+            VIR_WARN("Failed to evacuate domain %s: %s",
+                     evac->doms[i]->name, virGetLastErrorMessage());
+            evac->failed++;
+            if (!evac->err)
+                evac->err = virSaveLastError();
+            virResetLastError();
+        } else {
+            evac->completed++;
+        }
+        virObjectUnlock(evac);
+
+        qemuEvacuationDetach(evac, evac->doms[i]);
+        qemuEvacuationRebalance(evac);
+    }
+
+    ignore_value(virIdentitySetCurrent(NULL));
+}
+
+
+static int
+qemuDomainListEvacuate(virDomainPtr *doms,
+                       unsigned int ndoms,
+                       virTypedParameterPtr params,
+                       int nparams,
+                       unsigned int flags)
+{
+    virQEMUDriverPtr driver = doms[0]->conn->privateData;
+    qemuEvacuationPtr evac = NULL;
+    virThreadPtr workers = NULL;
+    size_t nworkers = 0;
+    size_t nattached = 0;
+    size_t i;
+    int ret = -1;
+
+    virCheckFlags(VIR_DOMAIN_EVACUATE_MIGRATE |
+                  VIR_DOMAIN_EVACUATE_BYPASS_CACHE, -1);
+
+    if (virTypedParamsValidate(params, nparams,
+                               VIR_DOMAIN_EVACUATE_PARAM_CONCURRENCY,
+                               VIR_TYPED_PARAM_UINT,
+                               VIR_DOMAIN_EVACUATE_PARAM_BANDWIDTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_EVACUATE_PARAM_URI,
+                               VIR_TYPED_PARAM_STRING,
+                               NULL) < 0)
+        return -1;
+
+    if (!(evac = qemuEvacuationNew(driver, doms, ndoms)))
+        return -1;
+
+    evac->flags = flags;
+
+    if (virTypedParamsGetUInt(params, nparams,
+                              VIR_DOMAIN_EVACUATE_PARAM_CONCURRENCY,
+                              &evac->concurrency) < 0 ||
+        virTypedParamsGetULLong(params, nparams,
+                                VIR_DOMAIN_EVACUATE_PARAM_BANDWIDTH,
+                                &evac->bandwidth) < 0 ||
+        virTypedParamsGetString(params, nparams,
+                                VIR_DOMAIN_EVACUATE_PARAM_URI,
+                                &evac->uri) < 0)
+        goto cleanup;
+
+    if (evac->concurrency == 0) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("evacuation concurrency must be at least 1"));
+        goto cleanup;
+    }
+
+    if (evac->bandwidth > QEMU_DOMAIN_MIG_BANDWIDTH_MAX) {
+        virReportError(VIR_ERR_OVERFLOW,
+                       _("bandwidth must be less than %llu"),
+                       QEMU_DOMAIN_MIG_BANDWIDTH_MAX + 1ULL);
+        goto cleanup;
+    }
+
+    if (!!(flags & VIR_DOMAIN_EVACUATE_MIGRATE) != !!evac->uri) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       (flags & VIR_DOMAIN_EVACUATE_MIGRATE) ?
+                       _("migrating domains requires a destination URI") :
+                       _("destination URI is only valid when migrating"));
+        goto cleanup;
+    }
+
+    if (flags & VIR_DOMAIN_EVACUATE_MIGRATE &&
+        flags & VIR_DOMAIN_EVACUATE_BYPASS_CACHE) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("bypassing the cache is only valid when saving"));
+        goto cleanup;
+    }
+
+    for (nattached = 0; nattached < ndoms; nattached++) {
+        if (qemuEvacuationAttach(evac, doms[nattached]) < 0)
+            goto cleanup;
+    }
+
+    nworkers = MIN(evac->concurrency, ndoms);
+    if (VIR_ALLOC_N(workers, nworkers) < 0)
+        goto cleanup;
+
+    VIR_DEBUG("Evacuating %u domains, %zu at a time, bandwidth %llu MiB/s",
+              ndoms, nworkers, evac->bandwidth);
+
+    for (i = 0; i < nworkers; i++) {
+        if (virThreadCreate(&workers[i], true,
+                            qemuEvacuationWorker, evac) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create evacuation thread"));
+            break;
+        }
+    }
+
+    /* Whatever workers did start still go through every domain */
+    if (i == 0)
+        goto cleanup;
+    nworkers = i;
+    virResetLastError();
+
+    for (i = 0; i < nworkers; i++)
+        virThreadJoin(&workers[i]);
+
+    if (evac->err) {
+        virSetError(evac->err);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < nattached; i++)
+        qemuEvacuationDetach(evac, doms[i]);
+    VIR_FREE(workers);
+    virObjectUnref(evac);
+    return ret;
+}
+
+
+/* Add the progress of the evacuation @vm is part of to its job stats */
+static int
+qemuEvacuationGetStats(virDomainObjPtr vm,
+                       virTypedParameterPtr *params,
+                       int *nparams,
+                       int *maxparams)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuEvacuationPtr evac = priv->evac;
+    int ret = -1;
+
+    if (!evac)
+        return 0;
+
+    virObjectLock(evac);
+    if (virTypedParamsAddUInt(params, nparams, maxparams,
+                              VIR_DOMAIN_JOB_EVACUATE_TOTAL,
+                              evac->ndoms) < 0 ||
+        virTypedParamsAddUInt(params, nparams, maxparams,
+                              VIR_DOMAIN_JOB_EVACUATE_COMPLETED,
+                              evac->completed) < 0 ||
+        virTypedParamsAddUInt(params, nparams, maxparams,
+                              VIR_DOMAIN_JOB_EVACUATE_FAILED,
+                              evac->failed) < 0 ||
+        virTypedParamsAddUInt(params, nparams, maxparams,
+                              VIR_DOMAIN_JOB_EVACUATE_ACTIVE,
+                              evac->active) < 0)
+        goto cleanup;
+
+    if (priv->evacBandwidth &&
+        virTypedParamsAddULLong(params, nparams, maxparams,
+                                VIR_DOMAIN_JOB_EVACUATE_BANDWIDTH,
+                                priv->evacBandwidth) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virObjectUnlock(evac);
+    return ret;
+}
+
+
+static int qemuDomainGetJobInfo(virDomainPtr dom,
+                                virDomainJobInfoPtr info)
+{
+    virDomainObjPtr vm;
+    int ret = -1;
+    qemuDomainObjPrivatePtr priv;
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        goto cleanup;
+
+    priv = vm->privateData;
+
+    if (virDomainGetJobInfoEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (virDomainObjIsActive(vm)) {
+        if (priv->job.asyncJob && !priv->job.dump_memory_only) {
+            memcpy(info, &priv->job.info, sizeof(*info));
+
+            /* Refresh elapsed time again just to ensure it
+             * is fully updated. This is primarily for benefit
+             * of incoming migration which we don't currently
+             * monitor actively in the background thread
+             */
+            if (virTimeMillisNow(&info->timeElapsed) < 0)
+                goto cleanup;
+            info->timeElapsed -= priv->job.start;
+        } else {
+            memset(info, 0, sizeof(*info));
+            info->type = VIR_DOMAIN_JOB_NONE;
+        }
+    } else {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       "%s", _("domain is not running"));
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (vm)
+        virObjectUnlock(vm);
+    return ret;
+}
+
+
+static int
+qemuDomainGetJobStats(virDomainPtr dom,
+                      int *type,
+                      virTypedParameterPtr *params,
+                      int *nparams,
+                      unsigned int flags)
+{
+    virDomainObjPtr vm;
+    qemuDomainObjPrivatePtr priv;
+    virTypedParameterPtr par = NULL;
+    int maxpar = 0;
+    int npar = 0;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
     if (!(vm = qemuDomObjFromDomain(dom)))
         goto cleanup;
 
@@ -11634,9 +12474,13 @@ qemuDomainGetJobStats(virDomainPtr dom,
     }
 
     if (!priv->job.asyncJob || priv->job.dump_memory_only) {
+        /* Domains waiting for their turn in an evacuation still
+         * report how far the evacuation as a whole got */
+        if (qemuEvacuationGetStats(vm, &par, &npar, &maxpar) < 0)
+            goto cleanup;
         *type = VIR_DOMAIN_JOB_NONE;
-        *params = NULL;
-        *nparams = 0;
+        *params = par;
+        *nparams = npar;
         ret = 0;
         goto cleanup;
     }
@@ -11732,6 +12576,31 @@ qemuDomainGetJobStats(virDomainPtr dom,
             goto cleanup;
     }
 
+    if (priv->job.tune.enabled) {
+        if (virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                    VIR_DOMAIN_JOB_AUTO_TUNE_TRANSFER_RATE,
+                                    priv->job.tune.rate) < 0 ||
+            virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                    VIR_DOMAIN_JOB_AUTO_TUNE_DIRTY_RATE,
+                                    priv->job.tune.dirtyRate) < 0 ||
+            virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                    VIR_DOMAIN_JOB_AUTO_TUNE_DOWNTIME,
+                                    priv->job.tune.downtime) < 0 ||
+            virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                    VIR_DOMAIN_JOB_AUTO_TUNE_BANDWIDTH,
+                                    priv->job.tune.bandwidth) < 0 ||
+            virTypedParamsAddUInt(&par, &npar, &maxpar,
+                                  VIR_DOMAIN_JOB_AUTO_TUNE_ADJUSTMENTS,
+                                  priv->job.tune.adjustments) < 0 ||
+            virTypedParamsAddString(&par, &npar, &maxpar,
+                                    VIR_DOMAIN_JOB_AUTO_TUNE_LAST_ACTION,
+                                    priv->job.tune.lastAction) < 0)
+            goto cleanup;
+    }
+
+    if (qemuEvacuationGetStats(vm, &par, &npar, &maxpar) < 0)
+        goto cleanup;
+
     *type = priv->job.info.type;
     *params = par;
     *nparams = npar;
@@ -11838,6 +12707,10 @@ qemuDomainMigrateSetMaxDowntime(virDomainPtr dom,
     ret = qemuMonitorSetMigrationDowntime(priv->mon, downtime);
     qemuDomainObjExitMonitor(driver, vm);
 
+    /* auto-tuning carries on from the new value */
+    if (ret == 0)
+        priv->job.tune.downtime = downtime;
+
  endjob:
     if (!qemuDomainObjEndJob(driver, vm))
         vm = NULL;
@@ -12001,8 +12874,10 @@ qemuDomainMigrateSetMaxSpeed(virDomainPtr dom,
         ret = qemuMonitorSetMigrationSpeed(priv->mon, bandwidth);
         qemuDomainObjExitMonitor(driver, vm);
 
-        if (ret == 0)
+        if (ret == 0) {
             priv->migMaxBandwidth = bandwidth;
+            priv->job.tune.bandwidth = bandwidth;
+        }
 
  endjob:
         if (!qemuDomainObjEndJob(driver, vm))
@@ -15032,6 +15907,11 @@ qemuDomainBlockJobImpl(virDomainObjPtr vm,
     virDomainDiskDefPtr disk;
     virStorageSourcePtr baseSource = NULL;
     unsigned int baseIndex = 0;
+    qemuDomainBlockJobPtr job = NULL;
+    int oldStatus = -1;
+    bool waitAbort = false;
+    unsigned int waitId = 0;
+    char *dst = NULL;
 
     if (!virDomainObjIsActive(vm)) {
         virReportError(VIR_ERR_OPERATION_INVALID, "%s",
@@ -15099,19 +15979,47 @@ qemuDomainBlockJobImpl(virDomainObjPtr vm,
                                                   base, baseIndex, NULL))))
         goto endjob;
 
+    /* The job may be over by the time the command returns, so the
+     * tracking has to be in place before it's issued.  */
+    if (mode == BLOCK_JOB_PULL &&
+        !(job = qemuDomainBlockJobStart(priv, disk->dst,
+                                        VIR_DOMAIN_BLOCK_JOB_TYPE_PULL)))
+        goto endjob;
+    if (mode == BLOCK_JOB_ABORT && async) {
+        if (!(job = qemuDomainBlockJobAdd(priv, disk->dst)))
+            goto endjob;
+        oldStatus = job->status;
+        qemuDomainBlockJobSetStatus(priv, job, -1);
+        waitId = job->id;
+    }
+
     qemuDomainObjEnterMonitor(driver, vm);
     ret = qemuMonitorBlockJob(priv->mon, device,
                               baseIndex ? baseSource->path : base,
                               bandwidth, info, mode, async);
     qemuDomainObjExitMonitor(driver, vm);
-    if (ret < 0)
+    if (ret < 0) {
+        /* Undo the tracking; the domain was unlocked in the monitor, so
+         * the job has to be looked up again.  */
+        if (mode == BLOCK_JOB_PULL)
+            qemuDomainBlockJobRemove(priv, disk->dst);
+        else if (mode == BLOCK_JOB_ABORT && async &&
+                 (job = qemuDomainBlockJobFind(priv, disk->dst)) &&
+                 job->id == waitId && job->status == -1)
+            qemuDomainBlockJobSetStatus(priv, job, oldStatus);
         goto endjob;
+    }
+
+    if (mode == BLOCK_JOB_INFO) {
+        /* Snoop block copy operations, so future cancel operations can
+         * avoid checking if pivot is safe.  */
+        if (ret == 1 && disk->mirror && info->cur == info->end &&
+            info->type == VIR_DOMAIN_BLOCK_JOB_TYPE_COPY)
+            disk->mirroring = true;
 
-    /* Snoop block copy operations, so future cancel operations can
-     * avoid checking if pivot is safe.  */
-    if (mode == BLOCK_JOB_INFO && ret == 1 && disk->mirror &&
-        info->cur == info->end && info->type == VIR_DOMAIN_BLOCK_JOB_TYPE_COPY)
-        disk->mirroring = true;
+        if (ret == 1 && (job = qemuDomainBlockJobAdd(priv, disk->dst)))
+            qemuDomainBlockJobUpdate(job, info);
+    }
 
     /* A successful block job cancelation stops any mirroring.  */
     if (mode == BLOCK_JOB_ABORT && disk->mirror) {
@@ -15140,33 +16048,15 @@ qemuDomainBlockJobImpl(virDomainObjPtr vm,
             event2 = virDomainEventBlockJob2NewFromObj(vm, disk->dst, type,
                                                        status);
         } else if (!(flags & VIR_DOMAIN_BLOCK_JOB_ABORT_ASYNC)) {
-            while (1) {
-                /* Poll every 50ms */
-                static struct timespec ts = { .tv_sec = 0,
-                                              .tv_nsec = 50 * 1000 * 1000ull };
-                virDomainBlockJobInfo dummy;
-
-                qemuDomainObjEnterMonitor(driver, vm);
-                ret = qemuMonitorBlockJob(priv->mon, device, NULL, 0, &dummy,
-                                          BLOCK_JOB_INFO, async);
-                qemuDomainObjExitMonitor(driver, vm);
-
-                if (ret <= 0)
-                    break;
-
-                virObjectUnlock(vm);
-
-                nanosleep(&ts, NULL);
-
-                virObjectLock(vm);
-
-                if (!virDomainObjIsActive(vm)) {
-                    virReportError(VIR_ERR_OPERATION_INVALID, "%s",
-                                   _("domain is not running"));
-                    ret = -1;
-                    break;
-                }
+            /* QEMU tells us by an event once the job is gone; wait for
+             * it after ending our job so that queries on the domain
+             * don't stall behind a slow cancellation.  */
+            if (VIR_STRDUP(dst, disk->dst) < 0) {
+                ret = -1;
+                goto endjob;
             }
+            waitAbort = true;
+            virObjectRef(vm);
         }
     }
 
@@ -15176,10 +16066,16 @@ qemuDomainBlockJobImpl(virDomainObjPtr vm,
         goto cleanup;
     }
 
+    if (waitAbort && qemuDomainBlockJobWait(driver, vm, dst, waitId) < 0)
+        ret = -1;
+
  cleanup:
     VIR_FREE(device);
+    VIR_FREE(dst);
     if (vm)
         virObjectUnlock(vm);
+    if (waitAbort)
+        virObjectUnref(vm);
     if (event)
         qemuDomainEventQueue(driver, event);
     if (event2)
@@ -15226,6 +16122,149 @@ qemuDomainGetBlockJobInfo(virDomainPtr dom, const char *path,
                                   flags);
 }
 
+static int
+qemuDomainGetBlockJobStats(virDomainPtr dom,
+                           const char *path,
+                           virTypedParameterPtr *params,
+                           int *nparams,
+                           unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    qemuDomainObjPrivatePtr priv;
+    qemuDomainBlockJobPtr job;
+    virDomainBlockJobInfo info;
+    virTypedParameterPtr par = NULL;
+    int maxpar = 0;
+    int npar = 0;
+    char *device = NULL;
+    char *dst = NULL;
+    unsigned long long now;
+    unsigned long long eta;
+    int idx;
+    int rc;
+    int ret = -1;
+
+    virCheckFlags(VIR_DOMAIN_BLOCK_JOB_STATS_WAIT, -1);
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainGetBlockJobStatsEnsureACL(dom->conn, vm->def) < 0) {
+        virObjectUnlock(vm);
+        return -1;
+    }
+
+    /* Waiting happens without a job, keep the domain around meanwhile */
+    virObjectRef(vm);
+    priv = vm->privateData;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+        goto cleanup;
+
+    if (!virDomainObjIsActive(vm)) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("domain is not running"));
+        goto endjob;
+    }
+
+    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKJOB_ASYNC)) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("block job statistics not supported with this "
+                         "QEMU binary"));
+        goto endjob;
+    }
+
+    if (!(device = qemuDiskPathToAlias(vm, path, &idx)) ||
+        VIR_STRDUP(dst, vm->def->disks[idx]->dst) < 0)
+        goto endjob;
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    rc = qemuMonitorBlockJob(priv->mon, device, NULL, 0, &info,
+                             BLOCK_JOB_INFO, true);
+    qemuDomainObjExitMonitor(driver, vm);
+    if (rc < 0)
+        goto endjob;
+
+    job = qemuDomainBlockJobFind(priv, dst);
+    if (rc == 1) {
+        if (!job && !(job = qemuDomainBlockJobAdd(priv, dst)))
+            goto endjob;
+        qemuDomainBlockJobUpdate(job, &info);
+    } else if (job && job->status == -1) {
+        /* The job is gone and we missed how it ended */
+        qemuDomainBlockJobRemove(priv, dst);
+    }
+
+    ret = 0;
+
+ endjob:
+    if (!qemuDomainObjEndJob(driver, vm))
+        goto cleanup;
+    if (ret < 0)
+        goto cleanup;
+    ret = -1;
+
+    if ((flags & VIR_DOMAIN_BLOCK_JOB_STATS_WAIT) &&
+        (job = qemuDomainBlockJobFind(priv, dst)) &&
+        qemuDomainBlockJobWait(driver, vm, dst, job->id) < 0)
+        goto cleanup;
+
+    if (!(job = qemuDomainBlockJobFind(priv, dst))) {
+        *params = NULL;
+        *nparams = 0;
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddInt(&par, &npar, &maxpar,
+                             VIR_DOMAIN_BLOCK_JOB_STATS_TYPE,
+                             job->type) < 0 ||
+        (job->status != -1 &&
+         virTypedParamsAddInt(&par, &npar, &maxpar,
+                              VIR_DOMAIN_BLOCK_JOB_STATS_STATUS,
+                              job->status) < 0) ||
+        virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                VIR_DOMAIN_BLOCK_JOB_STATS_CUR,
+                                job->cur) < 0 ||
+        virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                VIR_DOMAIN_BLOCK_JOB_STATS_END,
+                                job->end) < 0 ||
+        virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                VIR_DOMAIN_BLOCK_JOB_STATS_BANDWIDTH,
+                                job->bandwidth) < 0 ||
+        virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                VIR_DOMAIN_BLOCK_JOB_STATS_ELAPSED,
+                                job->started && now > job->started ?
+                                now - job->started : 0) < 0)
+        goto cleanup;
+
+    if (qemuDomainBlockJobGetETA(job, &eta) &&
+        (virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                 VIR_DOMAIN_BLOCK_JOB_STATS_RATE,
+                                 job->rate) < 0 ||
+         virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                 VIR_DOMAIN_BLOCK_JOB_STATS_ETA,
+                                 eta) < 0))
+        goto cleanup;
+
+    *params = par;
+    *nparams = npar;
+    par = NULL;
+    ret = 1;
+
+ cleanup:
+    virTypedParamsFree(par, npar);
+    VIR_FREE(device);
+    VIR_FREE(dst);
+    virObjectUnlock(vm);
+    virObjectUnref(vm);
+    return ret;
+}
+
 static int
 qemuDomainBlockJobSetSpeed(virDomainPtr dom, const char *path,
                            unsigned long bandwidth, unsigned int flags)
@@ -15381,6 +16420,13 @@ qemuDomainBlockCopy(virDomainObjPtr vm,
         goto endjob;
     }
 
+    if (!qemuDomainBlockJobStart(priv, disk->dst,
+                                 VIR_DOMAIN_BLOCK_JOB_TYPE_COPY)) {
+        qemuDomainPrepareDiskChainElementPath(driver, vm, disk, dest,
+                                              VIR_DISK_CHAIN_NO_ACCESS);
+        goto endjob;
+    }
+
     /* Actually start the mirroring */
     qemuDomainObjEnterMonitor(driver, vm);
     ret = qemuMonitorDriveMirror(priv->mon, device, dest, format, bandwidth,
@@ -15388,6 +16434,7 @@ qemuDomainBlockCopy(virDomainObjPtr vm,
     virDomainAuditDisk(vm, NULL, dest, "mirror", ret >= 0);
     qemuDomainObjExitMonitor(driver, vm);
     if (ret < 0) {
+        qemuDomainBlockJobRemove(priv, disk->dst);
         qemuDomainPrepareDiskChainElementPath(driver, vm, disk, dest,
                                               VIR_DISK_CHAIN_NO_ACCESS);
         goto endjob;
@@ -15602,6 +16649,12 @@ qemuDomainBlockCommit(virDomainPtr dom,
                                                VIR_DISK_CHAIN_READ_WRITE) < 0))
         goto endjob;
 
+    if (!qemuDomainBlockJobStart(priv, disk->dst,
+                                 (flags & VIR_DOMAIN_BLOCK_COMMIT_ACTIVE) ?
+                                 VIR_DOMAIN_BLOCK_JOB_TYPE_ACTIVE_COMMIT :
+                                 VIR_DOMAIN_BLOCK_JOB_TYPE_COMMIT))
+        goto endjob;
+
     /* Start the commit operation.  Pass the user's original spelling,
      * if any, through to qemu, since qemu may behave differently
      * depending on whether the input was specified as relative or
@@ -15613,6 +16666,8 @@ qemuDomainBlockCommit(virDomainPtr dom,
                                  base && !baseIndex ? base : baseSource->path,
                                  bandwidth);
     qemuDomainObjExitMonitor(driver, vm);
+    if (ret < 0)
+        qemuDomainBlockJobRemove(priv, disk->dst);
 
  endjob:
     if (ret < 0 && clean_access) {
@@ -16384,6 +17439,26 @@ qemuConnectListAllDomains(virConnectPtr conn,
     return ret;
 }
 
+static int
+qemuConnectListDomainsPage(virConnectPtr conn,
+                           const char *after,
+                           unsigned int maxdomains,
+                           virDomainPtr **domains,
+                           unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+
+    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ALL, -1);
+
+    if (virConnectListDomainsPageEnsureACL(conn) < 0)
+        return -1;
+
+    return virDomainObjListExportPage(driver->domains, conn, after,
+                                      maxdomains, domains,
+                                      virConnectListDomainsPageCheckACL,
+                                      flags);
+}
+
 static char *
 qemuDomainQemuAgentCommand(virDomainPtr domain,
                            const char *cmd,
@@ -17092,6 +18167,9 @@ static virDriver qemuDriver = {
     .domainGetTime = qemuDomainGetTime, /* 1.2.5 */
     .domainSetTime = qemuDomainSetTime, /* 1.2.5 */
     .nodeGetFreePages = qemuNodeGetFreePages, /* 1.2.6 */
+    .domainListEvacuate = qemuDomainListEvacuate, /* 1.2.7 */
+    .domainGetBlockJobStats = qemuDomainGetBlockJobStats, /* 1.2.7 */
+    .connectListDomainsPage = qemuConnectListDomainsPage, /* 1.2.7 */
 };
 
 
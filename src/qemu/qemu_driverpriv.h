@@ -0,0 +1,73 @@
+/*
+ * qemu_driverpriv.h: private declarations for the QEMU driver
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __QEMU_DRIVERPRIV_H__
+# define __QEMU_DRIVERPRIV_H__
+
+# include "qemu_conf.h"
+# include "qemu_domain.h"
+# include "viridentity.h"
+
+/*
+ * This header file should never be used outside unit tests.
+ */
+
+/* Saves or migrates one domain of an evacuation */
+typedef int (*qemuEvacuationRunFunc)(qemuEvacuationPtr evac,
+                                     virDomainPtr dom);
+
+/* A virDomainListEvacuate call in progress. Every domain it covers
+ * holds a reference in its private data so that virDomainGetJobStats
+ * can report the progress of the whole evacuation. Lock ordering is
+ * domain object first, evacuation second. */
+struct _qemuEvacuation {
+    virObjectLockable parent;
+
+    virQEMUDriverPtr driver;
+    virDomainPtr *doms;
+    bool *running;          /* which of @doms are in flight */
+    size_t ndoms;
+    size_t next;            /* first domain not picked by a worker yet */
+    qemuEvacuationRunFunc run;
+
+    size_t active;
+    size_t completed;
+    size_t failed;
+    virErrorPtr err;        /* first failure */
+
+    unsigned int concurrency;
+    unsigned long long bandwidth; /* aggregate cap in MiB/s, 0 for none */
+    const char *uri;
+    unsigned int flags;
+
+    /* The caller's, so that access checks in the workers see it */
+    virIdentityPtr identity;
+};
+
+qemuEvacuationPtr qemuEvacuationNew(virQEMUDriverPtr driver,
+                                    virDomainPtr *doms,
+                                    size_t ndoms);
+
+void qemuEvacuationRebalance(qemuEvacuationPtr evac);
+
+void qemuEvacuationWorker(void *opaque);
+
+#endif /* __QEMU_DRIVERPRIV_H__ */
@@ -32,6 +32,7 @@
 #include <poll.h>
 
 #include "qemu_migration.h"
+#include "qemu_migrationpriv.h"
 #include "qemu_monitor.h"
 #include "qemu_domain.h"
 #include "qemu_process.h"
@@ -51,6 +52,7 @@
 #include "virtime.h"
 #include "locking/domain_lock.h"
 #include "rpc/virnetsocket.h"
+#include "rpc/virnetprotocol.h"
 #include "virstoragefile.h"
 #include "viruri.h"
 #include "virhook.h"
@@ -1622,10 +1624,13 @@ qemuMigrationSetCompression(virQEMUDriverPtr driver,
     return ret;
 }
 
+/* With @required false, a QEMU binary lacking auto-converge is not
+ * an error, migration just goes on without it */
 static int
 qemuMigrationSetAutoConverge(virQEMUDriverPtr driver,
                              virDomainObjPtr vm,
-                             qemuDomainAsyncJob job)
+                             qemuDomainAsyncJob job,
+                             bool required)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
     int ret;
@@ -1640,6 +1645,10 @@ qemuMigrationSetAutoConverge(virQEMUDriverPtr driver,
     if (ret < 0) {
         goto cleanup;
     } else if (ret == 0) {
+        if (!required) {
+            VIR_DEBUG("Auto-Converge is not supported by QEMU binary");
+            goto cleanup;
+        }
         virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
                        _("Auto-Converge is not supported by "
                          "QEMU binary"));
@@ -1783,6 +1792,211 @@ qemuMigrationUpdateJobStatus(virQEMUDriverPtr driver,
 }
 
 
+/* QEMU's own limit on the downtime at the end of migration, in ms */
+#define QEMU_MIGRATION_DEFAULT_DOWNTIME 30
+
+/* How often (ms) the auto-tuning controller recomputes the rates and how
+ * many samples in a row must show no progress before it changes anything */
+#define QEMU_MIGRATION_AUTO_TUNE_INTERVAL 1000
+#define QEMU_MIGRATION_AUTO_TUNE_STALLS 3
+
+/* Bounds (ms) on how long the wait loop sleeps between status checks when
+ * polling, and how long it waits when QEMU sends MIGRATION events */
+#define QEMU_MIGRATION_POLL_MIN 50
+#define QEMU_MIGRATION_POLL_MAX 500
+#define QEMU_MIGRATION_EVENT_INTERVAL 1000
+
+int
+qemuMigrationAutoTuneStart(virQEMUDriverPtr driver,
+                           virDomainObjPtr vm,
+                           unsigned long flags,
+                           unsigned long bandwidth)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    qemuDomainJobTune *tune = &priv->job.tune;
+    int ret = -1;
+
+    if (cfg->migrationAutoTuneAutoConverge &&
+        !(flags & VIR_MIGRATE_AUTO_CONVERGE) &&
+        qemuMigrationSetAutoConverge(driver, vm,
+                                     QEMU_ASYNC_JOB_MIGRATION_OUT,
+                                     false) < 0)
+        goto cleanup;
+
+    memset(tune, 0, sizeof(*tune));
+    tune->enabled = true;
+    tune->maxDowntime = cfg->migrationAutoTuneMaxDowntime;
+    tune->maxBandwidth = MIN(cfg->migrationAutoTuneMaxBandwidth,
+                             QEMU_DOMAIN_MIG_BANDWIDTH_MAX);
+    tune->downtime = QEMU_MIGRATION_DEFAULT_DOWNTIME;
+    tune->bandwidth = bandwidth;
+    tune->lastAction = "none";
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(cfg);
+    return ret;
+}
+
+
+/* Called from the migration wait loop after each status update. Every
+ * second the transfer rate and the rate at which the guest dirties memory
+ * again are estimated from the RAM counters. When the remaining memory
+ * stops shrinking and can't be sent within the allowed downtime, one limit
+ * is raised a step: bandwidth first, then downtime, then XBZRLE cache. */
+void
+qemuMigrationAutoTune(virQEMUDriverPtr driver,
+                      virDomainObjPtr vm,
+                      qemuDomainAsyncJob asyncJob)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainJobTune *tune = &priv->job.tune;
+    qemuMonitorMigrationStatusPtr status = &priv->job.status;
+    unsigned long long now;
+    unsigned long long elapsed;
+    unsigned long long sent;
+    unsigned long long needed;
+    unsigned long long cacheLimit;
+    unsigned long long value = 0;
+    const char *action;
+    int rc = -1;
+
+    if (status->status != QEMU_MONITOR_MIGRATION_STATUS_ACTIVE ||
+        virTimeMillisNow(&now) < 0)
+        return;
+
+    if (tune->sampled && now - tune->sampled < QEMU_MIGRATION_AUTO_TUNE_INTERVAL)
+        return;
+
+    if (!tune->sampled || status->ram_transferred < tune->transferred)
+        goto sample;
+
+    elapsed = now - tune->sampled;
+    sent = status->ram_transferred - tune->transferred;
+    tune->rate = sent * 1000 / elapsed;
+    /* Had the guest not touched any memory, what's left would have
+     * dropped by exactly what was sent */
+    if (status->ram_remaining + sent > tune->remaining)
+        tune->dirtyRate = (status->ram_remaining + sent - tune->remaining) *
+            1000 / elapsed;
+    else
+        tune->dirtyRate = 0;
+
+    needed = tune->rate ? status->ram_remaining * 1000 / tune->rate : 0;
+
+    if (!tune->rate ||
+        tune->dirtyRate < tune->rate / 10 * 9 ||
+        needed <= tune->downtime) {
+        tune->stalls = 0;
+        goto sample;
+    }
+
+    if (++tune->stalls < QEMU_MIGRATION_AUTO_TUNE_STALLS)
+        goto sample;
+    tune->stalls = 0;
+
+    cacheLimit = vm->def->mem.cur_balloon * 1024 / 4;
+
+    if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
+        return;
+
+    /* Raising the bandwidth only helps if we're actually using it all,
+     * and an evacuation decides the bandwidth of its domains itself */
+    if (!priv->evacBandwidth &&
+        tune->bandwidth < tune->maxBandwidth &&
+        tune->rate >= tune->bandwidth * 1024ULL * 1024 / 10 * 9) {
+        action = "bandwidth";
+        value = MIN(tune->bandwidth * 2ULL, tune->maxBandwidth);
+        if ((rc = qemuMonitorSetMigrationSpeed(priv->mon, value)) == 0)
+            tune->bandwidth = value;
+    } else if (tune->downtime < tune->maxDowntime) {
+        action = "downtime";
+        value = MIN(MAX(tune->downtime * 2, needed), tune->maxDowntime);
+        if ((rc = qemuMonitorSetMigrationDowntime(priv->mon, value)) == 0)
+            tune->downtime = value;
+    } else if (status->xbzrle_set &&
+               status->xbzrle_cache_miss > tune->cacheMisses &&
+               status->xbzrle_cache_size < cacheLimit) {
+        action = "compression_cache";
+        value = MIN(status->xbzrle_cache_size * 2, cacheLimit);
+        rc = qemuMonitorSetMigrationCacheSize(priv->mon, value);
+    } else {
+        action = "exhausted";
+        rc = 0;
+    }
+
+    qemuDomainObjExitMonitor(driver, vm);
+
+    if (rc < 0) {
+        VIR_WARN("Unable to adjust migration %s of domain %s: %s",
+                 action, vm->def->name, virGetLastErrorMessage());
+        virResetLastError();
+    } else {
+        VIR_DEBUG("Migration of domain %s not converging (sending %llu B/s, "
+                  "dirtying %llu B/s), %s now %llu",
+                  vm->def->name, tune->rate, tune->dirtyRate, action, value);
+        if (STRNEQ(action, "exhausted"))
+            tune->adjustments++;
+        tune->lastAction = action;
+    }
+
+ sample:
+    tune->sampled = now;
+    tune->transferred = status->ram_transferred;
+    tune->remaining = status->ram_remaining;
+    tune->cacheMisses = status->xbzrle_cache_miss;
+}
+
+
+/* How long to wait before checking migration status again. With MIGRATION
+ * events QEMU wakes us up itself and we only need to look now and then for
+ * the things it doesn't tell us about. Otherwise we poll: often when the
+ * migration is about to finish, less often while there's a lot left to
+ * send. */
+static unsigned long long
+qemuMigrationWaitInterval(qemuDomainObjPrivatePtr priv,
+                          unsigned long long rate)
+{
+    qemuMonitorMigrationStatusPtr status = &priv->job.status;
+    unsigned long long remaining;
+
+    if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATION_EVENT))
+        return QEMU_MIGRATION_EVENT_INTERVAL;
+
+    if (status->status != QEMU_MONITOR_MIGRATION_STATUS_ACTIVE || !rate)
+        return QEMU_MIGRATION_POLL_MIN;
+
+    remaining = status->ram_remaining + status->disk_remaining;
+    if (remaining / 4 > rate * QEMU_MIGRATION_POLL_MAX / 1000)
+        return QEMU_MIGRATION_POLL_MAX;
+
+    /* Poll about four times within the expected remaining time */
+    return MAX(remaining * 1000 / rate / 4, QEMU_MIGRATION_POLL_MIN);
+}
+
+
+/* Follow the share of an evacuation's bandwidth cap assigned to @vm,
+ * which changes as other domains of the evacuation start and finish.
+ * Failure is not fatal, the job just keeps its current speed. */
+static void
+qemuMigrationUpdateEvacBandwidth(virQEMUDriverPtr driver,
+                                 virDomainObjPtr vm,
+                                 qemuDomainAsyncJob asyncJob,
+                                 unsigned long bandwidth)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    VIR_DEBUG("Evacuation bandwidth of domain %s now %lu MiB/s",
+              vm->def->name, bandwidth);
+
+    if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
+        return;
+    ignore_value(qemuMonitorSetMigrationSpeed(priv->mon, bandwidth));
+    qemuDomainObjExitMonitor(driver, vm);
+}
+
+
 /* Returns 0 on success, -2 when migration needs to be cancelled, or -1 when
  * QEMU reports failed migration.
  */
@@ -1794,6 +2008,10 @@ qemuMigrationWaitForCompletion(virQEMUDriverPtr driver, virDomainObjPtr vm,
     qemuDomainObjPrivatePtr priv = vm->privateData;
     const char *job;
     int pauseReason;
+    unsigned long evacBandwidth = priv->evacBandwidth;
+    unsigned long long transferred = 0;
+    unsigned long long sampled = 0;
+    unsigned long long rate = 0;
 
     switch (priv->job.asyncJob) {
     case QEMU_ASYNC_JOB_MIGRATION_OUT:
@@ -1812,12 +2030,31 @@ qemuMigrationWaitForCompletion(virQEMUDriverPtr driver, virDomainObjPtr vm,
     priv->job.info.type = VIR_DOMAIN_JOB_UNBOUNDED;
 
     while (priv->job.info.type == VIR_DOMAIN_JOB_UNBOUNDED) {
-        /* Poll every 50ms for progress & to allow cancellation */
-        struct timespec ts = { .tv_sec = 0, .tv_nsec = 50 * 1000 * 1000ull };
+        qemuMonitorMigrationStatusPtr status = &priv->job.status;
+        unsigned long long now;
+        unsigned long long sent;
 
         if (qemuMigrationUpdateJobStatus(driver, vm, job, asyncJob) == -1)
             break;
 
+        if (virTimeMillisNow(&now) < 0)
+            break;
+
+        sent = status->ram_transferred + status->disk_transferred;
+        if (sampled && now > sampled && sent >= transferred)
+            rate = (sent - transferred) * 1000 / (now - sampled);
+        transferred = sent;
+        sampled = now;
+
+        if (priv->evacBandwidth && priv->evacBandwidth != evacBandwidth) {
+            evacBandwidth = priv->evacBandwidth;
+            qemuMigrationUpdateEvacBandwidth(driver, vm, asyncJob,
+                                             evacBandwidth);
+        }
+
+        if (priv->job.tune.enabled)
+            qemuMigrationAutoTune(driver, vm, asyncJob);
+
         /* cancel migration if disk I/O error is emitted while migrating */
         if (abort_on_error &&
             virDomainObjGetState(vm, &pauseReason) == VIR_DOMAIN_PAUSED &&
@@ -1833,11 +2070,24 @@ qemuMigrationWaitForCompletion(virQEMUDriverPtr driver, virDomainObjPtr vm,
             break;
         }
 
-        virObjectUnlock(vm);
+        now += qemuMigrationWaitInterval(priv, rate);
 
-        nanosleep(&ts, NULL);
+        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATION_EVENT)) {
+            if (qemuDomainObjMigrationEventWait(vm, now) < 0)
+                break;
+        } else {
+            struct timespec ts;
+            unsigned long long left = now - sampled;
 
-        virObjectLock(vm);
+            ts.tv_sec = left / 1000;
+            ts.tv_nsec = (left % 1000) * 1000 * 1000ull;
+
+            virObjectUnlock(vm);
+
+            nanosleep(&ts, NULL);
+
+            virObjectLock(vm);
+        }
     }
 
     if (priv->job.info.type == VIR_DOMAIN_JOB_COMPLETED) {
@@ -2971,10 +3221,20 @@ struct _qemuMigrationSpec {
     } fwd;
 };
 
-#define TUNNEL_SEND_BUF_SIZE 65536
+/* Stream packets are sent whole, so use the largest payload any peer
+ * daemon accepts, whatever its version */
+#define TUNNEL_SEND_BUF_SIZE VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX
+
+/* Number of buffers between the thread reading from qemu and the one
+ * sending into the stream, so that neither waits for the other */
+#define TUNNEL_SEND_BUF_COUNT 4
+
+typedef struct _qemuMigrationIOBuffer qemuMigrationIOBuffer;
+struct _qemuMigrationIOBuffer {
+    char *data;
+    size_t len;
+};
 
-typedef struct _qemuMigrationIOThread qemuMigrationIOThread;
-typedef qemuMigrationIOThread *qemuMigrationIOThreadPtr;
 struct _qemuMigrationIOThread {
     virThread thread;
     virStreamPtr st;
@@ -2982,28 +3242,112 @@ struct _qemuMigrationIOThread {
     virError err;
     int wakeupRecvFD;
     int wakeupSendFD;
+
+    /* Protects everything below, shared with the send thread */
+    virMutex lock;
+    virCond cond;
+    qemuMigrationIOBuffer bufs[TUNNEL_SEND_BUF_COUNT];
+    size_t head;        /* oldest buffer waiting to be sent */
+    size_t nfull;       /* buffers waiting to be sent */
+    bool eof;           /* no more data will be queued */
+    bool quit;          /* one of the threads failed */
 };
 
+
+/* Takes filled buffers in order and pushes them into the stream. Errors
+ * are stored in data->err, the stream is left for the reading thread to
+ * finish or abort. */
+static void qemuMigrationIOSendFunc(void *arg)
+{
+    qemuMigrationIOThreadPtr data = arg;
+
+    virMutexLock(&data->lock);
+
+    for (;;) {
+        qemuMigrationIOBuffer *buf;
+        size_t off = 0;
+
+        while (!data->nfull && !data->eof && !data->quit)
+            ignore_value(virCondWait(&data->cond, &data->lock));
+
+        if (data->quit || !data->nfull)
+            break;
+
+        buf = &data->bufs[data->head];
+        virMutexUnlock(&data->lock);
+
+        while (off < buf->len) {
+            int nbytes = virStreamSend(data->st, buf->data + off,
+                                       buf->len - off);
+            if (nbytes < 0)
+                break;
+            off += nbytes;
+        }
+
+        virMutexLock(&data->lock);
+
+        if (off < buf->len) {
+            virCopyLastError(&data->err);
+            virResetLastError();
+            data->quit = true;
+            virCondBroadcast(&data->cond);
+            break;
+        }
+
+        data->head = (data->head + 1) % TUNNEL_SEND_BUF_COUNT;
+        data->nfull--;
+        virCondBroadcast(&data->cond);
+    }
+
+    virMutexUnlock(&data->lock);
+}
+
+
 static void qemuMigrationIOFunc(void *arg)
 {
     qemuMigrationIOThreadPtr data = arg;
-    char *buffer = NULL;
+    virThread sendThread;
+    bool sending = false;
     struct pollfd fds[2];
     int timeout = -1;
     virErrorPtr err = NULL;
+    size_t i;
 
     VIR_DEBUG("Running migration tunnel; stream=%p, sock=%d",
               data->st, data->sock);
 
-    if (VIR_ALLOC_N(buffer, TUNNEL_SEND_BUF_SIZE) < 0)
+    for (i = 0; i < TUNNEL_SEND_BUF_COUNT; i++) {
+        if (VIR_ALLOC_N(data->bufs[i].data, TUNNEL_SEND_BUF_SIZE) < 0)
+            goto abrt;
+    }
+
+    if (virThreadCreate(&sendThread, true,
+                        qemuMigrationIOSendFunc, data) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create migration thread"));
         goto abrt;
+    }
+    sending = true;
 
     fds[0].fd = data->sock;
     fds[1].fd = data->wakeupRecvFD;
 
     for (;;) {
+        qemuMigrationIOBuffer *buf;
         int ret;
 
+        /* Wait for a free buffer first, so that a stalled stream
+         * throttles how fast we read from qemu */
+        virMutexLock(&data->lock);
+        while (data->nfull == TUNNEL_SEND_BUF_COUNT && !data->quit)
+            ignore_value(virCondWait(&data->cond, &data->lock));
+        if (data->quit) {
+            virMutexUnlock(&data->lock);
+            goto error;
+        }
+        buf = &data->bufs[(data->head + data->nfull) % TUNNEL_SEND_BUF_COUNT];
+        virMutexUnlock(&data->lock);
+
         fds[0].events = fds[1].events = POLLIN;
         fds[0].revents = fds[1].revents = 0;
 
@@ -3047,10 +3391,13 @@ static void qemuMigrationIOFunc(void *arg)
         if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
             int nbytes;
 
-            nbytes = saferead(data->sock, buffer, TUNNEL_SEND_BUF_SIZE);
+            nbytes = saferead(data->sock, buf->data, TUNNEL_SEND_BUF_SIZE);
             if (nbytes > 0) {
-                if (virStreamSend(data->st, buffer, nbytes) < 0)
-                    goto error;
+                buf->len = nbytes;
+                virMutexLock(&data->lock);
+                data->nfull++;
+                virCondBroadcast(&data->cond);
+                virMutexUnlock(&data->lock);
             } else if (nbytes < 0) {
                 virReportSystemError(errno, "%s",
                         _("tunnelled migration failed to read from qemu"));
@@ -3062,14 +3409,32 @@ static void qemuMigrationIOFunc(void *arg)
         }
     }
 
-    if (virStreamFinish(data->st) < 0)
+    /* Let the send thread drain what is queued */
+    virMutexLock(&data->lock);
+    data->eof = true;
+    virCondBroadcast(&data->cond);
+    virMutexUnlock(&data->lock);
+    virThreadJoin(&sendThread);
+    sending = false;
+
+    if (data->quit)
         goto error;
 
-    VIR_FREE(buffer);
+    if (virStreamFinish(data->st) < 0)
+        goto error;
 
-    return;
+    goto cleanup;
 
  abrt:
+    if (sending) {
+        virMutexLock(&data->lock);
+        data->quit = true;
+        virCondBroadcast(&data->cond);
+        virMutexUnlock(&data->lock);
+        virThreadJoin(&sendThread);
+        sending = false;
+    }
+
     err = virSaveLastError();
     if (err && err->code == VIR_ERR_OK) {
         virFreeError(err);
@@ -3082,13 +3447,23 @@ static void qemuMigrationIOFunc(void *arg)
     }
 
  error:
-    virCopyLastError(&data->err);
+    if (sending) {
+        virThreadJoin(&sendThread);
+        sending = false;
+    }
+
+    /* An error from the send thread is already stored */
+    if (data->err.code == VIR_ERR_OK)
+        virCopyLastError(&data->err);
     virResetLastError();
-    VIR_FREE(buffer);
+
+ cleanup:
+    for (i = 0; i < TUNNEL_SEND_BUF_COUNT; i++)
+        VIR_FREE(data->bufs[i].data);
 }
 
 
-static qemuMigrationIOThreadPtr
+qemuMigrationIOThreadPtr
 qemuMigrationStartTunnel(virStreamPtr st,
                          int sock)
 {
@@ -3104,6 +3479,21 @@ qemuMigrationStartTunnel(virStreamPtr st,
     if (VIR_ALLOC(io) < 0)
         goto error;
 
+    if (virMutexInit(&io->lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize mutex"));
+        VIR_FREE(io);
+        goto error;
+    }
+
+    if (virCondInit(&io->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize condition"));
+        virMutexDestroy(&io->lock);
+        VIR_FREE(io);
+        goto error;
+    }
+
     io->st = st;
     io->sock = sock;
     io->wakeupRecvFD = wakeupFD[0];
@@ -3114,6 +3504,8 @@ qemuMigrationStartTunnel(virStreamPtr st,
                         io) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to create migration thread"));
+        virCondDestroy(&io->cond);
+        virMutexDestroy(&io->lock);
         goto error;
     }
 
@@ -3126,7 +3518,7 @@ qemuMigrationStartTunnel(virStreamPtr st,
     return NULL;
 }
 
-static int
+int
 qemuMigrationStopTunnel(qemuMigrationIOThreadPtr io, bool error)
 {
     int rv = -1;
@@ -3156,6 +3548,8 @@ qemuMigrationStopTunnel(qemuMigrationIOThreadPtr io, bool error)
  cleanup:
     VIR_FORCE_CLOSE(io->wakeupSendFD);
     VIR_FORCE_CLOSE(io->wakeupRecvFD);
+    virCondDestroy(&io->cond);
+    virMutexDestroy(&io->lock);
     VIR_FREE(io);
     return rv;
 }
@@ -3236,6 +3630,10 @@ qemuMigrationRun(virQEMUDriverPtr driver,
               spec, spec->destType, spec->fwdType, dconn,
               NULLSTR(graphicsuri));
 
+    /* An evacuation decides how much of the host's bandwidth we get */
+    if (priv->evacBandwidth)
+        migrate_speed = priv->evacBandwidth;
+
     if (flags & VIR_MIGRATE_NON_SHARED_DISK) {
         migrate_flags |= QEMU_MONITOR_MIGRATE_NON_SHARED_DISK;
         cookieFlags |= QEMU_MIGRATION_COOKIE_NBD;
@@ -3284,7 +3682,11 @@ qemuMigrationRun(virQEMUDriverPtr driver,
 
     if (flags & VIR_MIGRATE_AUTO_CONVERGE &&
         qemuMigrationSetAutoConverge(driver, vm,
-                                     QEMU_ASYNC_JOB_MIGRATION_OUT) < 0)
+                                     QEMU_ASYNC_JOB_MIGRATION_OUT, true) < 0)
+        goto cleanup;
+
+    if (flags & VIR_MIGRATE_AUTO_TUNE &&
+        qemuMigrationAutoTuneStart(driver, vm, flags, migrate_speed) < 0)
         goto cleanup;
 
     if (qemuDomainObjEnterMonitorAsync(driver, vm,
@@ -3644,7 +4046,8 @@ static int doPeer2PeerMigrate2(virQEMUDriverPtr driver,
         flags |= VIR_MIGRATE_PAUSED;
 
     destflags = flags & ~(VIR_MIGRATE_ABORT_ON_ERROR |
-                          VIR_MIGRATE_AUTO_CONVERGE);
+                          VIR_MIGRATE_AUTO_CONVERGE |
+                          VIR_MIGRATE_AUTO_TUNE);
 
     VIR_DEBUG("Prepare2 %p", dconn);
     if (flags & VIR_MIGRATE_TUNNELLED) {
@@ -3838,7 +4241,8 @@ doPeer2PeerMigrate3(virQEMUDriverPtr driver,
         flags |= VIR_MIGRATE_PAUSED;
 
     destflags = flags & ~(VIR_MIGRATE_ABORT_ON_ERROR |
-                          VIR_MIGRATE_AUTO_CONVERGE);
+                          VIR_MIGRATE_AUTO_CONVERGE |
+                          VIR_MIGRATE_AUTO_TUNE);
 
     VIR_DEBUG("Prepare3 %p", dconn);
     cookiein = cookieout;
@@ -4703,15 +5107,18 @@ qemuMigrationToFile(virQEMUDriverPtr driver, virDomainObjPtr vm,
     virCommandPtr cmd = NULL;
     int pipeFD[2] = { -1, -1 };
     unsigned long saveMigBandwidth = priv->migMaxBandwidth;
+    unsigned long bandwidth = QEMU_DOMAIN_MIG_BANDWIDTH_MAX;
     char *errbuf = NULL;
     virErrorPtr orig_err = NULL;
 
-    /* Increase migration bandwidth to unlimited since target is a file.
+    /* Increase migration bandwidth to unlimited since target is a file,
+     * unless an evacuation is sharing the disk bandwidth out.
      * Failure to change migration speed is not fatal. */
+    if (priv->evacBandwidth)
+        bandwidth = priv->evacBandwidth;
     if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) == 0) {
-        qemuMonitorSetMigrationSpeed(priv->mon,
-                                     QEMU_DOMAIN_MIG_BANDWIDTH_MAX);
-        priv->migMaxBandwidth = QEMU_DOMAIN_MIG_BANDWIDTH_MAX;
+        qemuMonitorSetMigrationSpeed(priv->mon, bandwidth);
+        priv->migMaxBandwidth = bandwidth;
         qemuDomainObjExitMonitor(driver, vm);
     }
 
@@ -0,0 +1,41 @@
+/*
+ * qemu_migrationpriv.h: private declarations for QEMU migration handling
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __QEMU_MIGRATIONPRIV_H__
+# define __QEMU_MIGRATIONPRIV_H__
+
+# include "qemu_conf.h"
+# include "qemu_domain.h"
+
+/*
+ * This header file should never be used outside unit tests.
+ */
+
+int qemuMigrationAutoTuneStart(virQEMUDriverPtr driver,
+                               virDomainObjPtr vm,
+                               unsigned long flags,
+                               unsigned long bandwidth);
+
+void qemuMigrationAutoTune(virQEMUDriverPtr driver,
+                           virDomainObjPtr vm,
+                           qemuDomainAsyncJob asyncJob);
+
+#endif /* __QEMU_MIGRATIONPRIV_H__ */
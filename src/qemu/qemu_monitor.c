@@ -68,9 +68,13 @@ struct _qemuMonitor {
     qemuMonitorCallbacksPtr cb;
     void *callbackOpaque;
 
-    /* If there's a command being processed this will be
-     * non-NULL */
-    qemuMonitorMessagePtr msg;
+    /* Commands which were submitted and whose senders are still
+     * waiting, in transmission order. The JSON monitor matches replies
+     * by their "id" so it may have several of these on the wire at
+     * once; the text monitor only ever sends the next one after the
+     * previous reply arrived */
+    qemuMonitorMessagePtr *msgs;
+    size_t nmsgs;
 
     /* Buffer incoming data ready for Text/QMP monitor
      * code to process & find message boundaries */
@@ -121,7 +125,7 @@ VIR_ENUM_IMPL(qemuMonitorMigrationStatus,
 
 VIR_ENUM_IMPL(qemuMonitorMigrationCaps,
               QEMU_MONITOR_MIGRATION_CAPS_LAST,
-              "xbzrle", "auto-converge")
+              "xbzrle", "auto-converge", "events")
 
 VIR_ENUM_IMPL(qemuMonitorVMStatus,
               QEMU_MONITOR_VM_STATUS_LAST,
@@ -262,6 +266,7 @@ static void qemuMonitorDispose(void *obj)
 
     virResetError(&mon->lastError);
     virCondDestroy(&mon->notify);
+    VIR_FREE(mon->msgs);
     VIR_FREE(mon->buffer);
     virJSONValueFree(mon->options);
     VIR_FREE(mon->balloonpath);
@@ -368,6 +373,107 @@ qemuMonitorGetErrorFromLog(qemuMonitorPtr mon)
 }
 
 
+/* Returns the message whose data should be written next, if any */
+static qemuMonitorMessagePtr
+qemuMonitorTxMessage(qemuMonitorPtr mon)
+{
+    size_t i;
+
+    for (i = 0; i < mon->nmsgs; i++) {
+        qemuMonitorMessagePtr msg = mon->msgs[i];
+
+        if (msg->finished)
+            continue;
+
+        if (msg->txOffset < msg->txLength)
+            return msg;
+
+        if (!mon->json)
+            return NULL;
+    }
+
+    return NULL;
+}
+
+
+/* Returns the oldest message which was fully written but has not
+ * received its reply yet */
+static qemuMonitorMessagePtr
+qemuMonitorRxMessage(qemuMonitorPtr mon)
+{
+    size_t i;
+
+    for (i = 0; i < mon->nmsgs; i++) {
+        qemuMonitorMessagePtr msg = mon->msgs[i];
+
+        if (msg->finished)
+            continue;
+
+        if (msg->txOffset == msg->txLength)
+            return msg;
+
+        return NULL;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Find the in-flight message a reply belongs to: the one sent with
+ * @id, or if @id is NULL the oldest one still waiting for its reply.
+ */
+qemuMonitorMessagePtr
+qemuMonitorFindMessage(qemuMonitorPtr mon,
+                       const char *id)
+{
+    size_t i;
+
+    if (!id)
+        return qemuMonitorRxMessage(mon);
+
+    for (i = 0; i < mon->nmsgs; i++) {
+        qemuMonitorMessagePtr msg = mon->msgs[i];
+
+        if (!msg->finished &&
+            msg->txOffset == msg->txLength &&
+            STREQ_NULLABLE(msg->id, id))
+            return msg;
+    }
+
+    return NULL;
+}
+
+
+static size_t
+qemuMonitorCountFinished(qemuMonitorPtr mon)
+{
+    size_t i;
+    size_t n = 0;
+
+    for (i = 0; i < mon->nmsgs; i++) {
+        if (mon->msgs[i]->finished)
+            n++;
+    }
+
+    return n;
+}
+
+
+/* Wake up everyone waiting for a reply, typically because the monitor
+ * hit an error which lastError describes */
+static void
+qemuMonitorFinishAll(qemuMonitorPtr mon)
+{
+    size_t i;
+
+    for (i = 0; i < mon->nmsgs; i++)
+        mon->msgs[i]->finished = 1;
+
+    virCondBroadcast(&mon->notify);
+}
+
+
 /* This method processes data that has been received
  * from the monitor. Looking for async events and
  * replies/errors.
@@ -376,18 +482,14 @@ static int
 qemuMonitorIOProcess(qemuMonitorPtr mon)
 {
     int len;
-    qemuMonitorMessagePtr msg = NULL;
-
-    /* See if there's a message & whether its ready for its reply
-     * ie whether its completed writing all its data */
-    if (mon->msg && mon->msg->txOffset == mon->msg->txLength)
-        msg = mon->msg;
+    qemuMonitorMessagePtr msg = qemuMonitorRxMessage(mon);
+    size_t finished = qemuMonitorCountFinished(mon);
 
 #if DEBUG_IO
 # if DEBUG_RAW_IO
     char *str1 = qemuMonitorEscapeNonPrintable(msg ? msg->txBuffer : "");
     char *str2 = qemuMonitorEscapeNonPrintable(mon->buffer);
-    VIR_ERROR(_("Process %d %p %p [[[[%s]]][[[%s]]]"), (int)mon->bufferOffset, mon->msg, msg, str1, str2);
+    VIR_ERROR(_("Process %d %zu %p [[[[%s]]][[[%s]]]"), (int)mon->bufferOffset, mon->nmsgs, msg, str1, str2);
     VIR_FREE(str1);
     VIR_FREE(str2);
 # else
@@ -400,8 +502,7 @@ qemuMonitorIOProcess(qemuMonitorPtr mon)
 
     if (mon->json)
         len = qemuMonitorJSONIOProcess(mon,
-                                       mon->buffer, mon->bufferOffset,
-                                       msg);
+                                       mon->buffer, mon->bufferOffset);
     else
         len = qemuMonitorTextIOProcess(mon,
                                        mon->buffer, mon->bufferOffset,
@@ -423,7 +524,7 @@ qemuMonitorIOProcess(qemuMonitorPtr mon)
 #if DEBUG_IO
     VIR_DEBUG("Process done %d used %d", (int)mon->bufferOffset, len);
 #endif
-    if (msg && msg->finished)
+    if (qemuMonitorCountFinished(mon) != finished)
         virCondBroadcast(&mon->notify);
     return len;
 }
@@ -477,50 +578,57 @@ qemuMonitorIOWriteWithFD(qemuMonitorPtr mon,
 static int
 qemuMonitorIOWrite(qemuMonitorPtr mon)
 {
-    int done;
-
-    /* If no active message, or fully transmitted, the no-op */
-    if (!mon->msg || mon->msg->txOffset == mon->msg->txLength)
-        return 0;
-
-    if (mon->msg->txFD != -1 && !mon->hasSendFD) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Monitor does not support sending of file descriptors"));
-        return -1;
-    }
+    qemuMonitorMessagePtr msg;
+    int total = 0;
 
-    if (mon->msg->txFD == -1)
-        done = write(mon->fd,
-                     mon->msg->txBuffer + mon->msg->txOffset,
-                     mon->msg->txLength - mon->msg->txOffset);
-    else
-        done = qemuMonitorIOWriteWithFD(mon,
-                                        mon->msg->txBuffer + mon->msg->txOffset,
-                                        mon->msg->txLength - mon->msg->txOffset,
-                                        mon->msg->txFD);
+    /* Keep writing queued messages until the socket is full */
+    while ((msg = qemuMonitorTxMessage(mon))) {
+        int done;
 
-    PROBE(QEMU_MONITOR_IO_WRITE,
-          "mon=%p buf=%s len=%d ret=%d errno=%d",
-          mon,
-          mon->msg->txBuffer + mon->msg->txOffset,
-          mon->msg->txLength - mon->msg->txOffset,
-          done, errno);
+        if (msg->txFD != -1 && !mon->hasSendFD) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Monitor does not support sending of file descriptors"));
+            return -1;
+        }
 
-    if (mon->msg->txFD != -1)
-        PROBE(QEMU_MONITOR_IO_SEND_FD,
-              "mon=%p fd=%d ret=%d errno=%d",
-              mon, mon->msg->txFD, done, errno);
+        if (msg->txFD == -1)
+            done = write(mon->fd,
+                         msg->txBuffer + msg->txOffset,
+                         msg->txLength - msg->txOffset);
+        else
+            done = qemuMonitorIOWriteWithFD(mon,
+                                            msg->txBuffer + msg->txOffset,
+                                            msg->txLength - msg->txOffset,
+                                            msg->txFD);
+
+        PROBE(QEMU_MONITOR_IO_WRITE,
+              "mon=%p buf=%s len=%d ret=%d errno=%d",
+              mon,
+              msg->txBuffer + msg->txOffset,
+              msg->txLength - msg->txOffset,
+              done, errno);
+
+        if (msg->txFD != -1)
+            PROBE(QEMU_MONITOR_IO_SEND_FD,
+                  "mon=%p fd=%d ret=%d errno=%d",
+                  mon, msg->txFD, done, errno);
+
+        if (done < 0) {
+            if (errno == EAGAIN)
+                return total;
 
-    if (done < 0) {
-        if (errno == EAGAIN)
-            return 0;
+            virReportSystemError(errno, "%s",
+                                 _("Unable to write to monitor"));
+            return -1;
+        }
+        msg->txOffset += done;
+        total += done;
 
-        virReportSystemError(errno, "%s",
-                             _("Unable to write to monitor"));
-        return -1;
+        if (msg->txOffset < msg->txLength)
+            break;
     }
-    mon->msg->txOffset += done;
-    return done;
+
+    return total;
 }
 
 /*
@@ -587,8 +695,7 @@ static void qemuMonitorUpdateWatch(qemuMonitorPtr mon)
     if (mon->lastError.code == VIR_ERR_OK) {
         events |= VIR_EVENT_HANDLE_READABLE;
 
-        if ((mon->msg && mon->msg->txOffset < mon->msg->txLength) &&
-            !mon->waitGreeting)
+        if (qemuMonitorTxMessage(mon) && !mon->waitGreeting)
             events |= VIR_EVENT_HANDLE_WRITABLE;
     }
 
@@ -712,12 +819,9 @@ qemuMonitorIO(int watch, int fd, int events, void *opaque)
         }
 
         VIR_DEBUG("Error on monitor %s", NULLSTR(mon->lastError.message));
-        /* If IO process resulted in an error & we have a message,
-         * then wakeup that waiter */
-        if (mon->msg && !mon->msg->finished) {
-            mon->msg->finished = 1;
-            virCondSignal(&mon->notify);
-        }
+        /* If IO process resulted in an error & we have messages,
+         * then wakeup their waiters */
+        qemuMonitorFinishAll(mon);
     }
 
     qemuMonitorUpdateWatch(mon);
@@ -730,7 +834,7 @@ qemuMonitorIO(int watch, int fd, int events, void *opaque)
         virDomainObjPtr vm = mon->vm;
 
         /* Make sure anyone waiting wakes up now */
-        virCondSignal(&mon->notify);
+        virCondBroadcast(&mon->notify);
         virObjectUnlock(mon);
         VIR_DEBUG("Triggering EOF callback");
         (eofNotify)(mon, vm, mon->callbackOpaque);
@@ -740,7 +844,7 @@ qemuMonitorIO(int watch, int fd, int events, void *opaque)
         virDomainObjPtr vm = mon->vm;
 
         /* Make sure anyone waiting wakes up now */
-        virCondSignal(&mon->notify);
+        virCondBroadcast(&mon->notify);
         virObjectUnlock(mon);
         VIR_DEBUG("Triggering error callback");
         (errorNotify)(mon, vm, mon->callbackOpaque);
@@ -910,7 +1014,7 @@ void qemuMonitorClose(qemuMonitorPtr mon)
     /* In case another thread is waiting for its monitor command to be
      * processed, we need to wake it up with appropriate error set.
      */
-    if (mon->msg) {
+    if (mon->nmsgs) {
         if (mon->lastError.code == VIR_ERR_OK) {
             virErrorPtr err = virSaveLastError();
 
@@ -924,8 +1028,7 @@ void qemuMonitorClose(qemuMonitorPtr mon)
                 virResetLastError();
             }
         }
-        mon->msg->finished = 1;
-        virCondSignal(&mon->notify);
+        qemuMonitorFinishAll(mon);
     }
 
     /* Propagate existing monitor error in case the current thread has no
@@ -948,10 +1051,33 @@ char *qemuMonitorNextCommandID(qemuMonitorPtr mon)
 }
 
 
-int qemuMonitorSend(qemuMonitorPtr mon,
-                    qemuMonitorMessagePtr msg)
+static void
+qemuMonitorDequeue(qemuMonitorPtr mon,
+                   qemuMonitorMessagePtr msg)
+{
+    size_t i;
+
+    for (i = 0; i < mon->nmsgs; i++) {
+        if (mon->msgs[i] == msg) {
+            ignore_value(VIR_DELETE_ELEMENT(mon->msgs, i, mon->nmsgs));
+            return;
+        }
+    }
+}
+
+
+/*
+ * Queue @nmsgs messages for transmission and wait until all of them
+ * received their replies. With the JSON monitor the commands are
+ * written back to back without waiting for each reply in turn.
+ */
+int qemuMonitorSendBatch(qemuMonitorPtr mon,
+                         qemuMonitorMessagePtr *msgs,
+                         size_t nmsgs)
 {
     int ret = -1;
+    size_t nqueued = 0;
+    size_t i;
 
     /* Check whether qemu quit unexpectedly */
     if (mon->lastError.code != VIR_ERR_OK) {
@@ -961,18 +1087,25 @@ int qemuMonitorSend(qemuMonitorPtr mon,
         return -1;
     }
 
-    mon->msg = msg;
-    qemuMonitorUpdateWatch(mon);
+    for (i = 0; i < nmsgs; i++) {
+        if (VIR_APPEND_ELEMENT_COPY(mon->msgs, mon->nmsgs, msgs[i]) < 0)
+            goto cleanup;
+        nqueued++;
 
-    PROBE(QEMU_MONITOR_SEND_MSG,
-          "mon=%p msg=%s fd=%d",
-          mon, mon->msg->txBuffer, mon->msg->txFD);
+        PROBE(QEMU_MONITOR_SEND_MSG,
+              "mon=%p msg=%s fd=%d",
+              mon, msgs[i]->txBuffer, msgs[i]->txFD);
+    }
 
-    while (!mon->msg->finished) {
-        if (virCondWait(&mon->notify, &mon->parent.lock) < 0) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("Unable to wait on monitor condition"));
-            goto cleanup;
+    qemuMonitorUpdateWatch(mon);
+
+    for (i = 0; i < nmsgs; i++) {
+        while (!msgs[i]->finished) {
+            if (virCondWait(&mon->notify, &mon->parent.lock) < 0) {
+                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                               _("Unable to wait on monitor condition"));
+                goto cleanup;
+            }
         }
     }
 
@@ -986,13 +1119,21 @@ int qemuMonitorSend(qemuMonitorPtr mon,
     ret = 0;
 
  cleanup:
-    mon->msg = NULL;
+    for (i = 0; i < nqueued; i++)
+        qemuMonitorDequeue(mon, msgs[i]);
     qemuMonitorUpdateWatch(mon);
 
     return ret;
 }
 
 
+int qemuMonitorSend(qemuMonitorPtr mon,
+                    qemuMonitorMessagePtr msg)
+{
+    return qemuMonitorSendBatch(mon, &msg, 1);
+}
+
+
 virJSONValuePtr
 qemuMonitorGetOptions(qemuMonitorPtr mon)
 {
@@ -1384,6 +1525,20 @@ qemuMonitorEmitDeviceDeleted(qemuMonitorPtr mon,
 }
 
 
+int
+qemuMonitorEmitMigrationStatus(qemuMonitorPtr mon,
+                               int status)
+{
+    int ret = -1;
+    VIR_DEBUG("mon=%p, status=%s",
+              mon, NULLSTR(qemuMonitorMigrationStatusTypeToString(status)));
+
+    QEMU_MONITOR_CALLBACK(mon, ret, domainMigrationStatus, mon->vm, status);
+
+    return ret;
+}
+
+
 int qemuMonitorSetCapabilities(qemuMonitorPtr mon)
 {
     int ret;
@@ -1753,6 +1908,90 @@ int qemuMonitorGetBlockStatsInfo(qemuMonitorPtr mon,
     return ret;
 }
 
+
+/**
+ * qemuMonitorGetStatsSample:
+ * @mon: monitor object
+ * @mem: array to fill with memory statistics
+ * @nr_mem: size of @mem
+ * @balloon: filled with the current balloon size in KiB, 0 if unknown
+ * @devs: aliases of the disks to get block statistics for
+ * @blockstats: array filled with the statistics of each of @devs
+ * @ndevs: size of @devs and @blockstats
+ *
+ * Collects everything the periodic statistics sampling needs. With QMP
+ * the queries are sent as one batch so that a sample costs a single
+ * round trip however many disks the domain has. Parts of the sample
+ * QEMU can't provide are skipped rather than failing the whole call;
+ * disks without statistics are left with @rd_req set to -1.
+ *
+ * Returns the number of memory statistics filled in, or -1 if the
+ * monitor failed.
+ */
+int
+qemuMonitorGetStatsSample(qemuMonitorPtr mon,
+                          virDomainMemoryStatPtr mem,
+                          unsigned int nr_mem,
+                          unsigned long long *balloon,
+                          const char **devs,
+                          qemuMonitorBlockStatsPtr blockstats,
+                          size_t ndevs)
+{
+    int ret;
+    size_t i;
+
+    VIR_DEBUG("mon=%p mem=%p nr_mem=%u ndevs=%zu", mon, mem, nr_mem, ndevs);
+
+    if (!mon) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("monitor must not be NULL"));
+        return -1;
+    }
+
+    *balloon = 0;
+    for (i = 0; i < ndevs; i++) {
+        qemuMonitorBlockStatsPtr stats = &blockstats[i];
+
+        stats->rd_req = stats->rd_bytes = stats->rd_total_times = -1;
+        stats->wr_req = stats->wr_bytes = stats->wr_total_times = -1;
+        stats->flush_req = stats->flush_total_times = stats->errs = -1;
+    }
+
+    if (mon->json) {
+        ignore_value(qemuMonitorFindBalloonObjectPath(mon, mon->vm, "/"));
+        mon->ballooninit = true;
+        return qemuMonitorJSONGetStatsSample(mon, mon->balloonpath,
+                                             mem, nr_mem, balloon,
+                                             devs, blockstats, ndevs);
+    }
+
+    /* The text monitor can only be asked one question at a time */
+    if ((ret = qemuMonitorTextGetMemoryStats(mon, mem, nr_mem)) < 0)
+        ret = 0;
+
+    if (qemuMonitorTextGetBalloonInfo(mon, balloon) <= 0)
+        *balloon = 0;
+
+    for (i = 0; i < ndevs; i++) {
+        qemuMonitorBlockStatsPtr stats = &blockstats[i];
+
+        if (qemuMonitorTextGetBlockStatsInfo(mon, devs[i],
+                                             &stats->rd_req,
+                                             &stats->rd_bytes,
+                                             &stats->rd_total_times,
+                                             &stats->wr_req,
+                                             &stats->wr_bytes,
+                                             &stats->wr_total_times,
+                                             &stats->flush_req,
+                                             &stats->flush_total_times,
+                                             &stats->errs) < 0)
+            stats->rd_req = -1;
+    }
+
+    virResetLastError();
+    return ret;
+}
+
 /* Return 0 and update @nparams with the number of block stats
  * QEMU supports if success. Return -1 if failure.
  */
@@ -81,6 +81,7 @@ static void qemuMonitorJSONHandleBalloonChange(qemuMonitorPtr mon, virJSONValueP
 static void qemuMonitorJSONHandlePMSuspendDisk(qemuMonitorPtr mon, virJSONValuePtr data);
 static void qemuMonitorJSONHandleGuestPanic(qemuMonitorPtr mon, virJSONValuePtr data);
 static void qemuMonitorJSONHandleDeviceDeleted(qemuMonitorPtr mon, virJSONValuePtr data);
+static void qemuMonitorJSONHandleMigrationStatus(qemuMonitorPtr mon, virJSONValuePtr data);
 
 typedef struct {
     const char *type;
@@ -96,6 +97,7 @@ static qemuEventHandler eventHandlers[] = {
     { "DEVICE_DELETED", qemuMonitorJSONHandleDeviceDeleted, },
     { "DEVICE_TRAY_MOVED", qemuMonitorJSONHandleTrayChange, },
     { "GUEST_PANICKED", qemuMonitorJSONHandleGuestPanic, },
+    { "MIGRATION", qemuMonitorJSONHandleMigrationStatus, },
     { "POWERDOWN", qemuMonitorJSONHandlePowerdown, },
     { "RESET", qemuMonitorJSONHandleReset, },
     { "RESUME", qemuMonitorJSONHandleResume, },
@@ -170,8 +172,7 @@ qemuMonitorJSONIOProcessEvent(qemuMonitorPtr mon,
 
 static int
 qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
-                             const char *line,
-                             qemuMonitorMessagePtr msg)
+                             const char *line)
 {
     virJSONValuePtr obj = NULL;
     int ret = -1;
@@ -195,8 +196,15 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
         ret = qemuMonitorJSONIOProcessEvent(mon, obj);
     } else if (virJSONValueObjectHasKey(obj, "error") == 1 ||
                virJSONValueObjectHasKey(obj, "return") == 1) {
+        qemuMonitorMessagePtr msg;
+
         PROBE(QEMU_MONITOR_RECV_REPLY,
               "mon=%p reply=%s", mon, line);
+
+        /* Several commands may be in flight, pair the reply up with its
+         * command by the id QEMU echoes back */
+        msg = qemuMonitorFindMessage(mon,
+                                     virJSONValueObjectGetString(obj, "id"));
         if (msg) {
             msg->rxObject = obj;
             msg->finished = 1;
@@ -218,8 +226,7 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
 
 int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
                              const char *data,
-                             size_t len,
-                             qemuMonitorMessagePtr msg)
+                             size_t len)
 {
     int used = 0;
     /*VIR_DEBUG("Data %d bytes [%s]", len, data);*/
@@ -234,7 +241,7 @@ int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
                 return -1;
             used += got + strlen(LINE_ENDING);
             line[got] = '\0'; /* kill \n */
-            if (qemuMonitorJSONIOProcessLine(mon, line, msg) < 0) {
+            if (qemuMonitorJSONIOProcessLine(mon, line) < 0) {
                 VIR_FREE(line);
                 return -1;
             }
@@ -282,6 +289,7 @@ qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
         goto cleanup;
     msg.txLength = strlen(msg.txBuffer);
     msg.txFD = scm_fd;
+    msg.id = id;
 
     VIR_DEBUG("Send command '%s' for write with FD %d", cmdstr, scm_fd);
 
@@ -318,6 +326,89 @@ qemuMonitorJSONCommand(qemuMonitorPtr mon,
     return qemuMonitorJSONCommandWithFd(mon, cmd, -1, reply);
 }
 
+
+/*
+ * Submit @ncmds commands in one go and wait for all their replies,
+ * which QEMU may deliver in any order. On success @replies[i] holds
+ * the reply to @cmds[i]; each still needs checking for errors.
+ */
+int
+qemuMonitorJSONCommandBatch(qemuMonitorPtr mon,
+                            virJSONValuePtr *cmds,
+                            size_t ncmds,
+                            virJSONValuePtr *replies)
+{
+    int ret = -1;
+    qemuMonitorMessagePtr msgs = NULL;
+    qemuMonitorMessagePtr *msgptrs = NULL;
+    char **ids = NULL;
+    size_t i;
+
+    for (i = 0; i < ncmds; i++)
+        replies[i] = NULL;
+
+    if (VIR_ALLOC_N(msgs, ncmds) < 0 ||
+        VIR_ALLOC_N(msgptrs, ncmds) < 0 ||
+        VIR_ALLOC_N(ids, ncmds) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ncmds; i++) {
+        char *cmdstr = NULL;
+
+        if (!(ids[i] = qemuMonitorNextCommandID(mon)))
+            goto cleanup;
+        if (virJSONValueObjectAppendString(cmds[i], "id", ids[i]) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to append command 'id' string"));
+            goto cleanup;
+        }
+
+        if (!(cmdstr = virJSONValueToString(cmds[i], false)))
+            goto cleanup;
+        if (virAsprintf(&msgs[i].txBuffer, "%s\r\n", cmdstr) < 0) {
+            VIR_FREE(cmdstr);
+            goto cleanup;
+        }
+        msgs[i].txLength = strlen(msgs[i].txBuffer);
+        msgs[i].txFD = -1;
+        msgs[i].id = ids[i];
+        msgptrs[i] = &msgs[i];
+
+        VIR_DEBUG("Queue command '%s'", cmdstr);
+        VIR_FREE(cmdstr);
+    }
+
+    if (qemuMonitorSendBatch(mon, msgptrs, ncmds) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ncmds; i++) {
+        if (!msgs[i].rxObject) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Missing monitor reply object"));
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < ncmds; i++) {
+        replies[i] = msgs[i].rxObject;
+        msgs[i].rxObject = NULL;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; msgs && i < ncmds; i++) {
+        virJSONValueFree(msgs[i].rxObject);
+        VIR_FREE(msgs[i].txBuffer);
+    }
+    for (i = 0; ids && i < ncmds; i++)
+        VIR_FREE(ids[i]);
+    VIR_FREE(ids);
+    VIR_FREE(msgptrs);
+    VIR_FREE(msgs);
+    return ret;
+}
+
 /* Ignoring OOM in this method, since we're already reporting
  * a more important error
  *
@@ -1019,6 +1110,22 @@ qemuMonitorJSONHandleDeviceDeleted(qemuMonitorPtr mon, virJSONValuePtr data)
     qemuMonitorEmitDeviceDeleted(mon, device);
 }
 
+static void
+qemuMonitorJSONHandleMigrationStatus(qemuMonitorPtr mon,
+                                     virJSONValuePtr data)
+{
+    const char *str;
+
+    if (!(str = virJSONValueObjectGetString(data, "status"))) {
+        VIR_WARN("missing status in migration event");
+        return;
+    }
+
+    /* Statuses we don't know about still tell a waiter to look */
+    qemuMonitorEmitMigrationStatus(mon,
+                                   qemuMonitorMigrationStatusTypeFromString(str));
+}
+
 int
 qemuMonitorJSONHumanCommandWithFd(qemuMonitorPtr mon,
                                   const char *cmd_str,
@@ -1401,6 +1508,46 @@ int qemuMonitorJSONGetVirtType(qemuMonitorPtr mon,
 }
 
 
+/*
+ * Interprets the @reply to a query-balloon @cmd.
+ *
+ * Returns: 0 if balloon not supported, +1 if balloon query worked
+ * or -1 on failure
+ */
+static int
+qemuMonitorJSONBalloonInfoParse(virJSONValuePtr cmd,
+                                virJSONValuePtr reply,
+                                unsigned long long *currmem)
+{
+    virJSONValuePtr data;
+    unsigned long long mem;
+
+    /* See if balloon soft-failed */
+    if (qemuMonitorJSONHasError(reply, "DeviceNotActive") ||
+        qemuMonitorJSONHasError(reply, "KVMMissingCap"))
+        return 0;
+
+    /* See if any other fatal error occurred */
+    if (qemuMonitorJSONCheckError(cmd, reply) < 0)
+        return -1;
+
+    if (!(data = virJSONValueObjectGet(reply, "return"))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("info balloon reply was missing return data"));
+        return -1;
+    }
+
+    if (virJSONValueObjectGetNumberUlong(data, "actual", &mem) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("info balloon reply was missing balloon data"));
+        return -1;
+    }
+
+    *currmem = (mem/1024);
+    return 1;
+}
+
+
 /*
  * Returns: 0 if balloon not supported, +1 if balloon query worked
  * or -1 on failure
@@ -1420,40 +1567,9 @@ int qemuMonitorJSONGetBalloonInfo(qemuMonitorPtr mon,
 
     ret = qemuMonitorJSONCommand(mon, cmd, &reply);
 
-    if (ret == 0) {
-        /* See if balloon soft-failed */
-        if (qemuMonitorJSONHasError(reply, "DeviceNotActive") ||
-            qemuMonitorJSONHasError(reply, "KVMMissingCap"))
-            goto cleanup;
-
-        /* See if any other fatal error occurred */
-        ret = qemuMonitorJSONCheckError(cmd, reply);
-
-        /* Success */
-        if (ret == 0) {
-            virJSONValuePtr data;
-            unsigned long long mem;
-
-            if (!(data = virJSONValueObjectGet(reply, "return"))) {
-                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                               _("info balloon reply was missing return data"));
-                ret = -1;
-                goto cleanup;
-            }
-
-            if (virJSONValueObjectGetNumberUlong(data, "actual", &mem) < 0) {
-                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                               _("info balloon reply was missing balloon data"));
-                ret = -1;
-                goto cleanup;
-            }
-
-            *currmem = (mem/1024);
-            ret = 1;
-        }
-    }
+    if (ret == 0)
+        ret = qemuMonitorJSONBalloonInfoParse(cmd, reply, currmem);
 
- cleanup:
     virJSONValueFree(cmd);
     virJSONValueFree(reply);
     return ret;
@@ -1497,37 +1613,19 @@ int qemuMonitorJSONGetBalloonInfo(qemuMonitorPtr mon,
     }
 
 
-int qemuMonitorJSONGetMemoryStats(qemuMonitorPtr mon,
-                                  char *balloonpath,
-                                  virDomainMemoryStatPtr stats,
-                                  unsigned int nr_stats)
+/* Appends the statistics in the @reply to a qom-get guest-stats @cmd to
+ * the *@gotp already in @stats */
+static int
+qemuMonitorJSONMemoryStatsParse(virJSONValuePtr cmd,
+                                virJSONValuePtr reply,
+                                virDomainMemoryStatPtr stats,
+                                unsigned int nr_stats,
+                                int *gotp)
 {
-    int ret;
-    virJSONValuePtr cmd = NULL;
-    virJSONValuePtr reply = NULL;
     virJSONValuePtr data;
     virJSONValuePtr statsdata;
     unsigned long long mem;
-    int got = 0;
-
-    ret = qemuMonitorJSONGetBalloonInfo(mon, &mem);
-    if (ret == 1 && (got < nr_stats)) {
-        stats[got].tag = VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON;
-        stats[got].val = mem;
-        got++;
-    }
-
-    if (!balloonpath)
-        goto cleanup;
-
-    if (!(cmd = qemuMonitorJSONMakeCommand("qom-get",
-                                           "s:path", balloonpath,
-                                           "s:property", "guest-stats",
-                                           NULL)))
-        goto cleanup;
-
-    if ((ret = qemuMonitorJSONCommand(mon, cmd, &reply)) < 0)
-        goto cleanup;
+    int got = *gotp;
 
     if ((data = virJSONValueObjectGet(reply, "error"))) {
         const char *klass = virJSONValueObjectGetString(data, "class");
@@ -1537,22 +1635,22 @@ int qemuMonitorJSONGetMemoryStats(qemuMonitorPtr mon,
             STREQ_NULLABLE(desc, "guest hasn't updated any stats yet")) {
             virReportError(VIR_ERR_OPERATION_INVALID, "%s",
                            _("the guest hasn't updated any stats yet"));
-            goto cleanup;
+            return 0;
         }
     }
 
-    if ((ret = qemuMonitorJSONCheckError(cmd, reply)) < 0)
-        goto cleanup;
+    if (qemuMonitorJSONCheckError(cmd, reply) < 0)
+        return -1;
 
     if (!(data = virJSONValueObjectGet(reply, "return"))) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("qom-get reply was missing return data"));
-        goto cleanup;
+        return 0;
     }
 
     if (!(statsdata = virJSONValueObjectGet(data, "stats"))) {
         VIR_DEBUG("data does not include 'stats'");
-        goto cleanup;
+        return 0;
     }
 
     GET_BALLOON_STATS("stat-swap-in",
@@ -1568,6 +1666,42 @@ int qemuMonitorJSONGetMemoryStats(qemuMonitorPtr mon,
     GET_BALLOON_STATS("stat-total-memory",
                       VIR_DOMAIN_MEMORY_STAT_AVAILABLE, 1024);
 
+    *gotp = got;
+    return 0;
+}
+
+
+int qemuMonitorJSONGetMemoryStats(qemuMonitorPtr mon,
+                                  char *balloonpath,
+                                  virDomainMemoryStatPtr stats,
+                                  unsigned int nr_stats)
+{
+    int ret;
+    virJSONValuePtr cmd = NULL;
+    virJSONValuePtr reply = NULL;
+    unsigned long long mem;
+    int got = 0;
+
+    ret = qemuMonitorJSONGetBalloonInfo(mon, &mem);
+    if (ret == 1 && (got < nr_stats)) {
+        stats[got].tag = VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON;
+        stats[got].val = mem;
+        got++;
+    }
+
+    if (!balloonpath)
+        goto cleanup;
+
+    if (!(cmd = qemuMonitorJSONMakeCommand("qom-get",
+                                           "s:path", balloonpath,
+                                           "s:property", "guest-stats",
+                                           NULL)))
+        goto cleanup;
+
+    if ((ret = qemuMonitorJSONCommand(mon, cmd, &reply)) < 0)
+        goto cleanup;
+
+    ret = qemuMonitorJSONMemoryStatsParse(cmd, reply, stats, nr_stats, &got);
 
  cleanup:
     virJSONValueFree(cmd);
@@ -1700,54 +1834,29 @@ int qemuMonitorJSONGetBlockInfo(qemuMonitorPtr mon,
 }
 
 
-int qemuMonitorJSONGetBlockStatsInfo(qemuMonitorPtr mon,
-                                     const char *dev_name,
-                                     long long *rd_req,
-                                     long long *rd_bytes,
-                                     long long *rd_total_times,
-                                     long long *wr_req,
-                                     long long *wr_bytes,
-                                     long long *wr_total_times,
-                                     long long *flush_req,
-                                     long long *flush_total_times,
-                                     long long *errs)
+/* Fills in the statistics of @dev_name from a query-blockstats @reply.
+ * The outputs must have been initialized to -1 by the caller. */
+static int
+qemuMonitorJSONBlockStatsParse(virJSONValuePtr reply,
+                               const char *dev_name,
+                               long long *rd_req,
+                               long long *rd_bytes,
+                               long long *rd_total_times,
+                               long long *wr_req,
+                               long long *wr_bytes,
+                               long long *wr_total_times,
+                               long long *flush_req,
+                               long long *flush_total_times)
 {
-    int ret;
     size_t i;
     bool found = false;
-    virJSONValuePtr cmd = qemuMonitorJSONMakeCommand("query-blockstats",
-                                                     NULL);
-    virJSONValuePtr reply = NULL;
     virJSONValuePtr devices;
 
-    *rd_req = *rd_bytes = -1;
-    *wr_req = *wr_bytes = *errs = -1;
-
-    if (rd_total_times)
-        *rd_total_times = -1;
-    if (wr_total_times)
-        *wr_total_times = -1;
-    if (flush_req)
-        *flush_req = -1;
-    if (flush_total_times)
-        *flush_total_times = -1;
-
-    if (!cmd)
-        return -1;
-
-    ret = qemuMonitorJSONCommand(mon, cmd, &reply);
-
-    if (ret == 0)
-        ret = qemuMonitorJSONCheckError(cmd, reply);
-    if (ret < 0)
-        goto cleanup;
-    ret = -1;
-
     devices = virJSONValueObjectGet(reply, "return");
     if (!devices || devices->type != VIR_JSON_TYPE_ARRAY) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("blockstats reply was missing device list"));
-        goto cleanup;
+        return -1;
     }
 
     for (i = 0; i < virJSONValueArraySize(devices); i++) {
@@ -1757,13 +1866,13 @@ int qemuMonitorJSONGetBlockStatsInfo(qemuMonitorPtr mon,
         if (!dev || dev->type != VIR_JSON_TYPE_OBJECT) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("blockstats device entry was not in expected format"));
-            goto cleanup;
+            return -1;
         }
 
         if ((thisdev = virJSONValueObjectGetString(dev, "device")) == NULL) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("blockstats device entry was not in expected format"));
-            goto cleanup;
+            return -1;
         }
 
         /* New QEMU has separate names for host & guest side of the disk
@@ -1781,20 +1890,20 @@ int qemuMonitorJSONGetBlockStatsInfo(qemuMonitorPtr mon,
             stats->type != VIR_JSON_TYPE_OBJECT) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("blockstats stats entry was not in expected format"));
-            goto cleanup;
+            return -1;
         }
 
         if (virJSONValueObjectGetNumberLong(stats, "rd_bytes", rd_bytes) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("cannot read %s statistic"),
                            "rd_bytes");
-            goto cleanup;
+            return -1;
         }
         if (virJSONValueObjectGetNumberLong(stats, "rd_operations", rd_req) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("cannot read %s statistic"),
                             "rd_operations");
-            goto cleanup;
+            return -1;
         }
         if (rd_total_times &&
             virJSONValueObjectHasKey(stats, "rd_total_time_ns") &&
@@ -1803,19 +1912,19 @@ int qemuMonitorJSONGetBlockStatsInfo(qemuMonitorPtr mon,
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("cannot read %s statistic"),
                            "rd_total_time_ns");
-            goto cleanup;
+            return -1;
         }
         if (virJSONValueObjectGetNumberLong(stats, "wr_bytes", wr_bytes) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("cannot read %s statistic"),
                            "wr_bytes");
-            goto cleanup;
+            return -1;
         }
         if (virJSONValueObjectGetNumberLong(stats, "wr_operations", wr_req) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("cannot read %s statistic"),
                            "wr_operations");
-            goto cleanup;
+            return -1;
         }
         if (wr_total_times &&
             virJSONValueObjectHasKey(stats, "wr_total_time_ns") &&
@@ -1824,7 +1933,7 @@ int qemuMonitorJSONGetBlockStatsInfo(qemuMonitorPtr mon,
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("cannot read %s statistic"),
                            "wr_total_time_ns");
-            goto cleanup;
+            return -1;
         }
         if (flush_req &&
             virJSONValueObjectHasKey(stats, "flush_operations") &&
@@ -1833,7 +1942,7 @@ int qemuMonitorJSONGetBlockStatsInfo(qemuMonitorPtr mon,
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("cannot read %s statistic"),
                            "flush_operations");
-            goto cleanup;
+            return -1;
         }
         if (flush_total_times &&
             virJSONValueObjectHasKey(stats, "flush_total_time_ns") &&
@@ -1842,15 +1951,65 @@ int qemuMonitorJSONGetBlockStatsInfo(qemuMonitorPtr mon,
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("cannot read %s statistic"),
                            "flush_total_time_ns");
-            goto cleanup;
+            return -1;
         }
     }
 
     if (!found) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("cannot find statistics for device '%s'"), dev_name);
-        goto cleanup;
+        return -1;
     }
+    return 0;
+}
+
+
+int qemuMonitorJSONGetBlockStatsInfo(qemuMonitorPtr mon,
+                                     const char *dev_name,
+                                     long long *rd_req,
+                                     long long *rd_bytes,
+                                     long long *rd_total_times,
+                                     long long *wr_req,
+                                     long long *wr_bytes,
+                                     long long *wr_total_times,
+                                     long long *flush_req,
+                                     long long *flush_total_times,
+                                     long long *errs)
+{
+    int ret;
+    virJSONValuePtr cmd = qemuMonitorJSONMakeCommand("query-blockstats",
+                                                     NULL);
+    virJSONValuePtr reply = NULL;
+
+    *rd_req = *rd_bytes = -1;
+    *wr_req = *wr_bytes = *errs = -1;
+
+    if (rd_total_times)
+        *rd_total_times = -1;
+    if (wr_total_times)
+        *wr_total_times = -1;
+    if (flush_req)
+        *flush_req = -1;
+    if (flush_total_times)
+        *flush_total_times = -1;
+
+    if (!cmd)
+        return -1;
+
+    ret = qemuMonitorJSONCommand(mon, cmd, &reply);
+
+    if (ret == 0)
+        ret = qemuMonitorJSONCheckError(cmd, reply);
+    if (ret < 0)
+        goto cleanup;
+    ret = -1;
+
+    if (qemuMonitorJSONBlockStatsParse(reply, dev_name,
+                                       rd_req, rd_bytes, rd_total_times,
+                                       wr_req, wr_bytes, wr_total_times,
+                                       flush_req, flush_total_times) < 0)
+        goto cleanup;
+
     ret = 0;
 
  cleanup:
@@ -1860,6 +2019,85 @@ int qemuMonitorJSONGetBlockStatsInfo(qemuMonitorPtr mon,
 }
 
 
+/*
+ * Collects the balloon size, memory statistics and block statistics of
+ * @devs in a single batch of commands, see qemuMonitorGetStatsSample.
+ */
+int
+qemuMonitorJSONGetStatsSample(qemuMonitorPtr mon,
+                              char *balloonpath,
+                              virDomainMemoryStatPtr mem,
+                              unsigned int nr_mem,
+                              unsigned long long *balloon,
+                              const char **devs,
+                              qemuMonitorBlockStatsPtr blockstats,
+                              size_t ndevs)
+{
+    int ret = -1;
+    virJSONValuePtr cmds[3] = { NULL, NULL, NULL };
+    virJSONValuePtr replies[3] = { NULL, NULL, NULL };
+    size_t ncmds = 2;
+    int got = 0;
+    size_t i;
+
+    if (!(cmds[0] = qemuMonitorJSONMakeCommand("query-balloon", NULL)) ||
+        !(cmds[1] = qemuMonitorJSONMakeCommand("query-blockstats", NULL)))
+        goto cleanup;
+
+    if (balloonpath) {
+        if (!(cmds[2] = qemuMonitorJSONMakeCommand("qom-get",
+                                                   "s:path", balloonpath,
+                                                   "s:property", "guest-stats",
+                                                   NULL)))
+            goto cleanup;
+        ncmds++;
+    }
+
+    if (qemuMonitorJSONCommandBatch(mon, cmds, ncmds, replies) < 0)
+        goto cleanup;
+
+    /* Every part of the sample is optional: a guest without a balloon
+     * driver still has disks worth looking at */
+    if (qemuMonitorJSONBalloonInfoParse(cmds[0], replies[0], balloon) == 1 &&
+        got < nr_mem) {
+        mem[got].tag = VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON;
+        mem[got].val = *balloon;
+        got++;
+    }
+
+    if (balloonpath)
+        ignore_value(qemuMonitorJSONMemoryStatsParse(cmds[2], replies[2],
+                                                     mem, nr_mem, &got));
+
+    if (qemuMonitorJSONCheckError(cmds[1], replies[1]) == 0) {
+        for (i = 0; i < ndevs; i++) {
+            qemuMonitorBlockStatsPtr stats = &blockstats[i];
+
+            if (qemuMonitorJSONBlockStatsParse(replies[1], devs[i],
+                                               &stats->rd_req,
+                                               &stats->rd_bytes,
+                                               &stats->rd_total_times,
+                                               &stats->wr_req,
+                                               &stats->wr_bytes,
+                                               &stats->wr_total_times,
+                                               &stats->flush_req,
+                                               &stats->flush_total_times) < 0)
+                stats->rd_req = -1;
+        }
+    }
+
+    virResetLastError();
+    ret = got;
+
+ cleanup:
+    for (i = 0; i < ARRAY_CARDINALITY(cmds); i++) {
+        virJSONValueFree(cmds[i]);
+        virJSONValueFree(replies[i]);
+    }
+    return ret;
+}
+
+
 int qemuMonitorJSONGetBlockStatsParamsNumber(qemuMonitorPtr mon,
                                              int *nparams)
 {
@@ -1016,11 +1016,17 @@ qemuProcessHandleBlockJob(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     virObjectEventPtr event2 = NULL;
     const char *path;
     virDomainDiskDefPtr disk;
+    qemuDomainBlockJobPtr job;
 
     virObjectLock(vm);
     disk = qemuProcessFindDomainDiskByAlias(vm, diskAlias);
 
     if (disk) {
+        if ((job = qemuDomainBlockJobAdd(vm->privateData, disk->dst))) {
+            job->type = type;
+            qemuDomainBlockJobSetStatus(vm->privateData, job, status);
+        }
+
         /* Have to generate two variants of the event for old vs. new
          * client callbacks */
         path = virDomainDiskGetSource(disk);
@@ -1285,6 +1291,7 @@ qemuProcessHandleBalloonChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     VIR_DEBUG("Updating balloon from %lld to %lld kb",
               vm->def->mem.cur_balloon, actual);
     vm->def->mem.cur_balloon = actual;
+    qemuDomainStatsCacheUpdateBalloon(vm, actual);
 
     if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm) < 0)
         VIR_WARN("unable to save domain status with balloon change");
@@ -1420,6 +1427,35 @@ qemuProcessHandleDeviceDeleted(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
 }
 
 
+static int
+qemuProcessHandleMigrationStatus(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
+                                 virDomainObjPtr vm,
+                                 int status,
+                                 void *opaque ATTRIBUTE_UNUSED)
+{
+    qemuDomainObjPrivatePtr priv;
+
+    virObjectLock(vm);
+
+    VIR_DEBUG("Migration of domain %p %s changed state to %s",
+              vm, vm->def->name,
+              NULLSTR(qemuMonitorMigrationStatusTypeToString(status)));
+
+    priv = vm->privateData;
+    if (priv->job.asyncJob == QEMU_ASYNC_JOB_NONE) {
+        VIR_DEBUG("got MIGRATION event without a migration job");
+        goto cleanup;
+    }
+
+    /* qemuMigrationWaitForCompletion queries the details itself */
+    qemuDomainObjMigrationEventNotify(vm);
+
+ cleanup:
+    virObjectUnlock(vm);
+    return 0;
+}
+
+
 static qemuMonitorCallbacks monitorCallbacks = {
     .eofNotify = qemuProcessHandleMonitorEOF,
     .errorNotify = qemuProcessHandleMonitorError,
@@ -1441,6 +1477,7 @@ static qemuMonitorCallbacks monitorCallbacks = {
     .domainPMSuspendDisk = qemuProcessHandlePMSuspendDisk,
     .domainGuestPanic = qemuProcessHandleGuestPanic,
     .domainDeviceDeleted = qemuProcessHandleDeviceDeleted,
+    .domainMigrationStatus = qemuProcessHandleMigrationStatus,
 };
 
 static int
@@ -1500,6 +1537,17 @@ qemuConnectMonitor(virQEMUDriverPtr driver, virDomainObjPtr vm, int logfd)
     if (ret == 0 &&
         virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MONITOR_JSON))
         ret = virQEMUCapsProbeQMP(priv->qemuCaps, priv->mon);
+
+    /* QEMU only sends MIGRATION events once asked to; if that fails,
+     * migration just falls back to polling */
+    if (ret == 0 &&
+        virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATION_EVENT) &&
+        qemuMonitorSetMigrationCapability(priv->mon,
+                                          QEMU_MONITOR_MIGRATION_CAPS_EVENTS) < 0) {
+        VIR_DEBUG("Cannot enable migration events; clearing capability");
+        virQEMUCapsClear(priv->qemuCaps, QEMU_CAPS_MIGRATION_EVENT);
+        virResetLastError();
+    }
     qemuDomainObjExitMonitor(driver, vm);
 
  error:
@@ -2027,20 +2075,23 @@ qemuProcessDetectVcpuPIDs(virQEMUDriverPtr driver,
  */
 virBitmapPtr
 qemuPrepareCpumap(virQEMUDriverPtr driver,
+                  virDomainObjPtr vm,
                   virBitmapPtr nodemask)
 {
     size_t i;
-    int hostcpus, maxcpu = QEMUD_CPUMASK_LEN;
+    int maxcpu = QEMUD_CPUMASK_LEN;
     virBitmapPtr cpumap = NULL;
     virCapsPtr caps = NULL;
+    virQEMUDriverHostDataPtr hostData;
 
     /* setaffinity fails if you set bits for CPUs which
      * aren't present, so we have to limit ourselves */
-    if ((hostcpus = nodeGetCPUCount()) < 0)
+    if (!(hostData = qemuDomainGetHostData(driver, vm)))
         return NULL;
 
-    if (maxcpu > hostcpus)
-        maxcpu = hostcpus;
+    if (maxcpu > hostData->ncpus)
+        maxcpu = hostData->ncpus;
+    virObjectUnref(hostData);
 
     if (!(cpumap = virBitmapNew(maxcpu)))
         return NULL;
@@ -2094,7 +2145,7 @@ qemuProcessInitCpuAffinity(virQEMUDriverPtr driver,
         return -1;
     }
 
-    if (!(cpumap = qemuPrepareCpumap(driver, nodemask)))
+    if (!(cpumap = qemuPrepareCpumap(driver, vm, nodemask)))
         return -1;
 
     if (vm->def->placement_mode == VIR_DOMAIN_CPU_PLACEMENT_MODE_AUTO) {
@@ -3168,12 +3219,36 @@ qemuProcessUpdateDevices(virQEMUDriverPtr driver,
     return ret;
 }
 
+/* Upper bound on domains reconnected in parallel at daemon startup, so
+ * that a host running hundreds of guests doesn't spawn a thread and a
+ * monitor handshake for every one of them at once */
+#define QEMU_PROCESS_RECONNECT_WORKERS 8
+
 struct qemuProcessReconnectData {
     virConnectPtr conn;
     virQEMUDriverPtr driver;
     void *payload;
     struct qemuDomainJobObj oldjob;
+    unsigned long long queued; /* when the reconnect was queued */
 };
+
+
+/* Milliseconds since *@stamp, which is then moved forward to now */
+static unsigned long long
+qemuProcessReconnectLap(unsigned long long *stamp)
+{
+    unsigned long long now;
+    unsigned long long ret;
+
+    if (virTimeMillisNowRaw(&now) < 0 || !*stamp || now < *stamp)
+        return 0;
+
+    ret = now - *stamp;
+    *stamp = now;
+    return ret;
+}
+
+
 /*
  * Open an existing VM's monitor, re-detect VCPU threads
  * and re-reserve the security labels in use
@@ -3196,11 +3271,19 @@ qemuProcessReconnect(void *opaque)
     virQEMUDriverConfigPtr cfg;
     size_t i;
     int ret;
+    unsigned long long stamp = data->queued;
+    unsigned long long queuedTime;
+    unsigned long long monitorTime = 0;
+    unsigned long long devicesTime = 0;
+    unsigned long long stateTime = 0;
+    unsigned long long setupTime = 0;
 
     memcpy(&oldjob, &data->oldjob, sizeof(oldjob));
 
     VIR_FREE(data);
 
+    queuedTime = qemuProcessReconnectLap(&stamp);
+
     virObjectLock(obj);
 
     cfg = virQEMUDriverGetConfig(driver);
@@ -3230,6 +3313,8 @@ qemuProcessReconnect(void *opaque)
         priv->agentError = true;
     }
 
+    monitorTime = qemuProcessReconnectLap(&stamp);
+
     if (qemuUpdateActivePCIHostdevs(driver, obj->def) < 0) {
         goto error;
     }
@@ -3263,6 +3348,8 @@ qemuProcessReconnect(void *opaque)
             goto error;
     }
 
+    devicesTime = qemuProcessReconnectLap(&stamp);
+
     if (qemuProcessUpdateState(driver, obj) < 0)
         goto error;
 
@@ -3298,6 +3385,8 @@ qemuProcessReconnect(void *opaque)
         if ((qemuDomainAssignAddresses(obj->def, priv->qemuCaps, obj)) < 0)
             goto error;
 
+    stateTime = qemuProcessReconnectLap(&stamp);
+
     if (virSecurityManagerReserveLabel(driver->securityManager, obj->def, obj->pid) < 0)
         goto error;
 
@@ -3340,7 +3429,14 @@ qemuProcessReconnect(void *opaque)
     if (virAtomicIntInc(&driver->nactive) == 1 && driver->inhibitCallback)
         driver->inhibitCallback(true, driver->inhibitOpaque);
 
+    setupTime = qemuProcessReconnectLap(&stamp);
+
  endjob:
+    VIR_DEBUG("Reconnected to '%s': queued %llu ms, monitor %llu ms, "
+              "devices %llu ms, state %llu ms, setup %llu ms",
+              obj->def->name, queuedTime, monitorTime,
+              devicesTime, stateTime, setupTime);
+
     if (!qemuDomainObjEndJob(driver, obj))
         obj = NULL;
 
@@ -3386,13 +3482,70 @@ qemuProcessReconnect(void *opaque)
     virObjectUnref(cfg);
 }
 
+/*
+ * Runs in driver->reconnectPool. A domain a client is already waiting
+ * for is queued a second time with priority, so whichever job gets to
+ * it first takes the reconnect data and the other one does nothing.
+ */
+static void
+qemuProcessReconnectWorker(void *jobdata,
+                           void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainObjPtr obj = jobdata;
+    qemuDomainObjPrivatePtr priv;
+    struct qemuProcessReconnectData *data;
+
+    virObjectLock(obj);
+    priv = obj->privateData;
+    data = priv->reconnect;
+    priv->reconnect = NULL;
+    virObjectUnlock(obj);
+
+    if (data)
+        qemuProcessReconnect(data);
+
+    virObjectUnref(obj);
+}
+
+
+/**
+ * qemuProcessReconnectPrioritize:
+ * @driver: qemu driver
+ * @vm: domain object, locked
+ *
+ * Called when someone is about to wait for a job on @vm. If the
+ * reconnect to @vm queued at daemon startup didn't run yet, make sure
+ * it overtakes the domains nobody is waiting for.
+ */
+void
+qemuProcessReconnectPrioritize(virQEMUDriverPtr driver,
+                               virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    if (!priv->reconnect || priv->reconnectUrgent)
+        return;
+
+    VIR_DEBUG("Reconnecting to '%s' out of order", vm->def->name);
+
+    virObjectRef(vm);
+    if (virThreadPoolSendJob(driver->reconnectPool, 1, vm) < 0) {
+        /* It's still queued normally, nothing lost */
+        virResetLastError();
+        virObjectUnref(vm);
+        return;
+    }
+    priv->reconnectUrgent = true;
+}
+
+
 static int
 qemuProcessReconnectHelper(virDomainObjPtr obj,
                            void *opaque)
 {
-    virThread thread;
     struct qemuProcessReconnectData *src = opaque;
     struct qemuProcessReconnectData *data;
+    qemuDomainObjPrivatePtr priv = obj->privateData;
 
     if (!obj->pid)
         return 0;
@@ -3402,9 +3555,11 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
 
     memcpy(data, src, sizeof(*data));
     data->payload = obj;
+    if (virTimeMillisNowRaw(&data->queued) < 0)
+        data->queued = 0;
 
     /*
-     * We create a separate thread to run qemuProcessReconnect in it.
+     * We queue qemuProcessReconnect to driver->reconnectPool.
      * However, qemuProcessReconnect needs to:
      * 1. just before monitor reconnect do lightweight MonitorEnter
      *    (increase VM refcount, unlock VM & driver)
@@ -3431,12 +3586,18 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
      */
     virObjectRef(data->conn);
 
-    if (virThreadCreate(&thread, false, qemuProcessReconnect, data) < 0) {
+    virObjectRef(obj);
+    priv->reconnect = data;
+
+    if (!src->driver->reconnectPool ||
+        virThreadPoolSendJob(src->driver->reconnectPool, 0, obj) < 0) {
 
+        priv->reconnect = NULL;
+        virObjectUnref(obj);
         virObjectUnref(data->conn);
 
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Could not create thread. QEMU initialization "
+                       _("Could not queue reconnect. QEMU initialization "
                          "might be incomplete"));
         if (!qemuDomainObjEndJob(src->driver, obj)) {
             obj = NULL;
@@ -3471,6 +3632,12 @@ void
 qemuProcessReconnectAll(virConnectPtr conn, virQEMUDriverPtr driver)
 {
     struct qemuProcessReconnectData data = {.conn = conn, .driver = driver};
+
+    /* One priority worker for domains clients are already waiting on */
+    driver->reconnectPool = virThreadPoolNew(0, QEMU_PROCESS_RECONNECT_WORKERS,
+                                             1, qemuProcessReconnectWorker,
+                                             driver);
+
     virDomainObjListForEach(driver->domains, qemuProcessReconnectHelper, &data);
 }
 
@@ -3648,6 +3815,43 @@ qemuProcessVerifyGuestCPU(virQEMUDriverPtr driver, virDomainObjPtr vm)
 }
 
 
+/* Wall clock time spent in each phase of qemuProcessStart, logged
+ * once the domain is running so slow startups can be pinned down */
+typedef struct _qemuProcessStartTimes qemuProcessStartTimes;
+typedef qemuProcessStartTimes *qemuProcessStartTimesPtr;
+struct _qemuProcessStartTimes {
+    unsigned long long start;
+    unsigned long long last;
+    virBuffer phases;
+};
+
+
+static void
+qemuProcessStartTimesInit(qemuProcessStartTimesPtr times)
+{
+    virBuffer phases = VIR_BUFFER_INITIALIZER;
+
+    times->phases = phases;
+    if (virTimeMillisNowRaw(&times->start) < 0)
+        times->start = 0;
+    times->last = times->start;
+}
+
+
+static void
+qemuProcessStartTimesMark(qemuProcessStartTimesPtr times,
+                          const char *phase)
+{
+    unsigned long long now;
+
+    if (virTimeMillisNowRaw(&now) < 0)
+        return;
+
+    virBufferAsprintf(&times->phases, " %s=%llu", phase, now - times->last);
+    times->last = now;
+}
+
+
 int qemuProcessStart(virConnectPtr conn,
                      virQEMUDriverPtr driver,
                      virDomainObjPtr vm,
@@ -3673,7 +3877,11 @@ int qemuProcessStart(virConnectPtr conn,
     unsigned int stop_flags;
     virQEMUDriverConfigPtr cfg;
     virCapsPtr caps = NULL;
+    virQEMUDriverHostDataPtr hostData = NULL;
     unsigned int hostdev_flags = 0;
+    qemuProcessStartTimes times;
+
+    qemuProcessStartTimesInit(&times);
 
     VIR_DEBUG("vm=%p name=%s id=%d pid=%llu",
               vm, vm->def->name, vm->def->id,
@@ -3712,9 +3920,13 @@ int qemuProcessStart(virConnectPtr conn,
         return -1;
     }
 
-    if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
+    if (!(caps = virQEMUDriverGetCapabilities(driver, false)) ||
+        !(hostData = virQEMUDriverGetHostData(driver)))
         goto cleanup;
 
+    /* Let everything called from here reuse what was just probed */
+    priv->hostData = virObjectRef(hostData);
+
     /* Do this upfront, so any part of the startup process can add
      * runtime state to vm->def that won't be persisted. This let's us
      * report implicit runtime defaults in the XML, like vnc listen/socket
@@ -3747,12 +3959,16 @@ int qemuProcessStart(virConnectPtr conn,
             goto cleanup;
     }
 
+    qemuProcessStartTimesMark(&times, "prepare");
+
     VIR_DEBUG("Determining emulator version");
     virObjectUnref(priv->qemuCaps);
     if (!(priv->qemuCaps = virQEMUCapsCacheLookupCopy(driver->qemuCapsCache,
                                                       vm->def->emulator)))
         goto cleanup;
 
+    qemuProcessStartTimesMark(&times, "emulator");
+
     /* network devices must be "prepared" before hostdevs, because
      * setting up a network device might create a new hostdev that
      * will need to be setup.
@@ -3778,6 +3994,8 @@ int qemuProcessStart(virConnectPtr conn,
                                NULL) < 0)
         goto cleanup;
 
+    qemuProcessStartTimesMark(&times, "devices");
+
     /* If you are using a SecurityDriver with dynamic labelling,
        then generate a security label for isolation */
     VIR_DEBUG("Generating domain security label (if required)");
@@ -3870,13 +4088,15 @@ int qemuProcessStart(virConnectPtr conn,
         goto cleanup;
     }
 
+    qemuProcessStartTimesMark(&times, "labels");
+
     VIR_DEBUG("Creating domain log file");
     if ((logfile = qemuDomainCreateLog(driver, vm, false)) < 0)
         goto cleanup;
 
     if (vm->def->virtType == VIR_DOMAIN_VIRT_KVM) {
         VIR_DEBUG("Checking for KVM availability");
-        if (!virFileExists("/dev/kvm")) {
+        if (!hostData->kvm) {
             virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
                            _("Domain requires KVM, but it is not available. "
                              "Check that virtualization is enabled in the host BIOS, "
@@ -3911,6 +4131,8 @@ int qemuProcessStart(virConnectPtr conn,
     }
     hookData.nodemask = nodemask;
 
+    qemuProcessStartTimesMark(&times, "placement");
+
     /* "volume" type disk's source must be translated before
      * cgroup and security setting.
      */
@@ -3970,6 +4192,8 @@ int qemuProcessStart(virConnectPtr conn,
                                      &buildCommandLineCallbacks, false)))
         goto cleanup;
 
+    qemuProcessStartTimesMark(&times, "cmdline");
+
     /* now that we know it is about to start call the hook if present */
     if (virHookPresent(VIR_HOOK_DRIVER_QEMU)) {
         char *xml = qemuDomainDefFormatXML(driver, vm->def, 0);
@@ -4082,6 +4306,8 @@ int qemuProcessStart(virConnectPtr conn,
         goto cleanup;
     }
 
+    qemuProcessStartTimesMark(&times, "spawn");
+
     VIR_DEBUG("Setting up domain cgroup (if required)");
     if (qemuSetupCgroup(driver, vm, nodemask) < 0)
         goto cleanup;
@@ -4136,10 +4362,14 @@ int qemuProcessStart(virConnectPtr conn,
     if (ret == -1) /* The VM failed to start */
         goto cleanup;
 
+    qemuProcessStartTimesMark(&times, "setup");
+
     VIR_DEBUG("Waiting for monitor to show up");
     if (qemuProcessWaitForMonitor(driver, vm, priv->qemuCaps, pos) < 0)
         goto cleanup;
 
+    qemuProcessStartTimesMark(&times, "monitor");
+
     /* Failure to connect to agent shouldn't be fatal */
     if ((ret = qemuConnectAgent(driver, vm)) < 0) {
         if (ret == -2)
@@ -4175,6 +4405,8 @@ int qemuProcessStart(virConnectPtr conn,
     if (qemuProcessSetEmulatorAffinities(conn, vm) < 0)
         goto cleanup;
 
+    qemuProcessStartTimesMark(&times, "vcpus");
+
     VIR_DEBUG("Setting any required VM passwords");
     if (qemuProcessInitPasswords(conn, driver, vm) < 0)
         goto cleanup;
@@ -4270,10 +4502,22 @@ int qemuProcessStart(virConnectPtr conn,
     /* unset reporting errors from qemu log */
     qemuMonitorSetDomainLog(priv->mon, -1);
 
+    qemuProcessStartTimesMark(&times, "finish");
+    if (!virBufferError(&times.phases)) {
+        char *phases = virBufferContentAndReset(&times.phases);
+        VIR_INFO("Domain %s started in %llu ms:%s", vm->def->name,
+                 times.last - times.start, phases ? phases : "");
+        VIR_FREE(phases);
+    }
+    virBufferFreeAndReset(&times.phases);
+
     virCommandFree(cmd);
     VIR_FORCE_CLOSE(logfile);
     virObjectUnref(cfg);
     virObjectUnref(caps);
+    virObjectUnref(priv->hostData);
+    priv->hostData = NULL;
+    virObjectUnref(hostData);
 
     return 0;
 
@@ -4288,8 +4532,12 @@ int qemuProcessStart(virConnectPtr conn,
     if (priv->mon)
         qemuMonitorSetDomainLog(priv->mon, -1);
     qemuProcessStop(driver, vm, VIR_DOMAIN_SHUTOFF_FAILED, stop_flags);
+    virBufferFreeAndReset(&times.phases);
     virObjectUnref(cfg);
     virObjectUnref(caps);
+    virObjectUnref(priv->hostData);
+    priv->hostData = NULL;
+    virObjectUnref(hostData);
 
     return -1;
 }
@@ -4588,6 +4836,8 @@ void qemuProcessStop(virQEMUDriverPtr driver,
     priv->nvcpupids = 0;
     virObjectUnref(priv->qemuCaps);
     priv->qemuCaps = NULL;
+    qemuDomainStatsCacheClear(&priv->stats);
+    qemuDomainBlockJobClear(priv);
     VIR_FREE(priv->pidfile);
 
     /* The "release" hook cleans up additional resources */
@@ -41,6 +41,8 @@ int qemuProcessStopCPUs(virQEMUDriverPtr driver,
 
 void qemuProcessAutostartAll(virQEMUDriverPtr driver);
 void qemuProcessReconnectAll(virConnectPtr conn, virQEMUDriverPtr driver);
+void qemuProcessReconnectPrioritize(virQEMUDriverPtr driver,
+                                    virDomainObjPtr vm);
 
 int qemuProcessAssignPCIAddresses(virDomainDefPtr def);
 
@@ -99,6 +101,7 @@ int qemuProcessAutoDestroyRemove(virQEMUDriverPtr driver,
 bool qemuProcessAutoDestroyActive(virQEMUDriverPtr driver,
                                   virDomainObjPtr vm);
 virBitmapPtr qemuPrepareCpumap(virQEMUDriverPtr driver,
+                               virDomainObjPtr vm,
                                virBitmapPtr nodemask);
 
 int qemuProcessReadLog(int fd, char *buf, int buflen, int off, bool skipchar);
@@ -33,6 +33,7 @@
 #include "virlog.h"
 #include "datatypes.h"
 #include "domain_event.h"
+#include "domain_shm.h"
 #include "network_event.h"
 #include "driver.h"
 #include "virbuffer.h"
@@ -75,10 +76,26 @@ VIR_LOG_INIT("remote.remote_driver");
 static bool inside_daemon = false;
 static virDriverPtr remoteDriver = NULL;
 
+/* Upper limit for the "channels" URI parameter */
+#define REMOTE_CHANNELS_MAX 16
+
+struct remoteChannel {
+    virNetClientPtr client;
+    size_t calls;               /* Calls in flight */
+};
+
 struct private_data {
     virMutex lock;
 
     virNetClientPtr client;
+    size_t clientCalls;         /* Calls in flight on @client */
+
+    /* Additional connections to the same daemon, calls which don't
+     * depend on per-connection state in the daemon are spread over
+     * them and @client. Events and streams stay on @client */
+    struct remoteChannel *channels;
+    size_t nchannels;
+
     virNetClientProgramPtr remoteProgram;
     virNetClientProgramPtr qemuProgram;
     virNetClientProgramPtr lxcProgram;
@@ -97,6 +114,9 @@ struct private_data {
     bool serverEventFilter;     /* Does server support modern event filtering */
 
     virObjectEventStatePtr eventState;
+
+    /* Domain states published by the local daemon, if any */
+    virDomainShmReaderPtr domainShm;
 };
 
 enum {
@@ -566,6 +586,130 @@ remoteClientCloseFunc(virNetClientPtr client ATTRIBUTE_UNUSED,
  *   - xxx+ssh:///            -> SSH connection (legacy)
  *   - xxx+libssh2:///        -> SSH connection (using libssh2)
  */
+/*
+ * Open one more connection to the daemon @priv->client is talking to
+ * and do the same authentication and open calls on it. Only socket
+ * transports are supported, anything that runs a command to connect
+ * (ssh, ext) would do that once per channel.
+ */
+static virNetClientPtr
+remoteOpenChannel(virConnectPtr conn,
+                  struct private_data *priv,
+                  virConnectAuthPtr auth,
+                  const char *authtype,
+                  const char *sockname,
+                  const char *port,
+                  char *name,
+                  unsigned int flags)
+{
+    virNetClientPtr client;
+    virNetClientPtr mainClient = priv->client;
+    remote_connect_open_args args = { &name, flags };
+    int rc;
+
+    if (sockname)
+        client = virNetClientNewUNIX(sockname, false, NULL);
+    else
+        client = virNetClientNewTCP(priv->hostname, port);
+    if (!client)
+        return NULL;
+
+#ifdef WITH_GNUTLS
+    if (!sockname && priv->tls &&
+        virNetClientSetTLSSession(client, priv->tls) < 0)
+        goto error;
+#endif
+
+    if (virNetClientRegisterAsyncIO(client) < 0)
+        virResetLastError();
+    else if (virNetClientRegisterKeepAlive(client) < 0)
+        goto error;
+
+    if (virNetClientAddProgram(client, priv->remoteProgram) < 0)
+        goto error;
+
+    /* Authentication works on priv->client. Nobody else can see the
+     * connection yet, so borrowing it is safe */
+    priv->client = client;
+    rc = remoteAuthenticate(conn, priv, auth, authtype);
+    if (rc == 0)
+        rc = call(conn, priv, 0, REMOTE_PROC_CONNECT_OPEN,
+                  (xdrproc_t) xdr_remote_connect_open_args, (char *) &args,
+                  (xdrproc_t) xdr_void, (char *) NULL);
+    priv->client = mainClient;
+
+    if (rc < 0)
+        goto error;
+
+    return client;
+
+ error:
+    virNetClientClose(client);
+    virObjectUnref(client);
+    return NULL;
+}
+
+
+static int
+remoteCloseChannels(struct private_data *priv,
+                    struct remoteChannel *channels,
+                    size_t nchannels)
+{
+    size_t i;
+    int ret = 0;
+
+    for (i = 0; i < nchannels; i++) {
+        virNetClientPtr client = channels[i].client;
+
+        if (!client)
+            continue;
+
+        if (virNetClientIsOpen(client) &&
+            virNetClientProgramCall(priv->remoteProgram, client,
+                                    priv->counter++,
+                                    REMOTE_PROC_CONNECT_CLOSE,
+                                    0, NULL, NULL, NULL,
+                                    (xdrproc_t) xdr_void, (char *) NULL,
+                                    (xdrproc_t) xdr_void, (char *) NULL) < 0)
+            ret = -1;
+
+        virNetClientClose(client);
+        virObjectUnref(client);
+    }
+
+    VIR_FREE(channels);
+    return ret;
+}
+
+
+/*
+ * Read-only clients of the local system daemon may find the state of
+ * its domains published in shared memory, which answers the most
+ * common queries of monitoring tools without a round trip. Anything
+ * the snapshot cannot answer still goes to the daemon.
+ */
+static virDomainShmReaderPtr
+remoteDomainShmOpen(virConnectPtr conn)
+{
+    virDomainShmReaderPtr reader;
+    char *path = NULL;
+
+    if (!conn->uri || !conn->uri->scheme || conn->uri->server ||
+        STRNEQ_NULLABLE(conn->uri->path, "/system"))
+        return NULL;
+
+    if (virAsprintf(&path, "%s/run/libvirt/%.*s/%s", LOCALSTATEDIR,
+                    (int) strcspn(conn->uri->scheme, "+"), conn->uri->scheme,
+                    VIR_DOMAIN_SHM_FILE) < 0) {
+        virResetLastError();
+        return NULL;
+    }
+
+    reader = virDomainShmReaderOpen(path);
+    VIR_FREE(path);
+    return reader;
+}
+
 static int
 doRemoteOpen(virConnectPtr conn,
              struct private_data *priv,
@@ -663,6 +807,10 @@ doRemoteOpen(virConnectPtr conn,
 
     char *knownHostsVerify = NULL,  *knownHosts = NULL;
 
+    unsigned int nchannels = 1;
+    struct remoteChannel *channels = NULL;
+    char *channelName = NULL;
+
     /* Return code from this function, and the private data. */
     int retcode = VIR_DRV_OPEN_ERROR;
 
@@ -711,6 +859,19 @@ doRemoteOpen(virConnectPtr conn,
             EXTRACT_URI_ARG_BOOL("no_verify", verify);
             EXTRACT_URI_ARG_BOOL("no_tty", tty);
 
+            if (STRCASEEQ(var->name, "channels")) {
+                if (virStrToLong_ui(var->value, NULL, 10, &nchannels) < 0 ||
+                    nchannels < 1 || nchannels > REMOTE_CHANNELS_MAX) {
+                    virReportError(VIR_ERR_INVALID_ARG,
+                                   _("URI parameter channels must be "
+                                     "between 1 and %d"),
+                                   REMOTE_CHANNELS_MAX);
+                    goto failed;
+                }
+                var->ignore = 1;
+                continue;
+            }
+
             if (STRCASEEQ(var->name, "authfile")) {
                 /* Strip this param, used by virauth.c */
                 var->ignore = 1;
@@ -763,6 +924,16 @@ doRemoteOpen(virConnectPtr conn,
 
     VIR_DEBUG("proceeding with name = %s", name);
 
+    if (nchannels > 1 &&
+        transport != trans_unix &&
+        transport != trans_tcp &&
+        transport != trans_tls) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("remote_open: channels are only supported by the "
+                         "unix, tcp and tls transports"));
+        goto failed;
+    }
+
     /* For ext transport, command is required. */
     if (transport == trans_ext && !command) {
         virReportError(VIR_ERR_INVALID_ARG, "%s",
@@ -1051,6 +1222,35 @@ doRemoteOpen(virConnectPtr conn,
         }
     }
 
+    if (nchannels > 1) {
+        /* A probed URI must resolve to the same driver every time */
+        if (STREQ(name, "")) {
+            if (!(channelName = virURIFormat(conn->uri)))
+                goto failed;
+        } else if (VIR_STRDUP(channelName, name) < 0) {
+            goto failed;
+        }
+
+        if (VIR_ALLOC_N(channels, nchannels - 1) < 0)
+            goto failed;
+
+        /* callFull only sees the channels once they are all open */
+        for (i = 0; i < nchannels - 1; i++) {
+            if (!(channels[i].client =
+                  remoteOpenChannel(conn, priv, auth, authtype,
+                                    transport == trans_unix ? sockname : NULL,
+                                    port, channelName, flags)))
+                goto failed;
+        }
+
+        priv->channels = channels;
+        priv->nchannels = nchannels - 1;
+        channels = NULL;
+    }
+
+    if (transport == trans_unix && (flags & VIR_DRV_OPEN_REMOTE_RO))
+        priv->domainShm = remoteDomainShmOpen(conn);
+
     /* Successful. */
     retcode = VIR_DRV_OPEN_SUCCESS;
 
@@ -1068,10 +1268,13 @@ doRemoteOpen(virConnectPtr conn,
     VIR_FREE(pkipath);
     VIR_FREE(knownHostsVerify);
     VIR_FREE(knownHosts);
+    VIR_FREE(channelName);
 
     return retcode;
 
  failed:
+    if (channels)
+        ignore_value(remoteCloseChannels(priv, channels, nchannels - 1));
     virObjectUnref(priv->remoteProgram);
     virObjectUnref(priv->lxcProgram);
     virObjectUnref(priv->qemuProgram);
@@ -1225,6 +1428,11 @@ doRemoteClose(virConnectPtr conn, struct private_data *priv)
 {
     int ret = 0;
 
+    if (remoteCloseChannels(priv, priv->channels, priv->nchannels) < 0)
+        ret = -1;
+    priv->channels = NULL;
+    priv->nchannels = 0;
+
     if (call(conn, priv, 0, REMOTE_PROC_CONNECT_CLOSE,
              (xdrproc_t) xdr_void, (char *) NULL,
              (xdrproc_t) xdr_void, (char *) NULL) == -1)
@@ -1256,6 +1464,9 @@ doRemoteClose(virConnectPtr conn, struct private_data *priv)
     virObjectEventStateFree(priv->eventState);
     priv->eventState = NULL;
 
+    virDomainShmReaderFree(priv->domainShm);
+    priv->domainShm = NULL;
+
     return ret;
 }
 
@@ -1548,6 +1759,32 @@ remoteNodeGetCellsFreeMemory(virConnectPtr conn,
     return rv;
 }
 
+static int
+remoteConnectNumOfDomains(virConnectPtr conn)
+{
+    int rv = -1;
+    remote_connect_num_of_domains_ret ret;
+    struct private_data *priv = conn->privateData;
+
+    remoteDriverLock(priv);
+
+    if (priv->domainShm &&
+        (rv = virDomainShmReaderNumOfDomains(priv->domainShm)) >= 0)
+        goto done;
+
+    memset(&ret, 0, sizeof(ret));
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_NUM_OF_DOMAINS,
+             (xdrproc_t) xdr_void, (char *) NULL,
+             (xdrproc_t) xdr_remote_connect_num_of_domains_ret, (char *) &ret) == -1)
+        goto done;
+
+    rv = ret.num;
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
 static int
 remoteConnectListDomains(virConnectPtr conn, int *ids, int maxids)
 {
@@ -1559,6 +1796,10 @@ remoteConnectListDomains(virConnectPtr conn, int *ids, int maxids)
 
     remoteDriverLock(priv);
 
+    if (priv->domainShm &&
+        (rv = virDomainShmReaderListDomains(priv->domainShm, ids, maxids)) >= 0)
+        goto done;
+
     if (maxids > REMOTE_DOMAIN_LIST_MAX) {
         virReportError(VIR_ERR_RPC,
                        _("Too many domains '%d' for limit '%d'"),
@@ -1659,6 +1900,73 @@ remoteConnectListAllDomains(virConnectPtr conn,
     return rv;
 }
 
+static int
+remoteConnectListDomainsPage(virConnectPtr conn,
+                             const char *after,
+                             unsigned int maxdomains,
+                             virDomainPtr **domains,
+                             unsigned int flags)
+{
+    int rv = -1;
+    size_t i;
+    virDomainPtr *tmp = NULL;
+    remote_connect_list_domains_page_args args;
+    remote_connect_list_domains_page_ret ret;
+
+    struct private_data *priv = conn->privateData;
+
+    remoteDriverLock(priv);
+
+    args.after = after ? (char **) &after : NULL;
+    args.maxdomains = MIN(maxdomains, REMOTE_LIST_PAGE_MAX);
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    if (call(conn,
+             priv,
+             0,
+             REMOTE_PROC_CONNECT_LIST_DOMAINS_PAGE,
+             (xdrproc_t) xdr_remote_connect_list_domains_page_args,
+             (char *) &args,
+             (xdrproc_t) xdr_remote_connect_list_domains_page_ret,
+             (char *) &ret) == -1)
+        goto done;
+
+    if (ret.domains.domains_len > args.maxdomains) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many domains '%d' for limit '%d'"),
+                       ret.domains.domains_len, args.maxdomains);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(tmp, ret.domains.domains_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ret.domains.domains_len; i++) {
+        tmp[i] = get_nonnull_domain(conn, ret.domains.domains_val[i]);
+        if (!tmp[i])
+            goto cleanup;
+    }
+    *domains = tmp;
+    tmp = NULL;
+
+    rv = ret.domains.domains_len;
+
+ cleanup:
+    if (tmp) {
+        for (i = 0; i < ret.domains.domains_len; i++)
+            if (tmp[i])
+                virDomainFree(tmp[i]);
+        VIR_FREE(tmp);
+    }
+
+    xdr_free((xdrproc_t) xdr_remote_connect_list_domains_page_ret, (char *) &ret);
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
 /* Helper to free typed parameters. */
 static void
 remoteFreeTypedParameters(remote_typed_param *args_params_val,
@@ -2397,6 +2705,43 @@ remoteDomainGetSecurityLabelList(virDomainPtr domain, virSecurityLabelPtr* secla
     return rv;
 }
 
+static int
+remoteDomainGetInfo(virDomainPtr domain, virDomainInfoPtr info)
+{
+    int rv = -1;
+    remote_domain_get_info_args args;
+    remote_domain_get_info_ret ret;
+    struct private_data *priv = domain->conn->privateData;
+
+    remoteDriverLock(priv);
+
+    if (priv->domainShm &&
+        virDomainShmReaderGetInfo(priv->domainShm, domain->uuid, info) == 0) {
+        rv = 0;
+        goto done;
+    }
+
+    make_nonnull_domain(&args.dom, domain);
+
+    memset(&ret, 0, sizeof(ret));
+    if (call(domain->conn, priv, 0, REMOTE_PROC_DOMAIN_GET_INFO,
+             (xdrproc_t) xdr_remote_domain_get_info_args, (char *) &args,
+             (xdrproc_t) xdr_remote_domain_get_info_ret, (char *) &ret) == -1)
+        goto done;
+
+    info->state = ret.state;
+    info->maxMem = ret.maxMem;
+    info->memory = ret.memory;
+    info->nrVirtCpu = ret.nrVirtCpu;
+    info->cpuTime = ret.cpuTime;
+
+    rv = 0;
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
 static int
 remoteDomainGetState(virDomainPtr domain,
                      int *state,
@@ -2410,6 +2755,13 @@ remoteDomainGetState(virDomainPtr domain,
 
     remoteDriverLock(priv);
 
+    if (priv->domainShm && flags == 0 &&
+        virDomainShmReaderGetState(priv->domainShm, domain->uuid,
+                                   state, reason) == 0) {
+        rv = 0;
+        goto done;
+    }
+
     make_nonnull_domain(&args.dom, domain);
     args.flags = flags;
 
@@ -3394,6 +3746,73 @@ remoteConnectListAllNodeDevices(virConnectPtr conn,
     return rv;
 }
 
+static int
+remoteConnectListNodeDevicesPage(virConnectPtr conn,
+                                 const char *after,
+                                 unsigned int maxdevices,
+                                 virNodeDevicePtr **devices,
+                                 unsigned int flags)
+{
+    int rv = -1;
+    size_t i;
+    virNodeDevicePtr *tmp = NULL;
+    remote_connect_list_node_devices_page_args args;
+    remote_connect_list_node_devices_page_ret ret;
+
+    struct private_data *priv = conn->privateData;
+
+    remoteDriverLock(priv);
+
+    args.after = after ? (char **) &after : NULL;
+    args.maxdevices = MIN(maxdevices, REMOTE_LIST_PAGE_MAX);
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    if (call(conn,
+             priv,
+             0,
+             REMOTE_PROC_CONNECT_LIST_NODE_DEVICES_PAGE,
+             (xdrproc_t) xdr_remote_connect_list_node_devices_page_args,
+             (char *) &args,
+             (xdrproc_t) xdr_remote_connect_list_node_devices_page_ret,
+             (char *) &ret) == -1)
+        goto done;
+
+    if (ret.devices.devices_len > args.maxdevices) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many node devices '%d' for limit '%d'"),
+                       ret.devices.devices_len, args.maxdevices);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(tmp, ret.devices.devices_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ret.devices.devices_len; i++) {
+        tmp[i] = get_nonnull_node_device(conn, ret.devices.devices_val[i]);
+        if (!tmp[i])
+            goto cleanup;
+    }
+    *devices = tmp;
+    tmp = NULL;
+
+    rv = ret.devices.devices_len;
+
+ cleanup:
+    if (tmp) {
+        for (i = 0; i < ret.devices.devices_len; i++)
+            if (tmp[i])
+                virNodeDeviceFree(tmp[i]);
+        VIR_FREE(tmp);
+    }
+
+    xdr_free((xdrproc_t) xdr_remote_connect_list_node_devices_page_ret, (char *) &ret);
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
 static int
 remoteConnectListAllNWFilters(virConnectPtr conn,
                               virNWFilterPtr **filters,
@@ -3797,6 +4216,74 @@ remoteStoragePoolListAllVolumes(virStoragePoolPtr pool,
     return rv;
 }
 
+static int
+remoteStoragePoolListVolumesPage(virStoragePoolPtr pool,
+                                 const char *after,
+                                 unsigned int maxvols,
+                                 virStorageVolPtr **vols,
+                                 unsigned int flags)
+{
+    int rv = -1;
+    size_t i;
+    virStorageVolPtr *tmp = NULL;
+    remote_storage_pool_list_volumes_page_args args;
+    remote_storage_pool_list_volumes_page_ret ret;
+
+    struct private_data *priv = pool->conn->privateData;
+
+    remoteDriverLock(priv);
+
+    make_nonnull_storage_pool(&args.pool, pool);
+    args.after = after ? (char **) &after : NULL;
+    args.maxvols = MIN(maxvols, REMOTE_LIST_PAGE_MAX);
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    if (call(pool->conn,
+             priv,
+             0,
+             REMOTE_PROC_STORAGE_POOL_LIST_VOLUMES_PAGE,
+             (xdrproc_t) xdr_remote_storage_pool_list_volumes_page_args,
+             (char *) &args,
+             (xdrproc_t) xdr_remote_storage_pool_list_volumes_page_ret,
+             (char *) &ret) == -1)
+        goto done;
+
+    if (ret.vols.vols_len > args.maxvols) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many storage volumes '%d' for limit '%d'"),
+                       ret.vols.vols_len, args.maxvols);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(tmp, ret.vols.vols_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ret.vols.vols_len; i++) {
+        tmp[i] = get_nonnull_storage_vol(pool->conn, ret.vols.vols_val[i]);
+        if (!tmp[i])
+            goto cleanup;
+    }
+    *vols = tmp;
+    tmp = NULL;
+
+    rv = ret.vols.vols_len;
+
+ cleanup:
+    if (tmp) {
+        for (i = 0; i < ret.vols.vols_len; i++)
+            if (tmp[i])
+                virStorageVolFree(tmp[i]);
+        VIR_FREE(tmp);
+    }
+
+    xdr_free((xdrproc_t) xdr_remote_storage_pool_list_volumes_page_ret, (char *) &ret);
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
 
 /*----------------------------------------------------------------------*/
 
@@ -6446,6 +6933,7 @@ static int
 remoteConnectSetKeepAlive(virConnectPtr conn, int interval, unsigned int count)
 {
     struct private_data *priv = conn->privateData;
+    size_t i;
     int ret = -1;
 
     remoteDriverLock(priv);
@@ -6463,8 +6951,13 @@ remoteConnectSetKeepAlive(virConnectPtr conn, int interval, unsigned int count)
 
     if (interval > 0) {
         ret = virNetClientKeepAliveStart(priv->client, interval, count);
+        for (i = 0; ret == 0 && i < priv->nchannels; i++)
+            ret = virNetClientKeepAliveStart(priv->channels[i].client,
+                                             interval, count);
     } else {
         virNetClientKeepAliveStop(priv->client);
+        for (i = 0; i < priv->nchannels; i++)
+            virNetClientKeepAliveStop(priv->channels[i].client);
         ret = 0;
     }
 
@@ -6542,6 +7035,90 @@ remoteDomainGetDiskErrors(virDomainPtr dom,
  * Serial a set of arguments into a method call message,
  * send that to the server and wait for reply
  */
+/*
+ * Procedures which register events, open streams or leave state tied
+ * to the daemon side connection (autodestroy domains, migration close
+ * callbacks) must always use the main connection.
+ */
+static bool
+remoteCallNeedsMainClient(int proc_nr)
+{
+    switch (proc_nr) {
+    case REMOTE_PROC_CONNECT_CLOSE:
+    case REMOTE_PROC_CONNECT_DOMAIN_EVENT_REGISTER:
+    case REMOTE_PROC_CONNECT_DOMAIN_EVENT_DEREGISTER:
+    case REMOTE_PROC_CONNECT_DOMAIN_EVENT_REGISTER_ANY:
+    case REMOTE_PROC_CONNECT_DOMAIN_EVENT_DEREGISTER_ANY:
+    case REMOTE_PROC_CONNECT_DOMAIN_EVENT_CALLBACK_REGISTER_ANY:
+    case REMOTE_PROC_CONNECT_DOMAIN_EVENT_CALLBACK_DEREGISTER_ANY:
+    case REMOTE_PROC_CONNECT_NETWORK_EVENT_REGISTER_ANY:
+    case REMOTE_PROC_CONNECT_NETWORK_EVENT_DEREGISTER_ANY:
+    case REMOTE_PROC_DOMAIN_OPEN_CONSOLE:
+    case REMOTE_PROC_DOMAIN_OPEN_CHANNEL:
+    case REMOTE_PROC_DOMAIN_SCREENSHOT:
+    case REMOTE_PROC_STORAGE_VOL_UPLOAD:
+    case REMOTE_PROC_STORAGE_VOL_DOWNLOAD:
+    case REMOTE_PROC_DOMAIN_CREATE_XML:
+    case REMOTE_PROC_DOMAIN_CREATE_WITH_FLAGS:
+    case REMOTE_PROC_DOMAIN_CREATE_XML_WITH_FILES:
+    case REMOTE_PROC_DOMAIN_CREATE_WITH_FILES:
+    case REMOTE_PROC_DOMAIN_MIGRATE_PREPARE:
+    case REMOTE_PROC_DOMAIN_MIGRATE_PERFORM:
+    case REMOTE_PROC_DOMAIN_MIGRATE_FINISH:
+    case REMOTE_PROC_DOMAIN_MIGRATE_PREPARE2:
+    case REMOTE_PROC_DOMAIN_MIGRATE_FINISH2:
+    case REMOTE_PROC_DOMAIN_MIGRATE_PREPARE_TUNNEL:
+    case REMOTE_PROC_DOMAIN_MIGRATE_BEGIN3:
+    case REMOTE_PROC_DOMAIN_MIGRATE_PREPARE3:
+    case REMOTE_PROC_DOMAIN_MIGRATE_PREPARE_TUNNEL3:
+    case REMOTE_PROC_DOMAIN_MIGRATE_PERFORM3:
+    case REMOTE_PROC_DOMAIN_MIGRATE_FINISH3:
+    case REMOTE_PROC_DOMAIN_MIGRATE_CONFIRM3:
+    case REMOTE_PROC_DOMAIN_MIGRATE_BEGIN3_PARAMS:
+    case REMOTE_PROC_DOMAIN_MIGRATE_PREPARE3_PARAMS:
+    case REMOTE_PROC_DOMAIN_MIGRATE_PREPARE_TUNNEL3_PARAMS:
+    case REMOTE_PROC_DOMAIN_MIGRATE_PERFORM3_PARAMS:
+    case REMOTE_PROC_DOMAIN_MIGRATE_FINISH3_PARAMS:
+    case REMOTE_PROC_DOMAIN_MIGRATE_CONFIRM3_PARAMS:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+
+/* Pick the least busy connection for a call, preferring the main one */
+static virNetClientPtr
+remoteCallPickClient(struct private_data *priv,
+                     unsigned int flags,
+                     int proc_nr,
+                     size_t **calls)
+{
+    virNetClientPtr client = priv->client;
+    size_t i;
+
+    *calls = &priv->clientCalls;
+
+    if (!priv->nchannels ||
+        (flags & (REMOTE_CALL_QEMU | REMOTE_CALL_LXC)) ||
+        remoteCallNeedsMainClient(proc_nr))
+        return client;
+
+    for (i = 0; i < priv->nchannels; i++) {
+        struct remoteChannel *chan = &priv->channels[i];
+
+        if (chan->calls < **calls &&
+            virNetClientIsOpen(chan->client)) {
+            client = chan->client;
+            *calls = &chan->calls;
+        }
+    }
+
+    return client;
+}
+
+
 static int
 callFull(virConnectPtr conn ATTRIBUTE_UNUSED,
          struct private_data *priv,
@@ -6557,8 +7134,10 @@ callFull(virConnectPtr conn ATTRIBUTE_UNUSED,
     int rv;
     virNetClientProgramPtr prog;
     int counter = priv->counter++;
-    virNetClientPtr client = priv->client;
+    size_t *calls;
+    virNetClientPtr client = remoteCallPickClient(priv, flags, proc_nr, &calls);
     priv->localUses++;
+    (*calls)++;
 
     if (flags & REMOTE_CALL_QEMU)
         prog = priv->qemuProgram;
@@ -6582,6 +7161,7 @@ callFull(virConnectPtr conn ATTRIBUTE_UNUSED,
                                  ret_filter, ret);
     remoteDriverLock(priv);
     priv->localUses--;
+    (*calls)--;
 
     return rv;
 }
@@ -7733,6 +8313,116 @@ remoteNetworkGetDHCPLeasesForMAC(virNetworkPtr net,
 }
 
 
+static int
+remoteDomainListEvacuate(virDomainPtr *doms,
+                         unsigned int ndoms,
+                         virTypedParameterPtr params,
+                         int nparams,
+                         unsigned int flags)
+{
+    int rv = -1;
+    size_t i;
+    remote_domain_list_evacuate_args args;
+    struct private_data *priv = doms[0]->conn->privateData;
+
+    remoteDriverLock(priv);
+
+    memset(&args, 0, sizeof(args));
+
+    if (ndoms > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("too many domains '%d' for limit '%d'"),
+                       ndoms, REMOTE_DOMAIN_LIST_MAX);
+        goto done;
+    }
+
+    if (nparams > REMOTE_DOMAIN_EVACUATE_PARAMETERS_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("too many evacuation parameters '%d' for limit '%d'"),
+                       nparams, REMOTE_DOMAIN_EVACUATE_PARAMETERS_MAX);
+        goto done;
+    }
+
+    if (VIR_ALLOC_N(args.doms.doms_val, ndoms) < 0)
+        goto cleanup;
+    args.doms.doms_len = ndoms;
+    for (i = 0; i < ndoms; i++)
+        make_nonnull_domain(args.doms.doms_val + i, doms[i]);
+    args.flags = flags;
+
+    if (remoteSerializeTypedParameters(params, nparams,
+                                       &args.params.params_val,
+                                       &args.params.params_len) < 0)
+        goto cleanup;
+
+    if (call(doms[0]->conn, priv, 0, REMOTE_PROC_DOMAIN_LIST_EVACUATE,
+             (xdrproc_t) xdr_remote_domain_list_evacuate_args, (char *) &args,
+             (xdrproc_t) xdr_void, (char *) NULL) == -1)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    /* The domain names are borrowed from @doms, don't free them */
+    VIR_FREE(args.doms.doms_val);
+    remoteFreeTypedParameters(args.params.params_val,
+                              args.params.params_len);
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+static int
+remoteDomainGetBlockJobStats(virDomainPtr domain,
+                             const char *path,
+                             virTypedParameterPtr *params,
+                             int *nparams,
+                             unsigned int flags)
+{
+    int rv = -1;
+    remote_domain_get_block_job_stats_args args;
+    remote_domain_get_block_job_stats_ret ret;
+    struct private_data *priv = domain->conn->privateData;
+
+    remoteDriverLock(priv);
+
+    make_nonnull_domain(&args.dom, domain);
+    args.path = (char *) path;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    if (call(domain->conn, priv, 0, REMOTE_PROC_DOMAIN_GET_BLOCK_JOB_STATS,
+             (xdrproc_t) xdr_remote_domain_get_block_job_stats_args,
+             (char *) &args,
+             (xdrproc_t) xdr_remote_domain_get_block_job_stats_ret,
+             (char *) &ret) == -1)
+        goto done;
+
+    if (ret.params.params_len > REMOTE_DOMAIN_BLOCK_JOB_STATS_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many block job stats '%d' for limit '%d'"),
+                       ret.params.params_len,
+                       REMOTE_DOMAIN_BLOCK_JOB_STATS_MAX);
+        goto cleanup;
+    }
+
+    if (remoteDeserializeTypedParameters(ret.params.params_val,
+                                         ret.params.params_len,
+                                         0, params, nparams) < 0)
+        goto cleanup;
+
+    rv = ret.found;
+
+ cleanup:
+    xdr_free((xdrproc_t) xdr_remote_domain_get_block_job_stats_ret,
+             (char *) &ret);
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
 /* get_nonnull_domain and get_nonnull_network turn an on-wire
  * (name, uuid) pair into virDomainPtr or virNetworkPtr object.
  * These can return NULL if underlying memory allocations fail,
@@ -8070,6 +8760,9 @@ static virDriver remote_driver = {
     .domainGetTime = remoteDomainGetTime, /* 1.2.5 */
     .domainSetTime = remoteDomainSetTime, /* 1.2.5 */
     .nodeGetFreePages = remoteNodeGetFreePages, /* 1.2.6 */
+    .domainListEvacuate = remoteDomainListEvacuate, /* 1.2.7 */
+    .domainGetBlockJobStats = remoteDomainGetBlockJobStats, /* 1.2.7 */
+    .connectListDomainsPage = remoteConnectListDomainsPage, /* 1.2.7 */
 };
 
 static virNetworkDriver network_driver = {
@@ -8168,6 +8861,7 @@ static virStorageDriver storage_driver = {
     .storageVolResize = remoteStorageVolResize, /* 0.9.10 */
     .storagePoolIsActive = remoteStoragePoolIsActive, /* 0.7.3 */
     .storagePoolIsPersistent = remoteStoragePoolIsPersistent, /* 0.7.3 */
+    .storagePoolListVolumesPage = remoteStoragePoolListVolumesPage, /* 1.2.7 */
 };
 
 static virSecretDriver secret_driver = {
@@ -8200,7 +8894,8 @@ static virNodeDeviceDriver node_device_driver = {
     .nodeDeviceNumOfCaps = remoteNodeDeviceNumOfCaps, /* 0.5.0 */
     .nodeDeviceListCaps = remoteNodeDeviceListCaps, /* 0.5.0 */
     .nodeDeviceCreateXML = remoteNodeDeviceCreateXML, /* 0.6.3 */
-    .nodeDeviceDestroy = remoteNodeDeviceDestroy /* 0.6.3 */
+    .nodeDeviceDestroy = remoteNodeDeviceDestroy, /* 0.6.3 */
+    .connectListNodeDevicesPage = remoteConnectListNodeDevicesPage, /* 1.2.7 */
 };
 
 static virNWFilterDriver nwfilter_driver = {
@@ -241,6 +241,15 @@ const REMOTE_DOMAIN_FSFREEZE_MOUNTPOINTS_MAX = 256;
 /* Upper limit on the maximum number of leases in one lease file */
 const REMOTE_NETWORK_DHCP_LEASES_MAX = 65536;
 
+/* Upper limit on evacuation parameters */
+const REMOTE_DOMAIN_EVACUATE_PARAMETERS_MAX = 16;
+
+/* Upper limit on number of block job stats */
+const REMOTE_DOMAIN_BLOCK_JOB_STATS_MAX = 16;
+
+/* Upper limit on number of objects in one page of a paginated list */
+const REMOTE_LIST_PAGE_MAX = 1024;
+
 /* UUID.  VIR_UUID_BUFLEN definition comes from libvirt.h */
 typedef opaque remote_uuid[VIR_UUID_BUFLEN];
 
@@ -3056,6 +3065,54 @@ struct remote_network_get_dhcp_leases_for_mac_ret {
     unsigned int ret;
 };
 
+struct remote_domain_list_evacuate_args {
+    remote_nonnull_domain doms<REMOTE_DOMAIN_LIST_MAX>;
+    remote_typed_param params<REMOTE_DOMAIN_EVACUATE_PARAMETERS_MAX>;
+    unsigned int flags;
+};
+
+struct remote_domain_get_block_job_stats_args {
+    remote_nonnull_domain dom;
+    remote_nonnull_string path;
+    unsigned int flags;
+};
+
+struct remote_domain_get_block_job_stats_ret {
+    remote_typed_param params<REMOTE_DOMAIN_BLOCK_JOB_STATS_MAX>;
+    int found;
+};
+
+struct remote_connect_list_domains_page_args {
+    remote_string after;
+    unsigned int maxdomains;
+    unsigned int flags;
+};
+
+struct remote_connect_list_domains_page_ret {
+    remote_nonnull_domain domains<REMOTE_LIST_PAGE_MAX>;
+};
+
+struct remote_storage_pool_list_volumes_page_args {
+    remote_nonnull_storage_pool pool;
+    remote_string after;
+    unsigned int maxvols;
+    unsigned int flags;
+};
+
+struct remote_storage_pool_list_volumes_page_ret {
+    remote_nonnull_storage_vol vols<REMOTE_LIST_PAGE_MAX>;
+};
+
+struct remote_connect_list_node_devices_page_args {
+    remote_string after;
+    unsigned int maxdevices;
+    unsigned int flags;
+};
+
+struct remote_connect_list_node_devices_page_ret {
+    remote_nonnull_node_device devices<REMOTE_LIST_PAGE_MAX>;
+};
+
 /*----- Protocol. -----*/
 
 /* Define the program number, protocol version and procedure numbers here. */
@@ -3211,7 +3268,7 @@ enum remote_procedure {
     REMOTE_PROC_DOMAIN_GET_AUTOSTART = 15,
 
     /**
-     * @generate: both
+     * @generate: server
      * @acl: domain:read
      */
     REMOTE_PROC_DOMAIN_GET_INFO = 16,
@@ -3455,7 +3512,7 @@ enum remote_procedure {
     REMOTE_PROC_CONNECT_NUM_OF_DEFINED_NETWORKS = 50,
 
     /**
-     * @generate: both
+     * @generate: server
      * @priority: high
      * @acl: connect:search_domains
      * @aclfilter: domain:getattr
@@ -5419,5 +5476,42 @@ enum remote_procedure {
      * @generate: none
      * @acl: network:read
      */
-    REMOTE_PROC_NETWORK_GET_DHCP_LEASES_FOR_MAC = 342
+    REMOTE_PROC_NETWORK_GET_DHCP_LEASES_FOR_MAC = 342,
+
+    /**
+     * @generate: none
+     * @acl: domain:save:!VIR_DOMAIN_EVACUATE_MIGRATE
+     * @acl: domain:migrate:VIR_DOMAIN_EVACUATE_MIGRATE
+     */
+    REMOTE_PROC_DOMAIN_LIST_EVACUATE = 343,
+
+    /**
+     * @generate: none
+     * @acl: domain:read
+     */
+    REMOTE_PROC_DOMAIN_GET_BLOCK_JOB_STATS = 344,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: connect:search_domains
+     * @aclfilter: domain:getattr
+     */
+    REMOTE_PROC_CONNECT_LIST_DOMAINS_PAGE = 345,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: storage_pool:search_storage_vols
+     * @aclfilter: storage_vol:getattr
+     */
+    REMOTE_PROC_STORAGE_POOL_LIST_VOLUMES_PAGE = 346,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: connect:search_node_devices
+     * @aclfilter: node_device:getattr
+     */
+    REMOTE_PROC_CONNECT_LIST_NODE_DEVICES_PAGE = 347
 };
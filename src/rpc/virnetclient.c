@@ -38,6 +38,9 @@
 #include "virerror.h"
 #include "virprobe.h"
 #include "virstring.h"
+#include "virhash.h"
+#include "virhashcode.h"
+#include "virevent.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -59,6 +62,12 @@ struct _virNetClientCall {
     bool expectReply;
     bool nonBlock;
     bool haveThread;
+    bool indexed;
+
+    /* Set for calls submitted with virNetClientSendAsync */
+    virNetClientReplyFunc replyCb;
+    void *replyOpaque;
+    bool failed;
 
     virCond cond;
 
@@ -101,6 +110,14 @@ struct _virNetClient {
     /* True if a thread holds the buck */
     bool haveTheBuck;
 
+    /* Calls expecting a reply, keyed on their serial */
+    virHashTablePtr calls;
+
+    /* Finished asynchronous calls whose callbacks have yet to run */
+    virNetClientCallPtr asyncDone;
+    virNetClientCallPtr asyncDoneTail;
+    int asyncTimer;
+
     size_t nstreams;
     virNetClientStreamPtr *streams;
 
@@ -246,6 +263,129 @@ static bool virNetClientCallMatchPredicate(virNetClientCallPtr head,
 }
 
 
+static uint32_t
+virNetClientCallSerialCode(const void *name, uint32_t seed)
+{
+    unsigned int serial = (unsigned int)(uintptr_t)name;
+    return virHashCodeGen(&serial, sizeof(serial), seed);
+}
+
+
+static bool
+virNetClientCallSerialEqual(const void *namea, const void *nameb)
+{
+    return namea == nameb;
+}
+
+
+static void *
+virNetClientCallSerialCopy(const void *name)
+{
+    return (void *)name;
+}
+
+
+/* Let replies find their call without walking the whole queue. Calls
+ * sharing a serial with an outstanding one are left to the slow path */
+static void
+virNetClientCallIndex(virNetClientPtr client,
+                      virNetClientCallPtr call)
+{
+    void *key = (void *)(uintptr_t)call->msg->header.serial;
+
+    if (!call->expectReply ||
+        (call->msg->header.type != VIR_NET_CALL &&
+         call->msg->header.type != VIR_NET_CALL_WITH_FDS) ||
+        virHashLookup(client->calls, key))
+        return;
+
+    if (virHashAddEntry(client->calls, key, call) < 0) {
+        virResetLastError();
+        return;
+    }
+    call->indexed = true;
+}
+
+
+static void
+virNetClientCallUnindex(virNetClientPtr client,
+                        virNetClientCallPtr call)
+{
+    void *key = (void *)(uintptr_t)call->msg->header.serial;
+
+    if (!call->indexed)
+        return;
+
+    if (virHashLookup(client->calls, key) == call)
+        virHashRemoveEntry(client->calls, key);
+    call->indexed = false;
+}
+
+
+static void
+virNetClientAsyncQueueDone(virNetClientPtr client,
+                           virNetClientCallPtr call)
+{
+    call->next = NULL;
+    if (client->asyncDoneTail)
+        client->asyncDoneTail->next = call;
+    else
+        client->asyncDone = call;
+    client->asyncDoneTail = call;
+}
+
+
+/* Detach the finished asynchronous calls so their callbacks can be run
+ * once the client lock is released */
+static virNetClientCallPtr
+virNetClientAsyncTakeDone(virNetClientPtr client)
+{
+    virNetClientCallPtr done = client->asyncDone;
+
+    client->asyncDone = client->asyncDoneTail = NULL;
+
+    if (client->asyncTimer >= 0)
+        virEventUpdateTimeout(client->asyncTimer, -1);
+
+    return done;
+}
+
+
+static void
+virNetClientAsyncDeliver(virNetClientPtr client,
+                         virNetClientCallPtr done)
+{
+    while (done) {
+        virNetClientCallPtr next = done->next;
+
+        VIR_DEBUG("Completing asynchronous call %p failed=%d",
+                  done, done->failed);
+        done->replyCb(client, done->msg, done->failed ? -1 : 0,
+                      done->replyOpaque);
+
+        virNetMessageFree(done->msg);
+        virCondDestroy(&done->cond);
+        VIR_FREE(done);
+        done = next;
+    }
+}
+
+
+static void
+virNetClientAsyncTimer(int timer ATTRIBUTE_UNUSED,
+                       void *opaque)
+{
+    virNetClientPtr client = opaque;
+    virNetClientCallPtr done;
+
+    virObjectLock(client);
+    done = virNetClientAsyncTakeDone(client);
+    virObjectUnlock(client);
+
+    virNetClientAsyncDeliver(client, done);
+}
+
+
 bool
 virNetClientKeepAliveIsSupported(virNetClientPtr client)
 {
@@ -320,6 +460,15 @@ static virNetClientPtr virNetClientNew(virNetSocketPtr sock,
     client->wakeupReadFD = wakeupFD[0];
     client->wakeupSendFD = wakeupFD[1];
     wakeupFD[0] = wakeupFD[1] = -1;
+    client->asyncTimer = -1;
+
+    if (!(client->calls = virHashCreateFull(64,
+                                            NULL,
+                                            virNetClientCallSerialCode,
+                                            virNetClientCallSerialEqual,
+                                            virNetClientCallSerialCopy,
+                                            NULL)))
+        goto error;
 
     if (VIR_STRDUP(client->hostname, hostname) < 0)
         goto error;
@@ -613,6 +762,8 @@ void virNetClientDispose(void *obj)
 
     VIR_FREE(client->hostname);
 
+    virHashFree(client->calls);
+
     if (client->sock)
         virNetSocketRemoveIOCallback(client->sock);
     virObjectUnref(client->sock);
@@ -960,12 +1111,18 @@ virNetClientCallDispatchReply(virNetClientPtr client)
 
     /* Ok, definitely got an RPC reply now find
        out which waiting call is associated with it */
-    thecall = client->waitDispatch;
-    while (thecall &&
-           !(thecall->msg->header.prog == client->msg.header.prog &&
-             thecall->msg->header.vers == client->msg.header.vers &&
-             thecall->msg->header.serial == client->msg.header.serial))
-        thecall = thecall->next;
+    thecall = virHashLookup(client->calls,
+                            (void *)(uintptr_t)client->msg.header.serial);
+    if (!thecall ||
+        thecall->msg->header.prog != client->msg.header.prog ||
+        thecall->msg->header.vers != client->msg.header.vers) {
+        thecall = client->waitDispatch;
+        while (thecall &&
+               !(thecall->msg->header.prog == client->msg.header.prog &&
+                 thecall->msg->header.vers == client->msg.header.vers &&
+                 thecall->msg->header.serial == client->msg.header.serial))
+            thecall = thecall->next;
+    }
 
     if (!thecall) {
         virReportError(VIR_ERR_RPC,
@@ -988,6 +1145,14 @@ virNetClientCallDispatchReply(virNetClientPtr client)
     client->msg.fds = NULL;
 
     thecall->mode = VIR_NET_CLIENT_MODE_COMPLETE;
+    virNetClientCallUnindex(client, thecall);
+
+    /* Nobody sleeps on an asynchronous call, hand it straight over to
+     * whoever runs the callbacks */
+    if (thecall->replyCb) {
+        virNetClientCallRemove(&client->waitDispatch, thecall);
+        virNetClientAsyncQueueDone(client, thecall);
+    }
 
     return 0;
 }
@@ -1407,6 +1572,59 @@ virNetClientIOEventLoopRemoveAll(virNetClientCallPtr call,
 }
 
 
+static bool
+virNetClientIOEventLoopRemoveAsync(virNetClientCallPtr call,
+                                   void *opaque)
+{
+    virNetClientPtr client = opaque;
+
+    if (!call->replyCb)
+        return false;
+
+    VIR_DEBUG("Failing asynchronous call %p", call);
+    call->mode = VIR_NET_CLIENT_MODE_COMPLETE;
+    call->failed = true;
+    virNetClientAsyncQueueDone(client, call);
+    return true;
+}
+
+
+/* Drop every queued call on a closed client. Asynchronous calls still
+ * get their callback, reporting the failure, run right away with the
+ * client unlocked like the close callback. Nothing can be queued on a
+ * closed client, so the timer and the reference it holds go too. */
+static void
+virNetClientIOEventLoopRemoveAllCalls(virNetClientPtr client,
+                                      virNetClientCallPtr thiscall)
+{
+    virNetClientCallPtr done;
+
+    virNetClientCallRemovePredicate(&client->waitDispatch,
+                                    virNetClientIOEventLoopRemoveAsync,
+                                    client);
+    virNetClientCallRemovePredicate(&client->waitDispatch,
+                                    virNetClientIOEventLoopRemoveAll,
+                                    thiscall);
+    virHashRemoveAll(client->calls);
+
+    if (client->asyncTimer >= 0) {
+        virEventRemoveTimeout(client->asyncTimer);
+        client->asyncTimer = -1;
+    }
+
+    if (!(done = virNetClientAsyncTakeDone(client)))
+        return;
+
+    virObjectRef(client);
+    virObjectUnlock(client);
+
+    virNetClientAsyncDeliver(client, done);
+
+    virObjectLock(client);
+    virObjectUnref(client);
+}
+
+
 static void
 virNetClientIOEventLoopPassTheBuck(virNetClientPtr client,
                                    virNetClientCallPtr thiscall)
@@ -1428,9 +1646,7 @@ virNetClientIOEventLoopPassTheBuck(virNetClientPtr client,
     VIR_DEBUG("No thread to pass the buck to");
     if (client->wantClose) {
         virNetClientCloseLocked(client);
-        virNetClientCallRemovePredicate(&client->waitDispatch,
-                                        virNetClientIOEventLoopRemoveAll,
-                                        thiscall);
+        virNetClientIOEventLoopRemoveAllCalls(client, thiscall);
     }
 }
 
@@ -1788,6 +2004,11 @@ static int virNetClientIO(virNetClientPtr client,
     if (client->sock)
         virNetClientIOUpdateCallback(client, true);
 
+    /* Replies to asynchronous calls we picked up on the way are
+     * completed from the event loop */
+    if (client->asyncDone && client->asyncTimer >= 0)
+        virEventUpdateTimeout(client->asyncTimer, 0);
+
     if (rv == 0 &&
         virGetLastError())
         rv = -1;
@@ -1804,6 +2025,7 @@ void virNetClientIncomingEvent(virNetSocketPtr sock,
                                void *opaque)
 {
     virNetClientPtr client = opaque;
+    virNetClientCallPtr done;
 
     virObjectLock(client);
 
@@ -1846,11 +2068,12 @@ void virNetClientIncomingEvent(virNetSocketPtr sock,
  done:
     if (client->wantClose && !client->haveTheBuck) {
         virNetClientCloseLocked(client);
-        virNetClientCallRemovePredicate(&client->waitDispatch,
-                                        virNetClientIOEventLoopRemoveAll,
-                                        NULL);
+        virNetClientIOEventLoopRemoveAllCalls(client, NULL);
     }
+    done = virNetClientAsyncTakeDone(client);
     virObjectUnlock(client);
+
+    virNetClientAsyncDeliver(client, done);
 }
 
 
@@ -1955,6 +2178,7 @@ static int virNetClientSendInternal(virNetClientPtr client,
         return -1;
 
     call->haveThread = true;
+    virNetClientCallIndex(client, call);
     ret = virNetClientIO(client, call);
 
     /* If queued, the call will be finished and freed later by another thread;
@@ -1962,6 +2186,8 @@ static int virNetClientSendInternal(virNetClientPtr client,
     if (ret == 1)
         return 1;
 
+    virNetClientCallUnindex(client, call);
+
     virCondDestroy(&call->cond);
     VIR_FREE(call);
     return ret;
@@ -2065,3 +2291,95 @@ int virNetClientSendWithReplyStream(virNetClientPtr client,
         return -1;
     return 0;
 }
+
+
+/*
+ * @msg: a message allocated on the heap
+ * @cb: callback to run once the reply has arrived
+ * @opaque: data for @cb
+ *
+ * Queue a call expecting a reply without waiting for it. The reply is
+ * read into @msg and handed to @cb from the event loop, with a status
+ * of 0, or -1 if the connection went away first. Any number of calls
+ * can be outstanding at once, so a single thread can keep the
+ * connection busy.
+ *
+ * The client must have been registered with the event loop using
+ * virNetClientRegisterAsyncIO.
+ *
+ * On success @msg is owned by the client and freed once @cb returns.
+ * On failure the caller keeps @msg.
+ *
+ * Returns 0 on success, -1 on failure
+ */
+int virNetClientSendAsync(virNetClientPtr client,
+                          virNetMessagePtr msg,
+                          virNetClientReplyFunc cb,
+                          void *opaque)
+{
+    virNetClientCallPtr call;
+    int ret = -1;
+
+    PROBE(RPC_CLIENT_MSG_TX_QUEUE,
+          "client=%p len=%zu prog=%u vers=%u proc=%u type=%u status=%u serial=%u",
+          client, msg->bufferLength,
+          msg->header.prog, msg->header.vers, msg->header.proc,
+          msg->header.type, msg->header.status, msg->header.serial);
+
+    virObjectLock(client);
+
+    if (!client->sock || client->wantClose) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("client socket is closed"));
+        goto cleanup;
+    }
+
+    if (!client->asyncIO) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("asynchronous calls require the client to be "
+                         "registered with the event loop"));
+        goto cleanup;
+    }
+
+    if (client->asyncTimer < 0) {
+        virObjectRef(client);
+        if ((client->asyncTimer = virEventAddTimeout(-1,
+                                                     virNetClientAsyncTimer,
+                                                     client,
+                                                     virObjectFreeCallback)) < 0) {
+            virObjectUnref(client);
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to register async reply timer"));
+            goto cleanup;
+        }
+    }
+
+    if (!(call = virNetClientCallNew(msg, true, false)))
+        goto cleanup;
+
+    call->replyCb = cb;
+    call->replyOpaque = opaque;
+
+    VIR_DEBUG("Queueing asynchronous call %p serial=%u",
+              call, msg->header.serial);
+
+    virNetClientCallQueue(&client->waitDispatch, call);
+    virNetClientCallIndex(client, call);
+
+    if (client->haveTheBuck) {
+        char ignore = 1;
+
+        /* The dispatching thread picks up the new call once it
+         * recomputes what to poll for */
+        if (safewrite(client->wakeupSendFD, &ignore, sizeof(ignore)) != sizeof(ignore))
+            VIR_WARN("failed to wake up polling thread");
+    } else {
+        virNetClientIOUpdateCallback(client, true);
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(client);
+    return ret;
+}
@@ -106,6 +106,16 @@ int virNetClientSendWithReplyStream(virNetClientPtr client,
                                     virNetMessagePtr msg,
                                     virNetClientStreamPtr st);
 
+typedef void (*virNetClientReplyFunc)(virNetClientPtr client,
+                                      virNetMessagePtr msg,
+                                      int status,
+                                      void *opaque);
+
+int virNetClientSendAsync(virNetClientPtr client,
+                          virNetMessagePtr msg,
+                          virNetClientReplyFunc cb,
+                          void *opaque);
+
 # ifdef WITH_SASL
 void virNetClientSetSASLSession(virNetClientPtr client,
                                 virNetSASLSessionPtr sasl);
@@ -39,6 +39,11 @@
 #include "virdbus.h"
 #include "virstring.h"
 #include "virsystemd.h"
+#include "viridentity.h"
+#include "virprobe.h"
+
+#define __VIR_NET_SERVER_PRIV_H_ALLOW__
+#include "virnetserverpriv.h"
 
 #ifndef SA_SIGINFO
 # define SA_SIGINFO 0
@@ -65,6 +70,11 @@ struct _virNetServerJob {
     virNetServerClientPtr client;
     virNetMessagePtr msg;
     virNetServerProgramPtr prog;
+
+    /* Set while the call counts against a quota */
+    virNetServerQuotaPtr quota;
+    char *identity;
+    unsigned int cost;
 };
 
 struct _virNetServer {
@@ -106,6 +116,8 @@ struct _virNetServer {
     virNetTLSContextPtr tls;
 #endif
 
+    virNetServerQuotaPtr quota;
+
     unsigned int autoShutdownTimeout;
     size_t autoShutdownInhibitions;
     bool autoShutdownCallingInhibit;
@@ -182,23 +194,137 @@ static int virNetServerProcessMsg(virNetServerPtr srv,
     return ret;
 }
 
+/* The identity quotas are kept for: the most specific name the
+ * client authenticated with */
+static char *virNetServerGetQuotaIdentity(virNetServerClientPtr client)
+{
+    virIdentityPtr ident;
+    const char *value = NULL;
+    char *ret = NULL;
+
+    if (!(ident = virNetServerClientGetIdentity(client)))
+        return NULL;
+
+    if (virIdentityGetAttr(ident, VIR_IDENTITY_ATTR_SASL_USER_NAME,
+                           &value) == 0 && value) {
+        ignore_value(virAsprintf(&ret, "sasl:%s", value));
+    } else if (virIdentityGetAttr(ident, VIR_IDENTITY_ATTR_X509_DISTINGUISHED_NAME,
+                                  &value) == 0 && value) {
+        ignore_value(virAsprintf(&ret, "x509:%s", value));
+    } else if (virIdentityGetAttr(ident, VIR_IDENTITY_ATTR_UNIX_USER_ID,
+                                  &value) == 0 && value) {
+        ignore_value(virAsprintf(&ret, "uid:%s", value));
+    } else {
+        ignore_value(VIR_STRDUP(ret, "anonymous"));
+    }
+
+    virObjectUnref(ident);
+    return ret;
+}
+
+
+/*
+ * Count a call against @quota for its client's identity. With worker
+ * threads this is done when a worker picks up the call rather than
+ * when the call is queued, since the client is locked then, and a
+ * rejected call only holds up the worker for as long as it takes to
+ * send back the error.
+ *
+ * Returns 1 if the call can go ahead, 0 if it was rejected and the
+ * error sent back, -1 on fatal error
+ */
+static int virNetServerAdmitJob(virNetServerQuotaPtr quota,
+                                virNetServerJobPtr job)
+{
+    virNetMessageError rerr;
+    const char *procname;
+    int ret = -1;
+
+    /* Until the client authenticated, its identity is not known and
+     * all it may call are the authentication procedures */
+    if (!quota || !job->prog ||
+        (job->msg->header.type != VIR_NET_CALL &&
+         job->msg->header.type != VIR_NET_CALL_WITH_FDS) ||
+        virNetServerClientNeedAuth(job->client))
+        return 1;
+
+    procname = virNetServerProgramGetProcName(job->prog,
+                                              job->msg->header.proc);
+    if (!(job->cost = virNetServerQuotaGetCost(quota, procname)))
+        return 1;
+
+    if (!(job->identity = virNetServerGetQuotaIdentity(job->client)))
+        goto cleanup;
+
+    if (virNetServerQuotaAcquire(quota, job->identity, job->cost) < 0) {
+        PROBE(RPC_SERVER_CLIENT_MSG_THROTTLE,
+              "client=%p identity=%s prog=%d proc=%d cost=%u",
+              job->client, job->identity, job->msg->header.prog,
+              job->msg->header.proc, job->cost);
+        memset(&rerr, 0, sizeof(rerr));
+        if (virNetServerProgramSendReplyError(job->prog, job->client,
+                                              job->msg, &rerr,
+                                              &job->msg->header) < 0)
+            goto cleanup;
+        ret = 0;
+        goto cleanup;
+    }
+
+    job->quota = virObjectRef(quota);
+    ret = 1;
+
+ cleanup:
+    if (!job->quota) {
+        VIR_FREE(job->identity);
+        job->cost = 0;
+    }
+    return ret;
+}
+
+
+/* Give back what an admitted call counted against the quota */
+static void virNetServerReleaseJob(virNetServerJobPtr job)
+{
+    if (job->quota)
+        virNetServerQuotaRelease(job->quota, job->identity, job->cost);
+    virObjectUnref(job->quota);
+    job->quota = NULL;
+    VIR_FREE(job->identity);
+    job->cost = 0;
+}
+
+
 static void virNetServerHandleJob(void *jobOpaque, void *opaque)
 {
     virNetServerPtr srv = opaque;
     virNetServerJobPtr job = jobOpaque;
+    virNetServerQuotaPtr quota;
+    int rv;
 
     VIR_DEBUG("server=%p client=%p message=%p prog=%p",
               srv, job->client, job->msg, job->prog);
 
-    if (virNetServerProcessMsg(srv, job->client, job->prog, job->msg) < 0)
+    virObjectLock(srv);
+    quota = virObjectRef(srv->quota);
+    virObjectUnlock(srv);
+
+    rv = virNetServerAdmitJob(quota, job);
+    virObjectUnref(quota);
+    if (rv < 0)
         goto error;
 
+    if (rv > 0 &&
+        virNetServerProcessMsg(srv, job->client, job->prog, job->msg) < 0)
+        goto error;
+
+    virNetServerReleaseJob(job);
     virObjectUnref(job->prog);
     virObjectUnref(job->client);
     VIR_FREE(job);
     return;
 
  error:
+    virNetServerReleaseJob(job);
     virObjectUnref(job->prog);
     virNetMessageFree(job->msg);
     virNetServerClientClose(job->client);
@@ -206,9 +332,9 @@ static void virNetServerHandleJob(void *jobOpaque, void *opaque)
     VIR_FREE(job);
 }
 
-static int virNetServerDispatchNewMessage(virNetServerClientPtr client,
-                                          virNetMessagePtr msg,
-                                          void *opaque)
+int virNetServerDispatchNewMessage(virNetServerClientPtr client,
+                                   virNetMessagePtr msg,
+                                   void *opaque)
 {
     virNetServerPtr srv = opaque;
     virNetServerProgramPtr prog = NULL;
@@ -249,7 +375,13 @@ static int virNetServerDispatchNewMessage(virNetServerClientPtr client,
             virObjectUnref(prog);
         }
     } else {
-        ret = virNetServerProcessMsg(srv, client, prog, msg);
+        virNetServerJob job = { .client = client, .msg = msg, .prog = prog };
+
+        if ((ret = virNetServerAdmitJob(srv->quota, &job)) > 0)
+            ret = virNetServerProcessMsg(srv, client, prog, msg);
+        virNetServerReleaseJob(&job);
+        if (ret > 0)
+            ret = 0;
     }
 
  cleanup:
@@ -1021,6 +1153,39 @@ int virNetServerSetTLSContext(virNetServerPtr srv,
 #endif
 
 
+/**
+ * virNetServerSetQuota:
+ * @srv: the server
+ * @quota: admission control for calls, or NULL for none
+ *
+ * Make every call of an authenticated client count against the
+ * quota of the client's identity. All programs must have been added
+ * already, since the procedures @quota sets costs for are checked
+ * against them.
+ *
+ * Returns 0 on success, -1 if @quota names an unknown procedure
+ */
+int virNetServerSetQuota(virNetServerPtr srv,
+                         virNetServerQuotaPtr quota)
+{
+    int ret = -1;
+
+    virObjectLock(srv);
+
+    if (quota &&
+        virNetServerQuotaCheckCosts(quota, srv->programs, srv->nprograms) < 0)
+        goto cleanup;
+
+    virObjectUnref(srv->quota);
+    srv->quota = virObjectRef(quota);
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(srv);
+    return ret;
+}
+
+
 static void virNetServerAutoShutdownTimer(int timerid ATTRIBUTE_UNUSED,
                                           void *opaque)
 {
@@ -1220,6 +1385,8 @@ void virNetServerDispose(void *obj)
     }
     VIR_FREE(srv->clients);
 
+    virObjectUnref(srv->quota);
+
     VIR_FREE(srv->mdnsGroupName);
     virNetServerMDNSFree(srv->mdns);
 }
@@ -32,6 +32,7 @@
 # include "virnetserverprogram.h"
 # include "virnetserverclient.h"
 # include "virnetserverservice.h"
+# include "virnetserverquota.h"
 # include "virobject.h"
 # include "virjson.h"
 
@@ -87,6 +88,9 @@ int virNetServerSetTLSContext(virNetServerPtr srv,
                               virNetTLSContextPtr tls);
 # endif
 
+int virNetServerSetQuota(virNetServerPtr srv,
+                         virNetServerQuotaPtr quota);
+
 void virNetServerUpdateServices(virNetServerPtr srv,
                                 bool enabled);
 
@@ -97,6 +97,18 @@ struct _virNetServerClient
      * back to client, including async events */
     virNetMessagePtr tx;
 
+    /* Count of async events in the 'tx' queue and the
+     * limit on it, or 0 for no limit. Events arriving
+     * while the limit is reached are dropped, so that a
+     * client not reading its socket can't make us queue
+     * events without bound */
+    size_t nevents;
+    size_t nevents_max;
+    /* Highest count of queued events seen, and number
+     * of events dropped */
+    size_t nevents_peak;
+    unsigned long long nevents_dropped;
+
     /* Filters to capture messages that would otherwise
      * end up on the 'dx' queue */
     virNetServerClientFilterPtr filters;
@@ -655,9 +667,7 @@ virNetServerClientCreateIdentity(virNetServerClientPtr client)
 {
     char *processid = NULL;
     char *processtime = NULL;
-    char *username = NULL;
     char *userid = NULL;
-    char *groupname = NULL;
     char *groupid = NULL;
 #if WITH_SASL
     char *saslname = NULL;
@@ -678,12 +688,8 @@ virNetServerClientCreateIdentity(virNetServerClientPtr client)
                                         &timestamp) < 0)
             goto cleanup;
 
-        if (!(username = virGetUserName(uid)))
-            goto cleanup;
         if (virAsprintf(&userid, "%d", (int)uid) < 0)
             goto cleanup;
-        if (!(groupname = virGetGroupName(gid)))
-            goto cleanup;
         if (virAsprintf(&groupid, "%d", (int)gid) < 0)
             goto cleanup;
         if (virAsprintf(&processid, "%llu",
@@ -717,21 +723,15 @@ virNetServerClientCreateIdentity(virNetServerClientPtr client)
     if (!(ret = virIdentityNew()))
         goto cleanup;
 
-    if (username &&
-        virIdentitySetAttr(ret,
-                           VIR_IDENTITY_ATTR_UNIX_USER_NAME,
-                           username) < 0)
-        goto error;
+    /* User and group names are only looked up once an access driver
+     * asks for them */
+    virIdentitySetResolver(ret, virIdentityResolveUnixName, NULL, NULL);
+
     if (userid &&
         virIdentitySetAttr(ret,
                            VIR_IDENTITY_ATTR_UNIX_USER_ID,
                            userid) < 0)
         goto error;
-    if (groupname &&
-        virIdentitySetAttr(ret,
-                           VIR_IDENTITY_ATTR_UNIX_GROUP_NAME,
-                           groupname) < 0)
-        goto error;
     if (groupid &&
         virIdentitySetAttr(ret,
                            VIR_IDENTITY_ATTR_UNIX_GROUP_ID,
@@ -768,9 +768,7 @@ virNetServerClientCreateIdentity(virNetServerClientPtr client)
         goto error;
 
  cleanup:
-    VIR_FREE(username);
     VIR_FREE(userid);
-    VIR_FREE(groupname);
     VIR_FREE(groupid);
     VIR_FREE(processid);
     VIR_FREE(processtime);
@@ -1355,6 +1353,9 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
             /* Get finished msg from head of tx queue */
             msg = virNetMessageQueueServe(&client->tx);
 
+            if (msg->event)
+                client->nevents--;
+
             if (msg->tracked) {
                 client->nrequests--;
                 /* See if the recv queue is currently throttled */
@@ -1489,6 +1490,102 @@ int virNetServerClientSendMessage(virNetServerClientPtr client,
 }
 
 
+/**
+ * virNetServerClientSetMaxEvents:
+ * @client: the client
+ * @nevents_max: maximum number of queued events, 0 for no limit
+ *
+ * Limit how many async events can be waiting in the transmit
+ * queue of @client before it is closed.
+ */
+void virNetServerClientSetMaxEvents(virNetServerClientPtr client,
+                                    size_t nevents_max)
+{
+    virObjectLock(client);
+    client->nevents_max = nevents_max;
+    virObjectUnlock(client);
+}
+
+
+/**
+ * virNetServerClientSendEvent:
+ * @client: the client
+ * @msg: the encoded event message
+ *
+ * Queue the async event @msg for transmission to @client, unless
+ * the limit set with virNetServerClientSetMaxEvents() has been
+ * reached. A client that far behind has lost track of the state
+ * of the objects it watches, so it is then closed instead of
+ * silently missing events, and @msg is dropped and accounted for.
+ * As with virNetServerClientSendMessage(), the caller keeps
+ * ownership of @msg on failure.
+ *
+ * Returns 0 if @msg was queued, -1 if it was dropped or the client
+ * is closing
+ */
+int virNetServerClientSendEvent(virNetServerClientPtr client,
+                                virNetMessagePtr msg)
+{
+    int ret = -1;
+
+    virObjectLock(client);
+
+    if (client->wantClose)
+        goto cleanup;
+
+    if (client->nevents_max &&
+        client->nevents >= client->nevents_max) {
+        if (client->nevents_dropped++ == 0)
+            VIR_WARN("Client %p is not reading its events, closing it "
+                     "with %zu events queued",
+                     client, client->nevents);
+        PROBE(RPC_SERVER_CLIENT_EVENT_DROP,
+              "client=%p proc=%u queued=%zu dropped=%llu",
+              client, msg->header.proc, client->nevents,
+              client->nevents_dropped);
+        client->wantClose = true;
+        goto cleanup;
+    }
+
+    msg->event = true;
+    if (virNetServerClientSendMessageLocked(client, msg) < 0) {
+        msg->event = false;
+        goto cleanup;
+    }
+
+    client->nevents++;
+    if (client->nevents > client->nevents_peak)
+        client->nevents_peak = client->nevents;
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(client);
+    return ret;
+}
+
+
+/**
+ * virNetServerClientGetEventStats:
+ * @client: the client
+ * @nevents: filled with the number of queued events
+ * @nevents_peak: filled with the highest number of queued events seen
+ * @nevents_dropped: filled with the number of dropped events
+ *
+ * Report how well @client keeps up with its async events.
+ */
+void virNetServerClientGetEventStats(virNetServerClientPtr client,
+                                     size_t *nevents,
+                                     size_t *nevents_peak,
+                                     unsigned long long *nevents_dropped)
+{
+    virObjectLock(client);
+    *nevents = client->nevents;
+    *nevents_peak = client->nevents_peak;
+    *nevents_dropped = client->nevents_dropped;
+    virObjectUnlock(client);
+}
+
+
 bool virNetServerClientNeedAuth(virNetServerClientPtr client)
 {
     bool need = false;
@@ -139,6 +139,15 @@ const char *virNetServerClientRemoteAddrString(virNetServerClientPtr client);
 int virNetServerClientSendMessage(virNetServerClientPtr client,
                                   virNetMessagePtr msg);
 
+void virNetServerClientSetMaxEvents(virNetServerClientPtr client,
+                                    size_t nevents_max);
+int virNetServerClientSendEvent(virNetServerClientPtr client,
+                                virNetMessagePtr msg);
+void virNetServerClientGetEventStats(virNetServerClientPtr client,
+                                     size_t *nevents,
+                                     size_t *nevents_peak,
+                                     unsigned long long *nevents_dropped);
+
 bool virNetServerClientNeedAuth(virNetServerClientPtr client);
 
 
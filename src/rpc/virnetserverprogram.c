@@ -139,6 +139,32 @@ virNetServerProgramGetPriority(virNetServerProgramPtr prog,
     return proc->priority;
 }
 
+const char *
+virNetServerProgramGetProcName(virNetServerProgramPtr prog,
+                               int procedure)
+{
+    virNetServerProgramProcPtr proc = virNetServerProgramGetProc(prog, procedure);
+
+    if (!proc)
+        return NULL;
+
+    return proc->name;
+}
+
+bool
+virNetServerProgramHasProcName(virNetServerProgramPtr prog,
+                               const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < prog->nprocs; i++) {
+        if (prog->procs[i].func && STREQ_NULLABLE(prog->procs[i].name, name))
+            return true;
+    }
+
+    return false;
+}
+
 static int
 virNetServerProgramSendError(unsigned program,
                              unsigned version,
@@ -55,6 +55,7 @@ struct _virNetServerProgramProc {
     xdrproc_t ret_filter;
     bool needAuth;
     unsigned int priority;
+    const char *name;   /* "program:procedure", e.g. "remote:domain_create" */
 };
 
 virNetServerProgramPtr virNetServerProgramNew(unsigned program,
@@ -68,6 +69,11 @@ int virNetServerProgramGetVersion(virNetServerProgramPtr prog);
 unsigned int virNetServerProgramGetPriority(virNetServerProgramPtr prog,
                                             int procedure);
 
+const char *virNetServerProgramGetProcName(virNetServerProgramPtr prog,
+                                           int procedure);
+bool virNetServerProgramHasProcName(virNetServerProgramPtr prog,
+                                    const char *name);
+
 int virNetServerProgramMatches(virNetServerProgramPtr prog,
                                virNetMessagePtr msg);
 
@@ -0,0 +1,451 @@
+/*
+ * virnetserverquota.c: per-identity RPC call admission control
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "virnetserverquota.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virhash.h"
+#include "virlog.h"
+#include "virobject.h"
+#include "virstring.h"
+#include "virtime.h"
+#include "virutil.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+VIR_LOG_INIT("rpc.netserverquota");
+
+/* Token buckets count in thousandths of a cost unit, so that a bucket
+ * refilling at a few units per second gains something every ms */
+#define VIR_NET_SERVER_QUOTA_SCALE 1000ULL
+
+typedef struct _virNetServerQuotaEntry virNetServerQuotaEntry;
+typedef virNetServerQuotaEntry *virNetServerQuotaEntryPtr;
+
+struct _virNetServerQuotaEntry {
+    virNetServerQuotaStats stats;
+    unsigned long long tokens;
+    unsigned long long refilled;
+    bool warned;
+};
+
+struct _virNetServerQuota {
+    virObjectLockable parent;
+
+    size_t max_calls;           /* Cost allowed to run at once, 0 = any */
+    unsigned int rate;          /* Cost allowed per second, 0 = any */
+    unsigned int burst;         /* Size of the token bucket */
+
+    virHashTablePtr costs;      /* procedure name -> unsigned int */
+    virHashTablePtr entries;    /* identity -> virNetServerQuotaEntry */
+
+    virNetServerQuotaStats totals;
+};
+
+static virClassPtr virNetServerQuotaClass;
+static void virNetServerQuotaDispose(void *obj);
+
+static int virNetServerQuotaOnceInit(void)
+{
+    if (!(virNetServerQuotaClass = virClassNew(virClassForObjectLockable(),
+                                               "virNetServerQuota",
+                                               sizeof(virNetServerQuota),
+                                               virNetServerQuotaDispose)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virNetServerQuota)
+
+
+/**
+ * virNetServerQuotaNew:
+ * @max_calls: total cost of calls one identity may have running at once
+ * @rate: total cost of calls one identity may start per second
+ * @burst: cost one identity may start at once after being idle
+ *
+ * Create the admission control for an RPC server. Either limit may be
+ * 0 to disable it. A @burst of 0 means the same as @rate.
+ *
+ * Returns the new object or NULL on error
+ */
+virNetServerQuotaPtr virNetServerQuotaNew(size_t max_calls,
+                                          unsigned int rate,
+                                          unsigned int burst)
+{
+    virNetServerQuotaPtr quota;
+
+    if (virNetServerQuotaInitialize() < 0)
+        return NULL;
+
+    if (!(quota = virObjectLockableNew(virNetServerQuotaClass)))
+        return NULL;
+
+    quota->max_calls = max_calls;
+    quota->rate = rate;
+    quota->burst = MAX(burst, rate);
+
+    if (!(quota->costs = virHashCreate(32, virHashValueFree)) ||
+        !(quota->entries = virHashCreate(32, virHashValueFree)))
+        goto error;
+
+    return quota;
+
+ error:
+    virObjectUnref(quota);
+    return NULL;
+}
+
+
+static void virNetServerQuotaDispose(void *obj)
+{
+    virNetServerQuotaPtr quota = obj;
+
+    virHashFree(quota->costs);
+    virHashFree(quota->entries);
+}
+
+
+/**
+ * virNetServerQuotaSetCost:
+ * @quota: the admission control
+ * @procname: name of the procedure as "program:procedure", the
+ *            procedure named as in the protocol definition without
+ *            the program prefix, e.g. "remote:domain_migrate_perform3"
+ * @cost: weight of one call
+ *
+ * Calls count against both limits with their cost, which is 1 unless
+ * set otherwise. Procedures with a cost of 0 are never throttled.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virNetServerQuotaSetCost(virNetServerQuotaPtr quota,
+                             const char *procname,
+                             unsigned int cost)
+{
+    unsigned int *value;
+    int ret = -1;
+
+    if (VIR_ALLOC(value) < 0)
+        return -1;
+    *value = cost;
+
+    virObjectLock(quota);
+    if (virHashUpdateEntry(quota->costs, procname, value) < 0)
+        goto cleanup;
+    value = NULL;
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(quota);
+    VIR_FREE(value);
+    return ret;
+}
+
+
+/**
+ * virNetServerQuotaParseCost:
+ * @quota: the admission control
+ * @spec: "program:procedure:cost"
+ *
+ * Like virNetServerQuotaSetCost, for a cost as written in a
+ * configuration file.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virNetServerQuotaParseCost(virNetServerQuotaPtr quota,
+                               const char *spec)
+{
+    const char *sep = strrchr(spec, ':');
+    char *procname = NULL;
+    unsigned int cost;
+    int ret = -1;
+
+    if (!sep || strchr(spec, ':') == sep || spec[0] == ':' || sep[-1] == ':' ||
+        virStrToLong_uip(sep + 1, NULL, 10, &cost) < 0) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("Malformed call cost '%s', expected 'program:procedure:cost'"),
+                       spec);
+        return -1;
+    }
+
+    if (VIR_STRNDUP(procname, spec, sep - spec) < 0)
+        return -1;
+
+    ret = virNetServerQuotaSetCost(quota, procname, cost);
+    VIR_FREE(procname);
+    return ret;
+}
+
+
+unsigned int virNetServerQuotaGetCost(virNetServerQuotaPtr quota,
+                                      const char *procname)
+{
+    unsigned int *value = NULL;
+    unsigned int cost;
+
+    virObjectLock(quota);
+    if (procname)
+        value = virHashLookup(quota->costs, procname);
+    cost = value ? *value : 1;
+    virObjectUnlock(quota);
+
+    return cost;
+}
+
+
+/**
+ * virNetServerQuotaCheckCosts:
+ * @quota: the admission control
+ * @progs: the programs the server dispatches calls to
+ * @nprogs: number of programs in @progs
+ *
+ * Make sure every procedure given a cost exists in one of @progs, so
+ * that a misspelled name doesn't silently leave it at the default.
+ *
+ * Returns 0 on success, -1 with an error reported otherwise
+ */
+int virNetServerQuotaCheckCosts(virNetServerQuotaPtr quota,
+                                virNetServerProgramPtr *progs,
+                                size_t nprogs)
+{
+    virHashKeyValuePairPtr costs = NULL;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    virObjectLock(quota);
+
+    if (!(costs = virHashGetItems(quota->costs, NULL)))
+        goto cleanup;
+
+    for (i = 0; costs[i].key; i++) {
+        for (j = 0; j < nprogs; j++) {
+            if (virNetServerProgramHasProcName(progs[j], costs[i].key))
+                break;
+        }
+
+        if (j == nprogs) {
+            virReportError(VIR_ERR_CONF_SYNTAX,
+                           _("Cannot set the cost of unknown procedure '%s'"),
+                           (const char *)costs[i].key);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(quota);
+    VIR_FREE(costs);
+    return ret;
+}
+
+
+static void
+virNetServerQuotaRefill(virNetServerQuotaPtr quota,
+                        virNetServerQuotaEntryPtr entry,
+                        unsigned long long now)
+{
+    unsigned long long full = quota->burst * VIR_NET_SERVER_QUOTA_SCALE;
+
+    if (!quota->rate)
+        return;
+
+    if (now > entry->refilled) {
+        entry->tokens += (now - entry->refilled) * quota->rate;
+        if (entry->tokens > full)
+            entry->tokens = full;
+    }
+    entry->refilled = now;
+}
+
+
+struct virNetServerQuotaIdleData {
+    virNetServerQuotaPtr quota;
+    unsigned long long now;
+};
+
+/* An identity with nothing running and a full bucket is in the same
+ * state as one never seen, so its entry can go */
+static int
+virNetServerQuotaEntryIsIdle(const void *payload,
+                             const void *name,
+                             const void *opaque)
+{
+    const struct virNetServerQuotaIdleData *data = opaque;
+    virNetServerQuotaEntryPtr entry = (virNetServerQuotaEntryPtr) payload;
+
+    if (entry->stats.calls)
+        return 0;
+
+    virNetServerQuotaRefill(data->quota, entry, data->now);
+    if (entry->tokens < data->quota->burst * VIR_NET_SERVER_QUOTA_SCALE)
+        return 0;
+
+    if (entry->stats.throttled_calls || entry->stats.throttled_rate)
+        VIR_INFO("Identity '%s' idle after %llu calls, %llu throttled "
+                 "for concurrency, %llu for rate, peak cost %zu",
+                 (const char *)name, entry->stats.admitted,
+                 entry->stats.throttled_calls, entry->stats.throttled_rate,
+                 entry->stats.calls_peak);
+    return 1;
+}
+
+
+/**
+ * virNetServerQuotaAcquire:
+ * @quota: the admission control
+ * @identity: who is making the call
+ * @cost: cost of the call
+ *
+ * Admit a call of @identity, if neither the limit on running calls nor
+ * the call rate would be exceeded. A call costing more than the limits
+ * allow is still admitted when @identity has nothing else running, or
+ * has not made calls for a while, so that it is not locked out for
+ * good. An admitted call must be released with virNetServerQuotaRelease
+ * once it completed.
+ *
+ * Returns 0 if the call was admitted, -1 with an error reported
+ * otherwise
+ */
+int virNetServerQuotaAcquire(virNetServerQuotaPtr quota,
+                             const char *identity,
+                             unsigned int cost)
+{
+    virNetServerQuotaEntryPtr entry;
+    unsigned long long now;
+    unsigned long long need;
+    int ret = -1;
+
+    if (!cost)
+        return 0;
+
+    if (virTimeMillisNow(&now) < 0)
+        return -1;
+
+    virObjectLock(quota);
+
+    if (!(entry = virHashLookup(quota->entries, identity))) {
+        struct virNetServerQuotaIdleData data = { quota, now };
+
+        virHashRemoveSet(quota->entries, virNetServerQuotaEntryIsIdle, &data);
+
+        if (VIR_ALLOC(entry) < 0)
+            goto cleanup;
+        entry->tokens = quota->burst * VIR_NET_SERVER_QUOTA_SCALE;
+        entry->refilled = now;
+        if (virHashAddEntry(quota->entries, identity, entry) < 0) {
+            VIR_FREE(entry);
+            goto cleanup;
+        }
+    }
+
+    if (quota->max_calls && entry->stats.calls &&
+        entry->stats.calls + cost > quota->max_calls) {
+        entry->stats.throttled_calls++;
+        quota->totals.throttled_calls++;
+        virReportError(VIR_ERR_RESOURCE_BUSY,
+                       _("Too many calls running for '%s', limit is %zu"),
+                       identity, quota->max_calls);
+        goto throttled;
+    }
+
+    virNetServerQuotaRefill(quota, entry, now);
+    need = MIN(cost, quota->burst) * VIR_NET_SERVER_QUOTA_SCALE;
+    if (quota->rate && entry->tokens < need) {
+        entry->stats.throttled_rate++;
+        quota->totals.throttled_rate++;
+        virReportError(VIR_ERR_RESOURCE_BUSY,
+                       _("Call rate of '%s' exceeds limit of %u per second"),
+                       identity, quota->rate);
+        goto throttled;
+    }
+    entry->tokens -= need;
+
+    entry->stats.calls += cost;
+    entry->stats.calls_peak = MAX(entry->stats.calls_peak, entry->stats.calls);
+    entry->stats.admitted++;
+    quota->totals.calls += cost;
+    quota->totals.calls_peak = MAX(quota->totals.calls_peak,
+                                   quota->totals.calls);
+    quota->totals.admitted++;
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(quota);
+    return ret;
+
+ throttled:
+    if (!entry->warned) {
+        VIR_WARN("Throttling calls from '%s'", identity);
+        entry->warned = true;
+    }
+    goto cleanup;
+}
+
+
+void virNetServerQuotaRelease(virNetServerQuotaPtr quota,
+                              const char *identity,
+                              unsigned int cost)
+{
+    virNetServerQuotaEntryPtr entry;
+
+    if (!cost)
+        return;
+
+    virObjectLock(quota);
+    if ((entry = virHashLookup(quota->entries, identity))) {
+        entry->stats.calls -= MIN(entry->stats.calls, cost);
+        quota->totals.calls -= MIN(quota->totals.calls, cost);
+    }
+    virObjectUnlock(quota);
+}
+
+
+/**
+ * virNetServerQuotaGetStats:
+ * @quota: the admission control
+ * @identity: identity to report on, or NULL for all of them
+ * @stats: filled with the counters
+ *
+ * Identities are forgotten some time after they went idle, reporting
+ * on such an identity gives all zeros.
+ */
+void virNetServerQuotaGetStats(virNetServerQuotaPtr quota,
+                               const char *identity,
+                               virNetServerQuotaStatsPtr stats)
+{
+    virNetServerQuotaEntryPtr entry;
+
+    memset(stats, 0, sizeof(*stats));
+
+    virObjectLock(quota);
+    if (!identity)
+        *stats = quota->totals;
+    else if ((entry = virHashLookup(quota->entries, identity)))
+        *stats = entry->stats;
+    virObjectUnlock(quota);
+}
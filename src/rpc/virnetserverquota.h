@@ -0,0 +1,67 @@
+/*
+ * virnetserverquota.h: per-identity RPC call admission control
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VIR_NET_SERVER_QUOTA_H__
+# define __VIR_NET_SERVER_QUOTA_H__
+
+# include "internal.h"
+# include "virnetserverprogram.h"
+
+typedef struct _virNetServerQuota virNetServerQuota;
+typedef virNetServerQuota *virNetServerQuotaPtr;
+
+typedef struct _virNetServerQuotaStats virNetServerQuotaStats;
+typedef virNetServerQuotaStats *virNetServerQuotaStatsPtr;
+
+struct _virNetServerQuotaStats {
+    size_t calls;                   /* Cost of the calls running now */
+    size_t calls_peak;              /* Highest value @calls has had */
+    unsigned long long admitted;    /* Calls let through */
+    unsigned long long throttled_calls; /* Rejected for max_calls */
+    unsigned long long throttled_rate;  /* Rejected for the call rate */
+};
+
+virNetServerQuotaPtr virNetServerQuotaNew(size_t max_calls,
+                                          unsigned int rate,
+                                          unsigned int burst);
+
+int virNetServerQuotaSetCost(virNetServerQuotaPtr quota,
+                             const char *procname,
+                             unsigned int cost);
+int virNetServerQuotaParseCost(virNetServerQuotaPtr quota,
+                               const char *spec);
+unsigned int virNetServerQuotaGetCost(virNetServerQuotaPtr quota,
+                                      const char *procname);
+int virNetServerQuotaCheckCosts(virNetServerQuotaPtr quota,
+                                virNetServerProgramPtr *progs,
+                                size_t nprogs);
+
+int virNetServerQuotaAcquire(virNetServerQuotaPtr quota,
+                             const char *identity,
+                             unsigned int cost);
+void virNetServerQuotaRelease(virNetServerQuotaPtr quota,
+                              const char *identity,
+                              unsigned int cost);
+
+void virNetServerQuotaGetStats(virNetServerQuotaPtr quota,
+                               const char *identity,
+                               virNetServerQuotaStatsPtr stats);
+
+#endif /* __VIR_NET_SERVER_QUOTA_H__ */
@@ -23,6 +23,7 @@
 #include <unistd.h>
 #include <fnmatch.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 
 #include <gnutls/gnutls.h>
 #if HAVE_GNUTLS_CRYPTO_H
@@ -41,10 +42,16 @@
 #include "virlog.h"
 #include "virprobe.h"
 #include "virthread.h"
+#include "virhash.h"
 #include "configmake.h"
 
 #define DH_BITS 1024
 
+/* Session tickets (RFC 5077) appeared in GNUTLS 2.10 */
+#if LIBGNUTLS_VERSION_NUMBER >= 0x020a00
+# define VIR_NET_TLS_SESSION_TICKETS
+#endif
+
 #define LIBVIRT_PKI_DIR SYSCONFDIR "/pki"
 #define LIBVIRT_CACERT LIBVIRT_PKI_DIR "/CA/cacert.pem"
 #define LIBVIRT_CACRL LIBVIRT_PKI_DIR "/CA/cacrl.pem"
@@ -66,14 +73,43 @@ struct _virNetTLSContext {
     bool isServer;
     bool requireValidCert;
     const char *const*x509dnWhitelist;
+
+#ifdef VIR_NET_TLS_SESSION_TICKETS
+    /* Server: key protecting the tickets handed out to clients */
+    gnutls_datum_t ticketKey;
+#endif
+    /* Client: last session negotiated with each host, for resumption */
+    virHashTablePtr sessionData;
+};
+
+/* Client contexts are reused by connections sharing the same credential
+ * files, for as long as none of those files changes on disk */
+enum {
+    VIR_NET_TLS_CACHE_CACERT,
+    VIR_NET_TLS_CACHE_CACRL,
+    VIR_NET_TLS_CACHE_CERT,
+    VIR_NET_TLS_CACHE_KEY,
+
+    VIR_NET_TLS_CACHE_LAST
 };
 
+typedef struct _virNetTLSContextCacheEntry virNetTLSContextCacheEntry;
+typedef virNetTLSContextCacheEntry *virNetTLSContextCacheEntryPtr;
+struct _virNetTLSContextCacheEntry {
+    virNetTLSContextPtr ctxt;
+    struct stat sb[VIR_NET_TLS_CACHE_LAST];
+};
+
+static virMutex virNetTLSContextCacheLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virNetTLSContextCache;
+
 struct _virNetTLSSession {
     virObjectLockable parent;
 
     bool handshakeComplete;
 
     bool isServer;
+    bool resumed;
     char *hostname;
     gnutls_session_t session;
     virNetTLSSessionWriteFunc writeFunc;
@@ -705,6 +741,16 @@ static int virNetTLSContextLoadCredentials(virNetTLSContextPtr ctxt,
 }
 
 
+static void virNetTLSContextSessionDataFree(void *payload,
+                                             const void *name ATTRIBUTE_UNUSED)
+{
+    gnutls_datum_t *data = payload;
+
+    gnutls_free(data->data);
+    VIR_FREE(data);
+}
+
+
 static virNetTLSContextPtr virNetTLSContextNew(const char *cacert,
                                                const char *cacrl,
                                                const char *cert,
@@ -772,6 +818,20 @@ static virNetTLSContextPtr virNetTLSContextNew(const char *cacert,
 
         gnutls_certificate_set_dh_params(ctxt->x509cred,
                                          ctxt->dhParams);
+
+#ifdef VIR_NET_TLS_SESSION_TICKETS
+        /* Lets returning clients skip the full handshake */
+        err = gnutls_session_ticket_key_generate(&ctxt->ticketKey);
+        if (err < 0) {
+            virReportError(VIR_ERR_SYSTEM_ERROR,
+                           _("Unable to generate TLS session ticket key: %s"),
+                           gnutls_strerror(err));
+            goto error;
+        }
+#endif
+    } else {
+        if (!(ctxt->sessionData = virHashCreate(8, virNetTLSContextSessionDataFree)))
+            goto error;
     }
 
     ctxt->requireValidCert = requireValidCert;
@@ -787,6 +847,10 @@ static virNetTLSContextPtr virNetTLSContextNew(const char *cacert,
  error:
     if (isServer)
         gnutls_dh_params_deinit(ctxt->dhParams);
+#ifdef VIR_NET_TLS_SESSION_TICKETS
+    gnutls_free(ctxt->ticketKey.data);
+#endif
+    virHashFree(ctxt->sessionData);
     gnutls_certificate_free_credentials(ctxt->x509cred);
     VIR_FREE(ctxt);
     return NULL;
@@ -918,6 +982,108 @@ static int virNetTLSContextLocateCredentials(const char *pkipath,
 }
 
 
+static void virNetTLSContextCacheEntryFree(void *payload,
+                                           const void *name ATTRIBUTE_UNUSED)
+{
+    virNetTLSContextCacheEntryPtr entry = payload;
+
+    virObjectUnref(entry->ctxt);
+    VIR_FREE(entry);
+}
+
+
+static void virNetTLSContextCacheStat(const char *const *files,
+                                      struct stat *sb)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_NET_TLS_CACHE_LAST; i++) {
+        if (!files[i] || stat(files[i], &sb[i]) < 0)
+            memset(&sb[i], 0, sizeof(sb[i]));
+    }
+}
+
+
+static bool virNetTLSContextCacheIsStale(virNetTLSContextCacheEntryPtr entry,
+                                         const struct stat *sb)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_NET_TLS_CACHE_LAST; i++) {
+        if (entry->sb[i].st_dev != sb[i].st_dev ||
+            entry->sb[i].st_ino != sb[i].st_ino ||
+            entry->sb[i].st_size != sb[i].st_size ||
+            entry->sb[i].st_mtime != sb[i].st_mtime)
+            return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * Loading and checking the credentials costs more than the rest of a
+ * short lived connection, so client contexts are shared by everyone
+ * using the same files, until one of them is modified.
+ */
+static virNetTLSContextPtr virNetTLSContextNewClientCached(const char *cacert,
+                                                           const char *cacrl,
+                                                           const char *cert,
+                                                           const char *key,
+                                                           bool sanityCheckCert,
+                                                           bool requireValidCert)
+{
+    const char *files[VIR_NET_TLS_CACHE_LAST] = { cacert, cacrl, cert, key };
+    struct stat sb[VIR_NET_TLS_CACHE_LAST];
+    virNetTLSContextCacheEntryPtr entry;
+    virNetTLSContextPtr ctxt = NULL;
+    char *name = NULL;
+
+    if (virAsprintf(&name, "%s|%s|%s|%s|%d|%d",
+                    NULLSTR(cacert), NULLSTR(cacrl), NULLSTR(cert), NULLSTR(key),
+                    sanityCheckCert, requireValidCert) < 0)
+        return NULL;
+
+    virNetTLSContextCacheStat(files, sb);
+
+    virMutexLock(&virNetTLSContextCacheLock);
+
+    if (!virNetTLSContextCache &&
+        !(virNetTLSContextCache = virHashCreate(8, virNetTLSContextCacheEntryFree)))
+        goto cleanup;
+
+    if ((entry = virHashLookup(virNetTLSContextCache, name))) {
+        if (!virNetTLSContextCacheIsStale(entry, sb)) {
+            VIR_DEBUG("Reusing TLS context %p for %s", entry->ctxt, name);
+            ctxt = virObjectRef(entry->ctxt);
+            goto cleanup;
+        }
+        VIR_DEBUG("TLS credentials for %s changed, reloading", name);
+        virHashRemoveEntry(virNetTLSContextCache, name);
+    }
+
+    if (!(ctxt = virNetTLSContextNew(cacert, cacrl, cert, key, NULL,
+                                     sanityCheckCert, requireValidCert,
+                                     false)))
+        goto cleanup;
+
+    /* Failing to cache the context doesn't stop this connection */
+    if (VIR_ALLOC_QUIET(entry) < 0)
+        goto cleanup;
+    entry->ctxt = virObjectRef(ctxt);
+    memcpy(entry->sb, sb, sizeof(sb));
+    if (virHashAddEntry(virNetTLSContextCache, name, entry) < 0) {
+        virResetLastError();
+        virNetTLSContextCacheEntryFree(entry, NULL);
+    }
+
+ cleanup:
+    virMutexUnlock(&virNetTLSContextCacheLock);
+    VIR_FREE(name);
+    return ctxt;
+}
+
+
 static virNetTLSContextPtr virNetTLSContextNewPath(const char *pkipath,
                                                    bool tryUserPkiPath,
                                                    const char *const*x509dnWhitelist,
@@ -932,9 +1098,14 @@ static virNetTLSContextPtr virNetTLSContextNewPath(const char *pkipath,
                                           &cacert, &cacrl, &cert, &key) < 0)
         return NULL;
 
-    ctxt = virNetTLSContextNew(cacert, cacrl, cert, key,
-                               x509dnWhitelist, sanityCheckCert,
-                               requireValidCert, isServer);
+    if (isServer)
+        ctxt = virNetTLSContextNew(cacert, cacrl, cert, key,
+                                   x509dnWhitelist, sanityCheckCert,
+                                   requireValidCert, isServer);
+    else
+        ctxt = virNetTLSContextNewClientCached(cacert, cacrl, cert, key,
+                                               sanityCheckCert,
+                                               requireValidCert);
 
     VIR_FREE(cacert);
     VIR_FREE(cacrl);
@@ -1133,6 +1304,33 @@ static int virNetTLSContextValidCertificate(virNetTLSContextPtr ctxt,
     return -1;
 }
 
+/* Remember the session of a verified server so that the next
+ * connection to the same host can resume it. Must be called
+ * with both objects locked */
+static void virNetTLSContextSaveSession(virNetTLSContextPtr ctxt,
+                                        virNetTLSSessionPtr sess)
+{
+    gnutls_datum_t *data;
+    int err;
+
+    if (VIR_ALLOC_QUIET(data) < 0)
+        return;
+
+    if ((err = gnutls_session_get_data2(sess->session, data)) < 0) {
+        VIR_DEBUG("Unable to save TLS session data: %s",
+                  gnutls_strerror(err));
+        VIR_FREE(data);
+        return;
+    }
+
+    if (virHashUpdateEntry(ctxt->sessionData,
+                           sess->hostname ? sess->hostname : "", data) < 0) {
+        virResetLastError();
+        virNetTLSContextSessionDataFree(data, NULL);
+    }
+}
+
+
 int virNetTLSContextCheckCertificate(virNetTLSContextPtr ctxt,
                                      virNetTLSSessionPtr sess)
 {
@@ -1152,6 +1350,9 @@ int virNetTLSContextCheckCertificate(virNetTLSContextPtr ctxt,
         VIR_INFO("Ignoring bad certificate at user request");
     }
 
+    if (!ctxt->isServer)
+        virNetTLSContextSaveSession(ctxt, sess);
+
     ret = 0;
 
  cleanup:
@@ -1169,6 +1370,10 @@ void virNetTLSContextDispose(void *obj)
           "ctxt=%p", ctxt);
 
     gnutls_dh_params_deinit(ctxt->dhParams);
+#ifdef VIR_NET_TLS_SESSION_TICKETS
+    gnutls_free(ctxt->ticketKey.data);
+#endif
+    virHashFree(ctxt->sessionData);
     gnutls_certificate_free_credentials(ctxt->x509cred);
 }
 
@@ -1249,6 +1454,28 @@ virNetTLSSessionPtr virNetTLSSessionNew(virNetTLSContextPtr ctxt,
         gnutls_certificate_server_set_request(sess->session, GNUTLS_CERT_REQUEST);
 
         gnutls_dh_set_prime_bits(sess->session, DH_BITS);
+
+#ifdef VIR_NET_TLS_SESSION_TICKETS
+        if ((err = gnutls_session_ticket_enable_server(sess->session,
+                                                       &ctxt->ticketKey)) != 0) {
+            virReportError(VIR_ERR_SYSTEM_ERROR,
+                           _("Failed to enable TLS session tickets: %s"),
+                           gnutls_strerror(err));
+            goto error;
+        }
+#endif
+    } else {
+        gnutls_datum_t *data;
+
+        /* A stale or rejected session just means a full handshake */
+        virObjectLock(ctxt);
+        if ((data = virHashLookup(ctxt->sessionData,
+                                  hostname ? hostname : "")) &&
+            (err = gnutls_session_set_data(sess->session,
+                                           data->data, data->size)) != 0)
+            VIR_DEBUG("Unable to resume TLS session: %s",
+                      gnutls_strerror(err));
+        virObjectUnlock(ctxt);
     }
 
     gnutls_transport_set_ptr(sess->session, sess);
@@ -1356,7 +1583,8 @@ int virNetTLSSessionHandshake(virNetTLSSessionPtr sess)
     VIR_DEBUG("Ret=%d", ret);
     if (ret == 0) {
         sess->handshakeComplete = true;
-        VIR_DEBUG("Handshake is complete");
+        sess->resumed = gnutls_session_is_resumed(sess->session) != 0;
+        VIR_DEBUG("Handshake is complete resumed=%d", sess->resumed);
         goto cleanup;
     }
     if (ret == GNUTLS_E_INTERRUPTED || ret == GNUTLS_E_AGAIN) {
@@ -1412,6 +1640,17 @@ int virNetTLSSessionGetKeySize(virNetTLSSessionPtr sess)
     return ssf;
 }
 
+bool virNetTLSSessionIsResumed(virNetTLSSessionPtr sess)
+{
+    bool ret;
+
+    virObjectLock(sess);
+    ret = sess->resumed;
+    virObjectUnlock(sess);
+
+    return ret;
+}
+
 const char *virNetTLSSessionGetX509DName(virNetTLSSessionPtr sess)
 {
     const char *ret = NULL;
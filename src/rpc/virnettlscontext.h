@@ -94,6 +94,8 @@ virNetTLSSessionGetHandshakeStatus(virNetTLSSessionPtr sess);
 
 int virNetTLSSessionGetKeySize(virNetTLSSessionPtr sess);
 
+bool virNetTLSSessionIsResumed(virNetTLSSessionPtr sess);
+
 const char *virNetTLSSessionGetX509DName(virNetTLSSessionPtr sess);
 
 #endif
@@ -223,11 +223,23 @@ virSecurityDACPreFork(virSecurityManagerPtr mgr)
 static int
 virSecurityDACSetOwnership(const char *path, uid_t uid, gid_t gid)
 {
+    struct stat sb;
+
+    /* Backing images shared between many disks end up being labelled
+     * once per disk; avoid the chown (and the inotify/audit churn it
+     * causes) when the ownership is already what we want. */
+    if (stat(path, &sb) >= 0 &&
+        sb.st_uid == uid &&
+        sb.st_gid == gid) {
+        VIR_DEBUG("DAC user and group on '%s' already '%ld:%ld'",
+                  path, (long) uid, (long) gid);
+        return 0;
+    }
+
     VIR_INFO("Setting DAC user and group on '%s' to '%ld:%ld'",
              path, (long) uid, (long) gid);
 
     if (chown(path, uid, gid) < 0) {
-        struct stat sb;
         int chown_errno = errno;
 
         if (stat(path, &sb) >= 0) {
@@ -59,12 +59,16 @@ typedef virSecuritySELinuxData *virSecuritySELinuxDataPtr;
 typedef struct _virSecuritySELinuxCallbackData virSecuritySELinuxCallbackData;
 typedef virSecuritySELinuxCallbackData *virSecuritySELinuxCallbackDataPtr;
 
+typedef struct _virSecuritySELinuxLabelState virSecuritySELinuxLabelState;
+typedef virSecuritySELinuxLabelState *virSecuritySELinuxLabelStatePtr;
+
 struct _virSecuritySELinuxData {
     char *domain_context;
     char *alt_domain_context;
     char *file_context;
     char *content_context;
     virHashTablePtr mcs;
+    virHashTablePtr labels;
     bool skipAllLabel;
 #if HAVE_SELINUX_LABEL_H
     struct selabel_handle *label_handle;
@@ -76,6 +80,16 @@ struct _virSecuritySELinuxCallbackData {
     virSecurityLabelDefPtr secdef;
 };
 
+/* What we know about a path we have relabelled, keyed on the path
+ * and kept until the path is restored */
+struct _virSecuritySELinuxLabelState {
+    char *origlabel;        /* context found before we first relabelled it */
+};
+
+/* Bound the per manager label state, it is a cache and is simply
+ * dropped when full */
+#define SECURITY_SELINUX_LABEL_STATE_MAX 4096
+
 #define SECURITY_SELINUX_VOID_DOI       "0"
 #define SECURITY_SELINUX_NAME "selinux"
 
@@ -85,6 +99,49 @@ virSecuritySELinuxRestoreSecurityTPMFileLabelInt(virSecurityManagerPtr mgr,
                                                  virDomainTPMDefPtr tpm);
 
 
+static void
+virSecuritySELinuxLabelStateFree(void *payload,
+                                 const void *name ATTRIBUTE_UNUSED)
+{
+    virSecuritySELinuxLabelStatePtr state = payload;
+
+    if (!state)
+        return;
+
+    VIR_FREE(state->origlabel);
+    VIR_FREE(state);
+}
+
+
+/*
+ * Returns the label state for @path, creating it if needed, or NULL
+ * on OOM.
+ */
+static virSecuritySELinuxLabelStatePtr
+virSecuritySELinuxLabelStateGet(virSecurityManagerPtr mgr,
+                                const char *path)
+{
+    virSecuritySELinuxDataPtr data = virSecurityManagerGetPrivateData(mgr);
+    virSecuritySELinuxLabelStatePtr state;
+
+    if ((state = virHashLookup(data->labels, path)))
+        return state;
+
+    if (virHashSize(data->labels) >= SECURITY_SELINUX_LABEL_STATE_MAX)
+        virHashRemoveAll(data->labels);
+
+    if (VIR_ALLOC(state) < 0)
+        return NULL;
+
+    if (virHashAddEntry(data->labels, path, state) < 0) {
+        virSecuritySELinuxLabelStateFree(state, NULL);
+        return NULL;
+    }
+
+    return state;
+}
+
+
 /*
  * Returns 0 on success, 1 if already reserved, or -1 on fatal error
  */
@@ -451,6 +508,10 @@ virSecuritySELinuxLXCInitialize(virSecurityManagerPtr mgr)
     if (!(data->mcs = virHashCreate(10, NULL)))
         goto error;
 
+    if (!(data->labels = virHashCreate(50,
+                                       virSecuritySELinuxLabelStateFree)))
+        goto error;
+
     virConfFree(selinux_conf);
     return 0;
 
@@ -464,6 +525,7 @@ virSecuritySELinuxLXCInitialize(virSecurityManagerPtr mgr)
     VIR_FREE(data->file_context);
     VIR_FREE(data->content_context);
     virHashFree(data->mcs);
+    virHashFree(data->labels);
     return -1;
 }
 #else
@@ -540,6 +602,10 @@ virSecuritySELinuxQEMUInitialize(virSecurityManagerPtr mgr)
     if (!(data->mcs = virHashCreate(10, NULL)))
         goto error;
 
+    if (!(data->labels = virHashCreate(50,
+                                       virSecuritySELinuxLabelStateFree)))
+        goto error;
+
     return 0;
 
  error:
@@ -552,6 +618,7 @@ virSecuritySELinuxQEMUInitialize(virSecurityManagerPtr mgr)
     VIR_FREE(data->file_context);
     VIR_FREE(data->content_context);
     virHashFree(data->mcs);
+    virHashFree(data->labels);
     return -1;
 }
 
@@ -815,6 +882,7 @@ virSecuritySELinuxSecurityDriverClose(virSecurityManagerPtr mgr)
 #endif
 
     virHashFree(data->mcs);
+    virHashFree(data->labels);
 
     VIR_FREE(data->domain_context);
     VIR_FREE(data->alt_domain_context);
@@ -881,26 +949,40 @@ virSecuritySELinuxGetSecurityProcessLabel(virSecurityManagerPtr mgr ATTRIBUTE_UN
 
 /* Attempt to change the label of PATH to TCON.  If OPTIONAL is true,
  * return 1 if labelling was not possible.  Otherwise, require a label
- * change, and return 0 for success, -1 for failure.  */
+ * change, and return 0 for success, -1 for failure.  If REMEMBER is
+ * true, the label PATH had before is recorded so that it can be put
+ * back if the policy has no default label for it.  */
 static int
-virSecuritySELinuxSetFileconHelper(const char *path, char *tcon, bool optional)
+virSecuritySELinuxSetFileconHelper(virSecurityManagerPtr mgr,
+                                   const char *path, char *tcon,
+                                   bool optional, bool remember)
 {
     security_context_t econ;
 
+    /* Backing images shared by many guests, and paths relabelled again
+     * on restore, often carry the right label already. Don't make the
+     * kernel revalidate the file for nothing in that case. */
+    if (getfilecon_raw(path, &econ) >= 0) {
+        virSecuritySELinuxLabelStatePtr state;
+
+        if (STREQ(tcon, econ)) {
+            VIR_DEBUG("SELinux context on '%s' is already '%s'", path, tcon);
+            freecon(econ);
+            return 0;
+        }
+
+        if (remember &&
+            (state = virSecuritySELinuxLabelStateGet(mgr, path)) &&
+            !state->origlabel)
+            ignore_value(VIR_STRDUP_QUIET(state->origlabel, econ));
+        freecon(econ);
+    }
+
     VIR_INFO("Setting SELinux context on '%s' to '%s'", path, tcon);
 
     if (setfilecon_raw(path, tcon) < 0) {
         int setfilecon_errno = errno;
 
-        if (getfilecon_raw(path, &econ) >= 0) {
-            if (STREQ(tcon, econ)) {
-                freecon(econ);
-                /* It's alright, there's nothing to change anyway. */
-                return optional ? 1 : 0;
-            }
-            freecon(econ);
-        }
-
         /* If the error complaint is related to an image hosted on a (possibly
          * read-only) NFS mount, or a usbfs/sysfs filesystem not supporting
          * labelling, then just ignore it & hope for the best.  The user
@@ -936,15 +1018,17 @@ virSecuritySELinuxSetFileconHelper(const char *path, char *tcon, bool optional)
 }
 
 static int
-virSecuritySELinuxSetFileconOptional(const char *path, char *tcon)
+virSecuritySELinuxSetFileconOptional(virSecurityManagerPtr mgr,
+                                     const char *path, char *tcon)
 {
-    return virSecuritySELinuxSetFileconHelper(path, tcon, true);
+    return virSecuritySELinuxSetFileconHelper(mgr, path, tcon, true, true);
 }
 
 static int
-virSecuritySELinuxSetFilecon(const char *path, char *tcon)
+virSecuritySELinuxSetFilecon(virSecurityManagerPtr mgr,
+                             const char *path, char *tcon)
 {
-    return virSecuritySELinuxSetFileconHelper(path, tcon, false);
+    return virSecuritySELinuxSetFileconHelper(mgr, path, tcon, false, true);
 }
 
 static int
@@ -1007,6 +1091,8 @@ static int
 virSecuritySELinuxRestoreSecurityFileLabel(virSecurityManagerPtr mgr,
                                            const char *path)
 {
+    virSecuritySELinuxDataPtr data = virSecurityManagerGetPrivateData(mgr);
+    virSecuritySELinuxLabelStatePtr state;
     struct stat buf;
     security_context_t fcon = NULL;
     int rc = -1;
@@ -1027,14 +1113,34 @@ virSecuritySELinuxRestoreSecurityFileLabel(virSecurityManagerPtr mgr,
         goto err;
     }
 
+    /* We recorded the original label under the path we were given
+     * when setting it, which need not be the one it resolves to */
+    if (!(state = virHashLookup(data->labels, path)) || !state->origlabel)
+        state = virHashLookup(data->labels, newpath);
+
     if (getContext(mgr, newpath, buf.st_mode, &fcon) < 0) {
         /* Any user created path likely does not have a default label,
-         * which makes this an expected non error
+         * which makes this an expected non error. Put back whatever
+         * label it had before we changed it, if we know it.
          */
-        VIR_WARN("cannot lookup default selinux label for %s", newpath);
-        rc = 0;
+        if (state && state->origlabel) {
+            rc = virSecuritySELinuxSetFileconHelper(mgr, newpath,
+                                                    state->origlabel,
+                                                    false, false);
+        } else {
+            VIR_WARN("cannot lookup default selinux label for %s", newpath);
+            rc = 0;
+        }
     } else {
-        rc = virSecuritySELinuxSetFilecon(newpath, fcon);
+        rc = virSecuritySELinuxSetFileconHelper(mgr, newpath, fcon,
+                                                false, false);
+    }
+
+    /* The original label is only good until the path is restored, an
+     * outside relabel may change it any time after that */
+    if (rc == 0) {
+        ignore_value(virHashRemoveEntry(data->labels, path));
+        ignore_value(virHashRemoveEntry(data->labels, newpath));
     }
 
  err:
@@ -1061,12 +1167,12 @@ virSecuritySELinuxSetSecurityTPMFileLabel(virSecurityManagerPtr mgr,
     switch (tpm->type) {
     case VIR_DOMAIN_TPM_TYPE_PASSTHROUGH:
         tpmdev = tpm->data.passthrough.source.data.file.path;
-        rc = virSecuritySELinuxSetFilecon(tpmdev, seclabel->imagelabel);
+        rc = virSecuritySELinuxSetFilecon(mgr, tpmdev, seclabel->imagelabel);
         if (rc < 0)
             return -1;
 
         if ((cancel_path = virTPMCreateCancelPath(tpmdev)) != NULL) {
-            rc = virSecuritySELinuxSetFilecon(cancel_path,
+            rc = virSecuritySELinuxSetFilecon(mgr, cancel_path,
                                               seclabel->imagelabel);
             VIR_FREE(cancel_path);
             if (rc < 0) {
@@ -1199,8 +1305,9 @@ virSecuritySELinuxSetSecurityFileLabel(virDomainDiskDefPtr disk,
     int ret;
     virSecurityDeviceLabelDefPtr disk_seclabel;
     virSecuritySELinuxCallbackDataPtr cbdata = opaque;
+    virSecurityManagerPtr mgr = cbdata->manager;
     virSecurityLabelDefPtr secdef = cbdata->secdef;
-    virSecuritySELinuxDataPtr data = virSecurityManagerGetPrivateData(cbdata->manager);
+    virSecuritySELinuxDataPtr data = virSecurityManagerGetPrivateData(mgr);
 
     disk_seclabel = virStorageSourceGetSecurityLabelDef(disk->src,
                                                         SECURITY_SELINUX_NAME);
@@ -1210,20 +1317,20 @@ virSecuritySELinuxSetSecurityFileLabel(virDomainDiskDefPtr disk,
 
     if (disk_seclabel && !disk_seclabel->norelabel &&
         disk_seclabel->label) {
-        ret = virSecuritySELinuxSetFilecon(path, disk_seclabel->label);
+        ret = virSecuritySELinuxSetFilecon(mgr, path, disk_seclabel->label);
     } else if (depth == 0) {
 
         if (disk->shared) {
-            ret = virSecuritySELinuxSetFileconOptional(path, data->file_context);
+            ret = virSecuritySELinuxSetFileconOptional(mgr, path, data->file_context);
         } else if (disk->readonly) {
-            ret = virSecuritySELinuxSetFileconOptional(path, data->content_context);
+            ret = virSecuritySELinuxSetFileconOptional(mgr, path, data->content_context);
         } else if (secdef->imagelabel) {
-            ret = virSecuritySELinuxSetFileconOptional(path, secdef->imagelabel);
+            ret = virSecuritySELinuxSetFileconOptional(mgr, path, secdef->imagelabel);
         } else {
             ret = 0;
         }
     } else {
-        ret = virSecuritySELinuxSetFileconOptional(path, data->content_context);
+        ret = virSecuritySELinuxSetFileconOptional(mgr, path, data->content_context);
     }
     if (ret == 1 && !disk_seclabel) {
         /* If we failed to set a label, but virt_use_nfs let us
@@ -1264,13 +1371,10 @@ virSecuritySELinuxSetSecurityDiskLabel(virSecurityManagerPtr mgr,
 static int
 virSecuritySELinuxSetSecurityHostdevLabelHelper(const char *file, void *opaque)
 {
-    virSecurityLabelDefPtr secdef;
-    virDomainDefPtr def = opaque;
+    virSecuritySELinuxCallbackDataPtr cbdata = opaque;
 
-    secdef = virDomainDefGetSecurityLabelDef(def, SECURITY_SELINUX_NAME);
-    if (secdef == NULL)
-        return 0;
-    return virSecuritySELinuxSetFilecon(file, secdef->imagelabel);
+    return virSecuritySELinuxSetFilecon(cbdata->manager, file,
+                                        cbdata->secdef->imagelabel);
 }
 
 static int
@@ -1295,12 +1399,20 @@ virSecuritySELinuxSetSecuritySCSILabel(virSCSIDevicePtr dev ATTRIBUTE_UNUSED,
 }
 
 static int
-virSecuritySELinuxSetSecurityHostdevSubsysLabel(virDomainDefPtr def,
+virSecuritySELinuxSetSecurityHostdevSubsysLabel(virSecurityManagerPtr mgr,
+                                                virDomainDefPtr def,
                                                 virDomainHostdevDefPtr dev,
                                                 const char *vroot)
 
 {
     int ret = -1;
+    virSecuritySELinuxCallbackData cbdata;
+
+    cbdata.manager = mgr;
+    cbdata.secdef = virDomainDefGetSecurityLabelDef(def, SECURITY_SELINUX_NAME);
+
+    if (cbdata.secdef == NULL)
+        return 0;
 
     switch (dev->source.subsys.type) {
     case VIR_DOMAIN_HOSTDEV_SUBSYS_TYPE_USB: {
@@ -1315,7 +1427,7 @@ virSecuritySELinuxSetSecurityHostdevSubsysLabel(virDomainDefPtr def,
         if (!usb)
             goto done;
 
-        ret = virUSBDeviceFileIterate(usb, virSecuritySELinuxSetSecurityUSBLabel, def);
+        ret = virUSBDeviceFileIterate(usb, virSecuritySELinuxSetSecurityUSBLabel, &cbdata);
         virUSBDeviceFree(usb);
         break;
     }
@@ -1338,10 +1450,10 @@ virSecuritySELinuxSetSecurityHostdevSubsysLabel(virDomainDefPtr def,
                 virPCIDeviceFree(pci);
                 goto done;
             }
-            ret = virSecuritySELinuxSetSecurityPCILabel(pci, vfioGroupDev, def);
+            ret = virSecuritySELinuxSetSecurityPCILabel(pci, vfioGroupDev, &cbdata);
             VIR_FREE(vfioGroupDev);
         } else {
-            ret = virPCIDeviceFileIterate(pci, virSecuritySELinuxSetSecurityPCILabel, def);
+            ret = virPCIDeviceFileIterate(pci, virSecuritySELinuxSetSecurityPCILabel, &cbdata);
         }
         virPCIDeviceFree(pci);
         break;
@@ -1360,7 +1472,7 @@ virSecuritySELinuxSetSecurityHostdevSubsysLabel(virDomainDefPtr def,
         if (!scsi)
             goto done;
 
-        ret = virSCSIDeviceFileIterate(scsi, virSecuritySELinuxSetSecuritySCSILabel, def);
+        ret = virSCSIDeviceFileIterate(scsi, virSecuritySELinuxSetSecuritySCSILabel, &cbdata);
         virSCSIDeviceFree(scsi);
 
         break;
@@ -1377,7 +1489,8 @@ virSecuritySELinuxSetSecurityHostdevSubsysLabel(virDomainDefPtr def,
 
 
 static int
-virSecuritySELinuxSetSecurityHostdevCapsLabel(virDomainDefPtr def,
+virSecuritySELinuxSetSecurityHostdevCapsLabel(virSecurityManagerPtr mgr,
+                                              virDomainDefPtr def,
                                               virDomainHostdevDefPtr dev,
                                               const char *vroot)
 {
@@ -1399,7 +1512,7 @@ virSecuritySELinuxSetSecurityHostdevCapsLabel(virDomainDefPtr def,
             if (VIR_STRDUP(path, dev->source.caps.u.storage.block) < 0)
                 return -1;
         }
-        ret = virSecuritySELinuxSetFilecon(path, secdef->imagelabel);
+        ret = virSecuritySELinuxSetFilecon(mgr, path, secdef->imagelabel);
         VIR_FREE(path);
         break;
     }
@@ -1413,7 +1526,7 @@ virSecuritySELinuxSetSecurityHostdevCapsLabel(virDomainDefPtr def,
             if (VIR_STRDUP(path, dev->source.caps.u.misc.chardev) < 0)
                 return -1;
         }
-        ret = virSecuritySELinuxSetFilecon(path, secdef->imagelabel);
+        ret = virSecuritySELinuxSetFilecon(mgr, path, secdef->imagelabel);
         VIR_FREE(path);
         break;
     }
@@ -1428,7 +1541,7 @@ virSecuritySELinuxSetSecurityHostdevCapsLabel(virDomainDefPtr def,
 
 
 static int
-virSecuritySELinuxSetSecurityHostdevLabel(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
+virSecuritySELinuxSetSecurityHostdevLabel(virSecurityManagerPtr mgr,
                                           virDomainDefPtr def,
                                           virDomainHostdevDefPtr dev,
                                           const char *vroot)
@@ -1442,10 +1555,10 @@ virSecuritySELinuxSetSecurityHostdevLabel(virSecurityManagerPtr mgr ATTRIBUTE_UN
 
     switch (dev->mode) {
     case VIR_DOMAIN_HOSTDEV_MODE_SUBSYS:
-        return virSecuritySELinuxSetSecurityHostdevSubsysLabel(def, dev, vroot);
+        return virSecuritySELinuxSetSecurityHostdevSubsysLabel(mgr, def, dev, vroot);
 
     case VIR_DOMAIN_HOSTDEV_MODE_CAPABILITIES:
-        return virSecuritySELinuxSetSecurityHostdevCapsLabel(def, dev, vroot);
+        return virSecuritySELinuxSetSecurityHostdevCapsLabel(mgr, def, dev, vroot);
 
     default:
         return 0;
@@ -1639,7 +1752,8 @@ virSecuritySELinuxRestoreSecurityHostdevLabel(virSecurityManagerPtr mgr,
 
 
 static int
-virSecuritySELinuxSetSecurityChardevLabel(virDomainDefPtr def,
+virSecuritySELinuxSetSecurityChardevLabel(virSecurityManagerPtr mgr,
+                                          virDomainDefPtr def,
                                           virDomainChrDefPtr dev,
                                           virDomainChrSourceDefPtr dev_source)
 
@@ -1669,13 +1783,13 @@ virSecuritySELinuxSetSecurityChardevLabel(virDomainDefPtr def,
     switch (dev_source->type) {
     case VIR_DOMAIN_CHR_TYPE_DEV:
     case VIR_DOMAIN_CHR_TYPE_FILE:
-        ret = virSecuritySELinuxSetFilecon(dev_source->data.file.path,
+        ret = virSecuritySELinuxSetFilecon(mgr, dev_source->data.file.path,
                                            imagelabel);
         break;
 
     case VIR_DOMAIN_CHR_TYPE_UNIX:
         if (!dev_source->data.nix.listen) {
-            if (virSecuritySELinuxSetFilecon(dev_source->data.file.path,
+            if (virSecuritySELinuxSetFilecon(mgr, dev_source->data.file.path,
                                              imagelabel) < 0)
                 goto done;
         }
@@ -1687,11 +1801,11 @@ virSecuritySELinuxSetSecurityChardevLabel(virDomainDefPtr def,
             (virAsprintf(&out, "%s.out", dev_source->data.file.path) < 0))
             goto done;
         if (virFileExists(in) && virFileExists(out)) {
-            if ((virSecuritySELinuxSetFilecon(in, imagelabel) < 0) ||
-                (virSecuritySELinuxSetFilecon(out, imagelabel) < 0)) {
+            if ((virSecuritySELinuxSetFilecon(mgr, in, imagelabel) < 0) ||
+                (virSecuritySELinuxSetFilecon(mgr, out, imagelabel) < 0)) {
                 goto done;
             }
-        } else if (virSecuritySELinuxSetFilecon(dev_source->data.file.path,
+        } else if (virSecuritySELinuxSetFilecon(mgr, dev_source->data.file.path,
                                                 imagelabel) < 0) {
             goto done;
         }
@@ -1930,7 +2044,7 @@ virSecuritySELinuxReleaseSecurityLabel(virSecurityManagerPtr mgr,
 
 
 static int
-virSecuritySELinuxSetSavedStateLabel(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
+virSecuritySELinuxSetSavedStateLabel(virSecurityManagerPtr mgr,
                                      virDomainDefPtr def,
                                      const char *savefile)
 {
@@ -1940,7 +2054,7 @@ virSecuritySELinuxSetSavedStateLabel(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
     if (!secdef || secdef->norelabel)
         return 0;
 
-    return virSecuritySELinuxSetFilecon(savefile, secdef->imagelabel);
+    return virSecuritySELinuxSetFilecon(mgr, savefile, secdef->imagelabel);
 }
 
 
@@ -2172,14 +2286,16 @@ virSecuritySELinuxClearSecuritySocketLabel(virSecurityManagerPtr mgr ATTRIBUTE_U
 static int
 virSecuritySELinuxSetSecurityChardevCallback(virDomainDefPtr def,
                                              virDomainChrDefPtr dev,
-                                             void *opaque ATTRIBUTE_UNUSED)
+                                             void *opaque)
 {
+    virSecurityManagerPtr mgr = opaque;
+
     /* This is taken care of by processing of def->serials */
     if (dev->deviceType == VIR_DOMAIN_CHR_DEVICE_TYPE_CONSOLE &&
         dev->targetType == VIR_DOMAIN_CHR_CONSOLE_TARGET_TYPE_SERIAL)
         return 0;
 
-    return virSecuritySELinuxSetSecurityChardevLabel(def, dev, &dev->source);
+    return virSecuritySELinuxSetSecurityChardevLabel(mgr, def, dev, &dev->source);
 }
 
 
@@ -2200,10 +2316,11 @@ virSecuritySELinuxSetSecuritySmartcardCallback(virDomainDefPtr def,
         database = dev->data.cert.database;
         if (!database)
             database = VIR_DOMAIN_SMARTCARD_DEFAULT_DATABASE;
-        return virSecuritySELinuxSetFilecon(database, data->content_context);
+        return virSecuritySELinuxSetFilecon(mgr, database, data->content_context);
 
     case VIR_DOMAIN_SMARTCARD_TYPE_PASSTHROUGH:
-        return virSecuritySELinuxSetSecurityChardevLabel(def, NULL, &dev->data.passthru);
+        return virSecuritySELinuxSetSecurityChardevLabel(mgr, def, NULL,
+                                                         &dev->data.passthru);
 
     default:
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -2262,7 +2379,7 @@ virSecuritySELinuxSetSecurityAllLabel(virSecurityManagerPtr mgr,
     if (virDomainChrDefForeach(def,
                                true,
                                virSecuritySELinuxSetSecurityChardevCallback,
-                               NULL) < 0)
+                               mgr) < 0)
         return -1;
 
     if (virDomainSmartcardDefForeach(def,
@@ -2272,19 +2389,19 @@ virSecuritySELinuxSetSecurityAllLabel(virSecurityManagerPtr mgr,
         return -1;
 
     if (def->os.kernel &&
-        virSecuritySELinuxSetFilecon(def->os.kernel, data->content_context) < 0)
+        virSecuritySELinuxSetFilecon(mgr, def->os.kernel, data->content_context) < 0)
         return -1;
 
     if (def->os.initrd &&
-        virSecuritySELinuxSetFilecon(def->os.initrd, data->content_context) < 0)
+        virSecuritySELinuxSetFilecon(mgr, def->os.initrd, data->content_context) < 0)
         return -1;
 
     if (def->os.dtb &&
-        virSecuritySELinuxSetFilecon(def->os.dtb, data->content_context) < 0)
+        virSecuritySELinuxSetFilecon(mgr, def->os.dtb, data->content_context) < 0)
         return -1;
 
     if (stdin_path) {
-        if (virSecuritySELinuxSetFilecon(stdin_path, data->content_context) < 0 &&
+        if (virSecuritySELinuxSetFilecon(mgr, stdin_path, data->content_context) < 0 &&
             virFileIsSharedFSType(stdin_path, VIR_FILE_SHFS_NFS) != 1)
             return -1;
     }
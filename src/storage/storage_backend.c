@@ -146,6 +146,264 @@ enum {
 #define READ_BLOCK_SIZE_DEFAULT  (1024 * 1024)
 #define WRITE_BLOCK_SIZE_DEFAULT (4 * 1024)
 
+#ifdef __linux__
+/* FICLONE is only exposed by linux/fs.h on newer kernel headers, but
+ * it is the same ioctl number btrfs has supported as BTRFS_IOC_CLONE
+ * since 2.6.29, so define it ourselves when missing. */
+# ifndef FICLONE
+#  define FICLONE _IOW(0x94, 9, int)
+# endif
+#endif
+
+/*
+ * Errors from the fast copy paths which merely mean that the
+ * filesystem or kernel cannot do it for this pair of files, and
+ * that we should fall back to copying the data ourselves.
+ */
+static bool
+virStorageBackendCopyUnsupported(int err)
+{
+    switch (err) {
+    case ENOSYS:
+    case ENOTTY:
+    case EOPNOTSUPP:
+#if ENOTSUP != EOPNOTSUPP
+    case ENOTSUP:
+#endif
+    case EXDEV:
+    case EINVAL:
+    case EBADF:
+    case ETXTBSY:
+        return true;
+    }
+    return false;
+}
+
+
+/*
+ * Ask the filesystem to share all extents of @inputfd with @fd.
+ *
+ * Returns 0 on success, 1 if reflinking is not possible and the
+ * caller should fall back to a data copy, or -errno on error.
+ */
+static int
+virStorageBackendCopyReflink(virStorageVolDefPtr vol,
+                             virStorageVolDefPtr inputvol,
+                             int inputfd,
+                             int fd)
+{
+#if defined(__linux__) && defined(FICLONE)
+    int err;
+
+    if (ioctl(fd, FICLONE, inputfd) == 0) {
+        VIR_DEBUG("reflinked '%s' to '%s'",
+                  inputvol->target.path, vol->target.path);
+        return 0;
+    }
+
+    err = errno;
+    if (virStorageBackendCopyUnsupported(err) || err == EPERM)
+        return 1;
+
+    virReportSystemError(err, _("failed to reflink '%s' to '%s'"),
+                         inputvol->target.path, vol->target.path);
+    return -err;
+#else
+    return 1;
+#endif
+}
+
+
+/*
+ * Copy @length bytes starting at @offset in @inputfd to the same
+ * offset in @fd. The kernel is asked to do the copy itself through
+ * copy_file_range() while *@copy_range is true; the first time it
+ * refuses, *@copy_range is cleared and the remaining data is moved
+ * through @buf instead, skipping all-zero blocks if @want_sparse.
+ *
+ * Returns the number of bytes copied, which is short only if the
+ * input ended early, or -errno on error.
+ */
+static off_t
+virStorageBackendCopyExtent(virStorageVolDefPtr vol,
+                            virStorageVolDefPtr inputvol,
+                            int inputfd,
+                            int fd,
+                            off_t offset,
+                            off_t length,
+                            char *buf,
+                            size_t buflen,
+                            const char *zerobuf,
+                            size_t wbytes,
+                            bool want_sparse,
+                            bool *copy_range)
+{
+    off_t done = 0;
+
+    if (lseek(inputfd, offset, SEEK_SET) < 0) {
+        virReportSystemError(errno,
+                             _("cannot seek to %llu in file '%s'"),
+                             (unsigned long long) offset,
+                             inputvol->target.path);
+        return -errno;
+    }
+    if (lseek(fd, offset, SEEK_SET) < 0) {
+        virReportSystemError(errno,
+                             _("cannot seek to %llu in file '%s'"),
+                             (unsigned long long) offset,
+                             vol->target.path);
+        return -errno;
+    }
+
+    while (done < length) {
+        size_t want = MIN((unsigned long long) (length - done), buflen);
+        ssize_t amtread;
+        size_t amtleft;
+
+#if HAVE_COPY_FILE_RANGE
+        if (*copy_range) {
+            ssize_t copied = copy_file_range(inputfd, NULL, fd, NULL,
+                                             length - done, 0);
+            if (copied > 0) {
+                done += copied;
+                continue;
+            }
+            if (copied == 0)
+                break;
+            if (errno == EINTR)
+                continue;
+            if (!virStorageBackendCopyUnsupported(errno)) {
+                virReportSystemError(errno,
+                                     _("failed copying data from '%s' to '%s'"),
+                                     inputvol->target.path, vol->target.path);
+                return -errno;
+            }
+            VIR_DEBUG("copy_file_range not usable for '%s', falling back",
+                      vol->target.path);
+            *copy_range = false;
+        }
+#endif
+
+        if ((amtread = saferead(inputfd, buf, want)) < 0) {
+            virReportSystemError(errno,
+                                 _("failed reading from file '%s'"),
+                                 inputvol->target.path);
+            return -errno;
+        }
+        if (amtread == 0)
+            break;
+
+        amtleft = amtread;
+        while (amtleft > 0) {
+            size_t interval = MIN(amtleft, wbytes);
+            size_t bufoff = amtread - amtleft;
+
+            if (want_sparse && memcmp(buf + bufoff, zerobuf, interval) == 0) {
+                if (lseek(fd, interval, SEEK_CUR) < 0) {
+                    virReportSystemError(errno,
+                                         _("cannot extend file '%s'"),
+                                         vol->target.path);
+                    return -errno;
+                }
+            } else if (safewrite(fd, buf + bufoff, interval) < 0) {
+                virReportSystemError(errno,
+                                     _("failed writing to file '%s'"),
+                                     vol->target.path);
+                return -errno;
+            }
+            amtleft -= interval;
+        }
+        done += amtread;
+    }
+
+    return done;
+}
+
+
+/*
+ * Copy the first @length bytes of the regular file @inputfd into @fd
+ * without going through the generic read/write loop: holes in the
+ * input are found with SEEK_DATA/SEEK_HOLE and skipped when
+ * @want_sparse, and the data extents are handed to the kernel if
+ * @copy_range, as it may share them with the input instead.
+ *
+ * Returns 0 on success, 1 if the input can't be mapped this way and
+ * nothing was copied, or -errno on error.
+ */
+static int
+virStorageBackendCopySparse(virStorageVolDefPtr vol,
+                            virStorageVolDefPtr inputvol,
+                            int inputfd,
+                            int fd,
+                            off_t length,
+                            char *buf,
+                            size_t buflen,
+                            const char *zerobuf,
+                            size_t wbytes,
+                            bool want_sparse,
+                            bool copy_range)
+{
+    off_t offset = 0;
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    while (want_sparse && offset < length) {
+        off_t data, hole;
+        off_t ret;
+
+        if ((data = lseek(inputfd, offset, SEEK_DATA)) < 0) {
+            /* No more data, the rest of the input is one big hole */
+            if (errno == ENXIO)
+                return 0;
+            /* Filesystem can't tell us, do a plain copy */
+            if (offset == 0 && errno == EINVAL)
+                return 1;
+            virReportSystemError(errno,
+                                 _("cannot find data in file '%s'"),
+                                 inputvol->target.path);
+            return -errno;
+        }
+        if (data >= length)
+            return 0;
+
+        if ((hole = lseek(inputfd, data, SEEK_HOLE)) < 0) {
+            virReportSystemError(errno,
+                                 _("cannot find hole in file '%s'"),
+                                 inputvol->target.path);
+            return -errno;
+        }
+        if (hole > length)
+            hole = length;
+
+        VIR_DEBUG("data extent %llu-%llu in '%s'",
+                  (unsigned long long) data, (unsigned long long) hole,
+                  inputvol->target.path);
+
+        if ((ret = virStorageBackendCopyExtent(vol, inputvol, inputfd, fd,
+                                               data, hole - data,
+                                               buf, buflen, zerobuf, wbytes,
+                                               want_sparse, &copy_range)) < 0)
+            return ret;
+        if (ret < hole - data)
+            return 0;
+
+        offset = hole;
+    }
+    if (want_sparse)
+        return 0;
+#else
+    if (want_sparse)
+        return 1;
+#endif
+
+    if ((offset = virStorageBackendCopyExtent(vol, inputvol, inputfd, fd,
+                                              0, length,
+                                              buf, buflen, zerobuf, wbytes,
+                                              false, &copy_range)) < 0)
+        return offset;
+    return 0;
+}
+
+
 static int ATTRIBUTE_NONNULL(2)
 virStorageBackendCopyToFD(virStorageVolDefPtr vol,
                           virStorageVolDefPtr inputvol,
@@ -162,6 +420,8 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
     char *zerobuf = NULL;
     char *buf = NULL;
     struct stat st;
+    struct stat inputst;
+    bool share;
 
     if ((inputfd = open(inputvol->target.path, O_RDONLY)) < 0) {
         ret = -errno;
@@ -171,12 +431,59 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
         goto cleanup;
     }
 
+    if (fstat(inputfd, &inputst) < 0) {
+        ret = -errno;
+        virReportSystemError(errno,
+                             _("cannot stat input path '%s'"),
+                             inputvol->target.path);
+        goto cleanup;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        ret = -errno;
+        virReportSystemError(errno,
+                             _("cannot stat file '%s'"),
+                             vol->target.path);
+        goto cleanup;
+    }
+
+    /* Sharing extents only gives the semantics we need when the input
+     * lands in a file the caller asked to be sparse: a preallocated
+     * volume must not share its blocks with the input. Both a clone and
+     * copy_file_range(), which reflinks or clones on the server side on
+     * some filesystems, may do that. */
+    share = vol->target.allocation < vol->target.capacity;
+
+    if (share &&
+        S_ISREG(inputst.st_mode) && S_ISREG(st.st_mode) &&
+        *total >= (unsigned long long) inputst.st_size) {
+        if ((ret = virStorageBackendCopyReflink(vol, inputvol,
+                                                inputfd, fd)) < 0)
+            goto cleanup;
+
+        if (ret == 0) {
+            /* The clone may have shrunk the file back to the input size */
+            if (fstat(fd, &st) < 0 ||
+                ((unsigned long long) st.st_size < vol->target.capacity &&
+                 ftruncate(fd, vol->target.capacity) < 0)) {
+                ret = -errno;
+                virReportSystemError(errno,
+                                     _("cannot extend file '%s'"),
+                                     vol->target.path);
+                goto cleanup;
+            }
+            *total -= inputst.st_size;
+            goto sync;
+        }
+        ret = 0;
+    }
+
 #ifdef __linux__
     if (ioctl(fd, BLKBSZGET, &wbytes) < 0) {
         wbytes = 0;
     }
 #endif
-    if ((wbytes == 0) && fstat(fd, &st) == 0)
+    if (wbytes == 0)
         wbytes = st.st_blksize;
     if (wbytes < WRITE_BLOCK_SIZE_DEFAULT)
         wbytes = WRITE_BLOCK_SIZE_DEFAULT;
@@ -191,6 +498,22 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
         goto cleanup;
     }
 
+    if (S_ISREG(inputst.st_mode)) {
+        off_t length = MIN(*total, (unsigned long long) inputst.st_size);
+
+        if ((ret = virStorageBackendCopySparse(vol, inputvol, inputfd, fd,
+                                               length, buf, rbytes,
+                                               zerobuf, wbytes,
+                                               want_sparse, share)) < 0)
+            goto cleanup;
+
+        if (ret == 0) {
+            *total -= length;
+            goto sync;
+        }
+        ret = 0;
+    }
+
     while (amtread != 0) {
         int amtleft;
 
@@ -232,6 +555,7 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
         } while ((amtleft -= interval) > 0);
     }
 
+ sync:
     if (fdatasync(fd) < 0) {
         ret = -errno;
         virReportSystemError(errno, _("cannot sync data to file '%s'"),
@@ -258,6 +582,193 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
     return ret;
 }
 
+/*
+ * Have the kernel zero @length bytes at @offset in the volume open
+ * on @fd without us writing them: BLKZEROOUT on block devices, which
+ * becomes WRITE SAME or an unmap on capable hardware, or a discard if
+ * the device guarantees discarded blocks read back as zeroes, and
+ * FALLOC_FL_ZERO_RANGE on regular files.
+ *
+ * Returns 0 on success, 1 if none of these are supported for @fd and
+ * the caller has to write zeroes itself, or -1 on error.
+ */
+int
+virStorageBackendZeroExtent(virStorageVolDefPtr vol,
+                            int fd,
+                            off_t offset,
+                            off_t length)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) < 0) {
+        virReportSystemError(errno, _("cannot stat file '%s'"),
+                             vol->target.path);
+        return -1;
+    }
+
+    if (length <= 0)
+        return 0;
+
+#ifdef __linux__
+    if (S_ISBLK(st.st_mode)) {
+        uint64_t range[2] = { offset, length };
+# ifdef BLKZEROOUT
+        if (ioctl(fd, BLKZEROOUT, range) == 0) {
+            VIR_DEBUG("zeroed %llu bytes of '%s' with BLKZEROOUT",
+                      (unsigned long long) length, vol->target.path);
+            return 0;
+        }
+        if (!virStorageBackendCopyUnsupported(errno)) {
+            virReportSystemError(errno, _("cannot zero out device '%s'"),
+                                 vol->target.path);
+            return -1;
+        }
+# endif
+# if defined(BLKDISCARD) && defined(BLKDISCARDZEROES)
+        {
+            unsigned int zeroes = 0;
+
+            if (ioctl(fd, BLKDISCARDZEROES, &zeroes) == 0 && zeroes &&
+                ioctl(fd, BLKDISCARD, range) == 0) {
+                VIR_DEBUG("discarded %llu bytes of '%s'",
+                          (unsigned long long) length, vol->target.path);
+                return 0;
+            }
+        }
+# endif
+        return 1;
+    }
+#endif
+
+/* Avoid issues with older kernel's <linux/fs.h> namespace pollution. */
+#if HAVE_FALLOCATE - 0 && defined(FALLOC_FL_ZERO_RANGE)
+    if (S_ISREG(st.st_mode)) {
+        if (fallocate(fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE,
+                      offset, length) == 0) {
+            if (fdatasync(fd) < 0) {
+                virReportSystemError(errno,
+                                     _("cannot sync data to file '%s'"),
+                                     vol->target.path);
+                return -1;
+            }
+            VIR_DEBUG("zeroed %llu bytes of '%s' with fallocate",
+                      (unsigned long long) length, vol->target.path);
+            return 0;
+        }
+        if (!virStorageBackendCopyUnsupported(errno)) {
+            virReportSystemError(errno, _("cannot zero out file '%s'"),
+                                 vol->target.path);
+            return -1;
+        }
+    }
+#endif
+
+    return 1;
+}
+
+
+static int
+virStorageBackendWipeExtent(virStorageVolDefPtr vol,
+                            int fd,
+                            off_t extent_start,
+                            off_t extent_length,
+                            char *writebuf,
+                            size_t writebuf_length,
+                            size_t *bytes_wiped)
+{
+    int ret = -1, written = 0;
+    off_t remaining = 0;
+    size_t write_size = 0;
+
+    VIR_DEBUG("extent logical start: %ju len: %ju",
+              (uintmax_t)extent_start, (uintmax_t)extent_length);
+
+    if ((ret = lseek(fd, extent_start, SEEK_SET)) < 0) {
+        virReportSystemError(errno,
+                             _("Failed to seek to position %ju in volume "
+                               "with path '%s'"),
+                             (uintmax_t)extent_start, vol->target.path);
+        goto cleanup;
+    }
+
+    remaining = extent_length;
+    while (remaining > 0) {
+
+        write_size = (writebuf_length < remaining) ? writebuf_length : remaining;
+        written = safewrite(fd, writebuf, write_size);
+        if (written < 0) {
+            virReportSystemError(errno,
+                                 _("Failed to write %zu bytes to "
+                                   "storage volume with path '%s'"),
+                                 write_size, vol->target.path);
+
+            goto cleanup;
+        }
+
+        *bytes_wiped += written;
+        remaining -= written;
+    }
+
+    if (fdatasync(fd) < 0) {
+        ret = -errno;
+        virReportSystemError(errno,
+                             _("cannot sync data to volume with path '%s'"),
+                             vol->target.path);
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Wrote %zu bytes to volume with path '%s'",
+              *bytes_wiped, vol->target.path);
+
+    ret = 0;
+
+ cleanup:
+    return ret;
+}
+
+
+/*
+ * Overwrite the first @length bytes of the volume open on @fd with
+ * zeroes, letting the kernel or the device do it through
+ * virStorageBackendZeroExtent when possible and writing the zeroes
+ * ourselves otherwise.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virStorageBackendWipeZero(virStorageVolDefPtr vol,
+                          int fd,
+                          off_t length)
+{
+    int ret = -1;
+    int rc;
+    struct stat st;
+    char *writebuf = NULL;
+    size_t bytes_wiped = 0;
+
+    if ((rc = virStorageBackendZeroExtent(vol, fd, 0, length)) <= 0)
+        return rc;
+
+    if (fstat(fd, &st) < 0) {
+        virReportSystemError(errno, _("cannot stat file '%s'"),
+                             vol->target.path);
+        return -1;
+    }
+
+    if (VIR_ALLOC_N(writebuf, st.st_blksize) < 0)
+        return -1;
+
+    if (virStorageBackendWipeExtent(vol, fd, 0, length, writebuf,
+                                    st.st_blksize, &bytes_wiped) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(writebuf);
+    return ret;
+}
+
+
 static int
 virStorageBackendCreateBlockFrom(virConnectPtr conn ATTRIBUTE_UNUSED,
                                  virStoragePoolObjPtr pool ATTRIBUTE_UNUSED,
@@ -80,6 +80,13 @@ int virStorageBackendCreateRaw(virConnectPtr conn,
                                virStorageVolDefPtr vol,
                                virStorageVolDefPtr inputvol,
                                unsigned int flags);
+int virStorageBackendZeroExtent(virStorageVolDefPtr vol,
+                                int fd,
+                                off_t offset,
+                                off_t length);
+int virStorageBackendWipeZero(virStorageVolDefPtr vol,
+                              int fd,
+                              off_t length);
 virStorageBackendBuildVolFrom
 virStorageBackendGetBuildVolFromFunction(virStorageVolDefPtr vol,
                                          virStorageVolDefPtr inputvol);
@@ -1301,6 +1301,39 @@ storagePoolListAllVolumes(virStoragePoolPtr pool,
     return ret;
 }
 
+static int
+storagePoolListVolumesPage(virStoragePoolPtr pool,
+                           const char *after,
+                           unsigned int maxvols,
+                           virStorageVolPtr **vols,
+                           unsigned int flags)
+{
+    virStoragePoolObjPtr obj;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (!(obj = virStoragePoolObjFromStoragePool(pool)))
+        return -1;
+
+    if (virStoragePoolListVolumesPageEnsureACL(pool->conn, obj->def) < 0)
+        goto cleanup;
+
+    if (!virStoragePoolObjIsActive(obj)) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("storage pool '%s' is not active"), obj->def->name);
+        goto cleanup;
+    }
+
+    ret = virStoragePoolObjVolumeListExportPage(pool->conn, obj, after,
+                                                maxvols, vols,
+                                                virStoragePoolListVolumesPageCheckACL);
+
+ cleanup:
+    virStoragePoolObjUnlock(obj);
+    return ret;
+}
+
 static virStorageVolPtr
 storageVolLookupByName(virStoragePoolPtr obj,
                        const char *name)
@@ -2159,74 +2192,12 @@ storageVolZeroSparseFile(virStorageVolDefPtr vol,
 }
 
 
-static int
-storageWipeExtent(virStorageVolDefPtr vol,
-                  int fd,
-                  off_t extent_start,
-                  off_t extent_length,
-                  char *writebuf,
-                  size_t writebuf_length,
-                  size_t *bytes_wiped)
-{
-    int ret = -1, written = 0;
-    off_t remaining = 0;
-    size_t write_size = 0;
-
-    VIR_DEBUG("extent logical start: %ju len: %ju",
-              (uintmax_t)extent_start, (uintmax_t)extent_length);
-
-    if ((ret = lseek(fd, extent_start, SEEK_SET)) < 0) {
-        virReportSystemError(errno,
-                             _("Failed to seek to position %ju in volume "
-                               "with path '%s'"),
-                             (uintmax_t)extent_start, vol->target.path);
-        goto cleanup;
-    }
-
-    remaining = extent_length;
-    while (remaining > 0) {
-
-        write_size = (writebuf_length < remaining) ? writebuf_length : remaining;
-        written = safewrite(fd, writebuf, write_size);
-        if (written < 0) {
-            virReportSystemError(errno,
-                                 _("Failed to write %zu bytes to "
-                                   "storage volume with path '%s'"),
-                                 write_size, vol->target.path);
-
-            goto cleanup;
-        }
-
-        *bytes_wiped += written;
-        remaining -= written;
-    }
-
-    if (fdatasync(fd) < 0) {
-        ret = -errno;
-        virReportSystemError(errno,
-                             _("cannot sync data to volume with path '%s'"),
-                             vol->target.path);
-        goto cleanup;
-    }
-
-    VIR_DEBUG("Wrote %zu bytes to volume with path '%s'",
-              *bytes_wiped, vol->target.path);
-
-    ret = 0;
-
- cleanup:
-    return ret;
-}
-
-
 static int
 storageVolWipeInternal(virStorageVolDefPtr def,
                        unsigned int algorithm)
 {
     int ret = -1, fd = -1;
     struct stat st;
-    char *writebuf = NULL;
-    size_t bytes_wiped = 0;
     virCommandPtr cmd = NULL;
 
     VIR_DEBUG("Wiping volume with path '%s' and algorithm %u",
@@ -2292,23 +2263,12 @@ storageVolWipeInternal(virStorageVolDefPtr def,
         if (S_ISREG(st.st_mode) && st.st_blocks < (st.st_size / DEV_BSIZE)) {
             ret = storageVolZeroSparseFile(def, st.st_size, fd);
         } else {
-
-            if (VIR_ALLOC_N(writebuf, st.st_blksize) < 0)
-                goto cleanup;
-
-            ret = storageWipeExtent(def,
-                                    fd,
-                                    0,
-                                    def->target.allocation,
-                                    writebuf,
-                                    st.st_blksize,
-                                    &bytes_wiped);
+            ret = virStorageBackendWipeZero(def, fd, def->target.allocation);
         }
     }
 
  cleanup:
     virCommandFree(cmd);
-    VIR_FREE(writebuf);
     VIR_FORCE_CLOSE(fd);
     return ret;
 }
@@ -2521,6 +2481,7 @@ static virStorageDriver storageDriver = {
 
     .storagePoolIsActive = storagePoolIsActive, /* 0.7.3 */
     .storagePoolIsPersistent = storagePoolIsPersistent, /* 0.7.3 */
+    .storagePoolListVolumesPage = storagePoolListVolumesPage, /* 1.2.7 */
 };
 
 
@@ -5338,6 +5338,45 @@ testStoragePoolListAllVolumes(virStoragePoolPtr obj,
     return ret;
 }
 
+static int
+testStoragePoolListVolumesPage(virStoragePoolPtr obj,
+                               const char *after,
+                               unsigned int maxvols,
+                               virStorageVolPtr **vols,
+                               unsigned int flags)
+{
+    testConnPtr privconn = obj->conn->privateData;
+    virStoragePoolObjPtr pool;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    testDriverLock(privconn);
+    pool = virStoragePoolObjFindByUUID(&privconn->pools, obj->uuid);
+    testDriverUnlock(privconn);
+
+    if (!pool) {
+        virReportError(VIR_ERR_NO_STORAGE_POOL, "%s",
+                       _("no storage pool with matching uuid"));
+        goto cleanup;
+    }
+
+    if (!virStoragePoolObjIsActive(pool)) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("storage pool is not active"));
+        goto cleanup;
+    }
+
+    ret = virStoragePoolObjVolumeListExportPage(obj->conn, pool, after,
+                                                maxvols, vols, NULL);
+
+ cleanup:
+    if (pool)
+        virStoragePoolObjUnlock(pool);
+
+    return ret;
+}
+
 static virStorageVolPtr
 testStorageVolLookupByName(virStoragePoolPtr pool,
                            const char *name ATTRIBUTE_UNUSED)
@@ -6345,6 +6384,26 @@ static int testConnectListAllDomains(virConnectPtr conn,
     return ret;
 }
 
+static int
+testConnectListDomainsPage(virConnectPtr conn,
+                           const char *after,
+                           unsigned int maxdomains,
+                           virDomainPtr **domains,
+                           unsigned int flags)
+{
+    testConnPtr privconn = conn->privateData;
+    int ret;
+
+    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ALL, -1);
+
+    testDriverLock(privconn);
+    ret = virDomainObjListExportPage(privconn->domains, conn, after,
+                                     maxdomains, domains, NULL, flags);
+    testDriverUnlock(privconn);
+
+    return ret;
+}
+
 static int
 testNodeGetCPUMap(virConnectPtr conn,
                   unsigned char **cpumap,
@@ -7368,6 +7427,7 @@ static virDriver testDriver = {
     .connectListDomains = testConnectListDomains, /* 0.1.1 */
     .connectNumOfDomains = testConnectNumOfDomains, /* 0.1.1 */
     .connectListAllDomains = testConnectListAllDomains, /* 0.9.13 */
+    .connectListDomainsPage = testConnectListDomainsPage, /* 1.2.7 */
     .domainCreateXML = testDomainCreateXML, /* 0.1.4 */
     .domainLookupByID = testDomainLookupByID, /* 0.1.1 */
     .domainLookupByUUID = testDomainLookupByUUID, /* 0.1.1 */
@@ -7543,6 +7603,7 @@ static virStorageDriver testStorageDriver = {
     .storageVolGetPath = testStorageVolGetPath, /* 0.5.0 */
     .storagePoolIsActive = testStoragePoolIsActive, /* 0.7.3 */
     .storagePoolIsPersistent = testStoragePoolIsPersistent, /* 0.7.3 */
+    .storagePoolListVolumesPage = testStoragePoolListVolumesPage, /* 1.2.7 */
 };
 
 static virNodeDeviceDriver testNodeDeviceDriver = {
@@ -477,7 +477,7 @@ umlStateInitialize(bool privileged,
     if (!(uml_driver->domains = virDomainObjListNew()))
         goto error;
 
-    uml_driver->domainEventState = virObjectEventStateNew();
+    uml_driver->domainEventState = virObjectEventStateNewFull(true);
     if (!uml_driver->domainEventState)
         goto error;
 
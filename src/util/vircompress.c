@@ -0,0 +1,631 @@
+/*
+ * vircompress.c: multithreaded chunked compression of a byte stream
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#if WITH_ZLIB
+# include <zlib.h>
+#endif
+
+#include "vircompress.h"
+#include "viralloc.h"
+#include "virendian.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.compress");
+
+/*
+ * The input is cut into chunks which are compressed independently of
+ * each other, so any number of threads can work on them at once. The
+ * compressed stream is a sequence of frames
+ *
+ *   uint32 BE  length of the chunk uncompressed
+ *   uint32 BE  length of the chunk compressed
+ *   the compressed chunk
+ *
+ * ended by a frame with both lengths 0, so that a stream cut short
+ * is told apart from a complete one.
+ */
+
+#define VIR_COMPRESS_FRAME_LEN 8
+
+typedef struct _virCompressChunk virCompressChunk;
+typedef virCompressChunk *virCompressChunkPtr;
+struct _virCompressChunk {
+    unsigned char *in;
+    size_t inlen;
+    unsigned char *out;
+    size_t outlen;
+    bool busy; /* a worker took it */
+    bool done; /* @out is ready to be written */
+};
+
+struct _virCompressJob {
+    virMutex lock;
+    virCond cond;
+
+    int infd;
+    int outfd;
+    bool decompress;
+    size_t chunkSize;
+    size_t maxChunks;
+
+    /* Chunks in stream order, the first one is written next */
+    virCompressChunkPtr *chunks;
+    size_t nchunks;
+
+    bool eof;  /* the reader queued its last chunk */
+    bool quit; /* something failed, everyone stops */
+    virErrorPtr err;
+
+    size_t nframes; /* written so far */
+
+    virThread reader;
+    virThread writer;
+    virThreadPtr workers;
+    size_t nworkers;
+};
+
+
+bool
+virCompressAvailable(void)
+{
+#if WITH_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+static void
+virCompressChunkFree(virCompressChunkPtr chunk)
+{
+    if (!chunk)
+        return;
+
+    VIR_FREE(chunk->in);
+    VIR_FREE(chunk->out);
+    VIR_FREE(chunk);
+}
+
+
+static void
+virCompressWriteBufInt32BE(unsigned char *buf,
+                           uint32_t val)
+{
+    buf[0] = val >> 24;
+    buf[1] = val >> 16;
+    buf[2] = val >> 8;
+    buf[3] = val;
+}
+
+
+/* Called with the job locked, from the thread that just
+ * reported an error */
+static void
+virCompressJobFail(virCompressJobPtr job)
+{
+    if (!job->err)
+        job->err = virSaveLastError();
+    job->quit = true;
+    virCondBroadcast(&job->cond);
+}
+
+
+static int
+virCompressJobReadExact(virCompressJobPtr job,
+                        void *buf,
+                        size_t len)
+{
+    ssize_t got = saferead(job->infd, buf, len);
+
+    if (got < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to read compression input"));
+        return -1;
+    }
+    if (got != len) {
+        virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                       _("compressed stream ended unexpectedly"));
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Read the next chunk off the input. Returns 0 with *@chunk
+ * NULL at the end of the stream */
+static int
+virCompressJobReadChunk(virCompressJobPtr job,
+                        virCompressChunkPtr *chunk)
+{
+    virCompressChunkPtr ret = NULL;
+    ssize_t got;
+
+    *chunk = NULL;
+
+    if (VIR_ALLOC(ret) < 0)
+        return -1;
+
+    if (job->decompress) {
+        unsigned char frame[VIR_COMPRESS_FRAME_LEN];
+
+        if (virCompressJobReadExact(job, frame, sizeof(frame)) < 0)
+            goto error;
+
+        ret->outlen = virReadBufInt32BE(frame);
+        ret->inlen = virReadBufInt32BE(frame + 4);
+
+        if (!ret->outlen && !ret->inlen) {
+            virCompressChunkFree(ret);
+            return 0;
+        }
+
+        if (!ret->outlen || ret->outlen > job->chunkSize ||
+            !ret->inlen || ret->inlen > job->chunkSize * 2 + 1024) {
+            virReportError(VIR_ERR_OPERATION_FAILED,
+                           _("invalid compressed chunk of %zu bytes"),
+                           ret->inlen);
+            goto error;
+        }
+
+        if (VIR_ALLOC_N(ret->in, ret->inlen) < 0 ||
+            virCompressJobReadExact(job, ret->in, ret->inlen) < 0)
+            goto error;
+    } else {
+        if (VIR_ALLOC_N(ret->in, job->chunkSize) < 0)
+            goto error;
+
+        if ((got = saferead(job->infd, ret->in, job->chunkSize)) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("unable to read compression input"));
+            goto error;
+        }
+
+        if (got == 0) {
+            virCompressChunkFree(ret);
+            return 0;
+        }
+        ret->inlen = got;
+    }
+
+    *chunk = ret;
+    return 0;
+
+ error:
+    virCompressChunkFree(ret);
+    return -1;
+}
+
+
+/* Keep reading until the producer is done even though the output
+ * is lost, so that it isn't stuck forever writing into a pipe that
+ * nobody empties */
+static void
+virCompressJobDrain(virCompressJobPtr job)
+{
+    char *buf;
+    size_t len = 64 * 1024;
+
+    if (VIR_ALLOC_N_QUIET(buf, len) < 0)
+        return;
+
+    while (saferead(job->infd, buf, len) > 0)
+        ;
+
+    VIR_FREE(buf);
+}
+
+
+static void
+virCompressJobReader(void *opaque)
+{
+    virCompressJobPtr job = opaque;
+    virCompressChunkPtr chunk = NULL;
+    bool quit;
+
+    while (true) {
+        virMutexLock(&job->lock);
+        while (!job->quit && job->nchunks >= job->maxChunks)
+            ignore_value(virCondWait(&job->cond, &job->lock));
+        quit = job->quit;
+        virMutexUnlock(&job->lock);
+
+        if (quit)
+            break;
+
+        if (virCompressJobReadChunk(job, &chunk) < 0) {
+            virMutexLock(&job->lock);
+            virCompressJobFail(job);
+            virMutexUnlock(&job->lock);
+            break;
+        }
+
+        if (!chunk)
+            break;
+
+        virMutexLock(&job->lock);
+        if (VIR_APPEND_ELEMENT(job->chunks, job->nchunks, chunk) < 0) {
+            virCompressChunkFree(chunk);
+            virCompressJobFail(job);
+        }
+        virCondBroadcast(&job->cond);
+        virMutexUnlock(&job->lock);
+    }
+
+    virMutexLock(&job->lock);
+    job->eof = true;
+    quit = job->quit;
+    virCondBroadcast(&job->cond);
+    virMutexUnlock(&job->lock);
+
+    if (quit && !job->decompress)
+        virCompressJobDrain(job);
+}
+
+
+static int
+virCompressChunkProcess(virCompressJobPtr job,
+                        virCompressChunkPtr chunk)
+{
+#if WITH_ZLIB
+    uLongf len;
+    int rc;
+
+    if (job->decompress) {
+        if (VIR_ALLOC_N(chunk->out, chunk->outlen) < 0)
+            return -1;
+
+        len = chunk->outlen;
+        rc = uncompress(chunk->out, &len, chunk->in, chunk->inlen);
+        if (rc != Z_OK || len != chunk->outlen) {
+            virReportError(VIR_ERR_OPERATION_FAILED,
+                           _("unable to decompress chunk: %s"),
+                           rc == Z_OK ? _("wrong length") : zError(rc));
+            return -1;
+        }
+    } else {
+        len = compressBound(chunk->inlen);
+        if (VIR_ALLOC_N(chunk->out, len) < 0)
+            return -1;
+
+        /* Throughput matters more than ratio when dumping guest RAM */
+        rc = compress2(chunk->out, &len, chunk->in, chunk->inlen,
+                       Z_BEST_SPEED);
+        if (rc != Z_OK) {
+            virReportError(VIR_ERR_OPERATION_FAILED,
+                           _("unable to compress chunk: %s"), zError(rc));
+            return -1;
+        }
+        chunk->outlen = len;
+    }
+
+    VIR_FREE(chunk->in);
+    return 0;
+#else
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("libvirt was built without zlib support"));
+    return -1;
+#endif
+}
+
+
+static void
+virCompressJobWorker(void *opaque)
+{
+    virCompressJobPtr job = opaque;
+    virCompressChunkPtr chunk;
+    size_t i;
+    int rc;
+
+    virMutexLock(&job->lock);
+
+    while (true) {
+        chunk = NULL;
+
+        while (!job->quit) {
+            for (i = 0; i < job->nchunks; i++) {
+                if (!job->chunks[i]->busy) {
+                    chunk = job->chunks[i];
+                    break;
+                }
+            }
+            if (chunk || job->eof)
+                break;
+            ignore_value(virCondWait(&job->cond, &job->lock));
+        }
+
+        if (!chunk)
+            break;
+
+        chunk->busy = true;
+        virMutexUnlock(&job->lock);
+
+        rc = virCompressChunkProcess(job, chunk);
+
+        virMutexLock(&job->lock);
+        if (rc < 0) {
+            virCompressJobFail(job);
+            break;
+        }
+        chunk->done = true;
+        virCondBroadcast(&job->cond);
+    }
+
+    virMutexUnlock(&job->lock);
+}
+
+
+static int
+virCompressJobWriteAll(virCompressJobPtr job,
+                       const void *buf,
+                       size_t len)
+{
+    if (safewrite(job->outfd, buf, len) != len) {
+        virReportSystemError(errno, "%s",
+                             _("unable to write compression output"));
+        return -1;
+    }
+    return 0;
+}
+
+
+static int
+virCompressJobWriteChunk(virCompressJobPtr job,
+                         virCompressChunkPtr chunk)
+{
+    unsigned char frame[VIR_COMPRESS_FRAME_LEN];
+
+    job->nframes++;
+
+    if (job->decompress)
+        return virCompressJobWriteAll(job, chunk->out, chunk->outlen);
+
+    virCompressWriteBufInt32BE(frame, chunk->inlen);
+    virCompressWriteBufInt32BE(frame + 4, chunk->outlen);
+
+    if (virCompressJobWriteAll(job, frame, sizeof(frame)) < 0 ||
+        virCompressJobWriteAll(job, chunk->out, chunk->outlen) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+virCompressJobWriteEnd(virCompressJobPtr job)
+{
+    unsigned char frame[VIR_COMPRESS_FRAME_LEN] = { 0 };
+
+    return virCompressJobWriteAll(job, frame, sizeof(frame));
+}
+
+
+static void
+virCompressJobWriter(void *opaque)
+{
+    virCompressJobPtr job = opaque;
+    virCompressChunkPtr chunk;
+    int rc;
+
+    virMutexLock(&job->lock);
+
+    while (true) {
+        while (!job->quit &&
+               !(job->nchunks && job->chunks[0]->done) &&
+               !(job->eof && !job->nchunks))
+            ignore_value(virCondWait(&job->cond, &job->lock));
+
+        if (job->quit)
+            break;
+
+        if (!job->nchunks) {
+            if (!job->decompress) {
+                virMutexUnlock(&job->lock);
+                rc = virCompressJobWriteEnd(job);
+                virMutexLock(&job->lock);
+                if (rc < 0)
+                    virCompressJobFail(job);
+            }
+            break;
+        }
+
+        chunk = job->chunks[0];
+        virMutexUnlock(&job->lock);
+
+        rc = virCompressJobWriteChunk(job, chunk);
+
+        virMutexLock(&job->lock);
+        VIR_DELETE_ELEMENT(job->chunks, 0, job->nchunks);
+        virCompressChunkFree(chunk);
+        virCondBroadcast(&job->cond);
+
+        if (rc < 0) {
+            virCompressJobFail(job);
+            break;
+        }
+    }
+
+    virMutexUnlock(&job->lock);
+}
+
+
+static void
+virCompressJobFree(virCompressJobPtr job)
+{
+    size_t i;
+
+    if (!job)
+        return;
+
+    for (i = 0; i < job->nchunks; i++)
+        virCompressChunkFree(job->chunks[i]);
+    VIR_FREE(job->chunks);
+    VIR_FREE(job->workers);
+    virFreeError(job->err);
+    virCondDestroy(&job->cond);
+    virMutexDestroy(&job->lock);
+    VIR_FREE(job);
+}
+
+
+/**
+ * virCompressJobStart:
+ * @infd: file descriptor to read from
+ * @outfd: file descriptor to write to
+ * @decompress: whether @infd holds a compressed stream
+ * @nworkers: number of threads (de)compressing chunks
+ * @chunkSize: size of an uncompressed chunk
+ *
+ * Start copying @infd to @outfd in the background, compressing or
+ * decompressing on the way. @chunkSize must match between compression
+ * and decompression of the same stream. Neither file descriptor is
+ * closed; the job stops at the end of @infd or as soon as a read or
+ * write fails.
+ *
+ * Returns the job, to be passed to virCompressJobFinish(), or NULL
+ * on error.
+ */
+virCompressJobPtr
+virCompressJobStart(int infd,
+                    int outfd,
+                    bool decompress,
+                    size_t nworkers,
+                    size_t chunkSize)
+{
+    virCompressJobPtr job = NULL;
+    size_t i;
+
+    if (!virCompressAvailable()) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("libvirt was built without zlib support"));
+        return NULL;
+    }
+
+    if (!nworkers || !chunkSize || chunkSize > UINT32_MAX / 2) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("invalid compression setup: %zu workers, "
+                         "%zu bytes per chunk"), nworkers, chunkSize);
+        return NULL;
+    }
+
+    if (VIR_ALLOC(job) < 0)
+        return NULL;
+
+    if (virMutexInit(&job->lock) < 0) {
+        VIR_FREE(job);
+        return NULL;
+    }
+    if (virCondInit(&job->cond) < 0) {
+        virMutexDestroy(&job->lock);
+        VIR_FREE(job);
+        return NULL;
+    }
+
+    job->infd = infd;
+    job->outfd = outfd;
+    job->decompress = decompress;
+    job->chunkSize = chunkSize;
+    /* Enough to keep every worker busy while the writer catches up */
+    job->maxChunks = nworkers * 2;
+
+    if (VIR_ALLOC_N(job->workers, nworkers) < 0)
+        goto error;
+
+    for (i = 0; i < nworkers; i++) {
+        if (virThreadCreate(&job->workers[i], true,
+                            virCompressJobWorker, job) < 0)
+            goto error_threads;
+        job->nworkers++;
+    }
+
+    if (virThreadCreate(&job->writer, true, virCompressJobWriter, job) < 0)
+        goto error_threads;
+
+    if (virThreadCreate(&job->reader, true, virCompressJobReader, job) < 0) {
+        virMutexLock(&job->lock);
+        job->quit = true;
+        virCondBroadcast(&job->cond);
+        virMutexUnlock(&job->lock);
+        virThreadJoin(&job->writer);
+        goto error_workers;
+    }
+
+    VIR_DEBUG("Started %scompression of fd %d into fd %d with %zu workers",
+              decompress ? "de" : "", infd, outfd, nworkers);
+
+    return job;
+
+ error_threads:
+    virReportSystemError(errno, "%s",
+                         _("unable to create compression thread"));
+    virMutexLock(&job->lock);
+    job->quit = true;
+    virCondBroadcast(&job->cond);
+    virMutexUnlock(&job->lock);
+ error_workers:
+    for (i = 0; i < job->nworkers; i++)
+        virThreadJoin(&job->workers[i]);
+ error:
+    virCompressJobFree(job);
+    return NULL;
+}
+
+
+/**
+ * virCompressJobFinish:
+ * @job: job from virCompressJobStart()
+ *
+ * Wait for @job to copy all of its input and free it.
+ *
+ * Returns 0 on success, -1 with the error of the job reported
+ * otherwise.
+ */
+int
+virCompressJobFinish(virCompressJobPtr job)
+{
+    size_t i;
+    int ret = -1;
+
+    virThreadJoin(&job->reader);
+    virThreadJoin(&job->writer);
+    for (i = 0; i < job->nworkers; i++)
+        virThreadJoin(&job->workers[i]);
+
+    if (job->err) {
+        virSetError(job->err);
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Finished %scompression of %zu chunks",
+              job->decompress ? "de" : "", job->nframes);
+
+    ret = 0;
+ cleanup:
+    virCompressJobFree(job);
+    return ret;
+}
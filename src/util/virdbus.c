@@ -302,6 +302,111 @@ static bool virDBusIsBasicType(char c)
     return !!memchr(virDBusBasicTypes, c, ARRAY_CARDINALITY(virDBusBasicTypes));
 }
 
+/*
+ * Array refs ('a&') can hold a single basic type, read from
+ * or written to a plain C array, or string to string dict
+ * entries, held in a flat C array of alternating keys and
+ * values.
+ */
+static bool virDBusIsAllowedRefType(const char *sig)
+{
+    if (STREQ(sig, "{ss}"))
+        return true;
+
+    return strlen(sig) == 1 && virDBusIsBasicType(*sig);
+}
+
+
+static int
+virDBusEncodeStringDict(DBusMessageIter *iter,
+                        size_t nentries,
+                        const char **entries)
+{
+    DBusMessageIter arrayiter;
+    size_t i;
+
+    if (!dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+                                          "{ss}", &arrayiter))
+        goto error;
+
+    for (i = 0; i < nentries; i++) {
+        DBusMessageIter entryiter;
+
+        if (!dbus_message_iter_open_container(&arrayiter,
+                                              DBUS_TYPE_DICT_ENTRY,
+                                              NULL, &entryiter) ||
+            !dbus_message_iter_append_basic(&entryiter, DBUS_TYPE_STRING,
+                                            &entries[i * 2]) ||
+            !dbus_message_iter_append_basic(&entryiter, DBUS_TYPE_STRING,
+                                            &entries[(i * 2) + 1]) ||
+            !dbus_message_iter_close_container(&arrayiter, &entryiter))
+            goto error;
+    }
+
+    if (!dbus_message_iter_close_container(iter, &arrayiter))
+        goto error;
+
+    return 0;
+
+ error:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("Cannot append string dict to message"));
+    return -1;
+}
+
+
+static int
+virDBusDecodeStringDict(DBusMessageIter *iter,
+                        size_t *nentries,
+                        char ***entries)
+{
+    DBusMessageIter arrayiter;
+    size_t nstrings = 0;
+
+    *nentries = 0;
+    *entries = NULL;
+
+    if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY ||
+        dbus_message_iter_get_element_type(iter) != DBUS_TYPE_DICT_ENTRY)
+        goto mismatch;
+
+    dbus_message_iter_recurse(iter, &arrayiter);
+    while (dbus_message_iter_get_arg_type(&arrayiter) ==
+           DBUS_TYPE_DICT_ENTRY) {
+        DBusMessageIter entryiter;
+        const char *key;
+        const char *value;
+
+        dbus_message_iter_recurse(&arrayiter, &entryiter);
+        if (dbus_message_iter_get_arg_type(&entryiter) != DBUS_TYPE_STRING)
+            goto mismatch;
+        dbus_message_iter_get_basic(&entryiter, &key);
+
+        if (!dbus_message_iter_next(&entryiter) ||
+            dbus_message_iter_get_arg_type(&entryiter) != DBUS_TYPE_STRING)
+            goto mismatch;
+        dbus_message_iter_get_basic(&entryiter, &value);
+
+        if (VIR_EXPAND_N(*entries, nstrings, 2) < 0 ||
+            VIR_STRDUP((*entries)[nstrings - 2], key) < 0 ||
+            VIR_STRDUP((*entries)[nstrings - 1], value) < 0)
+            goto error;
+
+        dbus_message_iter_next(&arrayiter);
+    }
+
+    *nentries = nstrings / 2;
+    return 0;
+
+ mismatch:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("Message field is not a string dict"));
+ error:
+    virStringFreeListCount(*entries, nstrings);
+    *entries = NULL;
+    return -1;
+}
+
 /*
  * All code related to virDBusMessageIterEncode and
  * virDBusMessageIterDecode is derived from systemd
@@ -649,10 +754,10 @@ virDBusMessageIterEncode(DBusMessageIter *rootiter,
             if (VIR_STRNDUP(contsig, t + 1, siglen) < 0)
                 goto cleanup;
 
-            if (arrayref && (strlen(contsig) > 1 ||
-                             !virDBusIsBasicType(*contsig))) {
+            if (arrayref && !virDBusIsAllowedRefType(contsig)) {
                 virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Got array ref but '%s' is not a single basic type"),
+                               _("Got array ref but '%s' is not a single basic type "
+                                 "or string dict"),
                                contsig);
                 goto cleanup;
             }
@@ -662,6 +767,17 @@ virDBusMessageIterEncode(DBusMessageIter *rootiter,
                 nstruct -= siglen;
             }
 
+            if (arrayref && *contsig == DBUS_DICT_ENTRY_BEGIN_CHAR) {
+                size_t nentries = va_arg(args, int);
+                const char **entries = va_arg(args, const char **);
+
+                VIR_FREE(contsig);
+                arrayref = false;
+                if (virDBusEncodeStringDict(iter, nentries, entries) < 0)
+                    goto cleanup;
+                break;
+            }
+
             if (VIR_ALLOC(newiter) < 0)
                 goto cleanup;
             VIR_DEBUG("Contsig '%s' '%zu'", contsig, siglen);
@@ -940,10 +1056,10 @@ virDBusMessageIterDecode(DBusMessageIter *rootiter,
             if (VIR_STRNDUP(contsig, t + 1, siglen) < 0)
                 goto cleanup;
 
-            if (arrayref && (strlen(contsig) > 1 ||
-                             !virDBusIsBasicType(*contsig))) {
+            if (arrayref && !virDBusIsAllowedRefType(contsig)) {
                 virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Got array ref but '%s' is not a single basic type"),
+                               _("Got array ref but '%s' is not a single basic type "
+                                 "or string dict"),
                                contsig);
                 goto cleanup;
             }
@@ -953,6 +1069,18 @@ virDBusMessageIterDecode(DBusMessageIter *rootiter,
                 nstruct -= siglen;
             }
 
+            if (arrayref && *contsig == DBUS_DICT_ENTRY_BEGIN_CHAR) {
+                size_t *nentries = va_arg(args, size_t *);
+                char ***entries = va_arg(args, char ***);
+
+                VIR_FREE(contsig);
+                arrayref = false;
+                advanceiter = true;
+                if (virDBusDecodeStringDict(iter, nentries, entries) < 0)
+                    goto cleanup;
+                break;
+            }
+
             if (VIR_ALLOC(newiter) < 0)
                 goto cleanup;
             VIR_DEBUG("Contsig '%s' '%zu' '%s'", contsig, siglen, types);
@@ -36,30 +36,82 @@
 #include "virutil.h"
 #include "virstring.h"
 #include "virprocess.h"
+#include "virhash.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_IDENTITY
 
 VIR_LOG_INIT("util.identity");
 
+/* How long a user or group name looked up from its ID is trusted,
+ * in milliseconds */
+#define VIR_IDENTITY_NAME_CACHE_TTL (60 * 1000)
+
 struct _virIdentity {
-    virObject parent;
+    virObjectLockable parent;
 
     char *attrs[VIR_IDENTITY_ATTR_LAST];
+
+    /* Attributes left unset are computed on first use by @resolve */
+    virIdentityResolveFunc resolve;
+    void *opaque;
+    virFreeCallback freeopaque;
+    unsigned int resolved;      /* Bitmask of attributes already tried */
+};
+
+typedef struct _virIdentityNameCacheEntry virIdentityNameCacheEntry;
+typedef virIdentityNameCacheEntry *virIdentityNameCacheEntryPtr;
+
+struct _virIdentityNameCacheEntry {
+    char *name;
+    unsigned long long expires;
 };
 
 static virClassPtr virIdentityClass;
 static virThreadLocal virIdentityCurrent;
 
+/* Name lookups can go to LDAP or similar, so they are shared among
+ * all identities for a while, keyed by "user:<uid>" or "group:<gid>".
+ * Our own start time is asked for every time the system identity is
+ * built, it can only change across a fork. */
+static virMutex virIdentityCacheLock;
+static virHashTablePtr virIdentityNameCache;
+static pid_t virIdentitySystemPid;
+static unsigned long long virIdentitySystemTime;
+
 static void virIdentityDispose(void *obj);
 
+static void
+virIdentityNameCacheEntryFree(void *payload,
+                              const void *name ATTRIBUTE_UNUSED)
+{
+    virIdentityNameCacheEntryPtr entry = payload;
+
+    if (!entry)
+        return;
+
+    VIR_FREE(entry->name);
+    VIR_FREE(entry);
+}
+
 static int virIdentityOnceInit(void)
 {
-    if (!(virIdentityClass = virClassNew(virClassForObject(),
+    if (!(virIdentityClass = virClassNew(virClassForObjectLockable(),
                                          "virIdentity",
                                          sizeof(virIdentity),
                                          virIdentityDispose)))
         return -1;
 
+    if (virMutexInit(&virIdentityCacheLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to initialize identity cache mutex"));
+        return -1;
+    }
+
+    if (!(virIdentityNameCache = virHashCreate(32,
+                                               virIdentityNameCacheEntryFree)))
+        return -1;
+
     if (virThreadLocalInit(&virIdentityCurrent,
                            (virThreadLocalCleanup)virObjectUnref) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -124,19 +176,175 @@ int virIdentitySetCurrent(virIdentityPtr ident)
 }
 
 
+static int
+virIdentityNameCacheIsExpired(const void *payload,
+                              const void *name ATTRIBUTE_UNUSED,
+                              const void *opaque)
+{
+    const virIdentityNameCacheEntry *entry = payload;
+    const unsigned long long *now = opaque;
+
+    return entry->expires <= *now;
+}
+
+
+static int
+virIdentityLookupName(bool group,
+                      unsigned int id,
+                      char **name)
+{
+    virIdentityNameCacheEntryPtr entry;
+    unsigned long long now;
+    char *key = NULL;
+    int ret = -1;
+
+    *name = NULL;
+
+    if (virTimeMillisNow(&now) < 0 ||
+        virAsprintf(&key, "%s:%u", group ? "group" : "user", id) < 0)
+        return -1;
+
+    virMutexLock(&virIdentityCacheLock);
+    entry = virHashLookup(virIdentityNameCache, key);
+    if (entry && entry->expires > now) {
+        ret = VIR_STRDUP(*name, entry->name);
+        virMutexUnlock(&virIdentityCacheLock);
+        goto cleanup;
+    }
+    virMutexUnlock(&virIdentityCacheLock);
+
+    /* Not holding the lock, a slow name service must not hold up
+     * lookups of names which are cached */
+    if (group)
+        *name = virGetGroupName(id);
+    else
+        *name = virGetUserName(id);
+    if (!*name)
+        goto cleanup;
+
+    if (VIR_ALLOC(entry) < 0 ||
+        VIR_STRDUP(entry->name, *name) < 0) {
+        virIdentityNameCacheEntryFree(entry, NULL);
+        goto error;
+    }
+    entry->expires = now + VIR_IDENTITY_NAME_CACHE_TTL;
+
+    virMutexLock(&virIdentityCacheLock);
+    virHashRemoveSet(virIdentityNameCache,
+                     virIdentityNameCacheIsExpired, &now);
+    if (virHashUpdateEntry(virIdentityNameCache, key, entry) < 0) {
+        virMutexUnlock(&virIdentityCacheLock);
+        virIdentityNameCacheEntryFree(entry, NULL);
+        goto error;
+    }
+    virMutexUnlock(&virIdentityCacheLock);
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(key);
+    return ret;
+
+ error:
+    VIR_FREE(*name);
+    goto cleanup;
+}
+
+
+/**
+ * virIdentityResolveUnixName:
+ * @ident: the identity being queried
+ * @attr: the attribute wanted
+ * @value: filled with the attribute value
+ * @opaque: unused
+ *
+ * Resolver for virIdentitySetResolver which provides
+ * VIR_IDENTITY_ATTR_UNIX_USER_NAME and VIR_IDENTITY_ATTR_UNIX_GROUP_NAME
+ * from the user and group IDs of @ident. Names are cached for a
+ * minute across all identities.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virIdentityResolveUnixName(virIdentityPtr ident,
+                               unsigned int attr,
+                               char **value,
+                               void *opaque ATTRIBUTE_UNUSED)
+{
+    const char *idstr;
+    unsigned int id;
+    bool group;
+
+    *value = NULL;
+
+    switch (attr) {
+    case VIR_IDENTITY_ATTR_UNIX_USER_NAME:
+        group = false;
+        if (virIdentityGetAttr(ident, VIR_IDENTITY_ATTR_UNIX_USER_ID,
+                               &idstr) < 0)
+            return -1;
+        break;
+    case VIR_IDENTITY_ATTR_UNIX_GROUP_NAME:
+        group = true;
+        if (virIdentityGetAttr(ident, VIR_IDENTITY_ATTR_UNIX_GROUP_ID,
+                               &idstr) < 0)
+            return -1;
+        break;
+    default:
+        return 0;
+    }
+
+    if (!idstr)
+        return 0;
+
+    if (virStrToLong_ui(idstr, NULL, 10, &id) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Malformed identity %s ID '%s'"),
+                       group ? "group" : "user", idstr);
+        return -1;
+    }
+
+    return virIdentityLookupName(group, id, value);
+}
+
+
+static int
+virIdentityGetSystemStartTime(unsigned long long *timestamp)
+{
+    pid_t pid = getpid();
+
+    if (virIdentityInitialize() < 0)
+        return -1;
+
+    virMutexLock(&virIdentityCacheLock);
+    if (virIdentitySystemPid == pid) {
+        *timestamp = virIdentitySystemTime;
+        virMutexUnlock(&virIdentityCacheLock);
+        return 0;
+    }
+    virMutexUnlock(&virIdentityCacheLock);
+
+    if (virProcessGetStartTime(pid, timestamp) < 0)
+        return -1;
+
+    virMutexLock(&virIdentityCacheLock);
+    virIdentitySystemPid = pid;
+    virIdentitySystemTime = *timestamp;
+    virMutexUnlock(&virIdentityCacheLock);
+    return 0;
+}
+
+
 /**
  * virIdentityGetSystem:
  *
  * Returns an identity that represents the system itself.
- * This is the identity that the process is running as
+ * This is the identity that the process is running as.
+ * The user and group names are only looked up when asked for.
  *
  * Returns a reference to the system identity, or NULL
  */
 virIdentityPtr virIdentityGetSystem(void)
 {
-    char *username = NULL;
     char *userid = NULL;
-    char *groupname = NULL;
     char *groupid = NULL;
     char *seccontext = NULL;
     virIdentityPtr ret = NULL;
@@ -151,20 +359,15 @@ virIdentityPtr virIdentityGetSystem(void)
                     (unsigned long long)getpid()) < 0)
         goto cleanup;
 
-    if (virProcessGetStartTime(getpid(), &timestamp) < 0)
+    if (virIdentityGetSystemStartTime(&timestamp) < 0)
         goto cleanup;
 
     if (timestamp != 0 &&
         virAsprintf(&processtime, "%llu", timestamp) < 0)
         goto cleanup;
 
-    if (!(username = virGetUserName(geteuid())))
-        goto cleanup;
     if (virAsprintf(&userid, "%d", (int)geteuid()) < 0)
         goto cleanup;
-
-    if (!(groupname = virGetGroupName(getegid())))
-        goto cleanup;
     if (virAsprintf(&groupid, "%d", (int)getegid()) < 0)
         goto cleanup;
 
@@ -186,18 +389,12 @@ virIdentityPtr virIdentityGetSystem(void)
     if (!(ret = virIdentityNew()))
         goto cleanup;
 
-    if (virIdentitySetAttr(ret,
-                           VIR_IDENTITY_ATTR_UNIX_USER_NAME,
-                           username) < 0)
-        goto error;
+    virIdentitySetResolver(ret, virIdentityResolveUnixName, NULL, NULL);
+
     if (virIdentitySetAttr(ret,
                            VIR_IDENTITY_ATTR_UNIX_USER_ID,
                            userid) < 0)
         goto error;
-    if (virIdentitySetAttr(ret,
-                           VIR_IDENTITY_ATTR_UNIX_GROUP_NAME,
-                           groupname) < 0)
-        goto error;
     if (virIdentitySetAttr(ret,
                            VIR_IDENTITY_ATTR_UNIX_GROUP_ID,
                            groupid) < 0)
@@ -218,9 +415,7 @@ virIdentityPtr virIdentityGetSystem(void)
         goto error;
 
  cleanup:
-    VIR_FREE(username);
     VIR_FREE(userid);
-    VIR_FREE(groupname);
     VIR_FREE(groupid);
     VIR_FREE(seccontext);
     VIR_FREE(processid);
@@ -249,7 +444,7 @@ virIdentityPtr virIdentityNew(void)
     if (virIdentityInitialize() < 0)
         return NULL;
 
-    if (!(ident = virObjectNew(virIdentityClass)))
+    if (!(ident = virObjectLockableNew(virIdentityClass)))
         return NULL;
 
     return ident;
@@ -263,6 +458,39 @@ static void virIdentityDispose(void *object)
 
     for (i = 0; i < VIR_IDENTITY_ATTR_LAST; i++)
         VIR_FREE(ident->attrs[i]);
+
+    if (ident->freeopaque)
+        ident->freeopaque(ident->opaque);
+}
+
+
+/**
+ * virIdentitySetResolver:
+ * @ident: the identity to modify
+ * @resolve: callback computing an attribute
+ * @opaque: data for @resolve
+ * @freeopaque: callback to free @opaque along with @ident, or NULL
+ *
+ * Have attributes which were not set computed when they are first
+ * asked for with virIdentityGetAttr, so that an identity can be
+ * built without doing lookups nobody might need. @resolve is called
+ * without @ident locked and may read other attributes, the value it
+ * returns is stored as if set with virIdentitySetAttr. It is tried
+ * at most once per attribute, unless it fails.
+ */
+void virIdentitySetResolver(virIdentityPtr ident,
+                            virIdentityResolveFunc resolve,
+                            void *opaque,
+                            virFreeCallback freeopaque)
+{
+    virObjectLock(ident);
+    if (ident->freeopaque)
+        ident->freeopaque(ident->opaque);
+    ident->resolve = resolve;
+    ident->opaque = opaque;
+    ident->freeopaque = freeopaque;
+    ident->resolved = 0;
+    virObjectUnlock(ident);
 }
 
 
@@ -284,6 +512,8 @@ int virIdentitySetAttr(virIdentityPtr ident,
     int ret = -1;
     VIR_DEBUG("ident=%p attribute=%u value=%s", ident, attr, value);
 
+    virObjectLock(ident);
+
     if (ident->attrs[attr]) {
         virReportError(VIR_ERR_OPERATION_DENIED, "%s",
                         _("Identity attribute is already set"));
@@ -296,6 +526,7 @@ int virIdentitySetAttr(virIdentityPtr ident,
     ret = 0;
 
  cleanup:
+    virObjectUnlock(ident);
     return ret;
 }
 
@@ -307,7 +538,8 @@ int virIdentitySetAttr(virIdentityPtr ident,
  * @value: filled with the attribute value
  *
  * Fills @value with a pointer to the value associated
- * with the identifying attribute @attr in @ident. If
+ * with the identifying attribute @attr in @ident, which
+ * is computed first if @ident has a resolver. If
  * @attr is not set, then it will simply be initialized
  * to NULL and considered as a successful read
  *
@@ -317,10 +549,37 @@ int virIdentityGetAttr(virIdentityPtr ident,
                        unsigned int attr,
                        const char **value)
 {
+    virIdentityResolveFunc resolve;
+    void *opaque;
+    char *resolved = NULL;
+
     VIR_DEBUG("ident=%p attribute=%d value=%p", ident, attr, value);
 
+    virObjectLock(ident);
+    *value = ident->attrs[attr];
+    resolve = ident->resolve;
+    opaque = ident->opaque;
+    if (*value || !resolve || (ident->resolved & (1U << attr))) {
+        virObjectUnlock(ident);
+        return 0;
+    }
+    virObjectUnlock(ident);
+
+    /* Two threads may race to resolve the same attribute, the first
+     * value stored wins */
+    if (resolve(ident, attr, &resolved, opaque) < 0)
+        return -1;
+
+    virObjectLock(ident);
+    if (!ident->attrs[attr])
+        ident->attrs[attr] = resolved;
+    else
+        VIR_FREE(resolved);
+    ident->resolved |= 1U << attr;
     *value = ident->attrs[attr];
+    virObjectUnlock(ident);
 
+    VIR_DEBUG("ident=%p attribute=%d resolved=%s", ident, attr, NULLSTR(*value));
     return 0;
 }
 
@@ -331,7 +590,8 @@ int virIdentityGetAttr(virIdentityPtr ident,
  * @identB: the second identity
  *
  * Compares every attribute in @identA and @identB
- * to determine if they refer to the same identity
+ * to determine if they refer to the same identity.
+ * Attributes which are not resolved yet are resolved.
  *
  * Returns true if they are equal, false if not equal
  */
@@ -343,8 +603,14 @@ bool virIdentityIsEqual(virIdentityPtr identA,
     VIR_DEBUG("identA=%p identB=%p", identA, identB);
 
     for (i = 0; i < VIR_IDENTITY_ATTR_LAST; i++) {
-        if (STRNEQ_NULLABLE(identA->attrs[i],
-                            identB->attrs[i]))
+        const char *valA;
+        const char *valB;
+
+        if (virIdentityGetAttr(identA, i, &valA) < 0 ||
+            virIdentityGetAttr(identB, i, &valB) < 0)
+            goto cleanup;
+
+        if (STRNEQ_NULLABLE(valA, valB))
             goto cleanup;
     }
 
@@ -48,6 +48,24 @@ virIdentityPtr virIdentityGetSystem(void);
 
 virIdentityPtr virIdentityNew(void);
 
+typedef int (*virIdentityResolveFunc)(virIdentityPtr ident,
+                                      unsigned int attr,
+                                      char **value,
+                                      void *opaque);
+
+void virIdentitySetResolver(virIdentityPtr ident,
+                            virIdentityResolveFunc resolve,
+                            void *opaque,
+                            virFreeCallback freeopaque)
+    ATTRIBUTE_NONNULL(1);
+
+int virIdentityResolveUnixName(virIdentityPtr ident,
+                               unsigned int attr,
+                               char **value,
+                               void *opaque)
+    ATTRIBUTE_NONNULL(1)
+    ATTRIBUTE_NONNULL(3);
+
 int virIdentitySetAttr(virIdentityPtr ident,
                        unsigned int attr,
                        const char *value)
@@ -0,0 +1,117 @@
+/*
+ * virpolkit.c: helpers for using polkit APIs
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "virpolkit.h"
+#include "virdbus.h"
+#include "viralloc.h"
+#include "virstring.h"
+#include "virlog.h"
+#include "virerror.h"
+
+#define VIR_FROM_THIS VIR_FROM_ACCESS
+
+VIR_LOG_INIT("util.polkit");
+
+/*
+ * virPolkitCheckAuth:
+ * @actionid: permission to check
+ * @pid: client process ID
+ * @startTime: process start time, or 0
+ * @uid: client process user ID
+ * @details: NULL terminated (key, value) pair list, or NULL
+ * @challenge: set to true if authentication could grant the action
+ *
+ * Asks the polkit authority over the system bus whether the
+ * process may perform @actionid. No interactive authentication
+ * is attempted, so @challenge tells apart actions that are denied
+ * outright from those the user could still be allowed after
+ * authenticating.
+ *
+ * Returns 1 if allowed, 0 if denied, -1 on error
+ */
+int
+virPolkitCheckAuth(const char *actionid,
+                   pid_t pid,
+                   unsigned long long startTime,
+                   uid_t uid,
+                   const char **details,
+                   bool *challenge)
+{
+    DBusConnection *sysbus;
+    DBusMessage *reply = NULL;
+    char **retdetails = NULL;
+    size_t nretdetails = 0;
+    size_t ndetails = 0;
+    int is_authorized;
+    int is_challenge;
+    int ret = -1;
+
+    if (!(sysbus = virDBusGetSystemBus()))
+        goto cleanup;
+
+    while (details && details[ndetails * 2] && details[(ndetails * 2) + 1])
+        ndetails++;
+
+    VIR_DEBUG("Checking action '%s' for PID %lld running as %d",
+              actionid, (long long) pid, (int) uid);
+
+    if (virDBusCallMethod(sysbus,
+                          &reply,
+                          NULL,
+                          VIR_POLKIT_AUTHORITY_SERVICE,
+                          VIR_POLKIT_AUTHORITY_PATH,
+                          VIR_POLKIT_AUTHORITY_INTERFACE,
+                          "CheckAuthorization",
+                          "(sa{sv})sa&{ss}us",
+                          "unix-process",
+                          3,
+                          "pid", "u", (unsigned int) pid,
+                          "start-time", "t", startTime,
+                          "uid", "i", (int) uid,
+                          actionid,
+                          (int) ndetails,
+                          details,
+                          0, /* no user interaction */
+                          "" /* cancellation ID */) < 0)
+        goto cleanup;
+
+    if (virDBusMessageRead(reply,
+                           "(bba&{ss})",
+                           &is_authorized,
+                           &is_challenge,
+                           &nretdetails,
+                           &retdetails) < 0)
+        goto cleanup;
+
+    VIR_DEBUG("Action '%s' authorized %d challenge %d",
+              actionid, is_authorized, is_challenge);
+
+    if (challenge)
+        *challenge = !!is_challenge;
+    ret = is_authorized ? 1 : 0;
+
+ cleanup:
+    virStringFreeListCount(retdetails, nretdetails * 2);
+    virDBusMessageUnref(reply);
+    return ret;
+}
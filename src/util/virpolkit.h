@@ -0,0 +1,39 @@
+/*
+ * virpolkit.h: helpers for using polkit APIs
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __VIR_POLKIT_H__
+# define __VIR_POLKIT_H__
+
+# include "internal.h"
+
+# define VIR_POLKIT_AUTHORITY_SERVICE "org.freedesktop.PolicyKit1"
+# define VIR_POLKIT_AUTHORITY_PATH "/org/freedesktop/PolicyKit1/Authority"
+# define VIR_POLKIT_AUTHORITY_INTERFACE "org.freedesktop.PolicyKit1.Authority"
+
+int virPolkitCheckAuth(const char *actionid,
+                       pid_t pid,
+                       unsigned long long startTime,
+                       uid_t uid,
+                       const char **details,
+                       bool *challenge)
+    ATTRIBUTE_NONNULL(1);
+
+#endif /* __VIR_POLKIT_H__ */
@@ -39,6 +39,7 @@
 #include "cpu/cpu.h"
 #include "cpu/cpu_map.h"
 #include "virstring.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_CPU
 
@@ -454,6 +455,83 @@ cpuTestHasFeature(const void *arg)
 }
 
 
+/* Repeatedly compare and decode the x86 test CPUs against the host to
+ * keep an eye on the cost of map lookups and CPUID data operations. */
+static const char *benchCPUs[] = {
+    "min", "pentium3", "exact", "strict-full", "guest", "nehalem-force",
+};
+
+static int
+cpuTestBench(const void *arg ATTRIBUTE_UNUSED)
+{
+    int ret = -1;
+    virCPUDefPtr host = NULL;
+    virCPUDefPtr cpus[ARRAY_CARDINALITY(benchCPUs)] = { NULL };
+    virCPUDataPtr guestData = NULL;
+    virCPUDefPtr guest = NULL;
+    virCPUCompareResult cmpResult;
+    unsigned long long start;
+    unsigned long long end;
+    size_t iterations = virTestGetExpensive() ? 10000 : 100;
+    size_t i;
+    size_t j;
+
+    if (!(host = cpuTestLoadXML("x86", "host")))
+        goto cleanup;
+
+    for (i = 0; i < ARRAY_CARDINALITY(benchCPUs); i++) {
+        if (!(cpus[i] = cpuTestLoadXML("x86", benchCPUs[i])))
+            goto cleanup;
+    }
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < iterations; i++) {
+        for (j = 0; j < ARRAY_CARDINALITY(benchCPUs); j++) {
+            if (cpuCompare(host, cpus[j]) == VIR_CPU_COMPARE_ERROR)
+                goto cleanup;
+
+            cmpResult = cpuGuestData(host, cpus[j], &guestData, NULL);
+            if (cmpResult == VIR_CPU_COMPARE_ERROR ||
+                cmpResult == VIR_CPU_COMPARE_INCOMPATIBLE)
+                goto cleanup;
+
+            if (VIR_ALLOC(guest) < 0)
+                goto cleanup;
+            guest->arch = host->arch;
+            guest->type = VIR_CPU_TYPE_GUEST;
+            guest->match = VIR_CPU_MATCH_EXACT;
+            guest->fallback = cpus[j]->fallback;
+            if (cpuDecode(guest, guestData, NULL, 0, NULL) < 0)
+                goto cleanup;
+
+            virCPUDefFree(guest);
+            guest = NULL;
+            cpuDataFree(guestData);
+            guestData = NULL;
+        }
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    if (virTestGetDebug())
+        fprintf(stderr, "\n%zu compare+decode rounds in %llu ms\n",
+                iterations, end - start);
+
+    ret = 0;
+
+ cleanup:
+    virCPUDefFree(guest);
+    cpuDataFree(guestData);
+    for (i = 0; i < ARRAY_CARDINALITY(benchCPUs); i++)
+        virCPUDefFree(cpus[i]);
+    virCPUDefFree(host);
+    return ret;
+}
+
+
 static int (*cpuTest[])(const void *) = {
     cpuTestCompare,
     cpuTestGuestData,
@@ -644,6 +722,9 @@ mymain(void)
     DO_TEST_GUESTDATA("ppc64", "host", "guest", ppc_models, NULL, 0);
     DO_TEST_GUESTDATA("ppc64", "host", "guest-nofallback", ppc_models, "POWER7_v2.1", -1);
 
+    if (virtTestRun("CPU compare+decode benchmark(x86)", cpuTestBench, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,392 @@
+/*
+ * domainshmtest.c: test the shared memory domain state snapshot
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "testutils.h"
+#include "virerror.h"
+#include "viralloc.h"
+#include "virlog.h"
+#include "virstring.h"
+
+#include "domain_conf.h"
+#include "domain_shm.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.domainshmtest");
+
+#define SHM_PATH abs_builddir "/domainshmtest.shm"
+
+static virCapsPtr caps;
+static virDomainXMLOptionPtr xmlopt;
+static virConnectPtr conn;
+static virDomainShmPublisherPtr pub;
+static virDomainShmReaderPtr reader;
+
+static const char domainDef[] =
+"<domain type='test'>"
+"  <name>shm%zu</name>"
+"  <memory>%zu</memory>"
+"  <vcpu>%zu</vcpu>"
+"  <os><type>hvm</type></os>"
+"</domain>";
+
+
+static int
+testDomainShmCompareIDs(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+
+/* The test driver lives inside this process, so the daemon side is
+ * played by a domain list mirroring it */
+static int
+testDomainShmPublish(void)
+{
+    virDomainObjListPtr doms = NULL;
+    virDomainPtr *domains = NULL;
+    virDomainDefPtr def = NULL;
+    virDomainObjPtr vm;
+    char *xml = NULL;
+    int ndomains = 0;
+    int state;
+    int reason;
+    int ret = -1;
+    size_t i;
+
+    if (!(doms = virDomainObjListNew()))
+        goto cleanup;
+
+    if ((ndomains = virConnectListAllDomains(conn, &domains, 0)) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndomains; i++) {
+        if (!(xml = virDomainGetXMLDesc(domains[i], 0)) ||
+            virDomainGetState(domains[i], &state, &reason, 0) < 0)
+            goto cleanup;
+
+        if (!(def = virDomainDefParseString(xml, caps, xmlopt,
+                                            1 << VIR_DOMAIN_VIRT_TEST, 0)))
+            goto cleanup;
+
+        if (!(vm = virDomainObjListAdd(doms, def, xmlopt, 0, NULL)))
+            goto cleanup;
+        def = NULL;
+
+        vm->def->id = virDomainGetID(domains[i]);
+        virDomainObjSetState(vm, state, reason);
+        virObjectUnlock(vm);
+        VIR_FREE(xml);
+    }
+
+    if (virDomainShmPublisherUpdate(pub, doms) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    for (i = 0; i < ndomains; i++)
+        virDomainFree(domains[i]);
+    VIR_FREE(domains);
+    virDomainDefFree(def);
+    VIR_FREE(xml);
+    virObjectUnref(doms);
+    return ret;
+}
+
+
+/* Everything the reader answers has to match what the driver says */
+static int
+testDomainShmCompare(void)
+{
+    virDomainPtr *domains = NULL;
+    int ids[1024];
+    int shmids[1024];
+    int ndomains = 0;
+    int nids;
+    int ret = -1;
+    size_t i;
+
+    if ((nids = virConnectListDomains(conn, ids, ARRAY_CARDINALITY(ids))) < 0)
+        goto cleanup;
+
+    if (virDomainShmReaderNumOfDomains(reader) != nids) {
+        fprintf(stderr, "Expected %d running domains\n", nids);
+        goto cleanup;
+    }
+
+    if (virDomainShmReaderListDomains(reader, shmids,
+                                      ARRAY_CARDINALITY(shmids)) != nids) {
+        fprintf(stderr, "Expected %d domain IDs\n", nids);
+        goto cleanup;
+    }
+
+    qsort(ids, nids, sizeof(ids[0]), testDomainShmCompareIDs);
+    qsort(shmids, nids, sizeof(shmids[0]), testDomainShmCompareIDs);
+    for (i = 0; i < nids; i++) {
+        if (ids[i] != shmids[i]) {
+            fprintf(stderr, "Expected domain ID %d, got %d\n",
+                    ids[i], shmids[i]);
+            goto cleanup;
+        }
+    }
+
+    if (nids > 1 &&
+        virDomainShmReaderListDomains(reader, shmids, 1) != 1) {
+        fprintf(stderr, "Domain IDs overflowed the caller's array\n");
+        goto cleanup;
+    }
+
+    if ((ndomains = virConnectListAllDomains(conn, &domains, 0)) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndomains; i++) {
+        const char *name = virDomainGetName(domains[i]);
+        unsigned char uuid[VIR_UUID_BUFLEN];
+        virDomainInfo info;
+        virDomainInfo shminfo;
+        int state;
+        int reason;
+        int shmstate;
+        int shmreason;
+        int active;
+
+        if (virDomainGetState(domains[i], &state, &reason, 0) < 0 ||
+            virDomainGetInfo(domains[i], &info) < 0 ||
+            (active = virDomainIsActive(domains[i])) < 0 ||
+            virDomainGetUUID(domains[i], uuid) < 0)
+            goto cleanup;
+
+        if (virDomainShmReaderGetState(reader, uuid,
+                                       &shmstate, &shmreason) < 0 ||
+            shmstate != state || shmreason != reason) {
+            fprintf(stderr, "State of %s doesn't match\n", name);
+            goto cleanup;
+        }
+
+        if (active) {
+            /* The daemon has to provide the CPU time */
+            if (virDomainShmReaderGetInfo(reader, uuid,
+                                          &shminfo) == 0) {
+                fprintf(stderr, "Info of running %s was answered\n", name);
+                goto cleanup;
+            }
+        } else {
+            if (virDomainShmReaderGetInfo(reader, uuid,
+                                          &shminfo) < 0 ||
+                shminfo.state != info.state ||
+                shminfo.maxMem != info.maxMem ||
+                shminfo.memory != info.memory ||
+                shminfo.nrVirtCpu != info.nrVirtCpu) {
+                fprintf(stderr, "Info of %s doesn't match\n", name);
+                goto cleanup;
+            }
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    for (i = 0; i < ndomains; i++)
+        virDomainFree(domains[i]);
+    VIR_FREE(domains);
+    return ret;
+}
+
+
+static int
+testDomainShmInitial(const void *opaque ATTRIBUTE_UNUSED)
+{
+    if (testDomainShmPublish() < 0)
+        return -1;
+
+    if (!(reader = virDomainShmReaderOpen(SHM_PATH))) {
+        fprintf(stderr, "Cannot open snapshot\n");
+        return -1;
+    }
+
+    return testDomainShmCompare();
+}
+
+
+static int
+testDomainShmSuspend(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainPtr dom;
+    int ret = -1;
+
+    if (!(dom = virDomainLookupByName(conn, "test")))
+        return -1;
+
+    if (virDomainSuspend(dom) < 0 ||
+        testDomainShmPublish() < 0 ||
+        testDomainShmCompare() < 0)
+        goto cleanup;
+
+    if (virDomainResume(dom) < 0 ||
+        testDomainShmPublish() < 0 ||
+        testDomainShmCompare() < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virDomainFree(dom);
+    return ret;
+}
+
+
+/* Enough new domains to outgrow the initial mapping several times,
+ * an open reader must follow the publisher to the bigger one */
+static int
+testDomainShmGrow(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainPtr dom;
+    char *xml = NULL;
+    int ret = -1;
+    size_t i;
+
+    for (i = 0; i < 100; i++) {
+        if (virAsprintf(&xml, domainDef, i, 8192 + i, 1 + i % 4) < 0)
+            goto cleanup;
+
+        if (!(dom = virDomainDefineXML(conn, xml)))
+            goto cleanup;
+        if (i % 2 && virDomainCreate(dom) < 0) {
+            virDomainFree(dom);
+            goto cleanup;
+        }
+        virDomainFree(dom);
+        VIR_FREE(xml);
+    }
+
+    if (testDomainShmPublish() < 0 ||
+        testDomainShmCompare() < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(xml);
+    return ret;
+}
+
+
+static int
+testDomainShmDestroy(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainPtr dom;
+    char *name = NULL;
+    int ret = -1;
+    size_t i;
+
+    for (i = 0; i < 100; i++) {
+        if (virAsprintf(&name, "shm%zu", i) < 0)
+            goto cleanup;
+
+        if (!(dom = virDomainLookupByName(conn, name)))
+            goto cleanup;
+        if (i % 2 && virDomainDestroy(dom) < 0) {
+            virDomainFree(dom);
+            goto cleanup;
+        }
+        if (i % 3 == 0 && virDomainUndefine(dom) < 0) {
+            virDomainFree(dom);
+            goto cleanup;
+        }
+        virDomainFree(dom);
+        VIR_FREE(name);
+    }
+
+    if (testDomainShmPublish() < 0 ||
+        testDomainShmCompare() < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(name);
+    return ret;
+}
+
+
+/* Once the publisher goes away, callers must fall back to the daemon */
+static int
+testDomainShmClose(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainShmPublisherClose(pub);
+
+    if (virDomainShmReaderNumOfDomains(reader) >= 0) {
+        fprintf(stderr, "Closed snapshot is still answering\n");
+        return -1;
+    }
+
+    if (virDomainShmReaderOpen(SHM_PATH)) {
+        fprintf(stderr, "Closed snapshot could be opened\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    unlink(SHM_PATH);
+
+    if (!(caps = virTestGenericCapsInit()) ||
+        !(xmlopt = virTestGenericDomainXMLConfInit()) ||
+        !(conn = virConnectOpen("test:///default")) ||
+        !(pub = virDomainShmPublisherNew(SHM_PATH))) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (virtTestRun("Domain shm initial", testDomainShmInitial, NULL) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+    if (virtTestRun("Domain shm suspend", testDomainShmSuspend, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Domain shm grow", testDomainShmGrow, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Domain shm destroy", testDomainShmDestroy, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Domain shm close", testDomainShmClose, NULL) < 0)
+        ret = -1;
+
+ cleanup:
+    virDomainShmReaderFree(reader);
+    if (pub) {
+        virDomainShmPublisherClose(pub);
+        virObjectUnref(pub);
+    }
+    if (conn)
+        virConnectClose(conn);
+    virObjectUnref(xmlopt);
+    virObjectUnref(caps);
+    unlink(SHM_PATH);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
@@ -0,0 +1,470 @@
+/*
+ * listpagetest.c: test the paginated list APIs
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include "testutils.h"
+#include "virerror.h"
+#include "viralloc.h"
+#include "virstring.h"
+#include "viruuid.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define NDOMAINS 150
+#define NVOLUMES 60
+#define PAGE_SIZE 7
+
+static virConnectPtr conn;
+
+static const char domainDef[] =
+"<domain type='test'>"
+"  <name>page%zu</name>"
+"  <memory>8192</memory>"
+"  <vcpu>1</vcpu>"
+"  <os><type>hvm</type></os>"
+"</domain>";
+
+static const char volumeDef[] =
+"<volume>"
+"  <name>vol%zu</name>"
+"  <capacity>1024</capacity>"
+"</volume>";
+
+
+static void
+testListPageFreeKeys(char **keys, size_t nkeys)
+{
+    size_t i;
+
+    for (i = 0; i < nkeys; i++)
+        VIR_FREE(keys[i]);
+    VIR_FREE(keys);
+}
+
+
+static bool
+testListPageHasKey(char **keys, size_t nkeys, const char *key)
+{
+    size_t i;
+
+    for (i = 0; i < nkeys; i++) {
+        if (STREQ(keys[i], key))
+            return true;
+    }
+    return false;
+}
+
+
+/* Checks that @key continues the walk in @keys in strictly increasing
+ * order and appends it */
+static int
+testListPageAppend(char ***keys, size_t *nkeys, const char *key)
+{
+    char *tmp;
+
+    if (*nkeys && strcmp((*keys)[*nkeys - 1], key) >= 0) {
+        fprintf(stderr, "'%s' came after '%s'\n", key, (*keys)[*nkeys - 1]);
+        return -1;
+    }
+
+    if (VIR_STRDUP(tmp, key) < 0 ||
+        VIR_APPEND_ELEMENT(*keys, *nkeys, tmp) < 0) {
+        VIR_FREE(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+
+static int
+testDefineDomain(size_t i)
+{
+    virDomainPtr dom;
+    char *xml = NULL;
+
+    if (virAsprintf(&xml, domainDef, i) < 0)
+        return -1;
+
+    dom = virDomainDefineXML(conn, xml);
+    VIR_FREE(xml);
+    if (!dom)
+        return -1;
+
+    if (i % 2 && virDomainCreate(dom) < 0) {
+        virDomainFree(dom);
+        return -1;
+    }
+    virDomainFree(dom);
+    return 0;
+}
+
+
+static int
+testUndefineDomain(size_t i)
+{
+    virDomainPtr dom;
+    char *name = NULL;
+    int ret = -1;
+
+    if (virAsprintf(&name, "page%zu", i) < 0)
+        return -1;
+
+    if (!(dom = virDomainLookupByName(conn, name)))
+        goto cleanup;
+
+    if (virDomainIsActive(dom) == 1 && virDomainDestroy(dom) < 0)
+        goto cleanup;
+    if (virDomainUndefine(dom) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    if (dom)
+        virDomainFree(dom);
+    VIR_FREE(name);
+    return ret;
+}
+
+
+/* Walks all domains matching @flags, calling @hook (if any) after
+ * the first page */
+static int
+testWalkDomains(unsigned int flags,
+                int (*hook)(void),
+                char ***keys,
+                size_t *nkeys)
+{
+    char after[VIR_UUID_STRING_BUFLEN];
+    bool first = true;
+    int ret = -1;
+    int ndomains;
+    size_t i;
+
+    *keys = NULL;
+    *nkeys = 0;
+
+    while (true) {
+        virDomainPtr *domains = NULL;
+        bool failed = false;
+
+        if ((ndomains = virConnectListDomainsPage(conn, first ? NULL : after,
+                                                  PAGE_SIZE, &domains,
+                                                  flags)) < 0)
+            goto cleanup;
+
+        if (ndomains > PAGE_SIZE) {
+            fprintf(stderr, "Page holds %d domains\n", ndomains);
+            failed = true;
+        }
+
+        for (i = 0; i < ndomains; i++) {
+            if (!failed &&
+                (virDomainGetUUIDString(domains[i], after) < 0 ||
+                 testListPageAppend(keys, nkeys, after) < 0))
+                failed = true;
+            virDomainFree(domains[i]);
+        }
+        VIR_FREE(domains);
+
+        if (failed)
+            goto cleanup;
+        if (ndomains == 0)
+            break;
+
+        if (first && hook && hook() < 0)
+            goto cleanup;
+        first = false;
+    }
+
+    ret = 0;
+ cleanup:
+    if (ret < 0) {
+        testListPageFreeKeys(*keys, *nkeys);
+        *keys = NULL;
+        *nkeys = 0;
+    }
+    return ret;
+}
+
+
+static int
+testListDomainsPageAll(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainPtr *domains = NULL;
+    char **keys = NULL;
+    size_t nkeys = 0;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    int ndomains = 0;
+    int ret = -1;
+    size_t i;
+
+    if (testWalkDomains(0, NULL, &keys, &nkeys) < 0 ||
+        (ndomains = virConnectListAllDomains(conn, &domains, 0)) < 0)
+        goto cleanup;
+
+    if (nkeys != ndomains) {
+        fprintf(stderr, "Walked %zu domains, expected %d\n", nkeys, ndomains);
+        goto cleanup;
+    }
+
+    for (i = 0; i < ndomains; i++) {
+        if (virDomainGetUUIDString(domains[i], uuidstr) < 0)
+            goto cleanup;
+        if (!testListPageHasKey(keys, nkeys, uuidstr)) {
+            fprintf(stderr, "Domain %s was not visited\n",
+                    virDomainGetName(domains[i]));
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    for (i = 0; i < ndomains; i++)
+        virDomainFree(domains[i]);
+    VIR_FREE(domains);
+    testListPageFreeKeys(keys, nkeys);
+    return ret;
+}
+
+
+static int
+testListDomainsPageActive(const void *opaque ATTRIBUTE_UNUSED)
+{
+    char **keys = NULL;
+    size_t nkeys = 0;
+    int nactive;
+    int ret = -1;
+
+    if (testWalkDomains(VIR_CONNECT_LIST_DOMAINS_ACTIVE, NULL,
+                        &keys, &nkeys) < 0 ||
+        (nactive = virConnectNumOfDomains(conn)) < 0)
+        goto cleanup;
+
+    if (nkeys != nactive) {
+        fprintf(stderr, "Walked %zu active domains, expected %d\n",
+                nkeys, nactive);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    testListPageFreeKeys(keys, nkeys);
+    return ret;
+}
+
+
+/* Domains coming and going in the middle of a walk must not make it
+ * skip or repeat any of the domains which stay */
+static int
+testListDomainsPageChurnHook(void)
+{
+    size_t i;
+
+    for (i = 0; i < NDOMAINS; i += 3) {
+        if (testUndefineDomain(i) < 0)
+            return -1;
+    }
+    for (i = NDOMAINS; i < NDOMAINS + 20; i++) {
+        if (testDefineDomain(i) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+
+static int
+testListDomainsPageChurn(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainPtr *domains = NULL;
+    char **keys = NULL;
+    size_t nkeys = 0;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    int ndomains = 0;
+    int ret = -1;
+    size_t i;
+
+    if (testWalkDomains(0, testListDomainsPageChurnHook, &keys, &nkeys) < 0 ||
+        (ndomains = virConnectListAllDomains(conn, &domains, 0)) < 0)
+        goto cleanup;
+
+    /* The walk is strictly increasing, so nothing was repeated. Every
+     * domain left now existed before the walk or was added during it,
+     * and only the latter may have been missed if it sorted before the
+     * first page */
+    for (i = 0; i < ndomains; i++) {
+        const char *name = virDomainGetName(domains[i]);
+        int n;
+
+        if (virDomainGetUUIDString(domains[i], uuidstr) < 0)
+            goto cleanup;
+        if (testListPageHasKey(keys, nkeys, uuidstr))
+            continue;
+        if (sscanf(name, "page%d", &n) == 1 && n >= NDOMAINS)
+            continue;
+
+        fprintf(stderr, "Domain %s was skipped\n", name);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    for (i = 0; i < ndomains; i++)
+        virDomainFree(domains[i]);
+    VIR_FREE(domains);
+    testListPageFreeKeys(keys, nkeys);
+    return ret;
+}
+
+
+static int
+testListDomainsPageBadCursor(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainPtr *domains = NULL;
+
+    if (virConnectListDomainsPage(conn, "not-a-uuid", PAGE_SIZE,
+                                  &domains, 0) >= 0) {
+        fprintf(stderr, "Bogus cursor was accepted\n");
+        return -1;
+    }
+    if (domains) {
+        fprintf(stderr, "Domains were returned on failure\n");
+        return -1;
+    }
+
+    virResetLastError();
+    return 0;
+}
+
+
+static int
+testListVolumesPage(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virStoragePoolPtr pool = NULL;
+    char **keys = NULL;
+    size_t nkeys = 0;
+    char *after = NULL;
+    char *xml = NULL;
+    int nvols;
+    int ret = -1;
+    size_t i;
+
+    if (!(pool = virStoragePoolLookupByName(conn, "default-pool")))
+        goto cleanup;
+
+    for (i = 0; i < NVOLUMES; i++) {
+        virStorageVolPtr vol;
+
+        if (virAsprintf(&xml, volumeDef, i) < 0)
+            goto cleanup;
+        if (!(vol = virStorageVolCreateXML(pool, xml, 0)))
+            goto cleanup;
+        virStorageVolFree(vol);
+        VIR_FREE(xml);
+    }
+
+    while (true) {
+        virStorageVolPtr *vols = NULL;
+        bool failed = false;
+
+        if ((nvols = virStoragePoolListVolumesPage(pool, after, PAGE_SIZE,
+                                                   &vols, 0)) < 0)
+            goto cleanup;
+
+        if (nvols > PAGE_SIZE) {
+            fprintf(stderr, "Page holds %d volumes\n", nvols);
+            failed = true;
+        }
+
+        for (i = 0; i < nvols; i++) {
+            if (!failed &&
+                testListPageAppend(&keys, &nkeys,
+                                   virStorageVolGetName(vols[i])) < 0)
+                failed = true;
+            virStorageVolFree(vols[i]);
+        }
+        VIR_FREE(vols);
+
+        if (failed)
+            goto cleanup;
+        if (nvols == 0)
+            break;
+
+        after = keys[nkeys - 1];
+    }
+
+    if ((nvols = virStoragePoolNumOfVolumes(pool)) < 0)
+        goto cleanup;
+
+    if (nkeys != nvols) {
+        fprintf(stderr, "Walked %zu volumes, expected %d\n", nkeys, nvols);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    testListPageFreeKeys(keys, nkeys);
+    VIR_FREE(xml);
+    if (pool)
+        virStoragePoolFree(pool);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    size_t i;
+
+    if (!(conn = virConnectOpen("test:///default")))
+        return EXIT_FAILURE;
+
+    for (i = 0; i < NDOMAINS; i++) {
+        if (testDefineDomain(i) < 0) {
+            ret = -1;
+            goto cleanup;
+        }
+    }
+
+    if (virtTestRun("List domains page all",
+                    testListDomainsPageAll, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("List domains page active",
+                    testListDomainsPageActive, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("List domains page churn",
+                    testListDomainsPageChurn, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("List domains page bad cursor",
+                    testListDomainsPageBadCursor, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("List volumes page",
+                    testListVolumesPage, NULL) < 0)
+        ret = -1;
+
+ cleanup:
+    virConnectClose(conn);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
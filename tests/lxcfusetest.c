@@ -0,0 +1,373 @@
+/*
+ * lxcfusetest.c: test the container's virtualized /proc files
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "testutils.h"
+
+#ifdef WITH_LXC
+
+# include "internal.h"
+# include "lxc/lxc_fuse.h"
+# include "viralloc.h"
+# include "virfile.h"
+# include "virstring.h"
+# include "virtime.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+static struct virLXCMeminfo testMeminfo = {
+    .memtotal = 1048576,
+    .memusage = 262144,
+    .cached = 65536,
+    .active_anon = 1024,
+    .inactive_anon = 2048,
+    .active_file = 4096,
+    .inactive_file = 8192,
+    .unevictable = 0,
+    .swaptotal = 2097152,
+    .swapusage = 393216,
+};
+
+struct testInfo {
+    const char *name;
+    bool limits;
+};
+
+
+static int
+testFormatMeminfo(const void *opaque)
+{
+    const struct testInfo *info = opaque;
+    int ret = -1;
+    virDomainDefPtr def = NULL;
+    char *hostpath = NULL;
+    char *outpath = NULL;
+    char *expected = NULL;
+    char *actual = NULL;
+    size_t len;
+
+    if (VIR_ALLOC(def) < 0)
+        goto cleanup;
+
+    if (info->limits) {
+        def->mem.hard_limit = testMeminfo.memtotal;
+        def->mem.swap_hard_limit = testMeminfo.swaptotal;
+    }
+
+    if (virAsprintf(&hostpath, "%s/lxcfusedata/meminfo.txt",
+                    abs_srcdir) < 0 ||
+        virAsprintf(&outpath, "%s/lxcfusedata/%s.txt",
+                    abs_srcdir, info->name) < 0)
+        goto cleanup;
+
+    if (virtTestLoadFile(outpath, &expected) < 0)
+        goto cleanup;
+
+    if (lxcFuseFormatMeminfo(hostpath, def, &testMeminfo,
+                             &actual, &len) < 0)
+        goto cleanup;
+
+    if (len != strlen(actual) || STRNEQ(expected, actual)) {
+        virtTestDifference(stderr, expected, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(hostpath);
+    VIR_FREE(outpath);
+    VIR_FREE(expected);
+    VIR_FREE(actual);
+    virDomainDefFree(def);
+    return ret;
+}
+
+
+/* Read the cached file in small chunks the way a polling agent would,
+ * making sure the pieces add back up to the whole */
+static int
+testCacheRead(const void *opaque ATTRIBUTE_UNUSED)
+{
+    int ret = -1;
+    struct virLXCFuseCache cache = { NULL, 0, 0 };
+    virDomainDefPtr def = NULL;
+    char *hostpath = NULL;
+    char *copy = NULL;
+    char buf[100];
+    size_t iterations = virTestGetExpensive() ? 1000000 : 10000;
+    unsigned long long start;
+    unsigned long long end;
+    unsigned long long bytes = 0;
+    size_t i;
+
+    if (VIR_ALLOC(def) < 0)
+        goto cleanup;
+
+    if (virAsprintf(&hostpath, "%s/lxcfusedata/meminfo.txt",
+                    abs_srcdir) < 0)
+        goto cleanup;
+
+    if (lxcFuseFormatMeminfo(hostpath, def, &testMeminfo,
+                             &cache.data, &cache.len) < 0)
+        goto cleanup;
+
+    if (VIR_ALLOC_N(copy, cache.len + 1) < 0)
+        goto cleanup;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < iterations; i++) {
+        off_t offset = 0;
+        int n;
+
+        while ((n = lxcFuseCacheRead(&cache, buf, sizeof(buf), offset)) > 0) {
+            memcpy(copy + offset, buf, n);
+            offset += n;
+        }
+
+        if ((size_t) offset != cache.len ||
+            memcmp(copy, cache.data, cache.len) != 0) {
+            virFilePrintf(stderr, "Chunked read doesn't match content\n");
+            goto cleanup;
+        }
+        bytes += offset;
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    if (virTestGetDebug())
+        virFilePrintf(stderr, "\nread %llu kB in %llu ms\n",
+                      bytes / 1024, end - start);
+
+    if (lxcFuseCacheRead(&cache, buf, sizeof(buf), cache.len) != 0 ||
+        lxcFuseCacheRead(&cache, buf, sizeof(buf), cache.len + 10) != 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    lxcFuseCacheClear(&cache);
+    VIR_FREE(copy);
+    VIR_FREE(hostpath);
+    virDomainDefFree(def);
+    return ret;
+}
+
+
+static int
+testFormatUptime(const void *opaque ATTRIBUTE_UNUSED)
+{
+    int ret = -1;
+    char *actual = NULL;
+    size_t len;
+
+    if (lxcFuseFormatUptime(123456, &actual, &len) < 0)
+        goto cleanup;
+
+    if (len != strlen(actual) || STRNEQ(actual, "123.45 0.00\n")) {
+        virtTestDifference(stderr, "123.45 0.00\n", actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(actual);
+    return ret;
+}
+
+
+/* Poll the container's files through the same path the FUSE read
+ * handler takes, with the cgroup files faked by vircgroupmock */
+static int
+testFuseRead(const void *opaque ATTRIBUTE_UNUSED)
+{
+    int ret = -1;
+    virLXCFusePtr fuse = NULL;
+    char *copy = NULL;
+    size_t copylen = 0;
+    char buf[100];
+    size_t iterations = virTestGetExpensive() ? 100000 : 1000;
+    size_t generated = 0;
+    unsigned long long stamp = 0;
+    unsigned long long start;
+    unsigned long long end;
+    unsigned long long bytes = 0;
+    unsigned long long uptime;
+    char *endptr;
+    int n;
+    size_t i;
+
+    if (VIR_ALLOC(fuse) < 0 ||
+        VIR_ALLOC(fuse->def) < 0)
+        goto cleanup;
+
+    if (virMutexInit(&fuse->lock) < 0) {
+        VIR_FREE(fuse->def);
+        VIR_FREE(fuse);
+        goto cleanup;
+    }
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+    fuse->start = start - 5000;
+
+    for (i = 0; i < iterations; i++) {
+        off_t offset = 0;
+        unsigned long long first = 0;
+
+        while ((n = lxcFuseRead(fuse, "/meminfo", buf,
+                                sizeof(buf), offset)) > 0) {
+            if (offset == 0)
+                first = fuse->meminfo.stamp;
+            if (VIR_RESIZE_N(copy, copylen, offset, n) < 0)
+                goto cleanup;
+            memcpy(copy + offset, buf, n);
+            offset += n;
+        }
+
+        if (n < 0) {
+            virFilePrintf(stderr, "Read failed: %s\n", strerror(-n));
+            goto cleanup;
+        }
+
+        /* Served from the generated content, not the host file */
+        if (!fuse->meminfo.data) {
+            virFilePrintf(stderr, "meminfo was not generated\n");
+            goto cleanup;
+        }
+
+        if (fuse->meminfo.stamp != stamp) {
+            stamp = fuse->meminfo.stamp;
+            generated++;
+        }
+
+        /* The pieces only add up if the content wasn't regenerated
+         * while the file was being read */
+        if (first == fuse->meminfo.stamp &&
+            ((size_t) offset != fuse->meminfo.len ||
+             memcmp(copy, fuse->meminfo.data, offset) != 0)) {
+            virFilePrintf(stderr, "Chunked read doesn't match content\n");
+            goto cleanup;
+        }
+        bytes += offset;
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    if (virTestGetDebug())
+        virFilePrintf(stderr, "\nread %llu kB in %llu ms\n",
+                      bytes / 1024, end - start);
+
+    if (generated > (end - start) / LXC_FUSE_CACHE_TTL_MS + 1) {
+        virFilePrintf(stderr, "meminfo generated %zu times in %llu ms\n",
+                      generated, end - start);
+        goto cleanup;
+    }
+
+    memset(buf, 0, sizeof(buf));
+    if ((n = lxcFuseRead(fuse, "/uptime", buf, sizeof(buf) - 1, 0)) <= 0 ||
+        virStrToLong_ull(buf, &endptr, 10, &uptime) < 0 ||
+        *endptr != '.' || uptime < 5) {
+        virFilePrintf(stderr, "Unexpected uptime '%s'\n", buf);
+        goto cleanup;
+    }
+
+    if (lxcFuseRead(fuse, "/stat", buf, sizeof(buf), 0) != -ENOENT)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    if (fuse) {
+        lxcFuseCacheClear(&fuse->meminfo);
+        lxcFuseCacheClear(&fuse->uptime);
+        virMutexDestroy(&fuse->lock);
+        virDomainDefFree(fuse->def);
+        VIR_FREE(fuse);
+    }
+    VIR_FREE(copy);
+    return ret;
+}
+
+
+# define FAKESYSFSDIRTEMPLATE abs_builddir "/fakesysfsdir-XXXXXX"
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    char *fakesysfsdir = NULL;
+
+    if (VIR_STRDUP_QUIET(fakesysfsdir, FAKESYSFSDIRTEMPLATE) < 0) {
+        fprintf(stderr, "Out of memory\n");
+        abort();
+    }
+
+    if (!mkdtemp(fakesysfsdir)) {
+        fprintf(stderr, "Cannot create fakesysfsdir");
+        abort();
+    }
+
+    setenv("LIBVIRT_FAKE_SYSFS_DIR", fakesysfsdir, 1);
+
+# define DO_TEST(name, limits)                                          \
+    do {                                                                \
+        const struct testInfo info = { name, limits };                  \
+        if (virtTestRun("format " name, testFormatMeminfo, &info) < 0)  \
+            ret = -1;                                                   \
+    } while (0)
+
+    DO_TEST("meminfo-nolimits", false);
+    DO_TEST("meminfo-limits", true);
+
+    if (virtTestRun("cached read", testCacheRead, NULL) < 0)
+        ret = -1;
+
+    if (virtTestRun("format uptime", testFormatUptime, NULL) < 0)
+        ret = -1;
+
+    if (virtTestRun("fuse read", testFuseRead, NULL) < 0)
+        ret = -1;
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(fakesysfsdir);
+
+    VIR_FREE(fakesysfsdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN_PRELOAD(mymain, abs_builddir "/.libs/vircgroupmock.so")
+
+#else
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* WITH_LXC */
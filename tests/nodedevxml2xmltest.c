@@ -13,6 +13,7 @@
 #include "node_device_conf.h"
 #include "testutilsqemu.h"
 #include "virstring.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -64,6 +65,111 @@ testCompareXMLToXMLHelper(const void *data)
 }
 
 
+/* Fill a device list with @data copies of the sriov PF definition,
+ * as a host with that many VFs would, and check that every device
+ * can be found and removed again by name and by sysfs path. */
+static int
+testObjListLookup(const void *data)
+{
+    size_t ndevs = *(const size_t *)data;
+    virNodeDeviceObjList devs;
+    virNodeDeviceDefPtr def = NULL;
+    virNodeDeviceObjPtr dev;
+    char *xml = NULL;
+    char *xmlData = NULL;
+    char *name = NULL;
+    unsigned long long start, end;
+    size_t i;
+    int ret = -1;
+
+    memset(&devs, 0, sizeof(devs));
+
+    if (virAsprintf(&xml, "%s/nodedevschemadata/pci_8086_10c9_sriov_pf.xml",
+                    abs_srcdir) < 0 ||
+        virtTestLoadFile(xml, &xmlData) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndevs; i++) {
+        if (!(def = virNodeDeviceDefParseString(xmlData, EXISTING_DEVICE,
+                                                NULL)))
+            goto cleanup;
+
+        VIR_FREE(def->name);
+        VIR_FREE(def->sysfs_path);
+        if (virAsprintf(&def->name, "pci_0000_%02zx_%02zx_%zx",
+                        i >> 8, (i >> 3) & 0x1f, i & 0x7) < 0 ||
+            virAsprintf(&def->sysfs_path, "/sys/devices/pci0000:00/%s",
+                        def->name) < 0)
+            goto cleanup;
+
+        if (!(dev = virNodeDeviceAssignDef(&devs, def)))
+            goto cleanup;
+        def = NULL;
+        virNodeDeviceObjUnlock(dev);
+    }
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndevs; i++) {
+        VIR_FREE(name);
+        if (virAsprintf(&name, "pci_0000_%02zx_%02zx_%zx",
+                        i >> 8, (i >> 3) & 0x1f, i & 0x7) < 0)
+            goto cleanup;
+
+        if (!(dev = virNodeDeviceFindByName(&devs, name))) {
+            fprintf(stderr, "Cannot find device %s by name\n", name);
+            goto cleanup;
+        }
+        virNodeDeviceObjUnlock(dev);
+
+        VIR_FREE(name);
+        if (virAsprintf(&name, "/sys/devices/pci0000:00/%s",
+                        dev->def->name) < 0)
+            goto cleanup;
+
+        if (virNodeDeviceFindBySysfsPath(&devs, name) != dev) {
+            fprintf(stderr, "Cannot find device %s by path\n", name);
+            goto cleanup;
+        }
+
+        /* Drop every other device to exercise index removal */
+        if (i % 2)
+            virNodeDeviceObjRemove(&devs, dev);
+        else
+            virNodeDeviceObjUnlock(dev);
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    if (virTestGetDebug())
+        fprintf(stderr, "\n%zu lookups in %llu ms\n", ndevs * 2, end - start);
+
+    if (devs.count != ndevs - ndevs / 2) {
+        fprintf(stderr, "Expected %zu devices, have %zu\n",
+                ndevs - ndevs / 2, devs.count);
+        goto cleanup;
+    }
+
+    if (virNodeDeviceFindBySysfsPath(&devs, name) ||
+        virNodeDeviceFindByName(&devs, "pci_0000_00_00_1")) {
+        fprintf(stderr, "Removed device still found\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virNodeDeviceDefFree(def);
+    virNodeDeviceObjListFree(&devs);
+    VIR_FREE(xml);
+    VIR_FREE(xmlData);
+    VIR_FREE(name);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -91,6 +197,13 @@ mymain(void)
     DO_TEST("pci_8086_4238_pcie_wireless");
     DO_TEST("pci_8086_0c0c_snd_hda_intel");
 
+    {
+        size_t ndevs = virTestGetExpensive() ? 65536 : 2048;
+        if (virtTestRun("Node device list lookup", testObjListLookup,
+                        &ndevs) < 0)
+            ret = -1;
+    }
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
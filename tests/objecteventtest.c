@@ -23,7 +23,14 @@
 
 #include "testutils.h"
 
+#include "datatypes.h"
+#include "domain_event.h"
+#include "object_event.h"
+#include "viralloc.h"
 #include "virerror.h"
+#include "virfile.h"
+#include "virthread.h"
+#include "virtime.h"
 #include "virxml.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -76,6 +83,12 @@ typedef struct {
     virNetworkPtr net;
 } objecteventTest;
 
+typedef struct {
+    virConnectPtr conn;
+    size_t nwatchers;
+    size_t ncycles;
+} objecteventBenchmark;
+
 
 static int
 domainLifecycleCb(virConnectPtr conn ATTRIBUTE_UNUSED,
@@ -518,6 +531,274 @@ testNetworkStartStopEvent(const void *data)
     return ret;
 }
 
+/* Lots of clients each watching the lifecycle of their own domain,
+ * while one domain goes through many start/stop cycles: only the
+ * callback registered for that domain may see the events */
+static int
+testDispatchBenchmark(const void *data)
+{
+    const objecteventBenchmark *bench = data;
+    lifecycleEventCounter counter;
+    lifecycleEventCounter others;
+    virDomainPtr *watched = NULL;
+    int *ids = NULL;
+    virDomainPtr dom = NULL;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    unsigned long long start;
+    unsigned long long end;
+    size_t i;
+    int id = -1;
+    int ret = -1;
+
+    lifecycleEventCounter_reset(&counter);
+    lifecycleEventCounter_reset(&others);
+
+    if (VIR_ALLOC_N(watched, bench->nwatchers) < 0 ||
+        VIR_ALLOC_N(ids, bench->nwatchers) < 0)
+        goto cleanup;
+
+    for (i = 0; i < bench->nwatchers; i++)
+        ids[i] = -1;
+
+    for (i = 0; i < bench->nwatchers; i++) {
+        char name[32];
+
+        memset(uuid, 0, sizeof(uuid));
+        memcpy(uuid, &i, sizeof(i));
+        snprintf(name, sizeof(name), "watched-%zu", i);
+
+        if (!(watched[i] = virGetDomain(bench->conn, name, uuid)))
+            goto cleanup;
+
+        ids[i] = virConnectDomainEventRegisterAny(bench->conn, watched[i],
+                           VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                           VIR_DOMAIN_EVENT_CALLBACK(&domainLifecycleCb),
+                           &others, NULL);
+        if (ids[i] < 0)
+            goto cleanup;
+    }
+
+    if (!(dom = virDomainDefineXML(bench->conn, domainDef)))
+        goto cleanup;
+
+    id = virConnectDomainEventRegisterAny(bench->conn, dom,
+                           VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                           VIR_DOMAIN_EVENT_CALLBACK(&domainLifecycleCb),
+                           &counter, NULL);
+    if (id < 0)
+        goto cleanup;
+
+    for (i = 0; i < bench->ncycles; i++) {
+        if (virDomainCreate(dom) < 0 ||
+            virDomainDestroy(dom) < 0)
+            goto cleanup;
+    }
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    if (virEventRunDefaultImpl() < 0)
+        goto cleanup;
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    if (counter.startEvents != (int) bench->ncycles ||
+        counter.stopEvents != (int) bench->ncycles ||
+        counter.unexpectedEvents > 0) {
+        virFilePrintf(stderr, "Expected %zu start/stop events, got %d/%d\n",
+                      bench->ncycles, counter.startEvents, counter.stopEvents);
+        goto cleanup;
+    }
+
+    if (others.startEvents || others.stopEvents ||
+        others.defineEvents || others.undefineEvents) {
+        virFilePrintf(stderr, "Events leaked to callbacks of other domains\n");
+        goto cleanup;
+    }
+
+    if (virTestGetDebug())
+        virFilePrintf(stderr,
+                      "\ndispatched %zu events with %zu callbacks in %llu ms\n",
+                      bench->ncycles * 2, bench->nwatchers + 1, end - start);
+
+    ret = 0;
+ cleanup:
+    if (id >= 0)
+        virConnectDomainEventDeregisterAny(bench->conn, id);
+    if (dom) {
+        virDomainUndefine(dom);
+        virDomainFree(dom);
+    }
+    for (i = 0; watched && i < bench->nwatchers; i++) {
+        if (ids[i] >= 0)
+            virConnectDomainEventDeregisterAny(bench->conn, ids[i]);
+        virObjectUnref(watched[i]);
+    }
+    VIR_FREE(watched);
+    VIR_FREE(ids);
+    return ret;
+}
+
+
+#define DISPATCH_THREAD_QUEUERS 4
+#define DISPATCH_THREAD_EVENTS 1000
+
+typedef struct {
+    virMutex lock;
+    virCond cond;
+    size_t received;
+    int next[DISPATCH_THREAD_QUEUERS];  /* detail expected from each queuer */
+    bool misordered;
+    bool unknown;
+    unsigned long long dispatcher;      /* thread delivering the events */
+    bool severalDispatchers;
+} dispatchThreadCounter;
+
+typedef struct {
+    virObjectEventStatePtr state;
+    int id;
+    virThread thread;
+} dispatchThreadQueuer;
+
+/* Each queuer sends lifecycle events for its own domain, with the
+ * sequence number as detail, and they must arrive in that order */
+static int
+dispatchThreadCb(virConnectPtr conn ATTRIBUTE_UNUSED,
+                 virDomainPtr dom,
+                 int event ATTRIBUTE_UNUSED,
+                 int detail,
+                 void *opaque)
+{
+    dispatchThreadCounter *counter = opaque;
+    int id = virDomainGetID(dom);
+
+    virMutexLock(&counter->lock);
+    if (counter->received == 0)
+        counter->dispatcher = virThreadSelfID();
+    else if (counter->dispatcher != virThreadSelfID())
+        counter->severalDispatchers = true;
+    if (id < 1 || id > DISPATCH_THREAD_QUEUERS)
+        counter->unknown = true;
+    else if (counter->next[id - 1]++ != detail)
+        counter->misordered = true;
+
+    if (++counter->received == DISPATCH_THREAD_QUEUERS * DISPATCH_THREAD_EVENTS)
+        virCondSignal(&counter->cond);
+    virMutexUnlock(&counter->lock);
+    return 0;
+}
+
+static void
+dispatchThreadQueue(void *opaque)
+{
+    dispatchThreadQueuer *queuer = opaque;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    char name[32];
+    size_t i;
+
+    memset(uuid, 0, sizeof(uuid));
+    uuid[0] = queuer->id;
+    snprintf(name, sizeof(name), "queuer-%d", queuer->id);
+
+    for (i = 0; i < DISPATCH_THREAD_EVENTS; i++) {
+        virObjectEventPtr event;
+
+        if (!(event = virDomainEventLifecycleNew(queuer->id, name, uuid,
+                                                 VIR_DOMAIN_EVENT_STARTED,
+                                                 i)))
+            return;
+        virObjectEventStateQueue(queuer->state, event);
+    }
+}
+
+/* With a dispatch thread, events queued concurrently from several
+ * threads are delivered without running the event loop, each thread's
+ * events in the order they were queued, all from the one dispatch
+ * thread rather than from the threads queuing them */
+static int
+testDispatchThread(const void *data)
+{
+    const objecteventTest *test = data;
+    virObjectEventStatePtr state = NULL;
+    dispatchThreadCounter counter;
+    dispatchThreadQueuer queuers[DISPATCH_THREAD_QUEUERS];
+    size_t nqueuers = 0;
+    unsigned long long deadline;
+    int callbackID = -1;
+    size_t i;
+    int ret = -1;
+
+    memset(&counter, 0, sizeof(counter));
+    if (virMutexInit(&counter.lock) < 0)
+        return -1;
+    if (virCondInit(&counter.cond) < 0) {
+        virMutexDestroy(&counter.lock);
+        return -1;
+    }
+
+    if (!(state = virObjectEventStateNewFull(true)))
+        goto cleanup;
+
+    if (virDomainEventStateRegisterID(test->conn, state, NULL,
+                                      VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                                      VIR_DOMAIN_EVENT_CALLBACK(&dispatchThreadCb),
+                                      &counter, NULL, &callbackID) < 0)
+        goto cleanup;
+
+    for (i = 0; i < DISPATCH_THREAD_QUEUERS; i++) {
+        queuers[i].state = state;
+        queuers[i].id = i + 1;
+        if (virThreadCreate(&queuers[i].thread, true,
+                            dispatchThreadQueue, &queuers[i]) < 0)
+            goto join;
+        nqueuers++;
+    }
+
+ join:
+    for (i = 0; i < nqueuers; i++)
+        virThreadJoin(&queuers[i].thread);
+    if (nqueuers != DISPATCH_THREAD_QUEUERS)
+        goto cleanup;
+
+    if (virTimeMillisNow(&deadline) < 0)
+        goto cleanup;
+    deadline += 5 * 1000;
+
+    virMutexLock(&counter.lock);
+    while (counter.received < DISPATCH_THREAD_QUEUERS * DISPATCH_THREAD_EVENTS) {
+        if (virCondWaitUntil(&counter.cond, &counter.lock, deadline) < 0)
+            break;
+    }
+    virMutexUnlock(&counter.lock);
+
+    if (counter.received != DISPATCH_THREAD_QUEUERS * DISPATCH_THREAD_EVENTS) {
+        virFilePrintf(stderr, "Expected %d events, got %zu\n",
+                      DISPATCH_THREAD_QUEUERS * DISPATCH_THREAD_EVENTS,
+                      counter.received);
+        goto cleanup;
+    }
+
+    if (counter.misordered || counter.unknown ||
+        counter.severalDispatchers ||
+        counter.dispatcher == virThreadSelfID()) {
+        virFilePrintf(stderr, "Events were %s\n",
+                      counter.misordered ? "reordered" :
+                      counter.unknown ? "mixed up" :
+                      "not dispatched by the dispatch thread");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (callbackID >= 0)
+        virObjectEventStateDeregisterID(test->conn, state, callbackID);
+    virObjectEventStateFree(state);
+    virCondDestroy(&counter.cond);
+    virMutexDestroy(&counter.lock);
+    return ret;
+}
+
 static void
 timeout(int id ATTRIBUTE_UNUSED, void *opaque ATTRIBUTE_UNUSED)
 {
@@ -529,6 +810,7 @@ static int
 mymain(void)
 {
     objecteventTest test;
+    objecteventBenchmark bench = { NULL, 1000, 100 };
     int ret = EXIT_SUCCESS;
     int timer;
 
@@ -570,6 +852,18 @@ mymain(void)
     if (virtTestRun("Network start stop events ", testNetworkStartStopEvent, &test) < 0)
         ret = EXIT_FAILURE;
 
+    if (virtTestRun("Dispatch thread", testDispatchThread, &test) < 0)
+        ret = EXIT_FAILURE;
+
+    /* Dispatch benchmark */
+    bench.conn = test.conn;
+    if (virTestGetExpensive()) {
+        bench.nwatchers = 10000;
+        bench.ncycles = 1000;
+    }
+    if (virtTestRun("Event dispatch benchmark", testDispatchBenchmark, &bench) < 0)
+        ret = EXIT_FAILURE;
+
     /* Cleanup */
     virNetworkUndefine(test.net);
     virNetworkFree(test.net);
@@ -0,0 +1,180 @@
+/*
+ * qemublockjobtest.c: test the block job progress tracking
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include "testutils.h"
+
+#ifdef WITH_QEMU
+
+# include "internal.h"
+# include "qemu/qemu_domain.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+/* Progress reports as QEMU would give them, in MiB at ms timestamps */
+struct testBlockJobSample {
+    unsigned long long now;
+    unsigned long long cur;
+    unsigned long long rate;    /* expected afterwards */
+};
+
+struct testBlockJobInfo {
+    unsigned long long end;
+    const struct testBlockJobSample *samples;
+    size_t nsamples;
+    bool haveETA;
+    unsigned long long eta;     /* expected after the last sample */
+};
+
+
+static int
+testBlockJobRate(const void *opaque)
+{
+    const struct testBlockJobInfo *data = opaque;
+    qemuDomainBlockJob job;
+    virDomainBlockJobInfo info;
+    unsigned long long eta = 0;
+    bool haveETA;
+    size_t i;
+
+    memset(&job, 0, sizeof(job));
+    job.status = -1;
+
+    for (i = 0; i < data->nsamples; i++) {
+        memset(&info, 0, sizeof(info));
+        info.type = VIR_DOMAIN_BLOCK_JOB_TYPE_COPY;
+        info.cur = data->samples[i].cur;
+        info.end = data->end;
+
+        qemuDomainBlockJobUpdateAt(&job, &info, data->samples[i].now);
+
+        if (job.rate != data->samples[i].rate) {
+            fprintf(stderr, "Sample %zu: rate %llu, expected %llu\n",
+                    i, job.rate, data->samples[i].rate);
+            return -1;
+        }
+    }
+
+    haveETA = qemuDomainBlockJobGetETA(&job, &eta);
+    if (haveETA != data->haveETA || eta != data->eta) {
+        fprintf(stderr, "ETA %s %llu, expected %s %llu\n",
+                haveETA ? "known" : "unknown", eta,
+                data->haveETA ? "known" : "unknown", data->eta);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* A finished job has no ETA, however fast it was */
+static int
+testBlockJobFinished(const void *opaque ATTRIBUTE_UNUSED)
+{
+    qemuDomainBlockJob job;
+    unsigned long long eta;
+
+    memset(&job, 0, sizeof(job));
+    job.status = VIR_DOMAIN_BLOCK_JOB_COMPLETED;
+    job.rate = 100;
+    job.cur = 50;
+    job.end = 100;
+
+    if (qemuDomainBlockJobGetETA(&job, &eta)) {
+        fprintf(stderr, "Finished job has an ETA of %llu\n", eta);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+# define DO_TEST(name, end, haveETA, eta, ...)                          \
+    do {                                                                \
+        static const struct testBlockJobSample samples[] = { __VA_ARGS__ }; \
+        struct testBlockJobInfo info = {                                \
+            end, samples, ARRAY_CARDINALITY(samples), haveETA, eta      \
+        };                                                              \
+        if (virtTestRun("rate " name, testBlockJobRate, &info) < 0)     \
+            ret = -1;                                                   \
+    } while (0)
+
+    /* A single sample gives no rate yet */
+    DO_TEST("first sample", 1000, false, 0,
+            { 10000, 100, 0 });
+
+    /* 200 units in 2 s */
+    DO_TEST("steady", 1000, true, 7000,
+            { 10000, 100, 0 },
+            { 12000, 300, 100 });
+
+    /* Samples closer than a second apart keep the previous rate */
+    DO_TEST("too soon", 1000, true, 6000,
+            { 10000, 100, 0 },
+            { 12000, 300, 100 },
+            { 12500, 400, 100 });
+
+    /* ...and count once a second has passed since the last rate */
+    DO_TEST("after interval", 1000, true, 400,
+            { 10000, 100, 0 },
+            { 12000, 300, 100 },
+            { 12500, 400, 100 },
+            { 13000, 800, 500 });
+
+    /* Going backwards, e.g. a restarted mirror, starts over */
+    DO_TEST("backwards", 1000, false, 0,
+            { 10000, 500, 0 },
+            { 12000, 100, 0 });
+
+    /* Unknown time of the report keeps the progress but not the rate */
+    DO_TEST("no time", 1000, false, 0,
+            { 0, 100, 0 },
+            { 0, 300, 0 });
+
+    /* Overshooting the end leaves nothing to wait for */
+    DO_TEST("overshoot", 1000, true, 0,
+            { 10000, 800, 0 },
+            { 11000, 1200, 400 });
+
+    if (virtTestRun("finished", testBlockJobFinished, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
+
+#else
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* WITH_QEMU */
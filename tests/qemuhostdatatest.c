@@ -0,0 +1,251 @@
+/*
+ * qemuhostdatatest.c: test the host details shared by domain startups
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include "testutils.h"
+
+#ifdef WITH_QEMU
+
+# include "internal.h"
+# include "nodeinfo.h"
+# include "qemu/qemu_conf.h"
+# include "qemu/qemu_domain.h"
+# include "vircgroup.h"
+# include "virfile.h"
+# include "virstring.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+# define SCRATCHDIRTEMPLATE abs_builddir "/qemuhostdatadir-XXXXXX"
+
+static virQEMUDriver driver;
+
+
+static int
+testHostDataCheck(virQEMUDriverHostDataPtr data)
+{
+    int ncpus = nodeGetCPUCount();
+
+    if (data->ncpus != ncpus ||
+        data->kvm != virFileExists("/dev/kvm") ||
+        data->cgroups != virCgroupAvailable()) {
+        fprintf(stderr, "Host data %d CPUs kvm %d cgroups %d, host has "
+                "%d CPUs kvm %d cgroups %d\n",
+                data->ncpus, data->kvm, data->cgroups,
+                ncpus, virFileExists("/dev/kvm"), virCgroupAvailable());
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Only startup_host_cache = 1 turns the cache on */
+static int
+testHostDataConfig(const void *opaque ATTRIBUTE_UNUSED)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    virQEMUDriverConfigPtr cfg = NULL;
+    char *path = NULL;
+    int ret = -1;
+
+    if (!mkdtemp(scratchdir)) {
+        fprintf(stderr, "Cannot create scratch dir\n");
+        return -1;
+    }
+
+    if (!(cfg = virQEMUDriverConfigNew(false)))
+        goto cleanup;
+
+    if (cfg->startupHostCache) {
+        fprintf(stderr, "Host cache is on by default\n");
+        goto cleanup;
+    }
+
+    if (virAsprintf(&path, "%s/qemu.conf", scratchdir) < 0 ||
+        virFileWriteStr(path, "startup_host_cache = 1\n", 0600) < 0 ||
+        virQEMUDriverConfigLoadFile(cfg, path) < 0)
+        goto cleanup;
+
+    if (!cfg->startupHostCache) {
+        fprintf(stderr, "Host cache not turned on by the config file\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (path)
+        unlink(path);
+    rmdir(scratchdir);
+    VIR_FREE(path);
+    virObjectUnref(cfg);
+    return ret;
+}
+
+
+/* With the cache every caller shares the details probed first */
+static int
+testHostDataCached(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virQEMUDriverHostDataPtr first = NULL;
+    virQEMUDriverHostDataPtr second = NULL;
+    int ret = -1;
+
+    driver.config->startupHostCache = true;
+
+    if (!(first = virQEMUDriverGetHostData(&driver)) ||
+        !(second = virQEMUDriverGetHostData(&driver)))
+        goto cleanup;
+
+    if (first != second || driver.hostData != first) {
+        fprintf(stderr, "Cached host data not shared\n");
+        goto cleanup;
+    }
+
+    if (testHostDataCheck(first) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(first);
+    virObjectUnref(second);
+    virObjectUnref(driver.hostData);
+    driver.hostData = NULL;
+    return ret;
+}
+
+
+/* Without it every caller probes the host again and nothing is kept */
+static int
+testHostDataUncached(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virQEMUDriverHostDataPtr first = NULL;
+    virQEMUDriverHostDataPtr second = NULL;
+    int ret = -1;
+
+    driver.config->startupHostCache = false;
+
+    if (!(first = virQEMUDriverGetHostData(&driver)) ||
+        !(second = virQEMUDriverGetHostData(&driver)))
+        goto cleanup;
+
+    if (first == second || driver.hostData) {
+        fprintf(stderr, "Host data cached although disabled\n");
+        goto cleanup;
+    }
+
+    if (testHostDataCheck(first) < 0 ||
+        testHostDataCheck(second) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(first);
+    virObjectUnref(second);
+    return ret;
+}
+
+
+/* A domain being started sees the details its startup probed, even
+ * without the cache */
+static int
+testHostDataDomain(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainObjPtr vm = NULL;
+    qemuDomainObjPrivatePtr priv;
+    virQEMUDriverHostDataPtr data = NULL;
+    int ret = -1;
+
+    driver.config->startupHostCache = false;
+
+    if (!(vm = virDomainObjNew(driver.xmlopt)))
+        return -1;
+    priv = vm->privateData;
+
+    if (!(priv->hostData = virQEMUDriverGetHostData(&driver)) ||
+        !(data = qemuDomainGetHostData(&driver, vm)))
+        goto cleanup;
+
+    if (data != priv->hostData) {
+        fprintf(stderr, "Domain startup probed the host again\n");
+        goto cleanup;
+    }
+
+    virObjectUnref(data);
+    virObjectUnref(priv->hostData);
+    priv->hostData = NULL;
+
+    /* Outside of a startup it's the same as asking the driver */
+    if (!(data = qemuDomainGetHostData(&driver, vm)))
+        goto cleanup;
+
+    if (testHostDataCheck(data) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(data);
+    virObjectUnlock(vm);
+    virObjectUnref(vm);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virMutexInit(&driver.lock) < 0)
+        return EXIT_FAILURE;
+
+    if (!(driver.config = virQEMUDriverConfigNew(false)) ||
+        !(driver.xmlopt = virQEMUDriverCreateXMLConf(&driver)))
+        return EXIT_FAILURE;
+
+    if (virtTestRun("config", testHostDataConfig, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("cached", testHostDataCached, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("uncached", testHostDataUncached, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("domain startup", testHostDataDomain, NULL) < 0)
+        ret = -1;
+
+    virObjectUnref(driver.xmlopt);
+    virObjectUnref(driver.config);
+    virMutexDestroy(&driver.lock);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
+
+#else
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* WITH_QEMU */
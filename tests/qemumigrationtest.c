@@ -0,0 +1,664 @@
+/*
+ * qemumigrationtest.c: test the migration progress tracking, tuning and
+ *                      host evacuation
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "testutils.h"
+
+#ifdef WITH_QEMU
+
+# include "internal.h"
+# include "datatypes.h"
+# include "qemumonitortestutils.h"
+# include "qemu/qemu_conf.h"
+# include "qemu/qemu_domain.h"
+# include "qemu/qemu_driverpriv.h"
+# include "qemu/qemu_migrationpriv.h"
+# include "virstring.h"
+# include "virthread.h"
+# include "virtime.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+static virQEMUDriver driver;
+
+struct testEventInfo {
+    virDomainObjPtr vm;
+    unsigned int delay;     /* ms before the event is sent */
+};
+
+
+/* Plays the part of the monitor thread delivering a MIGRATION event */
+static void
+testSendMigrationEvent(void *opaque)
+{
+    struct testEventInfo *info = opaque;
+
+    if (info->delay)
+        usleep(info->delay * 1000);
+
+    virObjectLock(info->vm);
+    qemuDomainObjMigrationEventNotify(info->vm);
+    virObjectUnlock(info->vm);
+}
+
+
+static int
+testMigrationEventWait(virDomainObjPtr vm,
+                       unsigned long long timeout,
+                       int expect,
+                       bool quick)
+{
+    unsigned long long start;
+    unsigned long long end;
+    int rc;
+
+    if (virTimeMillisNow(&start) < 0)
+        return -1;
+
+    rc = qemuDomainObjMigrationEventWait(vm, start + timeout);
+
+    if (virTimeMillisNow(&end) < 0)
+        return -1;
+
+    if (rc != expect) {
+        fprintf(stderr, "Wait returned %d, expected %d\n", rc, expect);
+        return -1;
+    }
+
+    if (quick && end - start >= timeout) {
+        fprintf(stderr, "Wait took %llu ms, the event was missed\n",
+                end - start);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testMigrationEvent(const void *opaque ATTRIBUTE_UNUSED)
+{
+    int ret = -1;
+    virDomainObjPtr vm = NULL;
+    virThread thread;
+    struct testEventInfo info;
+
+    if (!(vm = virDomainObjNew(driver.xmlopt)))
+        return -1;
+
+    info.vm = vm;
+
+    /* An event sent while the waiting thread had @vm unlocked, e.g. to
+     * query the status, must not be lost */
+    info.delay = 0;
+    virObjectUnlock(vm);
+    if (virThreadCreate(&thread, true, testSendMigrationEvent, &info) < 0) {
+        virObjectLock(vm);
+        goto cleanup;
+    }
+    virThreadJoin(&thread);
+    virObjectLock(vm);
+
+    if (testMigrationEventWait(vm, 5000, 1, true) < 0)
+        goto cleanup;
+
+    /* ... but must only be seen once */
+    if (testMigrationEventWait(vm, 100, 0, false) < 0)
+        goto cleanup;
+
+    /* An event sent while waiting ends the wait early */
+    info.delay = 50;
+    if (virThreadCreate(&thread, true, testSendMigrationEvent, &info) < 0)
+        goto cleanup;
+
+    ret = testMigrationEventWait(vm, 5000, 1, true);
+
+    virObjectUnlock(vm);
+    virThreadJoin(&thread);
+    virObjectLock(vm);
+
+ cleanup:
+    virObjectUnlock(vm);
+    virObjectUnref(vm);
+    return ret;
+}
+
+
+# define TEST_EVACUATION_DOMAINS 6
+
+struct testEvacuation {
+    virConnectPtr conn;
+    virDomainPtr doms[TEST_EVACUATION_DOMAINS];
+    qemuEvacuationPtr evac;
+};
+
+static virMutex testEvacuationLock;
+static size_t testEvacuationInFlight;
+static size_t testEvacuationPeak;
+static size_t testEvacuationRuns[TEST_EVACUATION_DOMAINS];
+static unsigned long testEvacuationBandwidth[TEST_EVACUATION_DOMAINS];
+
+
+static void
+testEvacuationFree(struct testEvacuation *test)
+{
+    size_t i;
+
+    for (i = 0; i < TEST_EVACUATION_DOMAINS; i++) {
+        virDomainObjPtr vm;
+
+        if (!test->doms[i])
+            continue;
+
+        if ((vm = virDomainObjListFindByUUID(driver.domains,
+                                             test->doms[i]->uuid)))
+            virDomainObjListRemove(driver.domains, vm);
+        virObjectUnref(test->doms[i]);
+    }
+
+    virObjectUnref(test->evac);
+    virObjectUnref(test->conn);
+}
+
+
+/* Set up an evacuation of domains evac0 .. evac5, all attached to it */
+static int
+testEvacuationNew(struct testEvacuation *test,
+                  unsigned int concurrency,
+                  unsigned long long bandwidth)
+{
+    size_t i;
+
+    memset(test, 0, sizeof(*test));
+
+    if (!(test->conn = virGetConnect()))
+        return -1;
+
+    for (i = 0; i < TEST_EVACUATION_DOMAINS; i++) {
+        virDomainDefPtr def;
+        virDomainObjPtr vm;
+
+        if (VIR_ALLOC(def) < 0 ||
+            virAsprintf(&def->name, "evac%zu", i) < 0) {
+            virDomainDefFree(def);
+            goto error;
+        }
+        def->uuid[0] = i + 1;
+
+        if (!(vm = virDomainObjListAdd(driver.domains, def,
+                                       driver.xmlopt, 0, NULL))) {
+            virDomainDefFree(def);
+            goto error;
+        }
+        virObjectUnlock(vm);
+
+        if (!(test->doms[i] = virGetDomain(test->conn, def->name, def->uuid)))
+            goto error;
+    }
+
+    if (!(test->evac = qemuEvacuationNew(&driver, test->doms,
+                                         TEST_EVACUATION_DOMAINS)))
+        goto error;
+    test->evac->concurrency = concurrency;
+    test->evac->bandwidth = bandwidth;
+
+    for (i = 0; i < TEST_EVACUATION_DOMAINS; i++) {
+        virDomainObjPtr vm;
+        qemuDomainObjPrivatePtr priv;
+
+        if (!(vm = virDomainObjListFindByUUID(driver.domains,
+                                              test->doms[i]->uuid)))
+            goto error;
+        priv = vm->privateData;
+        priv->evac = virObjectRef(test->evac);
+        virObjectUnlock(vm);
+    }
+
+    return 0;
+
+ error:
+    testEvacuationFree(test);
+    return -1;
+}
+
+
+static unsigned long
+testEvacuationGetBandwidth(virDomainPtr dom,
+                           bool *attached)
+{
+    virDomainObjPtr vm;
+    qemuDomainObjPrivatePtr priv;
+    unsigned long ret;
+
+    if (!(vm = virDomainObjListFindByUUID(driver.domains, dom->uuid)))
+        return 0;
+
+    priv = vm->privateData;
+    ret = priv->evacBandwidth;
+    if (attached)
+        *attached = !!priv->evac;
+    virObjectUnlock(vm);
+    return ret;
+}
+
+
+static int
+testEvacuationRebalance(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testEvacuation test;
+    qemuEvacuationPtr evac;
+    virDomainObjPtr vm;
+    qemuDomainObjPrivatePtr priv;
+    int ret = -1;
+
+    if (testEvacuationNew(&test, 2, 100) < 0)
+        return -1;
+    evac = test.evac;
+
+    /* The cap is split between the domains in flight only */
+    evac->running[0] = evac->running[1] = true;
+    evac->active = 2;
+    qemuEvacuationRebalance(evac);
+    if (testEvacuationGetBandwidth(test.doms[0], NULL) != 50 ||
+        testEvacuationGetBandwidth(test.doms[1], NULL) != 50 ||
+        testEvacuationGetBandwidth(test.doms[2], NULL) != 0) {
+        fprintf(stderr, "Two domains in flight don't get half each\n");
+        goto cleanup;
+    }
+
+    /* One finishing gives the other all of it */
+    evac->running[1] = false;
+    evac->active = 1;
+    qemuEvacuationRebalance(evac);
+    if (testEvacuationGetBandwidth(test.doms[0], NULL) != 100) {
+        fprintf(stderr, "Last domain in flight doesn't get all of it\n");
+        goto cleanup;
+    }
+
+    /* A domain which left the evacuation is not touched */
+    if (!(vm = virDomainObjListFindByUUID(driver.domains,
+                                          test.doms[2]->uuid)))
+        goto cleanup;
+    priv = vm->privateData;
+    virObjectUnref(priv->evac);
+    priv->evac = NULL;
+    virObjectUnlock(vm);
+
+    evac->running[2] = true;
+    evac->active = 2;
+    qemuEvacuationRebalance(evac);
+    if (testEvacuationGetBandwidth(test.doms[2], NULL) != 0) {
+        fprintf(stderr, "Domain out of the evacuation was given bandwidth\n");
+        goto cleanup;
+    }
+
+    /* A share never drops to 0, which would mean unlimited */
+    evac->bandwidth = 1;
+    qemuEvacuationRebalance(evac);
+    if (testEvacuationGetBandwidth(test.doms[0], NULL) != 1) {
+        fprintf(stderr, "Share below 1 MiB/s not rounded up\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    testEvacuationFree(&test);
+    return ret;
+}
+
+
+/* Stands in for saving a domain, failing for evac3 */
+static int
+testEvacuationRun(qemuEvacuationPtr evac,
+                  virDomainPtr dom)
+{
+    unsigned long bandwidth = testEvacuationGetBandwidth(dom, NULL);
+    size_t i;
+
+    for (i = 0; i < evac->ndoms; i++) {
+        if (evac->doms[i] == dom)
+            break;
+    }
+
+    virMutexLock(&testEvacuationLock);
+    if (i < TEST_EVACUATION_DOMAINS) {
+        testEvacuationRuns[i]++;
+        testEvacuationBandwidth[i] = bandwidth;
+    }
+    if (++testEvacuationInFlight > testEvacuationPeak)
+        testEvacuationPeak = testEvacuationInFlight;
+    virMutexUnlock(&testEvacuationLock);
+
+    /* Give the other workers a chance to overlap */
+    usleep(10 * 1000);
+
+    virMutexLock(&testEvacuationLock);
+    testEvacuationInFlight--;
+    virMutexUnlock(&testEvacuationLock);
+
+    if (STREQ(dom->name, "evac3")) {
+        virReportError(VIR_ERR_OPERATION_FAILED, "%s", "evac3 failed");
+        return -1;
+    }
+    return 0;
+}
+
+
+static int
+testEvacuationWorker(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testEvacuation test;
+    qemuEvacuationPtr evac;
+    virThread workers[2];
+    size_t nworkers = 0;
+    size_t i;
+    int ret = -1;
+
+    if (testEvacuationNew(&test, 2, 100) < 0)
+        return -1;
+    evac = test.evac;
+    evac->run = testEvacuationRun;
+
+    testEvacuationInFlight = testEvacuationPeak = 0;
+    memset(testEvacuationRuns, 0, sizeof(testEvacuationRuns));
+    memset(testEvacuationBandwidth, 0, sizeof(testEvacuationBandwidth));
+
+    for (nworkers = 0; nworkers < ARRAY_CARDINALITY(workers); nworkers++) {
+        if (virThreadCreate(&workers[nworkers], true,
+                            qemuEvacuationWorker, evac) < 0)
+            break;
+    }
+    for (i = 0; i < nworkers; i++)
+        virThreadJoin(&workers[i]);
+    if (nworkers != ARRAY_CARDINALITY(workers))
+        goto cleanup;
+
+    if (testEvacuationPeak > 2) {
+        fprintf(stderr, "%zu domains were in flight at once, limit is 2\n",
+                testEvacuationPeak);
+        goto cleanup;
+    }
+
+    for (i = 0; i < TEST_EVACUATION_DOMAINS; i++) {
+        bool attached = true;
+
+        if (testEvacuationRuns[i] != 1) {
+            fprintf(stderr, "Domain evac%zu evacuated %zu times\n",
+                    i, testEvacuationRuns[i]);
+            goto cleanup;
+        }
+
+        /* Whether alone or next to another one, each had a share */
+        if (testEvacuationBandwidth[i] != 50 &&
+            testEvacuationBandwidth[i] != 100) {
+            fprintf(stderr, "Domain evac%zu ran at %lu MiB/s\n",
+                    i, testEvacuationBandwidth[i]);
+            goto cleanup;
+        }
+
+        if (testEvacuationGetBandwidth(test.doms[i], &attached) != 0 ||
+            attached) {
+            fprintf(stderr, "Domain evac%zu still attached\n", i);
+            goto cleanup;
+        }
+    }
+
+    if (evac->completed != TEST_EVACUATION_DOMAINS - 1 ||
+        evac->failed != 1 || evac->active != 0) {
+        fprintf(stderr, "Evacuation counted %zu completed, %zu failed, "
+                "%zu active\n", evac->completed, evac->failed, evac->active);
+        goto cleanup;
+    }
+
+    if (!evac->err || STRNEQ_NULLABLE(evac->err->message, "evac3 failed")) {
+        fprintf(stderr, "Failure of evac3 not kept\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    testEvacuationFree(&test);
+    return ret;
+}
+
+
+# if WITH_YAJL
+#  define MiB (1024ULL * 1024)
+
+struct testAutoTuneData {
+    unsigned long bandwidth;        /* MiB/s the migration starts with */
+    unsigned long evacBandwidth;    /* MiB/s assigned by an evacuation */
+    bool saturated;                 /* all of the bandwidth is used */
+    bool dirtying;                  /* the guest dirties what's sent */
+    bool maxDowntime;               /* downtime already at its limit */
+    unsigned long long cacheSize;   /* XBZRLE cache size, 0 if off */
+    const char *command;            /* monitor command expected */
+    const char *action;             /* decision expected */
+    unsigned long bandwidthAfter;
+    unsigned long long downtimeAfter;
+};
+
+
+/*
+ * Feed the auto-tuning controller the status updates of a migration
+ * which doesn't converge for long enough to make it act once, and check
+ * what it decided. Samples are taken a second apart by moving the time
+ * of the previous one back rather than by sleeping.
+ */
+static int
+testAutoTune(const void *opaque)
+{
+    const struct testAutoTuneData *data = opaque;
+    qemuMonitorTestPtr test = NULL;
+    virDomainObjPtr vm = NULL;
+    qemuDomainObjPrivatePtr priv;
+    qemuMonitorMigrationStatusPtr status;
+    qemuDomainJobTune *tune;
+    unsigned long long rate;
+    unsigned long long now;
+    size_t i;
+    int ret = -1;
+
+    if (!(vm = virDomainObjNew(driver.xmlopt)))
+        return -1;
+
+    if (VIR_ALLOC(vm->def) < 0 ||
+        VIR_STRDUP(vm->def->name, "autotune") < 0)
+        goto cleanup;
+    vm->def->id = 1;
+    vm->def->mem.cur_balloon = 1024 * 1024;
+
+    if (!(test = qemuMonitorTestNew(true, driver.xmlopt, vm, &driver, NULL)))
+        goto cleanup;
+
+    if (data->command &&
+        qemuMonitorTestAddItem(test, data->command, "{\"return\": {}}") < 0)
+        goto cleanup;
+
+    priv = vm->privateData;
+    priv->mon = qemuMonitorTestGetMonitor(test);
+    priv->monJSON = true;
+    virObjectUnlock(priv->mon);
+    priv->evacBandwidth = data->evacBandwidth;
+
+    status = &priv->job.status;
+    tune = &priv->job.tune;
+
+    if (qemuMigrationAutoTuneStart(&driver, vm, 0, data->bandwidth) < 0)
+        goto relock;
+    if (data->maxDowntime)
+        tune->downtime = tune->maxDowntime;
+
+    status->status = QEMU_MONITOR_MIGRATION_STATUS_ACTIVE;
+    status->ram_remaining = 1024 * MiB;
+    if (data->cacheSize) {
+        status->xbzrle_set = true;
+        status->xbzrle_cache_size = data->cacheSize;
+    }
+
+    rate = data->bandwidth * MiB;
+    if (!data->saturated)
+        rate /= 2;
+
+    /* One sample to start from, then enough of them without progress */
+    for (i = 0; i < 4; i++) {
+        if (virTimeMillisNow(&now) < 0)
+            goto relock;
+        if (tune->sampled)
+            tune->sampled = now - 1000;
+
+        status->ram_transferred += rate;
+        if (!data->dirtying)
+            status->ram_remaining -= rate;
+        status->xbzrle_cache_miss += 100;
+
+        qemuMigrationAutoTune(&driver, vm, QEMU_ASYNC_JOB_NONE);
+    }
+
+    if (STRNEQ(tune->lastAction, data->action)) {
+        fprintf(stderr, "Auto-tuning decided '%s', expected '%s'\n",
+                tune->lastAction, data->action);
+        goto relock;
+    }
+
+    if (tune->bandwidth != data->bandwidthAfter ||
+        tune->downtime != data->downtimeAfter) {
+        fprintf(stderr, "Bandwidth %lu MiB/s downtime %llu ms, "
+                "expected %lu MiB/s %llu ms\n",
+                tune->bandwidth, tune->downtime,
+                data->bandwidthAfter, data->downtimeAfter);
+        goto relock;
+    }
+
+    if (tune->adjustments != (data->command ? 1 : 0)) {
+        fprintf(stderr, "%u adjustments made\n", tune->adjustments);
+        goto relock;
+    }
+
+    ret = 0;
+
+ relock:
+    virObjectLock(priv->mon);
+    priv->mon = NULL;
+ cleanup:
+    qemuMonitorTestFree(test);
+    virObjectUnlock(vm);
+    virObjectUnref(vm);
+    return ret;
+}
+# endif /* WITH_YAJL */
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+# if WITH_YAJL
+    struct testAutoTuneData data;
+# endif
+
+    if (virThreadInitialize() < 0 ||
+        virMutexInit(&testEvacuationLock) < 0 ||
+        !(driver.xmlopt = virQEMUDriverCreateXMLConf(&driver)) ||
+        !(driver.config = virQEMUDriverConfigNew(false)) ||
+        !(driver.domains = virDomainObjListNew()))
+        return EXIT_FAILURE;
+
+    virEventRegisterDefaultImpl();
+
+    driver.config->migrationAutoTuneMaxDowntime = 2000;
+    driver.config->migrationAutoTuneMaxBandwidth = 64;
+
+    if (virtTestRun("migration event", testMigrationEvent, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("evacuation rebalance", testEvacuationRebalance, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("evacuation worker", testEvacuationWorker, NULL) < 0)
+        ret = -1;
+
+# if WITH_YAJL
+#  define DO_TEST_AUTO_TUNE(name, ...)                                   \
+    do {                                                                \
+        data = (struct testAutoTuneData) { __VA_ARGS__ };               \
+        if (virtTestRun("auto-tune " name, testAutoTune, &data) < 0)    \
+            ret = -1;                                                   \
+    } while (0)
+
+    DO_TEST_AUTO_TUNE("converging", .bandwidth = 16, .saturated = true,
+                      .action = "none",
+                      .bandwidthAfter = 16, .downtimeAfter = 30);
+    DO_TEST_AUTO_TUNE("bandwidth", .bandwidth = 16, .saturated = true,
+                      .dirtying = true,
+                      .command = "migrate_set_speed", .action = "bandwidth",
+                      .bandwidthAfter = 32, .downtimeAfter = 30);
+    DO_TEST_AUTO_TUNE("bandwidth limit", .bandwidth = 48, .saturated = true,
+                      .dirtying = true,
+                      .command = "migrate_set_speed", .action = "bandwidth",
+                      .bandwidthAfter = 64, .downtimeAfter = 30);
+    DO_TEST_AUTO_TUNE("bandwidth unused", .bandwidth = 16, .dirtying = true,
+                      .command = "migrate_set_downtime", .action = "downtime",
+                      .bandwidthAfter = 16, .downtimeAfter = 2000);
+    DO_TEST_AUTO_TUNE("bandwidth at limit", .bandwidth = 64,
+                      .saturated = true, .dirtying = true,
+                      .command = "migrate_set_downtime", .action = "downtime",
+                      .bandwidthAfter = 64, .downtimeAfter = 2000);
+    DO_TEST_AUTO_TUNE("evacuation", .bandwidth = 16, .evacBandwidth = 16,
+                      .saturated = true, .dirtying = true,
+                      .command = "migrate_set_downtime", .action = "downtime",
+                      .bandwidthAfter = 16, .downtimeAfter = 2000);
+    DO_TEST_AUTO_TUNE("xbzrle", .bandwidth = 16, .dirtying = true,
+                      .maxDowntime = true, .cacheSize = 64 * MiB,
+                      .command = "migrate-set-cache-size",
+                      .action = "compression_cache",
+                      .bandwidthAfter = 16, .downtimeAfter = 2000);
+    DO_TEST_AUTO_TUNE("xbzrle limit", .bandwidth = 16, .dirtying = true,
+                      .maxDowntime = true, .cacheSize = 256 * MiB,
+                      .action = "exhausted",
+                      .bandwidthAfter = 16, .downtimeAfter = 2000);
+    DO_TEST_AUTO_TUNE("exhausted", .bandwidth = 16, .dirtying = true,
+                      .maxDowntime = true,
+                      .action = "exhausted",
+                      .bandwidthAfter = 16, .downtimeAfter = 2000);
+# endif /* WITH_YAJL */
+
+    virObjectUnref(driver.domains);
+    virObjectUnref(driver.config);
+    virObjectUnref(driver.xmlopt);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
+
+#else
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* WITH_QEMU */
@@ -0,0 +1,230 @@
+/*
+ * qemumigrationtunneltest.c: test the tunnelled migration data path
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/socket.h>
+
+#include "testutils.h"
+
+#ifdef WITH_QEMU
+
+# include "internal.h"
+# include "datatypes.h"
+# include "fdstream.h"
+# include "qemu/qemu_migration.h"
+# include "viralloc.h"
+# include "virfile.h"
+# include "virthread.h"
+# include "virtime.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+# define BLOCK_SIZE (64 * 1024)
+
+struct testTunnelInfo {
+    unsigned long long size;
+    bool broken;        /* destination stops reading half way */
+};
+
+struct testWriterData {
+    int fd;
+    unsigned long long size;
+};
+
+
+/* Plays the part of qemu, writing a recognizable pattern into the
+ * migration socket */
+static void
+testWriteMigrationData(void *opaque)
+{
+    struct testWriterData *data = opaque;
+    char buf[BLOCK_SIZE];
+    unsigned long long off;
+    size_t i;
+
+    for (off = 0; off < data->size; off += BLOCK_SIZE) {
+        size_t len = MIN(BLOCK_SIZE, data->size - off);
+
+        for (i = 0; i < len; i++)
+            buf[i] = (off + i) % 251;
+
+        if (safewrite(data->fd, buf, len) < 0)
+            break;
+    }
+
+    VIR_FORCE_CLOSE(data->fd);
+}
+
+
+static int
+testTunnel(const void *opaque)
+{
+    const struct testTunnelInfo *info = opaque;
+    int ret = -1;
+    virConnectPtr conn = NULL;
+    virStreamPtr st = NULL;
+    qemuMigrationIOThreadPtr io = NULL;
+    struct testWriterData writer;
+    virThread writerThread;
+    bool writing = false;
+    int sv[2] = { -1, -1 };
+    int out[2] = { -1, -1 };
+    char buf[BLOCK_SIZE];
+    unsigned long long total = 0;
+    unsigned long long limit;
+    unsigned long long start;
+    unsigned long long end;
+    ssize_t nbytes;
+    ssize_t i;
+    int rc;
+
+    if (!(conn = virGetConnect()) ||
+        !(st = virStreamNew(conn, 0)))
+        goto cleanup;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0 ||
+        pipe(out) < 0)
+        goto cleanup;
+
+    /* The stream owns the write end of the pipe from now on */
+    if (virFDStreamOpen(st, out[1]) < 0)
+        goto cleanup;
+    out[1] = -1;
+
+    writer.fd = sv[1];
+    writer.size = info->size;
+    sv[1] = -1;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    if (!(io = qemuMigrationStartTunnel(st, sv[0])))
+        goto cleanup;
+
+    if (virThreadCreate(&writerThread, true,
+                        testWriteMigrationData, &writer) < 0)
+        goto cleanup;
+    writing = true;
+
+    limit = info->broken ? info->size / 2 : info->size;
+    while (total < limit &&
+           (nbytes = saferead(out[0], buf, sizeof(buf))) > 0) {
+        for (i = 0; i < nbytes; i++) {
+            if (buf[i] != (char) ((total + i) % 251)) {
+                virFilePrintf(stderr, "Data mismatch at offset %llu\n",
+                              total + i);
+                goto cleanup;
+            }
+        }
+        total += nbytes;
+    }
+
+    if (info->broken)
+        VIR_FORCE_CLOSE(out[0]);
+
+    rc = qemuMigrationStopTunnel(io, false);
+    io = NULL;
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    if (info->broken) {
+        if (rc == 0) {
+            virFilePrintf(stderr, "Broken stream was not reported\n");
+            goto cleanup;
+        }
+        /* The tunnel leaves a failed stream for its owner to drop */
+        ignore_value(virStreamAbort(st));
+        virResetLastError();
+    } else {
+        if (rc < 0)
+            goto cleanup;
+
+        if (total != info->size ||
+            saferead(out[0], buf, sizeof(buf)) != 0) {
+            virFilePrintf(stderr, "Expected %llu bytes, got %llu\n",
+                          info->size, total);
+            goto cleanup;
+        }
+
+        if (virTestGetDebug())
+            virFilePrintf(stderr, "\ntunnelled %llu MiB in %llu ms\n",
+                          info->size / (1024 * 1024), end - start);
+    }
+
+    ret = 0;
+ cleanup:
+    if (io)
+        ignore_value(qemuMigrationStopTunnel(io, true));
+    /* Unblocks the writer if the tunnel stopped reading early */
+    VIR_FORCE_CLOSE(sv[0]);
+    if (writing)
+        virThreadJoin(&writerThread);
+    VIR_FORCE_CLOSE(sv[1]);
+    VIR_FORCE_CLOSE(out[0]);
+    VIR_FORCE_CLOSE(out[1]);
+    virObjectUnref(st);
+    virObjectUnref(conn);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    unsigned long long size = 64ULL * 1024 * 1024 + 12345;
+
+    /* A broken destination must show up as an error, not kill us */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (virTestGetExpensive())
+        size = 2048ULL * 1024 * 1024 + 12345;
+
+# define DO_TEST(name, broken)                                          \
+    do {                                                                \
+        struct testTunnelInfo info = { size, broken };                  \
+        if (virtTestRun("tunnel " name, testTunnel, &info) < 0)         \
+            ret = -1;                                                   \
+    } while (0)
+
+    DO_TEST("loopback", false);
+    DO_TEST("broken", true);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
+
+#else
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* WITH_QEMU */
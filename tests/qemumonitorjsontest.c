@@ -24,9 +24,17 @@
 #include "qemumonitortestutils.h"
 #include "qemu/qemu_conf.h"
 #include "qemu/qemu_monitor_json.h"
+#include "qemu/qemu_domain.h"
+#include "qemu/qemu_process.h"
+#include "security/security_manager.h"
 #include "virthread.h"
 #include "virerror.h"
 #include "virstring.h"
+#include "virtime.h"
+#include "viratomic.h"
+#include "vircommand.h"
+#include "virfile.h"
+#include "virthreadpool.h"
 #include "cpu/cpu.h"
 
 
@@ -781,6 +789,298 @@ testQemuMonitorJSONDetachChardev(const void *data)
     return ret;
 }
 
+/*
+ * Submit several commands at once where QEMU answers the first one
+ * last, and check each reply is still handed back for its command.
+ */
+static int
+testQemuMonitorJSONCommandBatch(const void *data)
+{
+    virDomainXMLOptionPtr xmlopt = (virDomainXMLOptionPtr)data;
+    qemuMonitorTestPtr test = qemuMonitorTestNewSimple(true, xmlopt);
+    const char *names[] = { "query-status", "query-name", "query-uuid" };
+    virJSONValuePtr cmds[ARRAY_CARDINALITY(names)] = { NULL };
+    virJSONValuePtr replies[ARRAY_CARDINALITY(names)] = { NULL };
+    virJSONValuePtr ret_obj;
+    size_t i;
+    int ret = -1;
+
+    if (!test)
+        return ret;
+
+    if (qemuMonitorTestAddItemDeferred(test, "query-status",
+                                       "{\"return\": {\"status\": \"running\","
+                                       " \"singlestep\": false,"
+                                       " \"running\": true}}") < 0 ||
+        qemuMonitorTestAddItem(test, "query-name",
+                               "{\"return\": {\"name\": \"vm1\"}}") < 0 ||
+        qemuMonitorTestAddItem(test, "query-uuid",
+                               "{\"return\": {\"UUID\": "
+                               "\"c7a5fdbd-edaf-9455-926a-d65c16db1809\"}}") < 0)
+        goto cleanup;
+
+    for (i = 0; i < ARRAY_CARDINALITY(names); i++) {
+        if (!(cmds[i] = virJSONValueNewObject()) ||
+            virJSONValueObjectAppendString(cmds[i], "execute", names[i]) < 0)
+            goto cleanup;
+    }
+
+    if (qemuMonitorJSONCommandBatch(qemuMonitorTestGetMonitor(test),
+                                    cmds, ARRAY_CARDINALITY(names),
+                                    replies) < 0)
+        goto cleanup;
+
+    if (!(ret_obj = virJSONValueObjectGet(replies[0], "return")) ||
+        STRNEQ_NULLABLE(virJSONValueObjectGetString(ret_obj, "status"),
+                        "running")) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "query-status got the wrong reply");
+        goto cleanup;
+    }
+
+    if (!(ret_obj = virJSONValueObjectGet(replies[1], "return")) ||
+        STRNEQ_NULLABLE(virJSONValueObjectGetString(ret_obj, "name"),
+                        "vm1")) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "query-name got the wrong reply");
+        goto cleanup;
+    }
+
+    if (!(ret_obj = virJSONValueObjectGet(replies[2], "return")) ||
+        STRNEQ_NULLABLE(virJSONValueObjectGetString(ret_obj, "UUID"),
+                        "c7a5fdbd-edaf-9455-926a-d65c16db1809")) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "query-uuid got the wrong reply");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ARRAY_CARDINALITY(names); i++) {
+        virJSONValueFree(cmds[i]);
+        virJSONValueFree(replies[i]);
+    }
+    qemuMonitorTestFree(test);
+    return ret;
+}
+
+
+static void
+testQemuMonitorJSONReconnectTick(int timer ATTRIBUTE_UNUSED,
+                                 void *opaque ATTRIBUTE_UNUSED)
+{
+    /* only there to make the event loop check for progress */
+}
+
+
+/*
+ * Reconnect to running domains the way the daemon does at startup,
+ * through qemuProcessReconnectAll and the reconnect pool. Every domain
+ * has its own monitor harness, all served from the default event loop
+ * run here. With debug output this gives the time the pool needs to
+ * get through them.
+ */
+static int
+testQemuMonitorJSONReconnectBench(const void *data ATTRIBUTE_UNUSED)
+{
+    virQEMUDriver driver;
+    virSecurityManagerPtr mgr = NULL;
+    size_t ndomains = virTestGetExpensive() ? 256 : 16;
+    virDomainObjPtr *vms = NULL;
+    qemuMonitorTestPtr *tests = NULL;
+    virCommandPtr guest = NULL;
+    pid_t pid;
+    char *stateDir = NULL;
+    char *xml = NULL;
+    int timer = -1;
+    unsigned long long start;
+    unsigned long long now;
+    size_t i;
+    int ret = -1;
+
+    memset(&driver, 0, sizeof(driver));
+
+    if (VIR_ALLOC_N(vms, ndomains) < 0 ||
+        VIR_ALLOC_N(tests, ndomains) < 0)
+        goto cleanup;
+
+    if (!(driver.caps = testQemuCapsInit()) ||
+        !(driver.xmlopt = virQEMUDriverCreateXMLConf(&driver)) ||
+        !(driver.config = virQEMUDriverConfigNew(false)) ||
+        !(driver.domains = virDomainObjListNew()))
+        goto cleanup;
+
+    if (!(mgr = virSecurityManagerNew("none", "qemu", false, false, false)) ||
+        !(driver.securityManager = virSecurityManagerNewStack(mgr)))
+        goto cleanup;
+    mgr = NULL;
+
+    /* The status XML of every domain is saved on reconnect */
+    if (VIR_STRDUP(stateDir, abs_builddir "/qemureconnectstate-XXXXXX") < 0)
+        goto cleanup;
+    if (!mkdtemp(stateDir)) {
+        virReportSystemError(errno, "%s",
+                             "Cannot create state directory");
+        VIR_FREE(stateDir);
+        goto cleanup;
+    }
+    VIR_FREE(driver.config->stateDir);
+    if (VIR_STRDUP(driver.config->stateDir, stateDir) < 0)
+        goto cleanup;
+
+    /* Stands in for the QEMU processes of all the domains; nothing
+     * may ever kill the test itself */
+    guest = virCommandNewArgList("/bin/sleep", "600", NULL);
+    if (virCommandRunAsync(guest, &pid) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndomains; i++) {
+        virDomainDefPtr def;
+        qemuDomainObjPrivatePtr priv;
+
+        if (virAsprintf(&xml,
+                        "<domain type='qemu'>"
+                        "  <name>reconnect%zu</name>"
+                        "  <memory unit='KiB'>219136</memory>"
+                        "  <vcpu>1</vcpu>"
+                        "  <os><type arch='i686' machine='pc'>hvm</type></os>"
+                        "  <devices><emulator>/usr/bin/qemu</emulator></devices>"
+                        "</domain>", i) < 0)
+            goto cleanup;
+
+        if (!(def = virDomainDefParseString(xml, driver.caps, driver.xmlopt,
+                                            QEMU_EXPECTED_VIRT_TYPES, 0)))
+            goto cleanup;
+        VIR_FREE(xml);
+
+        if (!(vms[i] = virDomainObjListAdd(driver.domains, def,
+                                           driver.xmlopt, 0, NULL))) {
+            virDomainDefFree(def);
+            goto cleanup;
+        }
+        virObjectRef(vms[i]);
+
+        vms[i]->def->id = i + 1;
+        vms[i]->pid = pid;
+        virDomainObjSetState(vms[i], VIR_DOMAIN_RUNNING,
+                             VIR_DOMAIN_RUNNING_BOOTED);
+
+        priv = vms[i]->privateData;
+        priv->monJSON = true;
+        if (!(priv->qemuCaps = virQEMUCapsNew()) ||
+            VIR_ALLOC(priv->monConfig) < 0 ||
+            !(tests[i] = qemuMonitorTestNewServer(driver.xmlopt, vms[i],
+                                                  priv->monConfig))) {
+            virObjectUnlock(vms[i]);
+            goto cleanup;
+        }
+        virObjectUnlock(vms[i]);
+
+        if (qemuMonitorTestAddItem(tests[i], "qmp_capabilities",
+                                   "{\"return\": {}}") < 0 ||
+            qemuMonitorTestAddItem(tests[i], "query-status",
+                                   "{\"return\": {\"status\": \"running\","
+                                   " \"singlestep\": false,"
+                                   " \"running\": true}}") < 0 ||
+            qemuMonitorTestAddItem(tests[i], "query-block",
+                                   "{\"return\": []}") < 0)
+            goto cleanup;
+    }
+
+    if ((timer = virEventAddTimeout(10, testQemuMonitorJSONReconnectTick,
+                                    NULL, NULL)) < 0 ||
+        virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    qemuProcessReconnectAll(NULL, &driver);
+
+    while (virAtomicIntGet(&driver.nactive) < (int)ndomains) {
+        if (virTimeMillisNow(&now) < 0)
+            goto cleanup;
+        if (now - start > 60 * 1000) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           "reconnected only %d of %zu domains",
+                           virAtomicIntGet(&driver.nactive), ndomains);
+            goto cleanup;
+        }
+        if (virEventRunDefaultImpl() < 0)
+            goto cleanup;
+    }
+
+    if (virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    /* Let the workers finish ending their jobs */
+    virThreadPoolFree(driver.reconnectPool);
+    driver.reconnectPool = NULL;
+
+    for (i = 0; i < ndomains; i++) {
+        qemuDomainObjPrivatePtr priv = vms[i]->privateData;
+        int state;
+
+        virObjectLock(vms[i]);
+        state = virDomainObjGetState(vms[i], NULL);
+        if (!priv->mon || priv->reconnect ||
+            priv->job.active != QEMU_JOB_NONE ||
+            state != VIR_DOMAIN_RUNNING) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           "domain %s was not fully reconnected",
+                           vms[i]->def->name);
+            virObjectUnlock(vms[i]);
+            goto cleanup;
+        }
+        virObjectUnlock(vms[i]);
+    }
+
+    if (virTestGetDebug())
+        virFilePrintf(stderr, "\nreconnected %zu domains in %llu ms\n",
+                      ndomains, now - start);
+
+    ret = 0;
+
+ cleanup:
+    if (timer >= 0)
+        virEventRemoveTimeout(timer);
+    /* On failure, closing the monitors and their harnesses makes any
+     * reconnect still running or queued fail instead of waiting for
+     * an event loop nobody runs anymore */
+    for (i = 0; i < ndomains && vms; i++) {
+        qemuDomainObjPrivatePtr priv;
+
+        if (!vms[i])
+            continue;
+
+        virObjectLock(vms[i]);
+        priv = vms[i]->privateData;
+        if (priv->mon) {
+            qemuMonitorClose(priv->mon);
+            priv->mon = NULL;
+        }
+        virObjectUnlock(vms[i]);
+    }
+    for (i = 0; i < ndomains && tests; i++)
+        qemuMonitorTestFree(tests[i]);
+    virThreadPoolFree(driver.reconnectPool);
+    for (i = 0; i < ndomains && vms; i++)
+        virObjectUnref(vms[i]);
+    virCommandAbort(guest);
+    virCommandFree(guest);
+    if (stateDir)
+        ignore_value(virFileDeleteTree(stateDir));
+    VIR_FREE(stateDir);
+    VIR_FREE(xml);
+    VIR_FREE(vms);
+    VIR_FREE(tests);
+    virObjectUnref(driver.domains);
+    virObjectUnref(driver.securityManager);
+    virObjectUnref(mgr);
+    virObjectUnref(driver.config);
+    virObjectUnref(driver.xmlopt);
+    virObjectUnref(driver.caps);
+    return ret;
+}
+
 /*
  * This test will request to return a list of paths for "/". It should be
  * a simple list of 1 real element that being the "machine". The following
@@ -1620,6 +1920,100 @@ testQemuMonitorJSONqemuMonitorJSONGetBlockStatsInfo(const void *data)
     return ret;
 }
 
+/*
+ * The periodic sample is a single batch of queries. QEMU answers the
+ * balloon query last here, and a disk it doesn't know about must not
+ * spoil the rest of the sample.
+ */
+static int
+testQemuMonitorJSONqemuMonitorJSONGetStatsSample(const void *data)
+{
+    virDomainXMLOptionPtr xmlopt = (virDomainXMLOptionPtr)data;
+    qemuMonitorTestPtr test = qemuMonitorTestNewSimple(true, xmlopt);
+    virDomainMemoryStatStruct mem[VIR_DOMAIN_MEMORY_STAT_NR];
+    const char *devs[] = { "virtio-disk0", "virtio-disk9" };
+    qemuMonitorBlockStats blockstats[ARRAY_CARDINALITY(devs)];
+    unsigned long long balloon;
+    size_t i;
+    int nmem;
+    int ret = -1;
+
+    if (!test)
+        return -1;
+
+    for (i = 0; i < ARRAY_CARDINALITY(devs); i++)
+        blockstats[i].rd_req = -1;
+
+    if (qemuMonitorTestAddItemDeferred(test, "query-balloon",
+                                       "{\"return\": {\"actual\": 4294967296}}") < 0 ||
+        qemuMonitorTestAddItem(test, "query-blockstats",
+                               "{\"return\": [{"
+                               "    \"device\": \"drive-virtio-disk0\","
+                               "    \"stats\": {"
+                               "        \"flush_total_time_ns\": 7,"
+                               "        \"wr_total_time_ns\": 530699221,"
+                               "        \"wr_bytes\": 2845696,"
+                               "        \"rd_total_time_ns\": 640616474,"
+                               "        \"flush_operations\": 3,"
+                               "        \"wr_operations\": 174,"
+                               "        \"rd_bytes\": 28505088,"
+                               "        \"rd_operations\": 1279"
+                               "    }"
+                               "}]}") < 0 ||
+        qemuMonitorTestAddItem(test, "qom-get",
+                               "{\"return\": {\"stats\": {"
+                               "    \"stat-swap-in\": 2048,"
+                               "    \"stat-free-memory\": -1"
+                               "}, \"last-update\": 1371221540}}") < 0)
+        goto cleanup;
+
+    if ((nmem = qemuMonitorJSONGetStatsSample(qemuMonitorTestGetMonitor(test),
+                                              (char *) "/machine/balloon",
+                                              mem, ARRAY_CARDINALITY(mem),
+                                              &balloon, devs, blockstats,
+                                              ARRAY_CARDINALITY(devs))) < 0)
+        goto cleanup;
+
+    if (balloon != 4294967296ULL / 1024) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "Unexpected balloon value: %llu", balloon);
+        goto cleanup;
+    }
+
+    if (nmem != 2 ||
+        mem[0].tag != VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON ||
+        mem[0].val != 4294967296ULL / 1024 ||
+        mem[1].tag != VIR_DOMAIN_MEMORY_STAT_SWAP_IN ||
+        mem[1].val != 2) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "Unexpected memory statistics, got %d", nmem);
+        goto cleanup;
+    }
+
+    if (blockstats[0].rd_req != 1279 ||
+        blockstats[0].rd_bytes != 28505088 ||
+        blockstats[0].wr_req != 174 ||
+        blockstats[0].wr_total_times != 530699221 ||
+        blockstats[0].flush_req != 3 ||
+        blockstats[0].flush_total_times != 7) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "Unexpected statistics for virtio-disk0");
+        goto cleanup;
+    }
+
+    if (blockstats[1].rd_req != -1) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "Statistics reported for unknown virtio-disk9");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    qemuMonitorTestFree(test);
+    return ret;
+}
+
 static int
 testQemuMonitorJSONqemuMonitorJSONGetMigrationCacheSize(const void *data)
 {
@@ -2206,6 +2600,8 @@ mymain(void)
     DO_TEST(GetCommandLineOptionParameters);
     DO_TEST(AttachChardev);
     DO_TEST(DetachChardev);
+    DO_TEST(CommandBatch);
+    DO_TEST(ReconnectBench);
     DO_TEST(GetListPaths);
     DO_TEST(GetObjectProperty);
     DO_TEST(SetObjectProperty);
@@ -2251,6 +2647,7 @@ mymain(void)
     DO_TEST(qemuMonitorJSONGetBalloonInfo);
     DO_TEST(qemuMonitorJSONGetBlockInfo);
     DO_TEST(qemuMonitorJSONGetBlockStatsInfo);
+    DO_TEST(qemuMonitorJSONGetStatsSample);
     DO_TEST(qemuMonitorJSONGetMigrationCacheSize);
     DO_TEST(qemuMonitorJSONGetMigrationStatus);
     DO_TEST(qemuMonitorJSONGetSpiceMigrationStatus);
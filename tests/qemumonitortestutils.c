@@ -44,6 +44,9 @@ struct _qemuMonitorTestItem {
     qemuMonitorTestResponseCallback cb;
     void *opaque;
     virFreeCallback freecb;
+
+    /* hold the reply back until the next command is answered */
+    bool deferred;
 };
 
 struct _qemuMonitorTest {
@@ -63,6 +66,14 @@ struct _qemuMonitorTest {
     size_t outgoingLength;
     size_t outgoingCapacity;
 
+    /* "id" of the JSON command being answered, echoed in the reply */
+    char *replyId;
+
+    /* replies held back by deferred items */
+    bool deferReply;
+    char **deferred;
+    size_t ndeferred;
+
     virNetSocketPtr server;
     virNetSocketPtr client;
 
@@ -94,9 +105,9 @@ qemuMonitorTestItemFree(qemuMonitorTestItemPtr item)
 /*
  * Appends data for a reply to the outgoing buffer
  */
-int
-qemuMonitorTestAddReponse(qemuMonitorTestPtr test,
-                          const char *response)
+static int
+qemuMonitorTestAppendReponse(qemuMonitorTestPtr test,
+                             const char *response)
 {
     size_t want = strlen(response) + 2;
     size_t have = test->outgoingCapacity - test->outgoingLength;
@@ -117,6 +128,56 @@ qemuMonitorTestAddReponse(qemuMonitorTestPtr test,
 }
 
 
+/*
+ * Queues a reply to the command being processed
+ */
+int
+qemuMonitorTestAddReponse(qemuMonitorTestPtr test,
+                          const char *response)
+{
+    char *withid = NULL;
+    int ret = -1;
+
+    /* Echo the command id back like QEMU does so that replies can be
+     * matched up even when they are sent out of order */
+    if (test->replyId && test->json && !test->agent) {
+        virJSONValuePtr val = virJSONValueFromString(response);
+
+        if (val &&
+            val->type == VIR_JSON_TYPE_OBJECT &&
+            virJSONValueObjectHasKey(val, "id") != 1 &&
+            virJSONValueObjectHasKey(val, "event") != 1) {
+            if (virJSONValueObjectAppendString(val, "id", test->replyId) < 0 ||
+                !(withid = virJSONValueToString(val, false))) {
+                virJSONValueFree(val);
+                goto cleanup;
+            }
+            response = withid;
+        }
+        virJSONValueFree(val);
+    }
+
+    if (test->deferReply) {
+        char *copy;
+
+        VIR_DEBUG("Deferring response to monitor command: '%s", response);
+        if (VIR_STRDUP(copy, response) < 0)
+            goto cleanup;
+        if (VIR_APPEND_ELEMENT(test->deferred, test->ndeferred, copy) < 0) {
+            VIR_FREE(copy);
+            goto cleanup;
+        }
+        ret = 0;
+    } else {
+        ret = qemuMonitorTestAppendReponse(test, response);
+    }
+
+ cleanup:
+    VIR_FREE(withid);
+    return ret;
+}
+
+
 int
 qemuMonitorTestAddUnexpectedErrorResponse(qemuMonitorTestPtr test)
 {
@@ -176,19 +237,46 @@ qemuMonitorTestProcessCommand(qemuMonitorTestPtr test,
                               const char *cmdstr)
 {
     int ret;
+    size_t i;
 
     VIR_DEBUG("Processing string from monitor handler: '%s", cmdstr);
 
+    VIR_FREE(test->replyId);
+    if (test->json && !test->agent) {
+        virJSONValuePtr val = virJSONValueFromString(cmdstr);
+        const char *id = val ? virJSONValueObjectGetString(val, "id") : NULL;
+
+        ret = VIR_STRDUP(test->replyId, id);
+        virJSONValueFree(val);
+        if (ret < 0)
+            return -1;
+    }
+
     if (test->nitems == 0) {
-        return qemuMonitorTestAddUnexpectedErrorResponse(test);
+        ret = qemuMonitorTestAddUnexpectedErrorResponse(test);
     } else {
         qemuMonitorTestItemPtr item = test->items[0];
+        bool deferred = item->deferred;
+
+        test->deferReply = deferred;
         ret = (item->cb)(test, item, cmdstr);
+        test->deferReply = false;
         qemuMonitorTestItemFree(item);
         if (VIR_DELETE_ELEMENT(test->items, 0, test->nitems) < 0)
             return -1;
+
+        if (deferred)
+            return ret;
     }
 
+    /* Release replies held back by earlier commands after this one */
+    for (i = 0; ret == 0 && i < test->ndeferred; i++)
+        ret = qemuMonitorTestAppendReponse(test, test->deferred[i]);
+    for (i = 0; i < test->ndeferred; i++)
+        VIR_FREE(test->deferred[i]);
+    VIR_FREE(test->deferred);
+    test->ndeferred = 0;
+
     return ret;
 }
 
@@ -350,7 +438,10 @@ qemuMonitorTestFree(qemuMonitorTestPtr test)
         virObjectUnref(test->client);
     }
 
-    virObjectUnref(test->server);
+    if (test->server) {
+        virNetSocketRemoveIOCallback(test->server);
+        virObjectUnref(test->server);
+    }
     if (test->mon) {
         virObjectUnlock(test->mon);
         qemuMonitorClose(test->mon);
@@ -371,6 +462,11 @@ qemuMonitorTestFree(qemuMonitorTestPtr test)
 
     VIR_FREE(test->incoming);
     VIR_FREE(test->outgoing);
+    VIR_FREE(test->replyId);
+
+    for (i = 0; i < test->ndeferred; i++)
+        VIR_FREE(test->deferred[i]);
+    VIR_FREE(test->deferred);
 
     for (i = 0; i < test->nitems; i++)
         qemuMonitorTestItemFree(test->items[i]);
@@ -528,6 +624,27 @@ qemuMonitorTestAddItem(qemuMonitorTestPtr test,
 }
 
 
+/*
+ * Like qemuMonitorTestAddItem, but the reply is only sent after the
+ * reply to the following command, to emulate commands completing out
+ * of order.
+ */
+int
+qemuMonitorTestAddItemDeferred(qemuMonitorTestPtr test,
+                               const char *command_name,
+                               const char *response)
+{
+    if (qemuMonitorTestAddItem(test, command_name, response) < 0)
+        return -1;
+
+    virMutexLock(&test->lock);
+    test->items[test->nitems - 1]->deferred = true;
+    virMutexUnlock(&test->lock);
+
+    return 0;
+}
+
+
 static int
 qemuMonitorTestProcessGuestAgentSync(qemuMonitorTestPtr test,
                                      qemuMonitorTestItemPtr item ATTRIBUTE_UNUSED,
@@ -925,6 +1042,91 @@ qemuMonitorTestNew(bool json,
     return NULL;
 }
 
+/*
+ * Accepts the monitor connection of the code under test, from the
+ * event loop of the caller
+ */
+static void
+qemuMonitorTestAccept(virNetSocketPtr sock,
+                      int events ATTRIBUTE_UNUSED,
+                      void *opaque)
+{
+    qemuMonitorTestPtr test = opaque;
+    virNetSocketPtr client = NULL;
+    int clientEvents = VIR_EVENT_HANDLE_READABLE;
+
+    if (virNetSocketAccept(sock, &client) < 0 || !client) {
+        VIR_WARN("Cannot accept monitor connection: %s",
+                 virGetLastErrorMessage());
+        return;
+    }
+
+    /* Only one monitor connection is served */
+    virNetSocketRemoveIOCallback(sock);
+
+    virMutexLock(&test->lock);
+    test->client = client;
+
+    if (test->outgoingLength > 0)
+        clientEvents = VIR_EVENT_HANDLE_WRITABLE;
+
+    if (virNetSocketAddIOCallback(client,
+                                  clientEvents,
+                                  qemuMonitorTestIO,
+                                  test,
+                                  NULL) < 0) {
+        VIR_WARN("Cannot watch monitor connection: %s",
+                 virGetLastErrorMessage());
+        virNetSocketClose(client);
+        virObjectUnref(client);
+        test->client = NULL;
+    }
+    virMutexUnlock(&test->lock);
+}
+
+
+/**
+ * qemuMonitorTestNewServer:
+ * @xmlopt: XML parser configuration
+ * @vm: domain object the monitor belongs to
+ * @src: filled with the monitor configuration
+ *
+ * Set up a JSON monitor for @vm without opening it, so that the code
+ * under test can connect through @src on its own. The connection is
+ * accepted and served from the default event loop, which the caller
+ * must run. The caller has to clear @src.
+ */
+qemuMonitorTestPtr
+qemuMonitorTestNewServer(virDomainXMLOptionPtr xmlopt,
+                         virDomainObjPtr vm,
+                         virDomainChrSourceDefPtr src)
+{
+    qemuMonitorTestPtr test = NULL;
+
+    if (!(test = qemuMonitorCommonTestNew(xmlopt, vm, src)))
+        goto error;
+
+    test->json = true;
+
+    if (qemuMonitorTestAddReponse(test, QEMU_JSON_GREETING) < 0)
+        goto error;
+
+    if (virNetSocketAddIOCallback(test->server,
+                                  VIR_EVENT_HANDLE_READABLE,
+                                  qemuMonitorTestAccept,
+                                  test,
+                                  NULL) < 0)
+        goto error;
+
+    return test;
+
+ error:
+    virDomainChrSourceDefClear(src);
+    qemuMonitorTestFree(test);
+    return NULL;
+}
+
+
 qemuMonitorTestPtr
 qemuMonitorTestNewAgent(virDomainXMLOptionPtr xmlopt)
 {
@@ -52,6 +52,10 @@ int qemuMonitorTestAddItem(qemuMonitorTestPtr test,
                            const char *command_name,
                            const char *response);
 
+int qemuMonitorTestAddItemDeferred(qemuMonitorTestPtr test,
+                                   const char *command_name,
+                                   const char *response);
+
 int qemuMonitorTestAddAgentSyncResponse(qemuMonitorTestPtr test);
 
 int qemuMonitorTestAddItemParams(qemuMonitorTestPtr test,
@@ -69,6 +73,10 @@ qemuMonitorTestPtr qemuMonitorTestNew(bool json,
                                       virQEMUDriverPtr driver,
                                       const char *greeting);
 
+qemuMonitorTestPtr qemuMonitorTestNewServer(virDomainXMLOptionPtr xmlopt,
+                                            virDomainObjPtr vm,
+                                            virDomainChrSourceDefPtr src);
+
 qemuMonitorTestPtr qemuMonitorTestNewAgent(virDomainXMLOptionPtr xmlopt);
 
 
@@ -0,0 +1,390 @@
+/*
+ * remotechanneltest.c: test spreading calls over several connections
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "testutils.h"
+
+#if defined(WITH_LIBVIRTD) && defined(WITH_TEST)
+
+# include "internal.h"
+# include "viralloc.h"
+# include "vircommand.h"
+# include "viratomic.h"
+# include "virerror.h"
+# include "virfile.h"
+# include "virprocess.h"
+# include "virstring.h"
+# include "virthread.h"
+# include "virtime.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+# define SCRATCHDIRTEMPLATE abs_builddir "/remotechanneldir-XXXXXX"
+# define LIBVIRTD abs_builddir "/../daemon/libvirtd"
+
+# define NTHREADS 8
+
+static char *sockpath;
+static pid_t daemonPid = -1;
+static int eventQuit;
+
+struct testChannelInfo {
+    unsigned int nchannels;
+    size_t ncalls;
+};
+
+struct testWorkerData {
+    virDomainPtr dom;
+    const char *xml;
+    size_t ncalls;
+    bool failed;
+};
+
+
+static int
+testStartDaemon(const char *dir)
+{
+    virCommandPtr cmd = NULL;
+    char *conf = NULL;
+    char *confdata = NULL;
+    int ret = -1;
+
+    if (virAsprintf(&sockpath, "%s/libvirt-sock", dir) < 0 ||
+        virAsprintf(&conf, "%s/libvirtd.conf", dir) < 0 ||
+        virAsprintf(&confdata,
+                    "unix_sock_dir = \"%s\"\n"
+                    "auth_unix_rw = \"none\"\n"
+                    "max_workers = %d\n"
+                    "max_client_requests = %d\n",
+                    dir, NTHREADS * 2, NTHREADS * 2) < 0)
+        goto cleanup;
+
+    if (virFileWriteStr(conf, confdata, 0600) < 0)
+        goto cleanup;
+
+    /* Keep the session daemon away from the user's own files */
+    if (setenv("XDG_CONFIG_HOME", dir, 1) < 0 ||
+        setenv("XDG_CACHE_HOME", dir, 1) < 0 ||
+        setenv("XDG_RUNTIME_DIR", dir, 1) < 0)
+        goto cleanup;
+
+    cmd = virCommandNewArgList(LIBVIRTD, "--config", conf,
+                               "--timeout", "600", NULL);
+    if (virCommandRunAsync(cmd, &daemonPid) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virCommandFree(cmd);
+    VIR_FREE(conf);
+    VIR_FREE(confdata);
+    return ret;
+}
+
+
+static void
+testStopDaemon(void)
+{
+    int status;
+
+    if (daemonPid < 0)
+        return;
+
+    ignore_value(virProcessKill(daemonPid, SIGTERM));
+    ignore_value(virProcessWait(daemonPid, &status, true));
+    daemonPid = -1;
+}
+
+
+/* The daemon needs a moment before it accepts connections */
+static virConnectPtr
+testOpenConnection(unsigned int nchannels)
+{
+    virConnectPtr conn = NULL;
+    char *uri = NULL;
+    size_t i;
+
+    if (virAsprintf(&uri, "test+unix:///default?socket=%s&channels=%u",
+                    sockpath, nchannels) < 0)
+        return NULL;
+
+    for (i = 0; i < 100 && !conn; i++) {
+        if (!(conn = virConnectOpen(uri)))
+            usleep(100 * 1000);
+    }
+
+    if (conn)
+        virResetLastError();
+
+    VIR_FREE(uri);
+    return conn;
+}
+
+
+static void
+testEventLoop(void *opaque ATTRIBUTE_UNUSED)
+{
+    while (!virAtomicIntGet(&eventQuit)) {
+        if (virEventRunDefaultImpl() < 0)
+            break;
+    }
+}
+
+
+static void
+testEventTick(int timer ATTRIBUTE_UNUSED,
+              void *opaque ATTRIBUTE_UNUSED)
+{
+}
+
+
+static void
+testWorker(void *opaque)
+{
+    struct testWorkerData *data = opaque;
+    virConnectPtr conn = virDomainGetConnect(data->dom);
+    size_t i;
+
+    for (i = 0; i < data->ncalls && !data->failed; i++) {
+        char *xml;
+
+        if (i % 2) {
+            if (virConnectNumOfDomains(conn) != 1)
+                data->failed = true;
+            continue;
+        }
+
+        if (!(xml = virDomainGetXMLDesc(data->dom, 0)) ||
+            STRNEQ(xml, data->xml))
+            data->failed = true;
+        VIR_FREE(xml);
+    }
+}
+
+
+static int
+testChannelCalls(const void *opaque)
+{
+    const struct testChannelInfo *info = opaque;
+    struct testWorkerData data[NTHREADS];
+    virThread threads[NTHREADS];
+    virConnectPtr conn = NULL;
+    virDomainPtr dom = NULL;
+    char *xml = NULL;
+    unsigned long long start;
+    unsigned long long end;
+    size_t nthreads = 0;
+    size_t running = 0;
+    size_t i;
+    int ret = -1;
+
+    if (!(conn = testOpenConnection(info->nchannels)))
+        goto cleanup;
+
+    if (!(dom = virDomainLookupByName(conn, "test")) ||
+        !(xml = virDomainGetXMLDesc(dom, 0)))
+        goto cleanup;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < NTHREADS; i++) {
+        data[i].dom = dom;
+        data[i].xml = xml;
+        data[i].ncalls = info->ncalls;
+        data[i].failed = false;
+        if (virThreadCreate(&threads[i], true, testWorker, &data[i]) < 0)
+            goto cleanup;
+        nthreads++;
+        running++;
+    }
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+    running = 0;
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nthreads; i++) {
+        if (data[i].failed) {
+            fprintf(stderr, "Thread %zu got a wrong reply\n", i);
+            goto cleanup;
+        }
+    }
+
+    if (virTestGetDebug())
+        fprintf(stderr, "\n%u channels: %zu calls in %llu ms\n",
+                info->nchannels, NTHREADS * info->ncalls, end - start);
+
+    ret = 0;
+ cleanup:
+    for (i = 0; i < running; i++) {
+        data[i].failed = true;
+        virThreadJoin(&threads[i]);
+    }
+    VIR_FREE(xml);
+    if (dom)
+        virDomainFree(dom);
+    if (conn)
+        virConnectClose(conn);
+    return ret;
+}
+
+
+static int
+testChannelLifecycle(virConnectPtr conn ATTRIBUTE_UNUSED,
+                     virDomainPtr dom ATTRIBUTE_UNUSED,
+                     int event ATTRIBUTE_UNUSED,
+                     int detail ATTRIBUTE_UNUSED,
+                     void *opaque)
+{
+    int *count = opaque;
+
+    virAtomicIntInc(count);
+    return 0;
+}
+
+
+/* Events have to keep working while calls go over other channels */
+static int
+testChannelEvents(const void *opaque)
+{
+    const struct testChannelInfo *info = opaque;
+    virConnectPtr conn = NULL;
+    virDomainPtr dom = NULL;
+    int count = 0;
+    int callback = -1;
+    size_t i;
+    int ret = -1;
+
+    if (!(conn = testOpenConnection(info->nchannels)) ||
+        !(dom = virDomainLookupByName(conn, "test")))
+        goto cleanup;
+
+    if ((callback = virConnectDomainEventRegisterAny(
+             conn, dom, VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+             VIR_DOMAIN_EVENT_CALLBACK(testChannelLifecycle),
+             &count, NULL)) < 0)
+        goto cleanup;
+
+    for (i = 0; i < 10; i++) {
+        if (virDomainSuspend(dom) < 0 ||
+            virConnectNumOfDomains(conn) != 1 ||
+            virDomainResume(dom) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < 100 && virAtomicIntGet(&count) < 20; i++)
+        usleep(50 * 1000);
+
+    if (virAtomicIntGet(&count) != 20) {
+        fprintf(stderr, "Expected 20 events, got %d\n",
+                virAtomicIntGet(&count));
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (callback >= 0)
+        virConnectDomainEventDeregisterAny(conn, callback);
+    if (dom)
+        virDomainFree(dom);
+    if (conn)
+        virConnectClose(conn);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    virThread eventThread;
+    int timer = -1;
+    size_t ncalls = 500;
+    int ret = 0;
+
+    /* Spawning a daemon is too heavy for every run, and as root it
+     * would be the system instance */
+    if (!virTestGetExpensive() || geteuid() == 0 ||
+        !virFileIsExecutable(LIBVIRTD))
+        return EXIT_AM_SKIP;
+
+    if (!mkdtemp(scratchdir)) {
+        fprintf(stderr, "Cannot create scratch dir");
+        abort();
+    }
+
+    if (virEventRegisterDefaultImpl() < 0 ||
+        (timer = virEventAddTimeout(100, testEventTick, NULL, NULL)) < 0 ||
+        virThreadCreate(&eventThread, true, testEventLoop, NULL) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (testStartDaemon(scratchdir) < 0) {
+        ret = -1;
+        goto stop;
+    }
+
+# define DO_TEST(name, func, nchannels)                                 \
+    do {                                                                \
+        struct testChannelInfo info = { nchannels, ncalls };            \
+        if (virtTestRun(name, func, &info) < 0)                         \
+            ret = -1;                                                   \
+    } while (0)
+
+    DO_TEST("calls 1 channel", testChannelCalls, 1);
+    DO_TEST("calls 4 channels", testChannelCalls, 4);
+    DO_TEST("calls 8 channels", testChannelCalls, 8);
+    DO_TEST("events 4 channels", testChannelEvents, 4);
+
+ stop:
+    testStopDaemon();
+    virAtomicIntSet(&eventQuit, 1);
+    virThreadJoin(&eventThread);
+
+ cleanup:
+    if (timer >= 0)
+        virEventRemoveTimeout(timer);
+    VIR_FREE(sockpath);
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
+
+#else /* ! (WITH_LIBVIRTD && WITH_TEST) */
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* ! (WITH_LIBVIRTD && WITH_TEST) */
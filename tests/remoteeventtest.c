@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "daemon/remote_event.h"
+#include "virerror.h"
+#include "virevent.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+#ifdef HAVE_SOCKETPAIR
+
+# define TEST_INTERVAL 50
+
+static bool testTimedOut;
+
+static void
+testTimeout(int timer ATTRIBUTE_UNUSED,
+            void *opaque ATTRIBUTE_UNUSED)
+{
+    testTimedOut = true;
+}
+
+
+static int
+testSend(remoteEventThrottlePtr throttle,
+         virNetServerClientPtr client,
+         const char *key,
+         size_t expect)
+{
+    virNetMessagePtr msg;
+    size_t nevents;
+    size_t nevents_peak;
+    unsigned long long nevents_dropped;
+
+    if (!(msg = virNetMessageNew(false)))
+        return -1;
+    msg->header.type = VIR_NET_MESSAGE;
+
+    remoteEventThrottleSend(throttle, key, msg);
+
+    virNetServerClientGetEventStats(client, &nevents, &nevents_peak,
+                                    &nevents_dropped);
+    if (nevents != expect) {
+        fprintf(stderr, "Event for '%s' left %zu events queued, expected %zu\n",
+                key, nevents, expect);
+        return -1;
+    }
+    return 0;
+}
+
+
+static int testThrottle(const void *opaque ATTRIBUTE_UNUSED)
+{
+    int sv[2];
+    int ret = -1;
+    int timer = -1;
+    virNetSocketPtr sock = NULL;
+    virNetServerClientPtr client = NULL;
+    remoteEventThrottlePtr throttle = NULL;
+    size_t nevents;
+    size_t nevents_peak;
+    unsigned long long nevents_dropped;
+
+    if (socketpair(PF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        virReportSystemError(errno, "%s",
+                             "Cannot create socket pair");
+        return -1;
+    }
+
+    if (virNetSocketNewConnectSockFD(sv[0], &sock) < 0)
+        goto cleanup;
+    sv[0] = -1;
+
+    if (!(client = virNetServerClientNew(sock, 0, false, 1,
+# ifdef WITH_GNUTLS
+                                         NULL,
+# endif
+                                         NULL, NULL, NULL, NULL)))
+        goto cleanup;
+
+    virNetServerClientSetMaxEvents(client, 10);
+
+    if (!(throttle = remoteEventThrottleNew(client, TEST_INTERVAL)))
+        goto cleanup;
+
+    /* The first event of an object goes out right away, the ones
+     * following it within the interval wait for the timer ... */
+    if (testSend(throttle, client, "a", 1) < 0 ||
+        testSend(throttle, client, "a", 1) < 0 ||
+        testSend(throttle, client, "a", 1) < 0)
+        goto cleanup;
+
+    /* ... without holding back the events of other objects */
+    if (testSend(throttle, client, "b", 2) < 0)
+        goto cleanup;
+
+    /* The timer sends only the latest of the coalesced events */
+    testTimedOut = false;
+    if ((timer = virEventAddTimeout(5000, testTimeout, NULL, NULL)) < 0)
+        goto cleanup;
+
+    do {
+        if (virEventRunDefaultImpl() < 0)
+            goto cleanup;
+        virNetServerClientGetEventStats(client, &nevents, &nevents_peak,
+                                        &nevents_dropped);
+    } while (nevents < 3 && !testTimedOut);
+
+    if (nevents != 3) {
+        fprintf(stderr, "Timer left %zu events queued, expected 3\n",
+                nevents);
+        goto cleanup;
+    }
+
+    /* Nothing is sent once closed */
+    remoteEventThrottleClose(throttle);
+    if (testSend(throttle, client, "c", 3) < 0)
+        goto cleanup;
+
+    if (nevents_dropped != 0) {
+        fprintf(stderr, "%llu events were dropped\n", nevents_dropped);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (timer >= 0)
+        virEventRemoveTimeout(timer);
+    remoteEventThrottleClose(throttle);
+    virObjectUnref(throttle);
+    if (client)
+        virNetServerClientClose(client);
+    virObjectUnref(sock);
+    virObjectUnref(client);
+    VIR_FORCE_CLOSE(sv[0]);
+    VIR_FORCE_CLOSE(sv[1]);
+    return ret;
+}
+
+
+static int testCanCoalesce(const void *opaque ATTRIBUTE_UNUSED)
+{
+    /* A guest may stop on the first I/O error, it must not be lost */
+    if (remoteEventCanCoalesce(VIR_DOMAIN_EVENT_ID_IO_ERROR) ||
+        remoteEventCanCoalesce(VIR_DOMAIN_EVENT_ID_IO_ERROR_REASON) ||
+        remoteEventCanCoalesce(VIR_DOMAIN_EVENT_ID_LIFECYCLE)) {
+        fprintf(stderr, "Event which must not be coalesced can be\n");
+        return -1;
+    }
+
+    if (!remoteEventCanCoalesce(VIR_DOMAIN_EVENT_ID_RTC_CHANGE) ||
+        !remoteEventCanCoalesce(VIR_DOMAIN_EVENT_ID_BLOCK_JOB)) {
+        fprintf(stderr, "Event which can be coalesced is not\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    virEventRegisterDefaultImpl();
+
+    if (virtTestRun("Throttle", testThrottle, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Can coalesce", testCanCoalesce, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+VIRT_TEST_MAIN(mymain)
+#else
+static int
+mymain(void)
+{
+    return EXIT_AM_SKIP;
+}
+VIRT_TEST_MAIN(mymain);
+#endif
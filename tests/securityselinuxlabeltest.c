@@ -315,6 +315,92 @@ testSELinuxLabeling(const void *opaque)
     return ret;
 }
 
+#define TEST_SELINUX_ORIG_LABEL "system_u:object_r:user_home_t:s0"
+
+/* The mock policy has no default labels, so restoring must put back
+ * whatever the files were labelled with before the domain started,
+ * also for disks labelled again while they already carry the label */
+static int
+testSELinuxRestore(const void *opaque)
+{
+    const char *testname = opaque;
+    int ret = -1;
+    testSELinuxFile *files = NULL;
+    size_t nfiles = 0;
+    size_t i;
+    virDomainDefPtr def = NULL;
+
+    if (testSELinuxLoadFileList(testname, &files, &nfiles) < 0)
+        goto cleanup;
+
+    if (testSELinuxCreateDisks(files, nfiles) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nfiles; i++) {
+        if (setfilecon(files[i].file,
+                       (security_context_t)TEST_SELINUX_ORIG_LABEL) < 0) {
+            virReportSystemError(errno, "Cannot set label on %s",
+                                 files[i].file);
+            goto cleanup;
+        }
+    }
+
+    if (!(def = testSELinuxLoadDef(testname)))
+        goto cleanup;
+
+    if (virSecurityManagerSetAllLabel(mgr, def, NULL) < 0)
+        goto cleanup;
+
+    if (testSELinuxCheckLabels(files, nfiles) < 0)
+        goto cleanup;
+
+    for (i = 0; i < def->ndisks; i++) {
+        virStorageSourcePtr src = def->disks[i]->src;
+        size_t j;
+
+        if (virSecurityManagerSetDiskLabel(mgr, def, def->disks[i]) < 0)
+            goto cleanup;
+
+        for (j = 0; j < src->nseclabels; j++) {
+            if (src->seclabels[j]->labelskip) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               "Restore of relabelled %s would be skipped",
+                               src->path);
+                goto cleanup;
+            }
+        }
+    }
+
+    if (virSecurityManagerRestoreAllLabel(mgr, def, false) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nfiles; i++) {
+        VIR_FREE(files[i].context);
+        if (VIR_STRDUP(files[i].context, TEST_SELINUX_ORIG_LABEL) < 0)
+            goto cleanup;
+    }
+
+    if (testSELinuxCheckLabels(files, nfiles) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    if (testSELinuxDeleteDisks(files, nfiles) < 0)
+        VIR_WARN("unable to fully clean up");
+
+    virDomainDefFree(def);
+    for (i = 0; i < nfiles; i++) {
+        VIR_FREE(files[i].file);
+        VIR_FREE(files[i].context);
+    }
+    VIR_FREE(files);
+    if (ret < 0 && virTestGetVerbose()) {
+        virErrorPtr err = virGetLastError();
+        fprintf(stderr, "%s\n", err ? err->message : "<unknown>");
+    }
+    return ret;
+}
 
 
 static int
@@ -346,6 +432,12 @@ mymain(void)
     DO_TEST_LABELING("chardev");
     DO_TEST_LABELING("nfs");
 
+    if (virtTestRun("Restoring kernel", testSELinuxRestore, "kernel") < 0)
+        ret = -1;
+    if (virtTestRun("Restoring relabelled disk", testSELinuxRestore,
+                    "prelabelled") < 0)
+        ret = -1;
+
     return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
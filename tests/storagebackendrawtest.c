@@ -0,0 +1,402 @@
+/*
+ * storagebackendrawtest.c: test cloning and wiping of raw volumes
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "internal.h"
+#include "testutils.h"
+#include "storage/storage_backend.h"
+#include "viralloc.h"
+#include "virfile.h"
+#include "virstring.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/storagebackendrawdir-XXXXXX"
+
+#define CHUNK_SIZE (1024 * 1024)
+
+struct testCloneInfo {
+    const char *dir;
+    const char *name;
+    unsigned long long size;
+    bool sparse;        /* leave every other chunk of the input as a hole */
+    bool preallocate;   /* request allocation == capacity for the clone */
+};
+
+
+static virStorageVolDefPtr
+testVolNew(const char *dir,
+           const char *name,
+           unsigned long long capacity,
+           unsigned long long allocation)
+{
+    virStorageVolDefPtr vol = NULL;
+
+    if (VIR_ALLOC(vol) < 0 ||
+        VIR_ALLOC(vol->target.perms) < 0 ||
+        VIR_STRDUP(vol->name, name) < 0 ||
+        virAsprintf(&vol->target.path, "%s/%s", dir, name) < 0) {
+        virStorageVolDefFree(vol);
+        return NULL;
+    }
+
+    vol->type = VIR_STORAGE_VOL_FILE;
+    vol->target.capacity = capacity;
+    vol->target.allocation = allocation;
+    vol->target.perms->mode = 0600;
+    vol->target.perms->uid = (uid_t) -1;
+    vol->target.perms->gid = (gid_t) -1;
+
+    return vol;
+}
+
+
+/* Fill @path with @size bytes of a recognizable pattern, leaving
+ * every other chunk unwritten if @sparse */
+static int
+testWriteInput(const char *path,
+               unsigned long long size,
+               bool sparse)
+{
+    int ret = -1;
+    int fd = -1;
+    char *buf = NULL;
+    unsigned long long off;
+    size_t i;
+
+    if (VIR_ALLOC_N(buf, CHUNK_SIZE) < 0)
+        goto cleanup;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+        goto cleanup;
+
+    if (ftruncate(fd, size) < 0)
+        goto cleanup;
+
+    for (off = 0; off < size; off += CHUNK_SIZE) {
+        if (sparse && (off / CHUNK_SIZE) % 2)
+            continue;
+
+        for (i = 0; i < CHUNK_SIZE; i++)
+            buf[i] = (off / CHUNK_SIZE + i) % 251 + 1;
+
+        if (lseek(fd, off, SEEK_SET) < 0 ||
+            safewrite(fd, buf, MIN(CHUNK_SIZE, size - off)) < 0)
+            goto cleanup;
+    }
+
+    if (VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(buf);
+    return ret;
+}
+
+
+static int
+testCompareFiles(const char *a,
+                 const char *b,
+                 unsigned long long size)
+{
+    int ret = -1;
+    int fda = -1;
+    int fdb = -1;
+    char *bufa = NULL;
+    char *bufb = NULL;
+    unsigned long long off;
+
+    if (VIR_ALLOC_N(bufa, CHUNK_SIZE) < 0 ||
+        VIR_ALLOC_N(bufb, CHUNK_SIZE) < 0)
+        goto cleanup;
+
+    if ((fda = open(a, O_RDONLY)) < 0 ||
+        (fdb = open(b, O_RDONLY)) < 0)
+        goto cleanup;
+
+    for (off = 0; off < size; off += CHUNK_SIZE) {
+        size_t len = MIN(CHUNK_SIZE, size - off);
+
+        if (saferead(fda, bufa, len) != (ssize_t) len ||
+            saferead(fdb, bufb, len) != (ssize_t) len) {
+            virFilePrintf(stderr, "Short read at offset %llu\n", off);
+            goto cleanup;
+        }
+        if (memcmp(bufa, bufb, len) != 0) {
+            virFilePrintf(stderr, "Data mismatch at offset %llu\n", off);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(fda);
+    VIR_FORCE_CLOSE(fdb);
+    VIR_FREE(bufa);
+    VIR_FREE(bufb);
+    return ret;
+}
+
+
+static int
+testCloneRaw(const void *opaque)
+{
+    const struct testCloneInfo *info = opaque;
+    int ret = -1;
+    virStoragePoolObj pool;
+    virStoragePoolDef pooldef;
+    virStorageVolDefPtr inputvol = NULL;
+    virStorageVolDefPtr vol = NULL;
+    char *inputname = NULL;
+    unsigned long long start;
+    unsigned long long end;
+    struct stat sb;
+
+    memset(&pool, 0, sizeof(pool));
+    memset(&pooldef, 0, sizeof(pooldef));
+    pooldef.type = VIR_STORAGE_POOL_DIR;
+    pool.def = &pooldef;
+
+    if (virAsprintf(&inputname, "%s-input", info->name) < 0)
+        goto cleanup;
+
+    if (!(inputvol = testVolNew(info->dir, inputname,
+                                info->size, info->size)) ||
+        !(vol = testVolNew(info->dir, info->name, info->size,
+                           info->preallocate ? info->size : 0)))
+        goto cleanup;
+
+    if (testWriteInput(inputvol->target.path, info->size, info->sparse) < 0)
+        goto cleanup;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    if (virStorageBackendCreateRaw(NULL, &pool, vol, inputvol, 0) < 0)
+        goto cleanup;
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    if (virTestGetDebug())
+        virFilePrintf(stderr, "\ncloned %llu MiB in %llu ms\n",
+                      info->size / (1024 * 1024), end - start);
+
+    if (stat(vol->target.path, &sb) < 0 ||
+        (unsigned long long) sb.st_size != info->size) {
+        virFilePrintf(stderr, "Clone has wrong size\n");
+        goto cleanup;
+    }
+
+    if (testCompareFiles(inputvol->target.path, vol->target.path,
+                         info->size) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    if (inputvol)
+        unlink(inputvol->target.path);
+    if (vol)
+        unlink(vol->target.path);
+    virStorageVolDefFree(inputvol);
+    virStorageVolDefFree(vol);
+    VIR_FREE(inputname);
+    return ret;
+}
+
+
+static int
+testCheckZero(int fd,
+              unsigned long long size)
+{
+    int ret = -1;
+    char *buf = NULL;
+    char *zero = NULL;
+    unsigned long long off;
+
+    if (VIR_ALLOC_N(buf, CHUNK_SIZE) < 0 ||
+        VIR_ALLOC_N(zero, CHUNK_SIZE) < 0)
+        goto cleanup;
+
+    if (lseek(fd, 0, SEEK_SET) < 0)
+        goto cleanup;
+
+    for (off = 0; off < size; off += CHUNK_SIZE) {
+        size_t len = MIN(CHUNK_SIZE, size - off);
+
+        if (saferead(fd, buf, len) != (ssize_t) len ||
+            memcmp(buf, zero, len) != 0) {
+            virFilePrintf(stderr, "Data left at offset %llu\n", off);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(buf);
+    VIR_FREE(zero);
+    return ret;
+}
+
+
+static int
+testZeroExtent(const void *opaque)
+{
+    const struct testCloneInfo *info = opaque;
+    int ret = -1;
+    int fd = -1;
+    int rc;
+    virStorageVolDefPtr vol = NULL;
+
+    if (!(vol = testVolNew(info->dir, info->name, info->size, info->size)))
+        goto cleanup;
+
+    if (testWriteInput(vol->target.path, info->size, false) < 0)
+        goto cleanup;
+
+    if ((fd = open(vol->target.path, O_RDWR)) < 0)
+        goto cleanup;
+
+    if ((rc = virStorageBackendZeroExtent(vol, fd, 0, info->size)) < 0)
+        goto cleanup;
+
+    /* Filesystem can't zero ranges itself, nothing more to check */
+    if (rc == 1) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (testCheckZero(fd, info->size) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    if (vol)
+        unlink(vol->target.path);
+    virStorageVolDefFree(vol);
+    return ret;
+}
+
+
+/* Whichever way the zeroes end up on disk, the volume must read back
+ * as zeroes and keep its size. */
+static int
+testWipeZero(const void *opaque)
+{
+    const struct testCloneInfo *info = opaque;
+    int ret = -1;
+    int fd = -1;
+    virStorageVolDefPtr vol = NULL;
+    struct stat sb;
+
+    if (!(vol = testVolNew(info->dir, info->name, info->size, info->size)))
+        goto cleanup;
+
+    if (testWriteInput(vol->target.path, info->size, false) < 0)
+        goto cleanup;
+
+    if ((fd = open(vol->target.path, O_RDWR)) < 0)
+        goto cleanup;
+
+    if (virStorageBackendWipeZero(vol, fd, info->size) < 0)
+        goto cleanup;
+
+    if (fstat(fd, &sb) < 0 ||
+        (unsigned long long) sb.st_size != info->size) {
+        virFilePrintf(stderr, "Wiped volume has wrong size\n");
+        goto cleanup;
+    }
+
+    if (testCheckZero(fd, info->size) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    if (vol)
+        unlink(vol->target.path);
+    virStorageVolDefFree(vol);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    int ret = 0;
+    unsigned long long size = 8ULL * CHUNK_SIZE;
+
+    if (!mkdtemp(scratchdir)) {
+        virFilePrintf(stderr, "Cannot create scratch dir");
+        abort();
+    }
+
+    /* Large enough to make the copy strategy visible in debug output */
+    if (virTestGetExpensive())
+        size = 512ULL * CHUNK_SIZE;
+
+#define DO_TEST(name, sparse, preallocate)                              \
+    do {                                                                \
+        struct testCloneInfo info = {                                   \
+            scratchdir, name, size, sparse, preallocate                 \
+        };                                                              \
+        if (virtTestRun("clone " name, testCloneRaw, &info) < 0)        \
+            ret = -1;                                                   \
+    } while (0)
+
+    DO_TEST("dense-sparse.img", false, false);
+    DO_TEST("dense-prealloc.img", false, true);
+    DO_TEST("holes-sparse.img", true, false);
+    DO_TEST("holes-prealloc.img", true, true);
+
+    {
+        struct testCloneInfo info = { scratchdir, "zero.img", size,
+                                      false, false };
+        if (virtTestRun("zero extent", testZeroExtent, &info) < 0)
+            ret = -1;
+    }
+
+    {
+        struct testCloneInfo info = { scratchdir, "wipe.img", size,
+                                      false, false };
+        if (virtTestRun("wipe zero", testWipeZero, &info) < 0)
+            ret = -1;
+    }
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
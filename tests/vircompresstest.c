@@ -0,0 +1,229 @@
+/*
+ * vircompresstest.c: test multithreaded chunked compression
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "internal.h"
+#include "testutils.h"
+#include "vircompress.h"
+#include "viralloc.h"
+#include "virfile.h"
+#include "virstring.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/vircompressdir-XXXXXX"
+
+struct testCompressInfo {
+    const char *dir;
+    const char *name;
+    size_t size;
+    size_t nworkers;
+    size_t chunkSize;
+};
+
+
+/* Half of every page compresses well, the other half doesn't, so that
+ * both kinds of chunks show up in the stream */
+static char *
+testMakeData(size_t size)
+{
+    char *data;
+    size_t i;
+
+    if (VIR_ALLOC_N(data, size) < 0)
+        return NULL;
+
+    srand(size);
+    for (i = 0; i < size; i++)
+        data[i] = (i % 4096 < 2048) ? i % 251 : rand();
+
+    return data;
+}
+
+
+static int
+testCompressFile(const char *inpath,
+                 const char *outpath,
+                 bool decompress,
+                 size_t nworkers,
+                 size_t chunkSize)
+{
+    int ret = -1;
+    int infd = -1;
+    int outfd = -1;
+    virCompressJobPtr job;
+
+    if ((infd = open(inpath, O_RDONLY)) < 0 ||
+        (outfd = open(outpath, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+        goto cleanup;
+
+    if (!(job = virCompressJobStart(infd, outfd, decompress,
+                                    nworkers, chunkSize)))
+        goto cleanup;
+
+    if (virCompressJobFinish(job) < 0)
+        goto cleanup;
+
+    if (VIR_CLOSE(outfd) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(infd);
+    VIR_FORCE_CLOSE(outfd);
+    return ret;
+}
+
+
+static int
+testCompressRoundTrip(const void *opaque)
+{
+    const struct testCompressInfo *info = opaque;
+    int ret = -1;
+    char *data = NULL;
+    char *result = NULL;
+    char *inpath = NULL;
+    char *zpath = NULL;
+    char *outpath = NULL;
+    unsigned long long start;
+    unsigned long long end;
+    struct stat sb;
+    int fd = -1;
+    int len;
+
+    if (virAsprintf(&inpath, "%s/%s", info->dir, info->name) < 0 ||
+        virAsprintf(&zpath, "%s/%s.z", info->dir, info->name) < 0 ||
+        virAsprintf(&outpath, "%s/%s.out", info->dir, info->name) < 0)
+        goto cleanup;
+
+    if (!(data = testMakeData(info->size)))
+        goto cleanup;
+
+    if ((fd = open(inpath, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0 ||
+        safewrite(fd, data, info->size) != (ssize_t) info->size ||
+        VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    if (testCompressFile(inpath, zpath, false, info->nworkers,
+                         info->chunkSize) < 0)
+        goto cleanup;
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    if (virTestGetDebug())
+        virFilePrintf(stderr,
+                      "\ncompressed %zu kB with %zu threads in %llu ms\n",
+                      info->size / 1024, info->nworkers, end - start);
+
+    if (testCompressFile(zpath, outpath, true, info->nworkers,
+                         info->chunkSize) < 0)
+        goto cleanup;
+
+    if ((len = virFileReadAll(outpath, info->size + 1, &result)) < 0)
+        goto cleanup;
+
+    if ((size_t) len != info->size ||
+        memcmp(data, result, info->size) != 0) {
+        virFilePrintf(stderr, "Decompressed data doesn't match input\n");
+        goto cleanup;
+    }
+
+    /* Chop the stream in the middle of a frame, decompression must
+     * notice instead of silently producing a short result */
+    if (stat(zpath, &sb) < 0 ||
+        truncate(zpath, sb.st_size / 2) < 0)
+        goto cleanup;
+
+    if (testCompressFile(zpath, outpath, true, info->nworkers,
+                         info->chunkSize) == 0) {
+        virFilePrintf(stderr, "Truncated stream was accepted\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    if (inpath)
+        unlink(inpath);
+    if (zpath)
+        unlink(zpath);
+    if (outpath)
+        unlink(outpath);
+    VIR_FREE(inpath);
+    VIR_FREE(zpath);
+    VIR_FREE(outpath);
+    VIR_FREE(data);
+    VIR_FREE(result);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    int ret = 0;
+    size_t size = 4 * 1024 * 1024 + 12345;
+
+    if (!virCompressAvailable())
+        return EXIT_AM_SKIP;
+
+    if (!mkdtemp(scratchdir)) {
+        virFilePrintf(stderr, "Cannot create scratch dir");
+        abort();
+    }
+
+    if (virTestGetExpensive())
+        size = 256 * 1024 * 1024 + 12345;
+
+#define DO_TEST(name, nworkers, chunkSize)                              \
+    do {                                                                \
+        struct testCompressInfo info = {                                \
+            scratchdir, name, size, nworkers, chunkSize                 \
+        };                                                              \
+        if (virtTestRun("round trip " name, testCompressRoundTrip,     \
+                        &info) < 0)                                     \
+            ret = -1;                                                   \
+    } while (0)
+
+    DO_TEST("single", 1, 1024 * 1024);
+    DO_TEST("parallel", 8, 1024 * 1024);
+    DO_TEST("small-chunks", 4, 4096);
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
@@ -21,6 +21,7 @@
 #include <config.h>
 
 #include <stdlib.h>
+#include <unistd.h>
 
 #if WITH_SELINUX
 # include <selinux/selinux.h>
@@ -32,6 +33,9 @@
 #include "virerror.h"
 #include "viralloc.h"
 #include "virlog.h"
+#include "virstring.h"
+#include "virtime.h"
+#include "virutil.h"
 
 #include "virlockspace.h"
 
@@ -164,6 +168,226 @@ static int testIdentityEqual(const void *data ATTRIBUTE_UNUSED)
     return ret;
 }
 
+static int
+testIdentityCountingResolver(virIdentityPtr ident ATTRIBUTE_UNUSED,
+                             unsigned int attr,
+                             char **value,
+                             void *opaque)
+{
+    size_t *calls = opaque;
+
+    (*calls)++;
+    *value = NULL;
+    if (attr == VIR_IDENTITY_ATTR_SELINUX_CONTEXT)
+        return VIR_STRDUP(*value, "system_u:system_r:virtd_t:s0");
+    return 0;
+}
+
+
+/* Attributes are resolved on first use, and only once */
+static int testIdentityResolve(const void *data ATTRIBUTE_UNUSED)
+{
+    int ret = -1;
+    virIdentityPtr ident;
+    size_t calls = 0;
+    const char *val;
+
+    if (!(ident = virIdentityNew()))
+        goto cleanup;
+
+    virIdentitySetResolver(ident, testIdentityCountingResolver, &calls, NULL);
+
+    if (virIdentitySetAttr(ident,
+                           VIR_IDENTITY_ATTR_UNIX_USER_NAME,
+                           "fred") < 0)
+        goto cleanup;
+
+    if (virIdentityGetAttr(ident,
+                           VIR_IDENTITY_ATTR_UNIX_USER_NAME,
+                           &val) < 0)
+        goto cleanup;
+
+    if (calls != 0 || STRNEQ_NULLABLE(val, "fred")) {
+        VIR_DEBUG("Set attribute was resolved");
+        goto cleanup;
+    }
+
+    if (virIdentityGetAttr(ident,
+                           VIR_IDENTITY_ATTR_SELINUX_CONTEXT,
+                           &val) < 0 ||
+        virIdentityGetAttr(ident,
+                           VIR_IDENTITY_ATTR_SELINUX_CONTEXT,
+                           &val) < 0)
+        goto cleanup;
+
+    if (calls != 1 ||
+        STRNEQ_NULLABLE(val, "system_u:system_r:virtd_t:s0")) {
+        VIR_DEBUG("Expected one lookup of the context, got %zu giving '%s'",
+                  calls, NULLSTR(val));
+        goto cleanup;
+    }
+
+    /* An attribute with no value is not looked up again either */
+    if (virIdentityGetAttr(ident,
+                           VIR_IDENTITY_ATTR_SASL_USER_NAME,
+                           &val) < 0 ||
+        virIdentityGetAttr(ident,
+                           VIR_IDENTITY_ATTR_SASL_USER_NAME,
+                           &val) < 0)
+        goto cleanup;
+
+    if (calls != 2 || val != NULL) {
+        VIR_DEBUG("Expected one lookup of the SASL name, got %zu",
+                  calls - 1);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(ident);
+    return ret;
+}
+
+
+static virIdentityPtr
+testIdentityNewUnix(uid_t uid, gid_t gid)
+{
+    virIdentityPtr ident = NULL;
+    char *userid = NULL;
+    char *groupid = NULL;
+
+    if (virAsprintf(&userid, "%d", (int)uid) < 0 ||
+        virAsprintf(&groupid, "%d", (int)gid) < 0)
+        goto error;
+
+    if (!(ident = virIdentityNew()))
+        goto error;
+
+    virIdentitySetResolver(ident, virIdentityResolveUnixName, NULL, NULL);
+
+    if (virIdentitySetAttr(ident,
+                           VIR_IDENTITY_ATTR_UNIX_USER_ID,
+                           userid) < 0 ||
+        virIdentitySetAttr(ident,
+                           VIR_IDENTITY_ATTR_UNIX_GROUP_ID,
+                           groupid) < 0)
+        goto error;
+
+    VIR_FREE(userid);
+    VIR_FREE(groupid);
+    return ident;
+
+ error:
+    virObjectUnref(ident);
+    VIR_FREE(userid);
+    VIR_FREE(groupid);
+    return NULL;
+}
+
+
+static int testIdentityUnixName(const void *data ATTRIBUTE_UNUSED)
+{
+    int ret = -1;
+    virIdentityPtr ident = NULL;
+    char *username = NULL;
+    char *groupname = NULL;
+    const char *val;
+
+    if (!(username = virGetUserName(getuid())) ||
+        !(groupname = virGetGroupName(getgid())))
+        goto cleanup;
+
+    if (!(ident = testIdentityNewUnix(getuid(), getgid())))
+        goto cleanup;
+
+    if (virIdentityGetAttr(ident,
+                           VIR_IDENTITY_ATTR_UNIX_USER_NAME,
+                           &val) < 0)
+        goto cleanup;
+
+    if (STRNEQ_NULLABLE(val, username)) {
+        VIR_DEBUG("Expected '%s' got '%s'", username, NULLSTR(val));
+        goto cleanup;
+    }
+
+    if (virIdentityGetAttr(ident,
+                           VIR_IDENTITY_ATTR_UNIX_GROUP_NAME,
+                           &val) < 0)
+        goto cleanup;
+
+    if (STRNEQ_NULLABLE(val, groupname)) {
+        VIR_DEBUG("Expected '%s' got '%s'", groupname, NULLSTR(val));
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(ident);
+    VIR_FREE(username);
+    VIR_FREE(groupname);
+    return ret;
+}
+
+
+/* What a daemon does for each new local client: build the identity,
+ * and look at the attributes the access check wants */
+static int testIdentitySetupLatency(const void *data ATTRIBUTE_UNUSED)
+{
+    int ret = -1;
+    virIdentityPtr ident = NULL;
+    unsigned long long start;
+    unsigned long long built;
+    unsigned long long named;
+    const char *val;
+    size_t nclients = 1000;
+    size_t i;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nclients; i++) {
+        if (!(ident = testIdentityNewUnix(getuid(), getgid())) ||
+            virIdentityGetAttr(ident,
+                               VIR_IDENTITY_ATTR_UNIX_USER_ID,
+                               &val) < 0)
+            goto cleanup;
+        virObjectUnref(ident);
+        ident = NULL;
+    }
+
+    if (virTimeMillisNow(&built) < 0)
+        goto cleanup;
+
+    /* With the names wanted too, only the first client pays for
+     * the lookup */
+    for (i = 0; i < nclients; i++) {
+        if (!(ident = testIdentityNewUnix(getuid(), getgid())) ||
+            virIdentityGetAttr(ident,
+                               VIR_IDENTITY_ATTR_UNIX_USER_NAME,
+                               &val) < 0 ||
+            virIdentityGetAttr(ident,
+                               VIR_IDENTITY_ATTR_UNIX_GROUP_NAME,
+                               &val) < 0)
+            goto cleanup;
+        virObjectUnref(ident);
+        ident = NULL;
+    }
+
+    if (virTimeMillisNow(&named) < 0)
+        goto cleanup;
+
+    if (virTestGetDebug())
+        fprintf(stderr, "\n%zu clients: %llu ms without names, "
+                "%llu ms with names\n",
+                nclients, built - start, named - built);
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(ident);
+    return ret;
+}
+
+
 static int testIdentityGetSystem(const void *data)
 {
     const char *context = data;
@@ -230,6 +454,12 @@ mymain(void)
         ret = -1;
     if (virtTestRun("Identity equality ", testIdentityEqual, NULL) < 0)
         ret = -1;
+    if (virtTestRun("Identity resolver ", testIdentityResolve, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Identity UNIX names ", testIdentityUnixName, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Identity setup latency ", testIdentitySetupLatency, NULL) < 0)
+        ret = -1;
     if (virtTestRun("Setting fake SELinux context ", testSetFakeSELinuxContext, context) < 0)
         ret = -1;
     if (virtTestRun("System identity (fake SELinux enabled) ", testIdentityGetSystem, context) < 0)
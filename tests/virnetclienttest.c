@@ -0,0 +1,524 @@
+/*
+ * virnetclienttest.c: test asynchronous calls of the RPC client
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "testutils.h"
+#include "viralloc.h"
+#include "viratomic.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "rpc/virnetclient.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+#ifndef WIN32
+
+# define TEST_PROGRAM 0x11223344
+# define TEST_VERSION 1
+# define TEST_PROC 1
+
+static char *sockpath;
+static int eventQuit;
+
+struct testAsyncResult {
+    int done;
+    int status;
+    unsigned int value;
+};
+
+struct testSyncData {
+    virNetClientPtr client;
+    int done;
+    int ret;
+    unsigned int value;
+};
+
+
+static virNetMessagePtr
+testMessageNew(int type,
+               unsigned int serial,
+               unsigned int value)
+{
+    virNetMessagePtr msg;
+
+    if (!(msg = virNetMessageNew(false)))
+        return NULL;
+
+    msg->header.prog = TEST_PROGRAM;
+    msg->header.vers = TEST_VERSION;
+    msg->header.proc = TEST_PROC;
+    msg->header.type = type;
+    msg->header.serial = serial;
+    msg->header.status = VIR_NET_OK;
+
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayload(msg, (xdrproc_t)xdr_u_int, &value) < 0) {
+        virNetMessageFree(msg);
+        return NULL;
+    }
+
+    return msg;
+}
+
+
+/* Plays the server: reads the next call off @fd */
+static int
+testServerRecv(int fd,
+               unsigned int *serial,
+               unsigned int *value)
+{
+    virNetMessagePtr msg;
+    int ret = -1;
+
+    if (!(msg = virNetMessageNew(false)))
+        return -1;
+
+    msg->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
+    if (VIR_ALLOC_N(msg->buffer, msg->bufferLength) < 0)
+        goto cleanup;
+
+    if (saferead(fd, msg->buffer, VIR_NET_MESSAGE_LEN_MAX) !=
+        VIR_NET_MESSAGE_LEN_MAX ||
+        virNetMessageDecodeLength(msg) < 0 ||
+        saferead(fd, msg->buffer + VIR_NET_MESSAGE_LEN_MAX,
+                 msg->bufferLength - VIR_NET_MESSAGE_LEN_MAX) !=
+        msg->bufferLength - VIR_NET_MESSAGE_LEN_MAX ||
+        virNetMessageDecodeHeader(msg) < 0 ||
+        virNetMessageDecodePayload(msg, (xdrproc_t)xdr_u_int, value) < 0) {
+        fprintf(stderr, "Server failed to read a call\n");
+        goto cleanup;
+    }
+
+    *serial = msg->header.serial;
+    ret = 0;
+
+ cleanup:
+    virNetMessageFree(msg);
+    return ret;
+}
+
+
+static int
+testServerReply(int fd,
+                unsigned int serial,
+                unsigned int value)
+{
+    virNetMessagePtr msg;
+    int ret = -1;
+
+    if (!(msg = testMessageNew(VIR_NET_REPLY, serial, value)))
+        return -1;
+
+    if (safewrite(fd, msg->buffer, msg->bufferLength) != msg->bufferLength) {
+        fprintf(stderr, "Server failed to send a reply\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    return ret;
+}
+
+
+static int
+testConnect(virNetClientPtr *client,
+            int *serverfd)
+{
+    struct sockaddr_un addr;
+    int listenfd = -1;
+    int ret = -1;
+
+    *client = NULL;
+    *serverfd = -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (virStrcpyStatic(addr.sun_path, sockpath) == NULL)
+        goto cleanup;
+
+    unlink(sockpath);
+    if ((listenfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        bind(listenfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listenfd, 1) < 0) {
+        virReportSystemError(errno, "%s", "Cannot listen for the client");
+        goto cleanup;
+    }
+
+    if (!(*client = virNetClientNewUNIX(sockpath, false, NULL)))
+        goto cleanup;
+
+    if ((*serverfd = accept(listenfd, NULL, NULL)) < 0) {
+        virReportSystemError(errno, "%s", "Cannot accept the client");
+        goto cleanup;
+    }
+
+    if (virNetClientRegisterAsyncIO(*client) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    if (ret < 0) {
+        virObjectUnref(*client);
+        *client = NULL;
+        VIR_FORCE_CLOSE(*serverfd);
+    }
+    VIR_FORCE_CLOSE(listenfd);
+    return ret;
+}
+
+
+static void
+testAsyncReply(virNetClientPtr client ATTRIBUTE_UNUSED,
+               virNetMessagePtr msg,
+               int status,
+               void *opaque)
+{
+    struct testAsyncResult *res = opaque;
+
+    res->status = status;
+    if (status == 0 &&
+        virNetMessageDecodePayload(msg, (xdrproc_t)xdr_u_int,
+                                   &res->value) < 0)
+        res->status = -2;
+
+    virAtomicIntSet(&res->done, 1);
+}
+
+
+static int
+testAsyncSend(virNetClientPtr client,
+              unsigned int serial,
+              unsigned int value,
+              struct testAsyncResult *res)
+{
+    virNetMessagePtr msg;
+
+    if (!(msg = testMessageNew(VIR_NET_CALL, serial, value)))
+        return -1;
+
+    if (virNetClientSendAsync(client, msg, testAsyncReply, res) < 0) {
+        virNetMessageFree(msg);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Callbacks run from the event loop thread */
+static bool
+testAsyncWait(struct testAsyncResult *res)
+{
+    size_t i;
+
+    for (i = 0; i < 500 && !virAtomicIntGet(&res->done); i++)
+        usleep(10 * 1000);
+
+    return virAtomicIntGet(&res->done);
+}
+
+
+/* Replies may come in any order */
+static int
+testAsyncCompletion(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNetClientPtr client = NULL;
+    struct testAsyncResult res[3];
+    int fd = -1;
+    unsigned int serial;
+    unsigned int value;
+    size_t i;
+    int ret = -1;
+
+    memset(res, 0, sizeof(res));
+
+    if (testConnect(&client, &fd) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ARRAY_CARDINALITY(res); i++) {
+        if (testAsyncSend(client, i + 1, (i + 1) * 10, &res[i]) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(res); i++) {
+        if (testServerRecv(fd, &serial, &value) < 0)
+            goto cleanup;
+        if (serial != i + 1 || value != (i + 1) * 10) {
+            fprintf(stderr, "Call %zu arrived as %u with %u\n",
+                    i + 1, serial, value);
+            goto cleanup;
+        }
+    }
+
+    for (i = ARRAY_CARDINALITY(res); i > 0; i--) {
+        if (testServerReply(fd, i, i * 100) < 0 ||
+            !testAsyncWait(&res[i - 1]))
+            goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(res); i++) {
+        if (res[i].status != 0 || res[i].value != (i + 1) * 100) {
+            fprintf(stderr, "Call %zu completed with %d and %u\n",
+                    i + 1, res[i].status, res[i].value);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    if (client)
+        virNetClientClose(client);
+    virObjectUnref(client);
+    VIR_FORCE_CLOSE(fd);
+    return ret;
+}
+
+
+static void
+testSyncCall(void *opaque)
+{
+    struct testSyncData *data = opaque;
+    virNetMessagePtr msg;
+
+    data->ret = -1;
+    if ((msg = testMessageNew(VIR_NET_CALL, 1, 5))) {
+        if (virNetClientSendWithReply(data->client, msg) == 0 &&
+            virNetMessageDecodePayload(msg, (xdrproc_t)xdr_u_int,
+                                       &data->value) == 0)
+            data->ret = 0;
+        virNetMessageFree(msg);
+    }
+    virAtomicIntSet(&data->done, 1);
+}
+
+
+/* An asynchronous reply read by a thread waiting for its own reply is
+ * handed over to the event loop */
+static int
+testAsyncWithSync(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNetClientPtr client = NULL;
+    struct testAsyncResult res;
+    struct testSyncData data;
+    virThread thread;
+    bool haveThread = false;
+    int fd = -1;
+    unsigned int serial;
+    unsigned int value;
+    int ret = -1;
+
+    memset(&res, 0, sizeof(res));
+    memset(&data, 0, sizeof(data));
+
+    if (testConnect(&client, &fd) < 0)
+        goto cleanup;
+
+    data.client = client;
+    if (virThreadCreate(&thread, true, testSyncCall, &data) < 0)
+        goto cleanup;
+    haveThread = true;
+
+    /* Once its call arrived, the thread holds the buck until it gets
+     * the reply */
+    if (testServerRecv(fd, &serial, &value) < 0)
+        goto cleanup;
+    if (serial != 1) {
+        fprintf(stderr, "Expected the synchronous call, got %u\n", serial);
+        goto cleanup;
+    }
+
+    if (testAsyncSend(client, 2, 7, &res) < 0 ||
+        testServerRecv(fd, &serial, &value) < 0)
+        goto cleanup;
+    if (serial != 2) {
+        fprintf(stderr, "Expected the asynchronous call, got %u\n", serial);
+        goto cleanup;
+    }
+
+    if (testServerReply(fd, 2, 14) < 0 ||
+        !testAsyncWait(&res))
+        goto cleanup;
+
+    if (res.status != 0 || res.value != 14) {
+        fprintf(stderr, "Asynchronous call completed with %d and %u\n",
+                res.status, res.value);
+        goto cleanup;
+    }
+
+    if (virAtomicIntGet(&data.done)) {
+        fprintf(stderr, "Synchronous call completed without a reply\n");
+        goto cleanup;
+    }
+
+    if (testServerReply(fd, 1, 10) < 0)
+        goto cleanup;
+    virThreadJoin(&thread);
+    haveThread = false;
+
+    if (data.ret != 0 || data.value != 10) {
+        fprintf(stderr, "Synchronous call completed with %d and %u\n",
+                data.ret, data.value);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (client)
+        virNetClientClose(client);
+    if (haveThread)
+        virThreadJoin(&thread);
+    virObjectUnref(client);
+    VIR_FORCE_CLOSE(fd);
+    return ret;
+}
+
+
+/* Closing fails outstanding calls, and nothing keeps the client
+ * around afterwards */
+static int
+testAsyncClose(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNetClientPtr client = NULL;
+    struct testAsyncResult res;
+    struct testAsyncResult late;
+    int fd = -1;
+    unsigned int serial;
+    unsigned int value;
+    int ret = -1;
+
+    memset(&res, 0, sizeof(res));
+    memset(&late, 0, sizeof(late));
+
+    if (testConnect(&client, &fd) < 0)
+        goto cleanup;
+
+    if (testAsyncSend(client, 1, 1, &res) < 0 ||
+        testServerRecv(fd, &serial, &value) < 0)
+        goto cleanup;
+
+    virNetClientClose(client);
+
+    if (!testAsyncWait(&res) || res.status != -1) {
+        fprintf(stderr, "Outstanding call was not failed on close\n");
+        goto cleanup;
+    }
+
+    if (testAsyncSend(client, 2, 2, &late) == 0) {
+        fprintf(stderr, "Call on a closed client was accepted\n");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    /* Give the event loop time to drop its references */
+    usleep(500 * 1000);
+
+    if (virObjectUnref(client)) {
+        fprintf(stderr, "Closed client is still referenced\n");
+        client = NULL;
+        goto cleanup;
+    }
+    client = NULL;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(client);
+    VIR_FORCE_CLOSE(fd);
+    return ret;
+}
+
+
+static void
+testEventLoop(void *opaque ATTRIBUTE_UNUSED)
+{
+    while (!virAtomicIntGet(&eventQuit)) {
+        if (virEventRunDefaultImpl() < 0)
+            break;
+    }
+}
+
+
+static void
+testEventTick(int timer ATTRIBUTE_UNUSED,
+              void *opaque ATTRIBUTE_UNUSED)
+{
+}
+
+
+static int
+mymain(void)
+{
+    char scratchdir[] = abs_builddir "/virnetclientdir-XXXXXX";
+    virThread eventThread;
+    int timer = -1;
+    int ret = 0;
+
+    if (!mkdtemp(scratchdir)) {
+        fprintf(stderr, "Cannot create scratch dir");
+        abort();
+    }
+
+    if (virAsprintf(&sockpath, "%s/sock", scratchdir) < 0 ||
+        virEventRegisterDefaultImpl() < 0 ||
+        (timer = virEventAddTimeout(100, testEventTick, NULL, NULL)) < 0 ||
+        virThreadCreate(&eventThread, true, testEventLoop, NULL) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (virtTestRun("Async completion", testAsyncCompletion, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Async with sync caller", testAsyncWithSync, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Async close", testAsyncClose, NULL) < 0)
+        ret = -1;
+
+    virAtomicIntSet(&eventQuit, 1);
+    virThreadJoin(&eventThread);
+
+ cleanup:
+    if (timer >= 0)
+        virEventRemoveTimeout(timer);
+    VIR_FREE(sockpath);
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
+
+#else /* WIN32 */
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* WIN32 */
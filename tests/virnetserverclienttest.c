@@ -137,6 +137,88 @@ static int testIdentity(const void *opaque ATTRIBUTE_UNUSED)
 }
 
 
+static int testEventLimit(const void *opaque ATTRIBUTE_UNUSED)
+{
+    int sv[2];
+    int ret = -1;
+    virNetSocketPtr sock = NULL;
+    virNetServerClientPtr client = NULL;
+    virNetMessagePtr msg = NULL;
+    size_t nevents;
+    size_t nevents_peak;
+    unsigned long long nevents_dropped;
+    size_t i;
+
+    if (socketpair(PF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        virReportSystemError(errno, "%s",
+                             "Cannot create socket pair");
+        return -1;
+    }
+
+    if (virNetSocketNewConnectSockFD(sv[0], &sock) < 0) {
+        virDispatchError(NULL);
+        goto cleanup;
+    }
+    sv[0] = -1;
+
+    if (!(client = virNetServerClientNew(sock, 0, false, 1,
+# ifdef WITH_GNUTLS
+                                         NULL,
+# endif
+                                         NULL, NULL, NULL, NULL))) {
+        virDispatchError(NULL);
+        goto cleanup;
+    }
+
+    virNetServerClientSetMaxEvents(client, 2);
+
+    /* Nothing reads the other end, so the third event must be dropped
+     * and the client closed, after which nothing more is queued */
+    for (i = 0; i < 4; i++) {
+        if (!(msg = virNetMessageNew(false)))
+            goto cleanup;
+        msg->header.type = VIR_NET_MESSAGE;
+
+        if (virNetServerClientSendEvent(client, msg) < 0) {
+            if (i < 2) {
+                fprintf(stderr, "Event %zu was not queued\n", i);
+                goto cleanup;
+            }
+            virNetMessageFree(msg);
+        } else if (i >= 2) {
+            fprintf(stderr, "Event beyond the limit was queued\n");
+            goto cleanup;
+        }
+        msg = NULL;
+
+        if (virNetServerClientWantClose(client) != (i >= 2)) {
+            fprintf(stderr, "Client %s closed after event %zu\n",
+                    i >= 2 ? "not" : "wrongly", i);
+            goto cleanup;
+        }
+    }
+
+    virNetServerClientGetEventStats(client, &nevents, &nevents_peak,
+                                    &nevents_dropped);
+    if (nevents != 2 || nevents_peak != 2 || nevents_dropped != 1) {
+        fprintf(stderr, "Want 2/2/1 queued/peak/dropped events, got %zu/%zu/%llu\n",
+                nevents, nevents_peak, nevents_dropped);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (client)
+        virNetServerClientClose(client);
+    virNetMessageFree(msg);
+    virObjectUnref(sock);
+    virObjectUnref(client);
+    VIR_FORCE_CLOSE(sv[0]);
+    VIR_FORCE_CLOSE(sv[1]);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -146,6 +228,9 @@ mymain(void)
     if (virtTestRun("Identity",
                     testIdentity, NULL) < 0)
         ret = -1;
+    if (virtTestRun("Event limit",
+                    testEventLimit, NULL) < 0)
+        ret = -1;
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virerror.h"
+#include "virobject.h"
+#include "rpc/virnetserverquota.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+
+static int
+testQuotaCheckStats(virNetServerQuotaPtr quota,
+                    const char *identity,
+                    size_t calls,
+                    unsigned long long admitted,
+                    unsigned long long throttled_calls,
+                    unsigned long long throttled_rate)
+{
+    virNetServerQuotaStats stats;
+
+    virNetServerQuotaGetStats(quota, identity, &stats);
+
+    if (stats.calls != calls ||
+        stats.admitted != admitted ||
+        stats.throttled_calls != throttled_calls ||
+        stats.throttled_rate != throttled_rate) {
+        fprintf(stderr,
+                "Stats of '%s': calls %zu admitted %llu throttled %llu/%llu, "
+                "expected %zu %llu %llu/%llu\n",
+                identity ? identity : "all", stats.calls, stats.admitted,
+                stats.throttled_calls, stats.throttled_rate,
+                calls, admitted, throttled_calls, throttled_rate);
+        return -1;
+    }
+    return 0;
+}
+
+
+static int testQuotaConcurrency(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNetServerQuotaPtr quota;
+    size_t i;
+    int ret = -1;
+
+    if (!(quota = virNetServerQuotaNew(3, 0, 0)))
+        return -1;
+
+    for (i = 0; i < 3; i++) {
+        if (virNetServerQuotaAcquire(quota, "uid:1000", 1) < 0)
+            goto cleanup;
+    }
+
+    if (virNetServerQuotaAcquire(quota, "uid:1000", 1) == 0) {
+        fprintf(stderr, "Call beyond the limit was admitted\n");
+        goto cleanup;
+    }
+
+    /* Others are not affected */
+    if (virNetServerQuotaAcquire(quota, "uid:1001", 1) < 0)
+        goto cleanup;
+
+    virNetServerQuotaRelease(quota, "uid:1000", 1);
+    if (virNetServerQuotaAcquire(quota, "uid:1000", 1) < 0)
+        goto cleanup;
+
+    if (testQuotaCheckStats(quota, "uid:1000", 3, 4, 1, 0) < 0 ||
+        testQuotaCheckStats(quota, "uid:1001", 1, 1, 0, 0) < 0 ||
+        testQuotaCheckStats(quota, NULL, 4, 5, 1, 0) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(quota);
+    virResetLastError();
+    return ret;
+}
+
+
+static int testQuotaCost(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNetServerQuotaPtr quota;
+    const char *bad[] = { "remote:domain_create", "domain_create:4",
+                          ":domain_create:4", "remote::4",
+                          "remote:domain_create:",
+                          "remote:domain_create:many",
+                          "remote:domain_create:-1" };
+    size_t i;
+    int ret = -1;
+
+    if (!(quota = virNetServerQuotaNew(5, 0, 0)))
+        return -1;
+
+    if (virNetServerQuotaParseCost(quota, "remote:domain_migrate_perform3:10") < 0 ||
+        virNetServerQuotaParseCost(quota, "remote:connect_list_all_domains:0") < 0 ||
+        virNetServerQuotaSetCost(quota, "remote:domain_save", 3) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ARRAY_CARDINALITY(bad); i++) {
+        if (virNetServerQuotaParseCost(quota, bad[i]) == 0) {
+            fprintf(stderr, "Cost '%s' was accepted\n", bad[i]);
+            goto cleanup;
+        }
+    }
+
+    if (virNetServerQuotaGetCost(quota, "remote:domain_migrate_perform3") != 10 ||
+        virNetServerQuotaGetCost(quota, "remote:connect_list_all_domains") != 0 ||
+        virNetServerQuotaGetCost(quota, "remote:domain_save") != 3 ||
+        virNetServerQuotaGetCost(quota, "remote:domain_create") != 1 ||
+        virNetServerQuotaGetCost(quota, "qemu:domain_save") != 1 ||
+        virNetServerQuotaGetCost(quota, NULL) != 1) {
+        fprintf(stderr, "Unexpected procedure cost\n");
+        goto cleanup;
+    }
+
+    /* Too expensive for the limit, but nothing else is running */
+    if (virNetServerQuotaAcquire(quota, "sasl:joe", 10) < 0)
+        goto cleanup;
+    if (virNetServerQuotaAcquire(quota, "sasl:joe", 1) == 0) {
+        fprintf(stderr, "Call next to an expensive one was admitted\n");
+        goto cleanup;
+    }
+
+    /* Free calls never count */
+    for (i = 0; i < 10; i++) {
+        if (virNetServerQuotaAcquire(quota, "sasl:joe", 0) < 0)
+            goto cleanup;
+    }
+
+    virNetServerQuotaRelease(quota, "sasl:joe", 10);
+    if (virNetServerQuotaAcquire(quota, "sasl:joe", 3) < 0 ||
+        virNetServerQuotaAcquire(quota, "sasl:joe", 1) < 0 ||
+        virNetServerQuotaAcquire(quota, "sasl:joe", 1) < 0)
+        goto cleanup;
+    if (virNetServerQuotaAcquire(quota, "sasl:joe", 1) == 0) {
+        fprintf(stderr, "Call beyond the limit was admitted\n");
+        goto cleanup;
+    }
+
+    if (testQuotaCheckStats(quota, "sasl:joe", 5, 4, 2, 0) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(quota);
+    virResetLastError();
+    return ret;
+}
+
+
+static int testQuotaRate(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNetServerQuotaPtr quota;
+    size_t i;
+    int ret = -1;
+
+    /* One call per second after a burst of three; the test is done
+     * long before the bucket gains a whole token */
+    if (!(quota = virNetServerQuotaNew(0, 1, 3)))
+        return -1;
+
+    for (i = 0; i < 3; i++) {
+        if (virNetServerQuotaAcquire(quota, "x509:CN=tenant", 1) < 0)
+            goto cleanup;
+        virNetServerQuotaRelease(quota, "x509:CN=tenant", 1);
+    }
+
+    if (virNetServerQuotaAcquire(quota, "x509:CN=tenant", 1) == 0) {
+        fprintf(stderr, "Call beyond the rate was admitted\n");
+        goto cleanup;
+    }
+
+    if (virNetServerQuotaAcquire(quota, "x509:CN=other", 1) < 0)
+        goto cleanup;
+    virNetServerQuotaRelease(quota, "x509:CN=other", 1);
+
+    if (testQuotaCheckStats(quota, "x509:CN=tenant", 0, 3, 0, 1) < 0 ||
+        testQuotaCheckStats(quota, NULL, 0, 4, 0, 1) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(quota);
+    virResetLastError();
+    return ret;
+}
+
+
+/* Identities with nothing left to track are dropped, their totals
+ * survive */
+static int testQuotaIdle(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNetServerQuotaPtr quota;
+    int ret = -1;
+
+    if (!(quota = virNetServerQuotaNew(1, 0, 0)))
+        return -1;
+
+    if (virNetServerQuotaAcquire(quota, "uid:1000", 1) < 0 ||
+        virNetServerQuotaAcquire(quota, "uid:1001", 1) < 0)
+        goto cleanup;
+    virNetServerQuotaRelease(quota, "uid:1000", 1);
+
+    if (virNetServerQuotaAcquire(quota, "uid:1002", 1) < 0)
+        goto cleanup;
+
+    if (testQuotaCheckStats(quota, "uid:1000", 0, 0, 0, 0) < 0 ||
+        testQuotaCheckStats(quota, "uid:1001", 1, 1, 0, 0) < 0 ||
+        testQuotaCheckStats(quota, NULL, 2, 3, 0, 0) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(quota);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virtTestRun("Concurrency", testQuotaConcurrency, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Cost", testQuotaCost, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Rate", testQuotaRate, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Idle", testQuotaIdle, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virerror.h"
+#include "rpc/virnetserver.h"
+
+#define __VIR_NET_SERVER_PRIV_H_ALLOW__
+#include "rpc/virnetserverpriv.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+#ifdef HAVE_SOCKETPAIR
+
+# define TEST_PROGRAM 0x11223344
+# define TEST_VERSION 1
+
+enum {
+    TEST_PROC_CHEAP = 1,
+    TEST_PROC_EXPENSIVE = 2,
+    TEST_PROC_FREE = 3,
+};
+
+static size_t testCalls;
+static virNetServerQuotaPtr testQuota;
+static size_t testRunningCost;
+
+static int
+testDispatch(virNetServerPtr server ATTRIBUTE_UNUSED,
+             virNetServerClientPtr client ATTRIBUTE_UNUSED,
+             virNetMessagePtr msg ATTRIBUTE_UNUSED,
+             virNetMessageErrorPtr rerr ATTRIBUTE_UNUSED,
+             void *args ATTRIBUTE_UNUSED,
+             void *ret ATTRIBUTE_UNUSED)
+{
+    virNetServerQuotaStats stats;
+
+    /* What the call counts against the quota while it runs */
+    virNetServerQuotaGetStats(testQuota, "uid:666", &stats);
+    testRunningCost = stats.calls;
+    testCalls++;
+    return 0;
+}
+
+static virNetServerProgramProc testProcs[] = {
+    { NULL, 0, (xdrproc_t)xdr_void, 0, (xdrproc_t)xdr_void, true, 0, NULL },
+    { testDispatch, 0, (xdrproc_t)xdr_void, 0, (xdrproc_t)xdr_void,
+      true, 0, "test:cheap" },
+    { testDispatch, 0, (xdrproc_t)xdr_void, 0, (xdrproc_t)xdr_void,
+      true, 0, "test:expensive" },
+    { testDispatch, 0, (xdrproc_t)xdr_void, 0, (xdrproc_t)xdr_void,
+      true, 0, "test:free" },
+};
+
+
+static virNetServerClientPtr
+testClientNew(int auth)
+{
+    int sv[2];
+    virNetSocketPtr sock = NULL;
+    virNetServerClientPtr client = NULL;
+
+    if (socketpair(PF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        virReportSystemError(errno, "%s",
+                             "Cannot create socket pair");
+        return NULL;
+    }
+
+    /* Replies are only queued, nothing needs to read the other end */
+    VIR_FORCE_CLOSE(sv[1]);
+
+    if (virNetSocketNewConnectSockFD(sv[0], &sock) < 0) {
+        VIR_FORCE_CLOSE(sv[0]);
+        return NULL;
+    }
+
+    client = virNetServerClientNew(sock, auth, false, 10,
+# ifdef WITH_GNUTLS
+                                   NULL,
+# endif
+                                   NULL, NULL, NULL, NULL);
+    virObjectUnref(sock);
+    return client;
+}
+
+
+/*
+ * Send a call of @proc from @client through the server dispatch,
+ * returning how many times a procedure ran for it
+ */
+static int
+testCall(virNetServerPtr srv,
+         virNetServerClientPtr client,
+         int proc,
+         size_t *calls)
+{
+    static unsigned int serial;
+    virNetMessagePtr msg;
+    size_t before = testCalls;
+
+    if (!(msg = virNetMessageNew(true)))
+        return -1;
+
+    msg->header.prog = TEST_PROGRAM;
+    msg->header.vers = TEST_VERSION;
+    msg->header.proc = proc;
+    msg->header.type = VIR_NET_CALL;
+    msg->header.serial = ++serial;
+    msg->header.status = VIR_NET_OK;
+
+    if (virNetServerDispatchNewMessage(client, msg, srv) < 0) {
+        virNetMessageFree(msg);
+        return -1;
+    }
+
+    *calls = testCalls - before;
+    return 0;
+}
+
+
+static int
+testCheckStats(const char *identity,
+               size_t calls,
+               unsigned long long admitted,
+               unsigned long long throttled_rate)
+{
+    virNetServerQuotaStats stats;
+
+    virNetServerQuotaGetStats(testQuota, identity, &stats);
+
+    if (stats.calls != calls ||
+        stats.admitted != admitted ||
+        stats.throttled_calls != 0 ||
+        stats.throttled_rate != throttled_rate) {
+        fprintf(stderr,
+                "Stats of '%s': calls %zu admitted %llu throttled %llu/%llu, "
+                "expected %zu %llu 0/%llu\n",
+                identity, stats.calls, stats.admitted,
+                stats.throttled_calls, stats.throttled_rate,
+                calls, admitted, throttled_rate);
+        return -1;
+    }
+    return 0;
+}
+
+
+static int testAdmitJob(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNetServerPtr srv = NULL;
+    virNetServerProgramPtr prog = NULL;
+    virNetServerClientPtr client = NULL;
+    virNetServerClientPtr unauth = NULL;
+    size_t calls;
+    int ret = -1;
+
+    testCalls = 0;
+
+    /* Without workers calls are dispatched right away */
+    if (!(srv = virNetServerNew(0, 0, 0, 10, 0, -1, 0, false, NULL,
+                                NULL, NULL, NULL, NULL)))
+        goto cleanup;
+
+    if (!(prog = virNetServerProgramNew(TEST_PROGRAM, TEST_VERSION,
+                                        testProcs,
+                                        ARRAY_CARDINALITY(testProcs))) ||
+        virNetServerAddProgram(srv, prog) < 0)
+        goto cleanup;
+
+    /* A bucket of 3 that refills far slower than the test runs */
+    if (!(testQuota = virNetServerQuotaNew(0, 1, 3)))
+        goto cleanup;
+
+    if (virNetServerQuotaParseCost(testQuota, "test:unknown:2") < 0)
+        goto cleanup;
+    if (virNetServerSetQuota(srv, testQuota) == 0) {
+        fprintf(stderr, "Cost of an unknown procedure was accepted\n");
+        goto cleanup;
+    }
+    virResetLastError();
+    virObjectUnref(testQuota);
+
+    if (!(testQuota = virNetServerQuotaNew(0, 1, 3)) ||
+        virNetServerQuotaParseCost(testQuota, "test:expensive:2") < 0 ||
+        virNetServerQuotaParseCost(testQuota, "test:free:0") < 0 ||
+        virNetServerSetQuota(srv, testQuota) < 0)
+        goto cleanup;
+
+    if (!(client = testClientNew(VIR_NET_SERVER_SERVICE_AUTH_NONE)) ||
+        !(unauth = testClientNew(VIR_NET_SERVER_SERVICE_AUTH_SASL)))
+        goto cleanup;
+
+    /* Counted with its cost while running, released afterwards */
+    if (testCall(srv, client, TEST_PROC_EXPENSIVE, &calls) < 0 ||
+        calls != 1 || testRunningCost != 2) {
+        fprintf(stderr, "Expensive call not admitted at cost 2\n");
+        goto cleanup;
+    }
+    if (testCheckStats("uid:666", 0, 1, 0) < 0)
+        goto cleanup;
+
+    if (testCall(srv, client, TEST_PROC_CHEAP, &calls) < 0 || calls != 1) {
+        fprintf(stderr, "Cheap call not admitted\n");
+        goto cleanup;
+    }
+
+    /* The bucket is empty now */
+    if (testCall(srv, client, TEST_PROC_CHEAP, &calls) < 0 || calls != 0) {
+        fprintf(stderr, "Call beyond the rate was dispatched\n");
+        goto cleanup;
+    }
+    if (testCheckStats("uid:666", 0, 2, 1) < 0)
+        goto cleanup;
+
+    /* Free calls and unauthenticated clients are never throttled */
+    if (testCall(srv, client, TEST_PROC_FREE, &calls) < 0 || calls != 1) {
+        fprintf(stderr, "Free call was throttled\n");
+        goto cleanup;
+    }
+    if (testCall(srv, unauth, TEST_PROC_CHEAP, &calls) < 0 || calls != 0) {
+        fprintf(stderr, "Unauthenticated client was dispatched\n");
+        goto cleanup;
+    }
+    if (testCheckStats("uid:666", 0, 2, 1) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    if (client)
+        virNetServerClientClose(client);
+    if (unauth)
+        virNetServerClientClose(unauth);
+    virObjectUnref(client);
+    virObjectUnref(unauth);
+    virObjectUnref(testQuota);
+    testQuota = NULL;
+    virObjectUnref(prog);
+    virObjectUnref(srv);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virtTestRun("Admit job", testAdmitJob, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+VIRT_TEST_MAIN_PRELOAD(mymain, abs_builddir "/.libs/virnetserverclientmock.so")
+#else
+static int
+mymain(void)
+{
+    return EXIT_AM_SKIP;
+}
+VIRT_TEST_MAIN(mymain);
+#endif
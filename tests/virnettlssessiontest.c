@@ -33,6 +33,7 @@
 #include "virfile.h"
 #include "vircommand.h"
 #include "virsocketaddr.h"
+#include "virtime.h"
 
 #if !defined WIN32 && HAVE_LIBTASN1_H && LIBGNUTLS_VERSION_NUMBER >= 0x020600
 
@@ -235,6 +236,199 @@ static int testTLSSessionInit(const void *opaque)
 }
 
 
+struct testTLSResumeData {
+    const char *cacrt;
+    const char *servercrt;
+    const char *clientcrt;
+    bool cached;
+    size_t nconns;
+};
+
+
+static int testTLSHandshake(virNetTLSSessionPtr serverSess,
+                            virNetTLSSessionPtr clientSess)
+{
+    bool clientShake = false;
+    bool serverShake = false;
+
+    while (!clientShake || !serverShake) {
+        int rv;
+        if (!serverShake) {
+            if ((rv = virNetTLSSessionHandshake(serverSess)) < 0)
+                return -1;
+            if (rv == VIR_NET_TLS_HANDSHAKE_COMPLETE)
+                serverShake = true;
+        }
+        if (!clientShake) {
+            if ((rv = virNetTLSSessionHandshake(clientSess)) < 0)
+                return -1;
+            if (rv == VIR_NET_TLS_HANDSHAKE_COMPLETE)
+                clientShake = true;
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * Opens many short lived connections one after the other, the way
+ * a poller does. With a cached client context every connection but
+ * the first must resume the previous session instead of doing a
+ * full handshake.
+ */
+static int testTLSSessionResume(const void *opaque)
+{
+    const struct testTLSResumeData *data = opaque;
+    virNetTLSContextPtr serverCtxt = NULL;
+    virNetTLSContextPtr clientCtxt = NULL;
+    virNetTLSSessionPtr serverSess = NULL;
+    virNetTLSSessionPtr clientSess = NULL;
+    int channel[2] = { -1, -1 };
+    unsigned long long start;
+    unsigned long long end;
+    size_t nresumed = 0;
+    size_t i;
+    int ret = -1;
+
+    if (!(serverCtxt = virNetTLSContextNewServer(data->cacrt, NULL,
+                                                 data->servercrt, KEYFILE,
+                                                 NULL, false, true)))
+        goto cleanup;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < data->nconns; i++) {
+        if (!clientCtxt &&
+            !(clientCtxt = virNetTLSContextNewClient(data->cacrt, NULL,
+                                                     data->clientcrt, KEYFILE,
+                                                     false, true)))
+            goto cleanup;
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, channel) < 0)
+            abort();
+        ignore_value(virSetNonBlock(channel[0]));
+        ignore_value(virSetNonBlock(channel[1]));
+
+        if (!(serverSess = virNetTLSSessionNew(serverCtxt, NULL)) ||
+            !(clientSess = virNetTLSSessionNew(clientCtxt, "libvirt.org")))
+            goto cleanup;
+
+        virNetTLSSessionSetIOCallbacks(serverSess, testWrite, testRead, &channel[0]);
+        virNetTLSSessionSetIOCallbacks(clientSess, testWrite, testRead, &channel[1]);
+
+        if (testTLSHandshake(serverSess, clientSess) < 0 ||
+            virNetTLSContextCheckCertificate(serverCtxt, serverSess) < 0 ||
+            virNetTLSContextCheckCertificate(clientCtxt, clientSess) < 0)
+            goto cleanup;
+
+        if (virNetTLSSessionIsResumed(clientSess))
+            nresumed++;
+
+        virObjectUnref(serverSess);
+        virObjectUnref(clientSess);
+        serverSess = clientSess = NULL;
+        VIR_FORCE_CLOSE(channel[0]);
+        VIR_FORCE_CLOSE(channel[1]);
+
+        if (!data->cached) {
+            virObjectUnref(clientCtxt);
+            clientCtxt = NULL;
+        }
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    if (virTestGetDebug())
+        fprintf(stderr, "\n%zu handshakes (%zu resumed) in %llu ms\n",
+                data->nconns, nresumed, end - start);
+
+    if (data->cached && nresumed != data->nconns - 1) {
+        VIR_WARN("Expected %zu resumed sessions, got %zu",
+                 data->nconns - 1, nresumed);
+        goto cleanup;
+    }
+    if (!data->cached && nresumed != 0) {
+        VIR_WARN("Unexpected resumed session without a cached context");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(serverSess);
+    virObjectUnref(clientSess);
+    virObjectUnref(serverCtxt);
+    virObjectUnref(clientCtxt);
+    VIR_FORCE_CLOSE(channel[0]);
+    VIR_FORCE_CLOSE(channel[1]);
+    return ret;
+}
+
+
+struct testTLSCacheData {
+    const char *cacrt;
+    const char *altcacrt;
+    const char *clientcrt;
+};
+
+# define PKIDIR "pki-sess"
+
+/*
+ * Client contexts loaded from the same directory are shared, until
+ * one of the credential files is replaced
+ */
+static int testTLSContextCache(const void *opaque)
+{
+    const struct testTLSCacheData *data = opaque;
+    virNetTLSContextPtr ctxt1 = NULL;
+    virNetTLSContextPtr ctxt2 = NULL;
+    virNetTLSContextPtr ctxt3 = NULL;
+    int ret = -1;
+
+    if (virFileMakePath(PKIDIR) < 0 ||
+        link(data->cacrt, PKIDIR "/cacert.pem") < 0 ||
+        link(data->clientcrt, PKIDIR "/clientcert.pem") < 0 ||
+        link(KEYFILE, PKIDIR "/clientkey.pem") < 0)
+        goto cleanup;
+
+    if (!(ctxt1 = virNetTLSContextNewClientPath(PKIDIR, false, false, true)) ||
+        !(ctxt2 = virNetTLSContextNewClientPath(PKIDIR, false, false, true)))
+        goto cleanup;
+
+    if (ctxt1 != ctxt2) {
+        VIR_WARN("Client context was not reused");
+        goto cleanup;
+    }
+
+    if (unlink(PKIDIR "/cacert.pem") < 0 ||
+        link(data->altcacrt, PKIDIR "/cacert.pem") < 0)
+        goto cleanup;
+
+    if (!(ctxt3 = virNetTLSContextNewClientPath(PKIDIR, false, false, true)))
+        goto cleanup;
+
+    if (ctxt3 == ctxt1) {
+        VIR_WARN("Client context was reused after the CA changed");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(ctxt1);
+    virObjectUnref(ctxt2);
+    virObjectUnref(ctxt3);
+    unlink(PKIDIR "/cacert.pem");
+    unlink(PKIDIR "/clientcert.pem");
+    unlink(PKIDIR "/clientkey.pem");
+    rmdir(PKIDIR);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -460,6 +654,29 @@ mymain(void)
     DO_SESS_TEST("cacertchain-sess.pem", servercertlevel3areq.filename, clientcertlevel2breq.filename,
                  false, false, "libvirt.org", NULL);
 
+    size_t nconns = virTestGetExpensive() ? 1000 : 20;
+    struct testTLSResumeData resumefresh = {
+        cacertreq.filename, servercertreq.filename, clientcertreq.filename,
+        false, nconns,
+    };
+    struct testTLSResumeData resumecached = {
+        cacertreq.filename, servercertreq.filename, clientcertreq.filename,
+        true, nconns,
+    };
+    struct testTLSCacheData cachedata = {
+        cacertreq.filename, altcacertreq.filename, clientcertreq.filename,
+    };
+
+    if (virtTestRun("TLS Session handshake rate, full",
+                    testTLSSessionResume, &resumefresh) < 0)
+        ret = -1;
+    if (virtTestRun("TLS Session handshake rate, resumed",
+                    testTLSSessionResume, &resumecached) < 0)
+        ret = -1;
+    if (virtTestRun("TLS Context client cache",
+                    testTLSContextCache, &cachedata) < 0)
+        ret = -1;
+
     testTLSDiscardCert(&clientcertreq);
     testTLSDiscardCert(&clientcertaltreq);
 
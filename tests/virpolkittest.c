@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#if defined(WITH_DBUS) && defined(__linux__)
+
+# include <stdlib.h>
+# include <dbus/dbus.h>
+
+# include "virpolkit.h"
+# include "virdbuspriv.h"
+# include "virlog.h"
+# include "virmock.h"
+# include "virstring.h"
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.polkittest");
+
+# define THE_PID 1711
+# define THE_TIME 11011000
+# define THE_UID 1000
+
+VIR_MOCK_IMPL_RET_ARGS(dbus_connection_send_with_reply_and_block,
+                       DBusMessage *,
+                       DBusConnection *, connection,
+                       DBusMessage *, message,
+                       int, timeout_milliseconds,
+                       DBusError *, error)
+{
+    DBusMessage *reply = NULL;
+    const char *service = dbus_message_get_destination(message);
+    const char *member = dbus_message_get_member(message);
+    char *type = NULL;
+    char *pidkey = NULL;
+    unsigned int pidval;
+    char *timekey = NULL;
+    unsigned long long timeval;
+    char *uidkey = NULL;
+    int uidval;
+    char *actionid = NULL;
+    char **details = NULL;
+    size_t detailslen = 0;
+    int allowInteraction;
+    char *cancellationId = NULL;
+    int is_authorized = 1;
+    int is_challenge = 0;
+    size_t i;
+
+    VIR_MOCK_IMPL_INIT_REAL(dbus_connection_send_with_reply_and_block);
+
+    if (STRNEQ(service, VIR_POLKIT_AUTHORITY_SERVICE) ||
+        STRNEQ(member, "CheckAuthorization")) {
+        dbus_set_error_const(error, "org.freedesktop.DBus.Error.UnknownMethod",
+                             "Unexpected method call");
+        goto cleanup;
+    }
+
+    if (virDBusMessageDecode(message,
+                             "(sa{sv})sa&{ss}us",
+                             &type,
+                             3,
+                             &pidkey, "u", &pidval,
+                             &timekey, "t", &timeval,
+                             &uidkey, "i", &uidval,
+                             &actionid,
+                             &detailslen,
+                             &details,
+                             &allowInteraction,
+                             &cancellationId) < 0)
+        goto error;
+
+    if (STRNEQ(type, "unix-process") ||
+        STRNEQ(pidkey, "pid") || pidval != THE_PID ||
+        STRNEQ(timekey, "start-time") || timeval != THE_TIME ||
+        STRNEQ(uidkey, "uid") || uidval != THE_UID ||
+        allowInteraction) {
+        dbus_set_error_const(error, "org.freedesktop.PolicyKit1.Error.Failed",
+                             "Unexpected subject");
+        goto cleanup;
+    }
+
+    if (STREQ(actionid, "org.libvirt.test.success")) {
+        is_authorized = 1;
+    } else if (STREQ(actionid, "org.libvirt.test.challenge")) {
+        is_authorized = 0;
+        is_challenge = 1;
+    } else if (STREQ(actionid, "org.libvirt.test.denied")) {
+        is_authorized = 0;
+    } else if (STREQ(actionid, "org.libvirt.test.details")) {
+        /* Only allowed with the details the test passes */
+        is_authorized = 0;
+        if (detailslen == 2) {
+            is_authorized = 1;
+            for (i = 0; i < detailslen; i++) {
+                if (!(STREQ(details[i * 2], "org.libvirt.test.person") &&
+                      STREQ(details[(i * 2) + 1], "Fred")) &&
+                    !(STREQ(details[i * 2], "org.libvirt.test.food") &&
+                      STREQ(details[(i * 2) + 1], "Earl Grey")))
+                    is_authorized = 0;
+            }
+        }
+    } else {
+        dbus_set_error_const(error, "org.freedesktop.PolicyKit1.Error.Failed",
+                             "Unknown action");
+        goto cleanup;
+    }
+
+    if (virDBusCreateReply(&reply,
+                           "(bba&{ss})",
+                           is_authorized,
+                           is_challenge,
+                           0, NULL) < 0)
+        goto error;
+
+ cleanup:
+    VIR_FREE(type);
+    VIR_FREE(pidkey);
+    VIR_FREE(timekey);
+    VIR_FREE(uidkey);
+    VIR_FREE(actionid);
+    VIR_FREE(cancellationId);
+    virStringFreeListCount(details, detailslen * 2);
+
+    return reply;
+
+ error:
+    dbus_set_error_const(error, "org.freedesktop.DBus.Error.Failed",
+                         "Unable to handle message");
+    goto cleanup;
+}
+
+
+static int
+testPolkitCheck(const char *actionid,
+                const char **details,
+                int expected,
+                bool expectChallenge)
+{
+    bool challenge = false;
+    int rv;
+
+    rv = virPolkitCheckAuth(actionid, THE_PID, THE_TIME, THE_UID,
+                            details, &challenge);
+
+    if (rv != expected) {
+        fprintf(stderr, "Expected %d for %s, got %d: %s\n",
+                expected, actionid, rv,
+                rv < 0 ? virGetLastErrorMessage() : "");
+        return -1;
+    }
+
+    if (expected >= 0 && challenge != expectChallenge) {
+        fprintf(stderr, "Expected challenge %d for %s\n",
+                expectChallenge, actionid);
+        return -1;
+    }
+
+    virResetLastError();
+    return 0;
+}
+
+
+static int testPolkitAuthSuccess(const void *opaque ATTRIBUTE_UNUSED)
+{
+    return testPolkitCheck("org.libvirt.test.success", NULL, 1, false);
+}
+
+
+static int testPolkitAuthDenied(const void *opaque ATTRIBUTE_UNUSED)
+{
+    return testPolkitCheck("org.libvirt.test.denied", NULL, 0, false);
+}
+
+
+static int testPolkitAuthChallenge(const void *opaque ATTRIBUTE_UNUSED)
+{
+    return testPolkitCheck("org.libvirt.test.challenge", NULL, 0, true);
+}
+
+
+static int testPolkitAuthDetails(const void *opaque ATTRIBUTE_UNUSED)
+{
+    const char *details[] = {
+        "org.libvirt.test.person", "Fred",
+        "org.libvirt.test.food", "Earl Grey",
+        NULL,
+    };
+    const char *wrongDetails[] = {
+        "org.libvirt.test.person", "Fred",
+        "org.libvirt.test.food", "Darjeeling",
+        NULL,
+    };
+
+    if (testPolkitCheck("org.libvirt.test.details", details, 1, false) < 0 ||
+        testPolkitCheck("org.libvirt.test.details", wrongDetails, 0, false) < 0 ||
+        testPolkitCheck("org.libvirt.test.details", NULL, 0, false) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int testPolkitAuthError(const void *opaque ATTRIBUTE_UNUSED)
+{
+    return testPolkitCheck("org.libvirt.test.unknown", NULL, -1, false);
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virtTestRun("Polkit auth success ", testPolkitAuthSuccess, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Polkit auth denied ", testPolkitAuthDenied, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Polkit auth challenge ", testPolkitAuthChallenge, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Polkit auth details ", testPolkitAuthDetails, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Polkit auth error ", testPolkitAuthError, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN_PRELOAD(mymain, abs_builddir "/.libs/virmockdbus.so")
+
+#else /* ! (WITH_DBUS && __linux__) */
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+#endif /* ! WITH_DBUS */
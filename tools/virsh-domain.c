@@ -60,57 +60,63 @@
 # define SA_SIGINFO 0
 #endif
 
-virDomainPtr
-vshCommandOptDomainBy(vshControl *ctl, const vshCmd *cmd,
-                      const char **name, unsigned int flags)
+static virDomainPtr
+vshLookupDomainBy(vshControl *ctl,
+                  const char *name,
+                  unsigned int flags)
 {
     virDomainPtr dom = NULL;
-    const char *n = NULL;
     int id;
-    const char *optname = "domain";
     virCheckFlags(VSH_BYID | VSH_BYUUID | VSH_BYNAME, NULL);
 
-    if (!vshCmdHasOption(ctl, cmd, optname))
-        return NULL;
-
-    if (vshCommandOptStringReq(ctl, cmd, optname, &n) < 0)
-        return NULL;
-
-    vshDebug(ctl, VSH_ERR_INFO, "%s: found option <%s>: %s\n",
-             cmd->def->name, optname, n);
-
-    if (name)
-        *name = n;
-
     /* try it by ID */
     if (flags & VSH_BYID) {
-        if (virStrToLong_i(n, NULL, 10, &id) == 0 && id >= 0) {
+        if (virStrToLong_i(name, NULL, 10, &id) == 0 && id >= 0) {
             vshDebug(ctl, VSH_ERR_DEBUG,
-                     "%s: <%s> seems like domain ID\n",
-                     cmd->def->name, optname);
+                     "<%s> seems like domain ID\n", name);
             dom = virDomainLookupByID(ctl->conn, id);
         }
     }
     /* try it by UUID */
     if (!dom && (flags & VSH_BYUUID) &&
-        strlen(n) == VIR_UUID_STRING_BUFLEN-1) {
-        vshDebug(ctl, VSH_ERR_DEBUG, "%s: <%s> trying as domain UUID\n",
-                 cmd->def->name, optname);
-        dom = virDomainLookupByUUIDString(ctl->conn, n);
+        strlen(name) == VIR_UUID_STRING_BUFLEN-1) {
+        vshDebug(ctl, VSH_ERR_DEBUG, "<%s> trying as domain UUID\n", name);
+        dom = virDomainLookupByUUIDString(ctl->conn, name);
     }
     /* try it by NAME */
     if (!dom && (flags & VSH_BYNAME)) {
-        vshDebug(ctl, VSH_ERR_DEBUG, "%s: <%s> trying as domain NAME\n",
-                 cmd->def->name, optname);
-        dom = virDomainLookupByName(ctl->conn, n);
+        vshDebug(ctl, VSH_ERR_DEBUG, "<%s> trying as domain NAME\n", name);
+        dom = virDomainLookupByName(ctl->conn, name);
     }
 
     if (!dom)
-        vshError(ctl, _("failed to get domain '%s'"), n);
+        vshError(ctl, _("failed to get domain '%s'"), name);
 
     return dom;
 }
 
+virDomainPtr
+vshCommandOptDomainBy(vshControl *ctl, const vshCmd *cmd,
+                      const char **name, unsigned int flags)
+{
+    const char *n = NULL;
+    const char *optname = "domain";
+
+    if (!vshCmdHasOption(ctl, cmd, optname))
+        return NULL;
+
+    if (vshCommandOptStringReq(ctl, cmd, optname, &n) < 0)
+        return NULL;
+
+    vshDebug(ctl, VSH_ERR_INFO, "%s: found option <%s>: %s\n",
+             cmd->def->name, optname, n);
+
+    if (name)
+        *name = n;
+
+    return vshLookupDomainBy(ctl, n, flags);
+}
+
 VIR_ENUM_DECL(vshDomainVcpuState)
 VIR_ENUM_IMPL(vshDomainVcpuState,
               VIR_VCPU_LAST,
@@ -2006,6 +2012,10 @@ static const vshCmdOptDef opts_block_job[] = {
      .type = VSH_OT_DATA,
      .help = N_("set the Bandwidth limit in MiB/s")
     },
+    {.name = "wait",
+     .type = VSH_OT_BOOL,
+     .help = N_("wait for the job to finish or become ready to pivot")
+    },
     {.name = NULL}
 };
 
@@ -2025,6 +2035,111 @@ vshDomainBlockJobToString(int type)
     return str ? _(str) : _("Unknown job");
 }
 
+VIR_ENUM_DECL(vshDomainBlockJobStatus)
+VIR_ENUM_IMPL(vshDomainBlockJobStatus,
+              VIR_DOMAIN_BLOCK_JOB_LAST,
+              N_("completed"),
+              N_("failed"),
+              N_("canceled"),
+              N_("ready"))
+
+static const char *
+vshDomainBlockJobStatusToString(int status)
+{
+    const char *str = vshDomainBlockJobStatusTypeToString(status);
+    return str ? _(str) : _("unknown");
+}
+
+/* Prints block job statistics, optionally waiting for the job to finish
+ * first. Returns -1 on error, -2 if the server doesn't support them, 0 if
+ * there's no job and 1 if something was printed. */
+static int
+vshBlockJobStats(vshControl *ctl, const vshCmd *cmd, bool wait)
+{
+    virDomainPtr dom = NULL;
+    const char *path;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int type = VIR_DOMAIN_BLOCK_JOB_TYPE_UNKNOWN;
+    int status;
+    unsigned long long cur = 0;
+    unsigned long long end = 0;
+    unsigned long long value;
+    int ret = -1;
+    int rc;
+
+    if (!(dom = vshCommandOptDomain(ctl, cmd, NULL)))
+        goto cleanup;
+
+    if (vshCommandOptStringReq(ctl, cmd, "path", &path) < 0)
+        goto cleanup;
+
+    rc = virDomainGetBlockJobStats(dom, path, &params, &nparams,
+                                   wait ? VIR_DOMAIN_BLOCK_JOB_STATS_WAIT : 0);
+    if (rc < 0) {
+        if (last_error->code == VIR_ERR_NO_SUPPORT) {
+            vshResetLibvirtError();
+            ret = -2;
+        }
+        goto cleanup;
+    }
+
+    if (rc == 0) {
+        if (wait)
+            vshPrint(ctl, _("No block job on %s\n"), path);
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (virTypedParamsGetInt(params, nparams,
+                             VIR_DOMAIN_BLOCK_JOB_STATS_TYPE, &type) < 0 ||
+        virTypedParamsGetULLong(params, nparams,
+                                VIR_DOMAIN_BLOCK_JOB_STATS_CUR, &cur) < 0 ||
+        virTypedParamsGetULLong(params, nparams,
+                                VIR_DOMAIN_BLOCK_JOB_STATS_END, &end) < 0)
+        goto cleanup;
+
+    rc = virTypedParamsGetInt(params, nparams,
+                              VIR_DOMAIN_BLOCK_JOB_STATS_STATUS, &status);
+    if (rc < 0)
+        goto cleanup;
+
+    if (rc == 0) {
+        vshPrintJobProgress(vshDomainBlockJobToString(type), end - cur, end);
+    } else {
+        vshPrint(ctl, "%s: %s\n", vshDomainBlockJobToString(type),
+                 vshDomainBlockJobStatusToString(status));
+    }
+
+    if (virTypedParamsGetULLong(params, nparams,
+                                VIR_DOMAIN_BLOCK_JOB_STATS_BANDWIDTH,
+                                &value) > 0 && value)
+        vshPrint(ctl, _("    Bandwidth limit: %llu MiB/s\n"), value);
+    if (virTypedParamsGetULLong(params, nparams,
+                                VIR_DOMAIN_BLOCK_JOB_STATS_ELAPSED,
+                                &value) > 0)
+        vshPrint(ctl, _("    Time elapsed:    %llu ms\n"), value);
+    if (virTypedParamsGetULLong(params, nparams,
+                                VIR_DOMAIN_BLOCK_JOB_STATS_RATE,
+                                &value) > 0) {
+        const char *unit;
+        double rate = vshPrettyCapacity(value, &unit);
+        vshPrint(ctl, _("    Rate:            %-.3lf %s/s\n"), rate, unit);
+    }
+    if (virTypedParamsGetULLong(params, nparams,
+                                VIR_DOMAIN_BLOCK_JOB_STATS_ETA,
+                                &value) > 0)
+        vshPrint(ctl, _("    Time remaining:  %llu ms\n"), value);
+
+    ret = 1;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    if (dom)
+        virDomainFree(dom);
+    return ret;
+}
+
 static bool
 cmdBlockJob(vshControl *ctl, const vshCmd *cmd)
 {
@@ -2036,13 +2151,26 @@ cmdBlockJob(vshControl *ctl, const vshCmd *cmd)
                       vshCommandOptBool(cmd, "pivot"));
     bool infoMode = vshCommandOptBool(cmd, "info");
     bool bandwidth = vshCommandOptBool(cmd, "bandwidth");
+    bool waitMode = vshCommandOptBool(cmd, "wait");
 
-    if (abortMode + infoMode + bandwidth > 1) {
+    if (abortMode + infoMode + bandwidth + waitMode > 1) {
         vshError(ctl, "%s",
-                 _("conflict between --abort, --info, and --bandwidth modes"));
+                 _("conflict between --abort, --info, --bandwidth, "
+                   "and --wait modes"));
         return false;
     }
 
+    if (waitMode) {
+        if ((ret = vshBlockJobStats(ctl, cmd, true)) == -2)
+            vshError(ctl, "%s", _("waiting for block jobs is not supported "
+                                  "by this server"));
+        return ret >= 0;
+    }
+
+    if (!abortMode && !bandwidth &&
+        (ret = vshBlockJobStats(ctl, cmd, false)) != -2)
+        return ret >= 0;
+
     if (abortMode)
         mode = VSH_CMD_BLOCK_JOB_ABORT;
     else if (bandwidth)
@@ -4110,6 +4238,271 @@ cmdManagedSave(vshControl *ctl, const vshCmd *cmd)
     return ret;
 }
 
+/*
+ * "evacuate" command
+ */
+static const vshCmdInfo info_evacuate[] = {
+    {.name = "help",
+     .data = N_("move many running domains off the host")
+    },
+    {.name = "desc",
+     .data = N_("Managed save, or with --migrate live migrate, a set of running\n"
+                "    domains, running a few of them at once and sharing one\n"
+                "    bandwidth limit between them.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_evacuate[] = {
+    {.name = "all",
+     .type = VSH_OT_BOOL,
+     .help = N_("evacuate all running domains")
+    },
+    {.name = "migrate",
+     .type = VSH_OT_STRING,
+     .help = N_("live migrate the domains to this connection URI "
+                "instead of saving them")
+    },
+    {.name = "concurrency",
+     .type = VSH_OT_INT,
+     .help = N_("number of domains to save or migrate at once")
+    },
+    {.name = "bandwidth",
+     .type = VSH_OT_INT,
+     .help = N_("bandwidth limit in MiB/s shared by all domains")
+    },
+    {.name = "bypass-cache",
+     .type = VSH_OT_BOOL,
+     .help = N_("avoid file system cache when saving")
+    },
+    {.name = "verbose",
+     .type = VSH_OT_BOOL,
+     .help = N_("display the progress of the evacuation")
+    },
+    {.name = "domain",
+     .type = VSH_OT_ARGV,
+     .help = N_("list of domain names, ids or uuids")
+    },
+    {.name = NULL}
+};
+
+typedef struct {
+    virDomainPtr *doms;
+    size_t ndoms;
+    virTypedParameterPtr params;
+    int nparams;
+    unsigned int flags;
+    int writefd;
+} vshEvacuateData;
+
+static void
+doEvacuate(void *opaque)
+{
+    char ret = '1';
+    vshEvacuateData *data = opaque;
+    sigset_t sigmask, oldsigmask;
+
+    sigemptyset(&sigmask);
+    sigaddset(&sigmask, SIGINT);
+    if (pthread_sigmask(SIG_BLOCK, &sigmask, &oldsigmask) < 0)
+        goto out_sig;
+
+    if (virDomainListEvacuate(data->doms, data->ndoms,
+                              data->params, data->nparams,
+                              data->flags) == 0)
+        ret = '0';
+
+    pthread_sigmask(SIG_SETMASK, &oldsigmask, NULL);
+ out_sig:
+    ignore_value(safewrite(data->writefd, &ret, sizeof(ret)));
+}
+
+/* Any domain still taking part in the evacuation reports the totals
+ * for the whole set, so ask them in turn until one answers */
+static void
+vshEvacuatePrintProgress(vshEvacuateData *data)
+{
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int type;
+    unsigned int total;
+    unsigned int completed = 0;
+    unsigned int failed = 0;
+    size_t i;
+
+    for (i = 0; i < data->ndoms; i++) {
+        if (virDomainGetJobStats(data->doms[i], &type,
+                                 &params, &nparams, 0) < 0) {
+            vshResetLibvirtError();
+            continue;
+        }
+
+        if (virTypedParamsGetUInt(params, nparams,
+                                  VIR_DOMAIN_JOB_EVACUATE_TOTAL,
+                                  &total) == 1) {
+            ignore_value(virTypedParamsGetUInt(params, nparams,
+                                               VIR_DOMAIN_JOB_EVACUATE_COMPLETED,
+                                               &completed));
+            ignore_value(virTypedParamsGetUInt(params, nparams,
+                                               VIR_DOMAIN_JOB_EVACUATE_FAILED,
+                                               &failed));
+            vshPrintJobProgress(_("Evacuate"),
+                                total - completed - failed, total);
+            virTypedParamsFree(params, nparams);
+            return;
+        }
+
+        virTypedParamsFree(params, nparams);
+        params = NULL;
+        nparams = 0;
+    }
+}
+
+static bool
+cmdEvacuate(vshControl *ctl, const vshCmd *cmd)
+{
+    vshEvacuateData data;
+    virDomainPtr *doms = NULL;
+    size_t ndoms = 0;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int maxparams = 0;
+    const char *uri = NULL;
+    const vshCmdOpt *opt = NULL;
+    unsigned int flags = 0;
+    unsigned int concurrency;
+    unsigned long long bandwidth;
+    bool verbose = vshCommandOptBool(cmd, "verbose");
+    int p[2] = { -1, -1 };
+    virThread workerThread;
+    struct pollfd pollfd = { .revents = 0, .events = POLLIN };
+    char retchar;
+    bool ret = false;
+    int rv;
+    size_t i;
+
+    VSH_EXCLUSIVE_OPTIONS("all", "domain");
+    VSH_EXCLUSIVE_OPTIONS("migrate", "bypass-cache");
+
+    if (!vshCommandOptBool(cmd, "all") && !vshCommandOptBool(cmd, "domain")) {
+        vshError(ctl, "%s", _("either --all or a list of domains is required"));
+        return false;
+    }
+
+    if (vshCommandOptStringReq(ctl, cmd, "migrate", &uri) < 0)
+        return false;
+
+    if (uri) {
+        flags |= VIR_DOMAIN_EVACUATE_MIGRATE;
+        if (virTypedParamsAddString(&params, &nparams, &maxparams,
+                                    VIR_DOMAIN_EVACUATE_PARAM_URI, uri) < 0)
+            goto save_error;
+    }
+
+    if (vshCommandOptBool(cmd, "bypass-cache"))
+        flags |= VIR_DOMAIN_EVACUATE_BYPASS_CACHE;
+
+    if ((rv = vshCommandOptUInt(cmd, "concurrency", &concurrency)) < 0) {
+        goto interror;
+    } else if (rv > 0) {
+        if (virTypedParamsAddUInt(&params, &nparams, &maxparams,
+                                  VIR_DOMAIN_EVACUATE_PARAM_CONCURRENCY,
+                                  concurrency) < 0)
+            goto save_error;
+    }
+
+    if ((rv = vshCommandOptULongLong(cmd, "bandwidth", &bandwidth)) < 0) {
+        goto interror;
+    } else if (rv > 0) {
+        if (virTypedParamsAddULLong(&params, &nparams, &maxparams,
+                                    VIR_DOMAIN_EVACUATE_PARAM_BANDWIDTH,
+                                    bandwidth) < 0)
+            goto save_error;
+    }
+
+    if (vshCommandOptBool(cmd, "all")) {
+        if ((rv = virConnectListAllDomains(ctl->conn, &doms,
+                                           VIR_CONNECT_LIST_DOMAINS_ACTIVE)) < 0)
+            goto save_error;
+        ndoms = rv;
+    } else {
+        while ((opt = vshCommandOptArgv(cmd, opt))) {
+            virDomainPtr dom;
+
+            if (!(dom = vshLookupDomainBy(ctl, opt->data,
+                                          VSH_BYID | VSH_BYUUID | VSH_BYNAME)))
+                goto cleanup;
+
+            if (VIR_APPEND_ELEMENT(doms, ndoms, dom) < 0) {
+                virDomainFree(dom);
+                goto cleanup;
+            }
+        }
+    }
+
+    if (ndoms == 0) {
+        vshPrint(ctl, "%s", _("No domains to evacuate\n"));
+        ret = true;
+        goto cleanup;
+    }
+
+    data.doms = doms;
+    data.ndoms = ndoms;
+    data.params = params;
+    data.nparams = nparams;
+    data.flags = flags;
+
+    if (!verbose) {
+        if (virDomainListEvacuate(doms, ndoms, params, nparams, flags) < 0)
+            goto save_error;
+    } else {
+        if (pipe(p) < 0)
+            goto cleanup;
+
+        data.writefd = p[1];
+        pollfd.fd = p[0];
+
+        if (virThreadCreate(&workerThread, true, doEvacuate, &data) < 0)
+            goto cleanup;
+
+        while ((rv = poll(&pollfd, 1, 500)) == 0 ||
+               (rv < 0 && errno == EINTR))
+            vshEvacuatePrintProgress(&data);
+
+        virThreadJoin(&workerThread);
+
+        if (rv < 0 ||
+            saferead(p[0], &retchar, sizeof(retchar)) <= 0 ||
+            retchar != '0')
+            goto error;
+
+        /* print [100 %] */
+        vshPrintJobProgress(_("Evacuate"), 0, 1);
+    }
+
+    vshPrint(ctl, _("\n%zu domains evacuated\n"), ndoms);
+    ret = true;
+
+ cleanup:
+    for (i = 0; i < ndoms; i++)
+        virDomainFree(doms[i]);
+    VIR_FREE(doms);
+    virTypedParamsFree(params, nparams);
+    VIR_FORCE_CLOSE(p[0]);
+    VIR_FORCE_CLOSE(p[1]);
+    return ret;
+
+ save_error:
+    vshSaveLibvirtError();
+ error:
+    vshError(ctl, "%s", _("Failed to evacuate domains"));
+    goto cleanup;
+
+ interror:
+    vshError(ctl, "%s", _("Unable to parse integer parameter"));
+    goto cleanup;
+}
+
 /*
  * "managedsave-remove" command
  */
@@ -5136,6 +5529,8 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
     virTypedParameterPtr params = NULL;
     int nparams = 0;
     unsigned long long value;
+    unsigned int adjustments;
+    const char *action;
     int rc;
 
     if (!(dom = vshCommandOptDomain(ctl, cmd, NULL)))
@@ -5296,6 +5691,51 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
         vshPrint(ctl, "%-17s %-13llu\n", _("Compression overflows:"), value);
     }
 
+    if ((rc = virTypedParamsGetULLong(params, nparams,
+                                      VIR_DOMAIN_JOB_AUTO_TUNE_TRANSFER_RATE,
+                                      &value)) < 0) {
+        goto save_error;
+    } else if (rc) {
+        val = vshPrettyCapacity(value, &unit);
+        vshPrint(ctl, "%-17s %-.3lf %s/s\n", _("Transfer rate:"), val, unit);
+    }
+    if ((rc = virTypedParamsGetULLong(params, nparams,
+                                      VIR_DOMAIN_JOB_AUTO_TUNE_DIRTY_RATE,
+                                      &value)) < 0) {
+        goto save_error;
+    } else if (rc) {
+        val = vshPrettyCapacity(value, &unit);
+        vshPrint(ctl, "%-17s %-.3lf %s/s\n", _("Dirty rate:"), val, unit);
+    }
+    if ((rc = virTypedParamsGetULLong(params, nparams,
+                                      VIR_DOMAIN_JOB_AUTO_TUNE_DOWNTIME,
+                                      &value)) < 0) {
+        goto save_error;
+    } else if (rc) {
+        vshPrint(ctl, "%-17s %-12llu ms\n", _("Max downtime:"), value);
+    }
+    if ((rc = virTypedParamsGetULLong(params, nparams,
+                                      VIR_DOMAIN_JOB_AUTO_TUNE_BANDWIDTH,
+                                      &value)) < 0) {
+        goto save_error;
+    } else if (rc) {
+        vshPrint(ctl, "%-17s %-12llu MiB/s\n", _("Bandwidth:"), value);
+    }
+    if ((rc = virTypedParamsGetUInt(params, nparams,
+                                    VIR_DOMAIN_JOB_AUTO_TUNE_ADJUSTMENTS,
+                                    &adjustments)) < 0) {
+        goto save_error;
+    } else if (rc) {
+        vshPrint(ctl, "%-17s %-12u\n", _("Tuning changes:"), adjustments);
+    }
+    if ((rc = virTypedParamsGetString(params, nparams,
+                                      VIR_DOMAIN_JOB_AUTO_TUNE_LAST_ACTION,
+                                      &action)) < 0) {
+        goto save_error;
+    } else if (rc) {
+        vshPrint(ctl, "%-17s %-12s\n", _("Last tuned:"), action);
+    }
+
     ret = true;
 
  cleanup:
@@ -8864,6 +9304,10 @@ static const vshCmdOptDef opts_migrate[] = {
      .type = VSH_OT_BOOL,
      .help = N_("force convergence during live migration")
     },
+    {.name = "auto-tune",
+     .type = VSH_OT_BOOL,
+     .help = N_("adjust downtime and bandwidth if migration doesn't converge")
+    },
     {.name = "abort-on-error",
      .type = VSH_OT_BOOL,
      .help = N_("abort on soft errors during migration")
@@ -9011,6 +9455,9 @@ doMigrate(void *opaque)
     if (vshCommandOptBool(cmd, "auto-converge"))
         flags |= VIR_MIGRATE_AUTO_CONVERGE;
 
+    if (vshCommandOptBool(cmd, "auto-tune"))
+        flags |= VIR_MIGRATE_AUTO_TUNE;
+
     if (vshCommandOptBool(cmd, "offline")) {
         flags |= VIR_MIGRATE_OFFLINE;
     }
@@ -10754,21 +11201,6 @@ vshGraphicsAddressToString(int family)
     return str ? _(str) : _("unknown");
 }
 
-VIR_ENUM_DECL(vshDomainBlockJobStatus)
-VIR_ENUM_IMPL(vshDomainBlockJobStatus,
-              VIR_DOMAIN_BLOCK_JOB_LAST,
-              N_("completed"),
-              N_("failed"),
-              N_("canceled"),
-              N_("ready"))
-
-static const char *
-vshDomainBlockJobStatusToString(int status)
-{
-    const char *str = vshDomainBlockJobStatusTypeToString(status);
-    return str ? _(str) : _("unknown");
-}
-
 VIR_ENUM_DECL(vshDomainEventDiskChange)
 VIR_ENUM_IMPL(vshDomainEventDiskChange,
               VIR_DOMAIN_EVENT_DISK_CHANGE_LAST,
@@ -11830,6 +12262,12 @@ const vshCmdDef domManagementCmds[] = {
      .info = info_edit,
      .flags = 0
     },
+    {.name = "evacuate",
+     .handler = cmdEvacuate,
+     .opts = opts_evacuate,
+     .info = info_evacuate,
+     .flags = 0
+    },
     {.name = "event",
      .handler = cmdEvent,
      .opts = opts_event,